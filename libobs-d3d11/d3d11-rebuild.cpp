@@ -108,6 +108,11 @@ inline void gs_stage_surface::Rebuild(ID3D11Device *dev)
 	HRESULT hr = dev->CreateTexture2D(&td, nullptr, &texture);
 	if (FAILED(hr))
 		throw HRError("Failed to create staging surface", hr);
+
+	D3D11_QUERY_DESC qd = {D3D11_QUERY_EVENT, 0};
+	hr = dev->CreateQuery(&qd, &fence);
+	if (FAILED(hr))
+		throw HRError("Failed to create staging surface fence", hr);
 }
 
 inline void gs_sampler_state::Rebuild(ID3D11Device *dev)
@@ -210,6 +215,10 @@ try {
 
 	/* ----------------------------------------------------------------- */
 
+	for (gs_device_loss &callback : loss_callbacks)
+		if (callback.device_loss_release)
+			callback.device_loss_release(callback.data);
+
 	gs_obj *obj = first_obj;
 
 	while (obj) {
@@ -344,6 +353,11 @@ try {
 	for (auto &state : blendStates)
 		state.Rebuild(dev);
 
+	for (gs_device_loss &callback : loss_callbacks)
+		if (callback.device_loss_rebuild)
+			callback.device_loss_rebuild(device.Get(),
+					callback.data);
+
 } catch (const char *error) {
 	bcrash("Failed to recreate D3D11: %s", error);
 
@@ -47,7 +47,6 @@ gs_vertex_shader::gs_vertex_shader(gs_device_t *device, const char *file,
 	  nTexUnits   (0)
 {
 	ShaderProcessor    processor(device);
-	ComPtr<ID3D10Blob> shaderBlob;
 	string             outputString;
 	HRESULT            hr;
 
@@ -58,10 +57,7 @@ gs_vertex_shader::gs_vertex_shader(gs_device_t *device, const char *file,
 	GetBuffersExpected(layoutData);
 	BuildConstantBuffer();
 
-	Compile(outputString.c_str(), file, "vs_4_0", shaderBlob.Assign());
-
-	data.resize(shaderBlob->GetBufferSize());
-	memcpy(&data[0], shaderBlob->GetBufferPointer(), data.size());
+	Compile(outputString.c_str(), file, "vs_4_0", data);
 
 	hr = device->device->CreateVertexShader(data.data(), data.size(),
 			NULL, shader.Assign());
@@ -83,7 +79,6 @@ gs_pixel_shader::gs_pixel_shader(gs_device_t *device, const char *file,
 	: gs_shader(device, gs_type::gs_pixel_shader, GS_SHADER_PIXEL)
 {
 	ShaderProcessor    processor(device);
-	ComPtr<ID3D10Blob> shaderBlob;
 	string             outputString;
 	HRESULT            hr;
 
@@ -93,10 +88,7 @@ gs_pixel_shader::gs_pixel_shader(gs_device_t *device, const char *file,
 	processor.BuildSamplers(samplers);
 	BuildConstantBuffer();
 
-	Compile(outputString.c_str(), file, "ps_4_0", shaderBlob.Assign());
-
-	data.resize(shaderBlob->GetBufferSize());
-	memcpy(&data[0], shaderBlob->GetBufferPointer(), data.size());
+	Compile(outputString.c_str(), file, "ps_4_0", data);
 
 	hr = device->device->CreatePixelShader(data.data(), data.size(),
 			NULL, shader.Assign());
@@ -167,6 +159,9 @@ void gs_shader::BuildConstantBuffer()
 
 	memset(&bd, 0, sizeof(bd));
 
+	/* padding between constants stays zeroed */
+	constData.assign(constantSize, 0);
+
 	if (constantSize) {
 		HRESULT hr;
 
@@ -186,18 +181,35 @@ void gs_shader::BuildConstantBuffer()
 }
 
 void gs_shader::Compile(const char *shaderString, const char *file,
-		const char *target, ID3D10Blob **shader)
+		const char *target, vector<uint8_t> &bytecode)
 {
+	ComPtr<ID3D10Blob> shaderBlob;
 	ComPtr<ID3D10Blob> errorsBlob;
 	HRESULT hr;
 
 	if (!shaderString)
 		throw "No shader string specified";
 
+	/* the key is everything that affects the bytecode */
+	string cacheKey = device->shaderCacheKey;
+	cacheKey += ';';
+	cacheKey += target;
+	cacheKey += ";O1;";
+	cacheKey += shaderString;
+
+	size_t cachedSize = 0;
+	uint8_t *cached = (uint8_t*)gs_shader_cache_load(cacheKey.data(),
+			cacheKey.size(), &cachedSize);
+	if (cached) {
+		bytecode.assign(cached, cached + cachedSize);
+		bfree(cached);
+		return;
+	}
+
 	hr = device->d3dCompile(shaderString, strlen(shaderString), file, NULL,
 			NULL, "main", target,
 			D3D10_SHADER_OPTIMIZATION_LEVEL1, 0,
-			shader, errorsBlob.Assign());
+			shaderBlob.Assign(), errorsBlob.Assign());
 	if (FAILED(hr)) {
 		if (errorsBlob != NULL && errorsBlob->GetBufferSize())
 			throw ShaderError(errorsBlob, hr);
@@ -205,14 +217,21 @@ void gs_shader::Compile(const char *shaderString, const char *file,
 			throw HRError("Failed to compile shader", hr);
 	}
 
+	bytecode.resize(shaderBlob->GetBufferSize());
+	memcpy(bytecode.data(), shaderBlob->GetBufferPointer(),
+			bytecode.size());
+
+	gs_shader_cache_save(cacheKey.data(), cacheKey.size(),
+			bytecode.data(), bytecode.size());
+
 #ifdef DISASSEMBLE_SHADERS
 	ComPtr<ID3D10Blob> asmBlob;
 
 	if (!device->d3dDisassemble)
 		return;
 
-	hr = device->d3dDisassemble((*shader)->GetBufferPointer(),
-			(*shader)->GetBufferSize(), 0, nullptr, &asmBlob);
+	hr = device->d3dDisassemble(bytecode.data(), bytecode.size(), 0,
+			nullptr, &asmBlob);
 
 	if (SUCCEEDED(hr) && !!asmBlob && asmBlob->GetBufferSize()) {
 		blog(LOG_INFO, "=============================================");
@@ -222,27 +241,24 @@ void gs_shader::Compile(const char *shaderString, const char *file,
 #endif
 }
 
-inline void gs_shader::UpdateParam(vector<uint8_t> &constData,
-		gs_shader_param &param, bool &upload)
+inline void gs_shader::UpdateParam(gs_shader_param &param, bool &upload)
 {
 	if (param.type != GS_SHADER_PARAM_TEXTURE) {
 		if (!param.curValue.size())
 			throw "Not all shader parameters were set";
 
-		/* padding in case the constant needs to start at a new
-		 * register */
-		if (param.pos > constData.size()) {
-			uint8_t zero  = 0;
-
-			constData.insert(constData.end(),
-					param.pos - constData.size(), zero);
-		}
+		/* the constant data is kept between draws, so only values
+		 * that changed get copied in to it */
+		if (param.changed) {
+			size_t end = param.pos + param.curValue.size();
+			if (end > constData.size())
+				throw "Invalid constant data size given to "
+				      "shader";
 
-		constData.insert(constData.end(),
-				param.curValue.begin(),
-				param.curValue.end());
+			memcpy(constData.data() + param.pos,
+					param.curValue.data(),
+					param.curValue.size());
 
-		if (param.changed) {
 			upload = true;
 			param.changed = false;
 		}
@@ -263,17 +279,12 @@ inline void gs_shader::UpdateParam(vector<uint8_t> &constData,
 
 void gs_shader::UploadParams()
 {
-	vector<uint8_t> constData;
-	bool            upload = false;
-
-	constData.reserve(constantSize);
+	bool upload = false;
 
 	for (size_t i = 0; i < params.size(); i++)
-		UpdateParam(constData, params[i], upload);
-
-	if (constData.size() != constantSize)
-		throw "Invalid constant data size given to shader";
+		UpdateParam(params[i], upload);
 
+	/* every changed constant goes up in one buffer update */
 	if (upload) {
 		D3D11_MAPPED_SUBRESOURCE map;
 		HRESULT hr;
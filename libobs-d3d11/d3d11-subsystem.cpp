@@ -187,6 +187,7 @@ void gs_device::InitCompiler()
 					module, "D3DDisassemble");
 #endif
 			if (d3dCompile) {
+				d3dCompilerName = d3dcompiler;
 				return;
 			}
 
@@ -227,7 +228,7 @@ const static D3D_FEATURE_LEVEL featureLevels[] =
 void gs_device::InitDevice(uint32_t adapterIdx)
 {
 	wstring adapterName;
-	DXGI_ADAPTER_DESC desc;
+	DXGI_ADAPTER_DESC desc = {};
 	D3D_FEATURE_LEVEL levelUsed = D3D_FEATURE_LEVEL_9_3;
 	HRESULT hr = 0;
 
@@ -241,6 +242,16 @@ void gs_device::InitDevice(uint32_t adapterIdx)
 	adapterName = (adapter->GetDesc(&desc) == S_OK) ? desc.Description :
 		L"<unknown>";
 
+	/* compiled shaders are cached per compiler, device and driver */
+	LARGE_INTEGER driverVersion = {};
+	adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
+
+	char deviceKey[128];
+	sprintf(deviceKey, ";%04X:%04X:%08X:%02X;%lld",
+			desc.VendorId, desc.DeviceId, desc.SubSysId,
+			desc.Revision, driverVersion.QuadPart);
+	shaderCacheKey = d3dCompilerName + deviceKey;
+
 	char *adapterNameUTF8;
 	os_wcs_to_utf8_ptr(adapterName.c_str(), 0, &adapterNameUTF8);
 	blog(LOG_INFO, "Loading up D3D11 on adapter %s (%" PRIu32 ")",
@@ -1323,6 +1334,10 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 
 		device->CopyTex(dst->texture, 0, 0, src, 0, 0, 0, 0);
 
+		/* signals once the copy in to the surface is done */
+		device->context->End(dst->fence);
+		dst->fenced = true;
+
 	} catch (const char *error) {
 		blog(LOG_ERROR, "device_copy_texture (D3D11): %s", error);
 	}
@@ -1911,6 +1926,19 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 	stagesurf->device->context->Unmap(stagesurf->texture, 0);
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	BOOL done = FALSE;
+	HRESULT hr;
+
+	if (!stagesurf->fenced)
+		return false;
+
+	hr = stagesurf->device->context->GetData(stagesurf->fence, &done,
+			sizeof(done), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	return hr == S_OK && done;
+}
+
 
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
@@ -2053,6 +2081,24 @@ extern "C" EXPORT bool device_shared_texture_available(void)
 	return true;
 }
 
+extern "C" EXPORT void device_register_loss_callbacks(gs_device_t *device,
+		const gs_device_loss *callbacks)
+{
+	device->loss_callbacks.emplace_back(*callbacks);
+}
+
+extern "C" EXPORT void device_unregister_loss_callbacks(gs_device_t *device,
+		void *data)
+{
+	for (auto iter = device->loss_callbacks.begin();
+	     iter != device->loss_callbacks.end(); ++iter) {
+		if (iter->data == data) {
+			device->loss_callbacks.erase(iter);
+			break;
+		}
+	}
+}
+
 extern "C" EXPORT gs_texture_t *device_texture_create_gdi(gs_device_t *device,
 		uint32_t width, uint32_t height)
 {
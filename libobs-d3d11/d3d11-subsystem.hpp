@@ -421,17 +421,21 @@ struct gs_zstencil_buffer : gs_obj {
 
 struct gs_stage_surface : gs_obj {
 	ComPtr<ID3D11Texture2D> texture;
+	ComPtr<ID3D11Query>     fence;
 	D3D11_TEXTURE2D_DESC td = {};
 
 	uint32_t        width, height;
 	gs_color_format format;
 	DXGI_FORMAT     dxgiFormat;
+	bool            fenced = false;
 
 	inline void Rebuild(ID3D11Device *dev);
 
 	inline void Release()
 	{
 		texture.Release();
+		fence.Release();
+		fenced = false;
 	}
 
 	gs_stage_surface(gs_device_t *device, uint32_t width, uint32_t height,
@@ -487,14 +491,14 @@ struct gs_shader : gs_obj {
 
 	D3D11_BUFFER_DESC       bd = {};
 	vector<uint8_t>         data;
+	vector<uint8_t>         constData;
 
-	inline void UpdateParam(vector<uint8_t> &constData,
-			gs_shader_param &param, bool &upload);
+	inline void UpdateParam(gs_shader_param &param, bool &upload);
 	void UploadParams();
 
 	void BuildConstantBuffer();
 	void Compile(const char *shaderStr, const char *file,
-			const char *target, ID3D10Blob **shader);
+			const char *target, vector<uint8_t> &bytecode);
 
 	inline gs_shader(gs_device_t *device, gs_type obj_type,
 			gs_shader_type type)
@@ -809,6 +813,8 @@ struct gs_device {
 	D3D11_PRIMITIVE_TOPOLOGY    curToplogy;
 
 	pD3DCompile                 d3dCompile = nullptr;
+	string                      d3dCompilerName;
+	string                      shaderCacheKey;
 #ifdef DISASSEMBLE_SHADERS
 	pD3DDisassemble             d3dDisassemble = nullptr;
 #endif
@@ -823,6 +829,8 @@ struct gs_device {
 
 	gs_obj                      *first_obj = nullptr;
 
+	vector<gs_device_loss>      loss_callbacks;
+
 	void InitCompiler();
 	void InitFactory(uint32_t adapterIdx);
 	void InitDevice(uint32_t adapterIdx);
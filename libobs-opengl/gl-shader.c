@@ -379,20 +379,31 @@ void gs_shader_get_param_info(const gs_sparam_t *param,
 	info->name = param->name;
 }
 
+static inline void shader_setval_inline(gs_sparam_t *param,
+		const void *data, size_t size)
+{
+	if (param->cur_value.num == size &&
+	    memcmp(param->cur_value.array, data, size) == 0)
+		return;
+
+	da_copy_array(param->cur_value, data, size);
+	param->version++;
+}
+
 void gs_shader_set_bool(gs_sparam_t *param, bool val)
 {
 	int int_val = val;
-	da_copy_array(param->cur_value, &int_val, sizeof(int_val));
+	shader_setval_inline(param, &int_val, sizeof(int_val));
 }
 
 void gs_shader_set_float(gs_sparam_t *param, float val)
 {
-	da_copy_array(param->cur_value, &val, sizeof(val));
+	shader_setval_inline(param, &val, sizeof(val));
 }
 
 void gs_shader_set_int(gs_sparam_t *param, int val)
 {
-	da_copy_array(param->cur_value, &val, sizeof(val));
+	shader_setval_inline(param, &val, sizeof(val));
 }
 
 void gs_shader_set_matrix3(gs_sparam_t *param, const struct matrix3 *val)
@@ -400,27 +411,27 @@ void gs_shader_set_matrix3(gs_sparam_t *param, const struct matrix3 *val)
 	struct matrix4 mat;
 	matrix4_from_matrix3(&mat, val);
 
-	da_copy_array(param->cur_value, &mat, sizeof(mat));
+	shader_setval_inline(param, &mat, sizeof(mat));
 }
 
 void gs_shader_set_matrix4(gs_sparam_t *param, const struct matrix4 *val)
 {
-	da_copy_array(param->cur_value, val, sizeof(*val));
+	shader_setval_inline(param, val, sizeof(*val));
 }
 
 void gs_shader_set_vec2(gs_sparam_t *param, const struct vec2 *val)
 {
-	da_copy_array(param->cur_value, val->ptr, sizeof(*val));
+	shader_setval_inline(param, val->ptr, sizeof(*val));
 }
 
 void gs_shader_set_vec3(gs_sparam_t *param, const struct vec3 *val)
 {
-	da_copy_array(param->cur_value, val->ptr, sizeof(*val));
+	shader_setval_inline(param, val->ptr, sizeof(*val));
 }
 
 void gs_shader_set_vec4(gs_sparam_t *param, const struct vec4 *val)
 {
-	da_copy_array(param->cur_value, val->ptr, sizeof(*val));
+	shader_setval_inline(param, val->ptr, sizeof(*val));
 }
 
 void gs_shader_set_texture(gs_sparam_t *param, gs_texture_t *val)
@@ -499,10 +510,20 @@ static void program_set_param_data(struct gs_program *program,
 	}
 }
 
+/* uniforms keep their values in the program, so only the ones that changed
+ * since the last draw with this program are set again.  textures are always
+ * loaded since other draws can bind different ones to the same units */
 void program_update_params(struct gs_program *program)
 {
 	for (size_t i = 0; i < program->params.num; i++) {
 		struct program_param *pp = program->params.array + i;
+
+		if (pp->param->type != GS_SHADER_PARAM_TEXTURE) {
+			if (pp->version == pp->param->version)
+				continue;
+			pp->version = pp->param->version;
+		}
+
 		program_set_param_data(program, pp);
 	}
 }
@@ -570,6 +591,7 @@ static bool assign_program_param(struct gs_program *program,
 	}
 
 	info.param = param;
+	info.version = param->version - 1;
 	da_push_back(program->params, &info);
 	return true;
 }
@@ -719,7 +741,7 @@ void gs_shader_set_val(gs_sparam_t *param, const void *val, size_t size)
 	if (param->type == GS_SHADER_PARAM_TEXTURE)
 		gs_shader_set_texture(param, *(gs_texture_t**)val);
 	else
-		da_copy_array(param->cur_value, val, size);
+		shader_setval_inline(param, val, size);
 }
 
 void gs_shader_set_default(gs_sparam_t *param)
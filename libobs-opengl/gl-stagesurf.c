@@ -68,6 +68,8 @@ gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
 {
 	if (stagesurf) {
+		if (stagesurf->fence)
+			glDeleteSync(stagesurf->fence);
 		if (stagesurf->pack_buffer)
 			gl_delete_buffers(1, &stagesurf->pack_buffer);
 
@@ -106,6 +108,20 @@ static bool can_stage(struct gs_stage_surface *dst, struct gs_texture_2d *src)
 	return true;
 }
 
+/* signals once the pack in to the surface is done, when sync objects are
+ * available */
+static void insert_fence(struct gs_stage_surface *dst)
+{
+	if (!GLAD_GL_VERSION_3_2 && !GLAD_GL_ARB_sync)
+		return;
+
+	if (dst->fence)
+		glDeleteSync(dst->fence);
+
+	dst->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_success("glFenceSync");
+}
+
 #ifdef __APPLE__
 
 /* Apparently for mac, PBOs won't do an asynchronous transfer unless you use
@@ -141,6 +157,7 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glReadPixels"))
 		goto failed_unbind_all;
 
+	insert_fence(dst);
 	success = true;
 
 failed_unbind_all:
@@ -172,6 +189,8 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glGetTexImage"))
 		goto failed;
 
+	insert_fence(dst);
+
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 	return;
@@ -232,3 +251,15 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 }
+
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	GLenum result;
+
+	if (!stagesurf->fence)
+		return false;
+
+	result = glClientWaitSync(stagesurf->fence, 0, 0);
+	return result == GL_ALREADY_SIGNALED ||
+	       result == GL_CONDITION_SATISFIED;
+}
@@ -310,6 +310,9 @@ struct gs_shader_param {
 	DARRAY(uint8_t)      cur_value;
 	DARRAY(uint8_t)      def_value;
 	bool                 changed;
+
+	/* bumped whenever cur_value changes */
+	uint32_t             version;
 };
 
 enum attrib_type {
@@ -343,6 +346,9 @@ struct gs_shader {
 struct program_param {
 	GLint                  obj;
 	struct gs_shader_param *param;
+
+	/* param version last uploaded to the program's uniform */
+	uint32_t               version;
 };
 
 struct gs_program {
@@ -438,6 +444,7 @@ struct gs_stage_surface {
 	GLint                gl_internal_format;
 	GLenum               gl_type;
 	GLuint               pack_buffer;
+	GLsync               fence;
 };
 
 struct gs_zstencil_buffer {
@@ -1316,6 +1316,7 @@ static void ep_compile_param(struct effect_parser *ep, size_t idx)
 	param_in->param = param;
 
 	param->name    = bstrdup(param_in->name);
+	param->name_hash = effect_param_name_hash(param->name);
 	param->section = EFFECT_PARAM;
 	param->effect  = ep->effect;
 	da_move(param->default_val, param_in->default_val);
@@ -120,10 +120,12 @@ void gs_technique_end(gs_technique_t *tech)
 	tech->effect->cur_technique = NULL;
 	tech->effect->graphics->cur_effect = NULL;
 
+	/* values go back to their defaults, the memory is kept for the next
+	 * time the effect is used */
 	for (i = 0; i < effect->params.num; i++) {
 		struct gs_effect_param *param = params+i;
 
-		da_free(param->cur_val);
+		da_resize(param->cur_val, 0);
 		param->changed = false;
 		if (param->next_sampler)
 			param->next_sampler = NULL;
@@ -157,7 +159,9 @@ static void upload_shader_params(struct darray *pass_params, bool changed_only)
 
 		if (!eparam->cur_val.num) {
 			if (eparam->default_val.num)
-				da_copy(eparam->cur_val, eparam->default_val);
+				da_copy_array(eparam->cur_val,
+						eparam->default_val.array,
+						eparam->default_val.num);
 			else
 				continue;
 		}
@@ -275,11 +279,12 @@ gs_eparam_t *gs_effect_get_param_by_name(const gs_effect_t *effect,
 	if (!effect) return NULL;
 
 	struct gs_effect_param *params = effect->params.array;
+	uint32_t hash = effect_param_name_hash(name);
 
 	for (size_t i = 0; i < effect->params.num; i++) {
 		struct gs_effect_param *param = params+i;
 
-		if (strcmp(param->name, name) == 0)
+		if (param->name_hash == hash && strcmp(param->name, name) == 0)
 			return param;
 	}
 
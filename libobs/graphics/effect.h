@@ -48,6 +48,7 @@ enum effect_section {
 
 struct gs_effect_param {
 	char *name;
+	uint32_t name_hash;
 	enum effect_section section;
 
 	enum gs_shader_param_type type;
@@ -63,6 +64,20 @@ struct gs_effect_param {
 	float scroller_min, scroller_max, scroller_inc, scroller_mul;*/
 };
 
+/* param names are hashed once when the effect is loaded so lookups by name
+ * only compare strings when the hashes match */
+static inline uint32_t effect_param_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
 static inline void effect_param_init(struct gs_effect_param *param)
 {
 	memset(param, 0, sizeof(struct gs_effect_param));
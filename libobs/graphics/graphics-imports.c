@@ -87,6 +87,8 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(device_clear);
 	GRAPHICS_IMPORT(device_present);
 	GRAPHICS_IMPORT(device_flush);
+	GRAPHICS_IMPORT_OPTIONAL(device_register_loss_callbacks);
+	GRAPHICS_IMPORT_OPTIONAL(device_unregister_loss_callbacks);
 	GRAPHICS_IMPORT(device_set_cull_mode);
 	GRAPHICS_IMPORT(device_get_cull_mode);
 	GRAPHICS_IMPORT(device_enable_blending);
@@ -134,6 +136,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(gs_stagesurface_get_color_format);
 	GRAPHICS_IMPORT(gs_stagesurface_map);
 	GRAPHICS_IMPORT(gs_stagesurface_unmap);
+	GRAPHICS_IMPORT_OPTIONAL(gs_stagesurface_ready);
 
 	GRAPHICS_IMPORT(gs_zstencil_destroy);
 
@@ -113,6 +113,10 @@ struct gs_exports {
 			const struct vec4 *color, float depth, uint8_t stencil);
 	void (*device_present)(gs_device_t *device);
 	void (*device_flush)(gs_device_t *device);
+	void (*device_register_loss_callbacks)(gs_device_t *device,
+			const struct gs_device_loss *callbacks);
+	void (*device_unregister_loss_callbacks)(gs_device_t *device,
+			void *data);
 	void (*device_set_cull_mode)(gs_device_t *device,
 			enum gs_cull_mode mode);
 	enum gs_cull_mode (*device_get_cull_mode)(const gs_device_t *device);
@@ -182,6 +186,7 @@ struct gs_exports {
 	bool     (*gs_stagesurface_map)(gs_stagesurf_t *stagesurf,
 			uint8_t **data, uint32_t *linesize);
 	void     (*gs_stagesurface_unmap)(gs_stagesurf_t *stagesurf);
+	bool     (*gs_stagesurface_ready)(gs_stagesurf_t *stagesurf);
 
 	void (*gs_zstencil_destroy)(gs_zstencil_t *zstencil);
 
@@ -303,4 +308,6 @@ struct graphics_subsystem {
 
 	struct blend_state     cur_blend_state;
 	DARRAY(struct blend_state) blend_state_stack;
+
+	char                   *shader_cache_path;
 };
@@ -27,6 +27,7 @@
 #include "axisang.h"
 #include "effect-parser.h"
 #include "effect.h"
+#include "shader-cache.h"
 
 static THREAD_LOCAL graphics_t *thread_graphics = NULL;
 
@@ -244,6 +245,7 @@ void gs_destroy(graphics_t *graphics)
 	da_free(graphics->matrix_stack);
 	da_free(graphics->viewport_stack);
 	da_free(graphics->blend_state_stack);
+	bfree(graphics->shader_cache_path);
 	if (graphics->module)
 		os_dlclose(graphics->module);
 	bfree(graphics);
@@ -302,6 +304,55 @@ int gs_get_device_type(void)
 		thread_graphics->exports.device_get_type() : -1;
 }
 
+void gs_set_shader_cache_path(const char *path)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid("gs_set_shader_cache_path"))
+		return;
+
+	bfree(graphics->shader_cache_path);
+	graphics->shader_cache_path = NULL;
+
+	if (!path || !*path)
+		return;
+
+	if (os_mkdirs(path) == MKDIR_ERROR) {
+		blog(LOG_WARNING, "gs_set_shader_cache_path: Could not create "
+		                  "'%s', shaders won't be cached", path);
+		return;
+	}
+
+	graphics->shader_cache_path = bstrdup(path);
+}
+
+void *gs_shader_cache_load(const void *key, size_t key_size, size_t *size)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p2("gs_shader_cache_load", key, size))
+		return NULL;
+	if (!graphics->shader_cache_path)
+		return NULL;
+
+	return shader_cache_load(graphics->shader_cache_path, key, key_size,
+			size);
+}
+
+void gs_shader_cache_save(const void *key, size_t key_size, const void *data,
+		size_t size)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p2("gs_shader_cache_save", key, data))
+		return;
+	if (!graphics->shader_cache_path)
+		return;
+
+	shader_cache_save(graphics->shader_cache_path, key, key_size, data,
+			size);
+}
+
 static inline struct matrix4 *top_matrix(graphics_t *graphics)
 {
 	return graphics->matrix_stack.array + graphics->cur_matrix;
@@ -1784,6 +1835,30 @@ void gs_flush(void)
 	graphics->exports.device_flush(graphics->device);
 }
 
+void gs_register_loss_callbacks(const struct gs_device_loss *callbacks)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_register_loss_callbacks", callbacks))
+		return;
+
+	if (graphics->exports.device_register_loss_callbacks)
+		graphics->exports.device_register_loss_callbacks(
+				graphics->device, callbacks);
+}
+
+void gs_unregister_loss_callbacks(void *data)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid("gs_unregister_loss_callbacks"))
+		return;
+
+	if (graphics->exports.device_unregister_loss_callbacks)
+		graphics->exports.device_unregister_loss_callbacks(
+				graphics->device, data);
+}
+
 void gs_set_cull_mode(enum gs_cull_mode mode)
 {
 	graphics_t *graphics = thread_graphics;
@@ -2433,6 +2508,18 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 	graphics->exports.gs_stagesurface_unmap(stagesurf);
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_stagesurface_ready", stagesurf))
+		return false;
+	if (!graphics->exports.gs_stagesurface_ready)
+		return false;
+
+	return graphics->exports.gs_stagesurface_ready(stagesurf);
+}
+
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
 	if (!gs_valid("gs_zstencil_destroy"))
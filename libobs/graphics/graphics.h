@@ -465,6 +465,18 @@ struct gs_init_data {
 
 EXPORT const char *gs_get_device_name(void);
 EXPORT int gs_get_device_type(void);
+
+/**
+ * Sets the directory compiled shaders are cached in, NULL to not cache.
+ * The graphics subsystem passes a key with everything that goes in to a
+ * compile and gets back a copy of the compiled shader (free with bfree),
+ * or NULL if it has to compile it and save the result.
+ */
+EXPORT void gs_set_shader_cache_path(const char *path);
+EXPORT void *gs_shader_cache_load(const void *key, size_t key_size,
+		size_t *size);
+EXPORT void gs_shader_cache_save(const void *key, size_t key_size,
+		const void *data, size_t size);
 EXPORT void gs_enum_adapters(
 		bool (*callback)(void *param, const char *name, uint32_t id),
 		void *param);
@@ -646,6 +658,19 @@ EXPORT void gs_clear(uint32_t clear_flags, const struct vec4 *color,
 EXPORT void gs_present(void);
 EXPORT void gs_flush(void);
 
+/** called from the graphics thread when the device is lost and rebuilt.
+ * release runs before any resources are released and rebuild once they've
+ * all been recreated.  only implemented by graphics subsystems that can
+ * rebuild the device */
+struct gs_device_loss {
+	void (*device_loss_release)(void *data);
+	void (*device_loss_rebuild)(void *device, void *data);
+	void *data;
+};
+
+EXPORT void gs_register_loss_callbacks(const struct gs_device_loss *callbacks);
+EXPORT void gs_unregister_loss_callbacks(void *data);
+
 EXPORT void gs_set_cull_mode(enum gs_cull_mode mode);
 EXPORT enum gs_cull_mode gs_get_cull_mode(void);
 
@@ -721,6 +746,11 @@ EXPORT bool     gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize);
 EXPORT void     gs_stagesurface_unmap(gs_stagesurf_t *stagesurf);
 
+/** returns true once the last gs_stage_texture in to the surface has
+ * finished on the GPU, without waiting for it.  always false if the graphics
+ * subsystem can't tell, in which case mapping waits for the copy */
+EXPORT bool     gs_stagesurface_ready(gs_stagesurf_t *stagesurf);
+
 EXPORT void     gs_zstencil_destroy(gs_zstencil_t *zstencil);
 
 EXPORT void     gs_samplerstate_destroy(gs_samplerstate_t *samplerstate);
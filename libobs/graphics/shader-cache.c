@@ -0,0 +1,166 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "../util/base.h"
+#include "../util/bmem.h"
+#include "../util/dstr.h"
+#include "../util/platform.h"
+#include "shader-cache.h"
+
+#define SHADER_CACHE_MAGIC    0x4353424F /* "OBSC" */
+#define SHADER_CACHE_VERSION  1
+#define SHADER_CACHE_MAX_SIZE (16 * 1024 * 1024)
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME        0x100000001B3ULL
+
+struct shader_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key_size;
+	uint64_t data_size;
+	uint64_t data_hash;
+};
+
+static uint64_t hash_data(const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static void get_entry_path(struct dstr *path, const char *dir,
+		const void *key, size_t key_size)
+{
+	dstr_printf(path, "%s/%016"PRIx64".shader", dir,
+			hash_data(key, key_size));
+}
+
+static bool read_entry(FILE *file, const void *key, size_t key_size,
+		uint8_t **data, size_t *size)
+{
+	struct shader_cache_header header;
+	uint8_t *entry_key = NULL;
+	bool success = false;
+
+	if (fread(&header, 1, sizeof(header), file) != sizeof(header))
+		return false;
+	if (header.magic != SHADER_CACHE_MAGIC ||
+	    header.version != SHADER_CACHE_VERSION ||
+	    header.key_size != key_size ||
+	    header.data_size == 0 ||
+	    header.data_size > SHADER_CACHE_MAX_SIZE)
+		return false;
+
+	entry_key = bmalloc(key_size);
+	if (fread(entry_key, 1, key_size, file) != key_size ||
+	    memcmp(entry_key, key, key_size) != 0)
+		goto fail;
+
+	*size = (size_t)header.data_size;
+	*data = bmalloc(*size);
+	if (fread(*data, 1, *size, file) != *size ||
+	    hash_data(*data, *size) != header.data_hash) {
+		bfree(*data);
+		*data = NULL;
+		goto fail;
+	}
+
+	success = true;
+
+fail:
+	bfree(entry_key);
+	return success;
+}
+
+void *shader_cache_load(const char *dir, const void *key, size_t key_size,
+		size_t *size)
+{
+	struct dstr path = {0};
+	uint8_t *data = NULL;
+	FILE *file;
+
+	get_entry_path(&path, dir, key, key_size);
+
+	file = os_fopen(path.array, "rb");
+	if (file) {
+		bool valid = read_entry(file, key, key_size, &data, size);
+		fclose(file);
+
+		/* another version's entry, a hash collision or a partial
+		 * write, it gets replaced once the shader is compiled */
+		if (!valid)
+			os_unlink(path.array);
+	}
+
+	dstr_free(&path);
+	return data;
+}
+
+void shader_cache_save(const char *dir, const void *key, size_t key_size,
+		const void *data, size_t size)
+{
+	struct shader_cache_header header;
+	struct dstr path = {0};
+	struct dstr temp_path = {0};
+	bool success = false;
+	FILE *file;
+
+	if (!size || size > SHADER_CACHE_MAX_SIZE)
+		return;
+
+	header.magic     = SHADER_CACHE_MAGIC;
+	header.version   = SHADER_CACHE_VERSION;
+	header.key_size  = key_size;
+	header.data_size = size;
+	header.data_hash = hash_data(data, size);
+
+	get_entry_path(&path, dir, key, key_size);
+	dstr_copy_dstr(&temp_path, &path);
+	dstr_cat(&temp_path, ".tmp");
+
+	/* written under another name and renamed so a crash or another
+	 * process never leaves a partial entry in place */
+	file = os_fopen(temp_path.array, "wb");
+	if (file) {
+		success = fwrite(&header, 1, sizeof(header), file) ==
+				sizeof(header) &&
+			fwrite(key, 1, key_size, file) == key_size &&
+			fwrite(data, 1, size, file) == size;
+		success = fclose(file) == 0 && success;
+	}
+
+	if (success)
+		success = os_rename(temp_path.array, path.array) == 0;
+	if (!success) {
+		os_unlink(temp_path.array);
+		blog(LOG_DEBUG, "shader_cache_save: Could not write '%s'",
+				path.array);
+	}
+
+	dstr_free(&path);
+	dstr_free(&temp_path);
+}
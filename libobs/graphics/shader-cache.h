@@ -0,0 +1,34 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+/*
+ * On-disk cache of compiled shaders.  Entries are looked up by a hash of the
+ * key, which holds everything that goes in to the compile (source, target,
+ * compiler, device and driver), and the full key is stored with the entry and
+ * compared on load so a hash collision can't return the wrong shader.
+ * Entries that are truncated, corrupt or from another cache version are
+ * deleted when they're found.
+ */
+
+extern void *shader_cache_load(const char *dir, const void *key,
+		size_t key_size, size_t *size);
+extern void shader_cache_save(const char *dir, const void *key,
+		size_t key_size, const void *data, size_t size);
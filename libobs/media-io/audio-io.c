@@ -25,6 +25,7 @@
 #include "../util/profiler.h"
 
 #include "audio-io.h"
+#include "audio-kernels.h"
 #include "audio-resampler.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
@@ -33,21 +34,50 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define nop() do {int invalid = 0;} while(0)
 
+#define MAX_INPUT_QUEUE 16
+
 struct audio_input {
 	struct audio_convert_info conversion;
 	audio_resampler_t         *resampler;
 
 	audio_output_callback_t callback;
 	void *param;
+
+	struct audio_output       *audio;
+	size_t                    mix_idx;
+	pthread_t                 thread;
+	bool                      thread_active;
+	os_sem_t                  *block_sem;
+	os_sem_t                  *space_sem;
+	volatile bool             stop;
+	volatile long             refs;
+
+	/* written by the audio thread, read by the input thread.  positions
+	 * wrap at twice the queue size so a full queue can be told apart from
+	 * an empty one */
+	float                     *blocks;
+	uint64_t                  timestamps[MAX_INPUT_QUEUE];
+	volatile long             write_pos;
+	volatile long             read_pos;
 };
 
 static inline void audio_input_free(struct audio_input *input)
 {
 	audio_resampler_destroy(input->resampler);
+	os_sem_destroy(input->block_sem);
+	os_sem_destroy(input->space_sem);
+	bfree(input->blocks);
+	bfree(input);
+}
+
+static inline void audio_input_release(struct audio_input *input)
+{
+	if (os_atomic_dec_long(&input->refs) == 0)
+		audio_input_free(input);
 }
 
 struct audio_mix {
-	DARRAY(struct audio_input) inputs;
+	DARRAY(struct audio_input*) inputs;
 	float buffer[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
 };
 
@@ -66,6 +96,7 @@ struct audio_output {
 	void                       *input_param;
 	pthread_mutex_t            input_mutex;
 	struct audio_mix           mixes[MAX_AUDIO_MIXES];
+	DARRAY(struct audio_input*) full_inputs;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -141,58 +172,124 @@ static bool resample_audio_output(struct audio_input *input,
 	return success;
 }
 
+static inline size_t audio_block_floats(const struct audio_output *audio)
+{
+	return AUDIO_OUTPUT_FRAMES * audio->block_size / sizeof(float);
+}
+
+static inline float *audio_input_block(struct audio_input *input, long pos)
+{
+	struct audio_output *audio = input->audio;
+	size_t plane_floats = audio_block_floats(audio);
+	size_t idx = (size_t)(pos & (MAX_INPUT_QUEUE - 1));
+
+	return input->blocks + idx * audio->planes * plane_floats;
+}
+
+static inline long input_queue_next(long pos)
+{
+	return (pos + 1) & (MAX_INPUT_QUEUE * 2 - 1);
+}
+
+static inline long input_queue_size(struct audio_input *input)
+{
+	return (os_atomic_load_long(&input->write_pos) -
+		os_atomic_load_long(&input->read_pos)) &
+		(MAX_INPUT_QUEUE * 2 - 1);
+}
+
+/* call with input_mutex held */
+static bool input_queue_push(struct audio_input *input, uint64_t timestamp)
+{
+	struct audio_output *audio = input->audio;
+	struct audio_mix *mix = &audio->mixes[input->mix_idx];
+	size_t plane_size = audio_block_floats(audio) * sizeof(float);
+	float *block;
+
+	if (input_queue_size(input) == MAX_INPUT_QUEUE)
+		return false;
+
+	block = audio_input_block(input, input->write_pos);
+	for (size_t i = 0; i < audio->planes; i++)
+		memcpy(block + i * plane_size / sizeof(float), mix->buffer[i],
+				plane_size);
+
+	input->timestamps[input->write_pos & (MAX_INPUT_QUEUE - 1)] =
+		timestamp;
+
+	os_atomic_set_long(&input->write_pos,
+			input_queue_next(input->write_pos));
+	os_sem_post(input->block_sem);
+	return true;
+}
+
+/* inputs that are a whole queue behind hold up the audio thread, but not
+ * while input_mutex is held, so they're still free to disconnect */
+static void wait_for_full_inputs(struct audio_output *audio,
+		uint64_t timestamp)
+{
+	for (size_t i = 0; i < audio->full_inputs.num; i++) {
+		struct audio_input *input = audio->full_inputs.array[i];
+		bool done = false;
+
+		while (!done && os_event_try(audio->stop_event) == EAGAIN) {
+			os_sem_wait(input->space_sem);
+
+			pthread_mutex_lock(&audio->input_mutex);
+			done = os_atomic_load_bool(&input->stop) ||
+				input_queue_push(input, timestamp);
+			pthread_mutex_unlock(&audio->input_mutex);
+		}
+
+		audio_input_release(input);
+	}
+
+	audio->full_inputs.num = 0;
+}
+
 static inline void do_audio_output(struct audio_output *audio,
-		size_t mix_idx, uint64_t timestamp, uint32_t frames)
+		size_t mix_idx, uint64_t timestamp)
 {
 	struct audio_mix *mix = &audio->mixes[mix_idx];
-	struct audio_data data;
 
 	pthread_mutex_lock(&audio->input_mutex);
 
-	for (size_t i = mix->inputs.num; i > 0; i--) {
-		struct audio_input *input = mix->inputs.array+(i-1);
-
-		for (size_t i = 0; i < audio->planes; i++)
-			data.data[i] = (uint8_t*)mix->buffer[i];
-		data.frames = frames;
-		data.timestamp = timestamp;
+	for (size_t i = 0; i < mix->inputs.num; i++) {
+		struct audio_input *input = mix->inputs.array[i];
 
-		if (resample_audio_output(input, &data))
-			input->callback(input->param, mix_idx, &data);
+		if (!input_queue_push(input, timestamp)) {
+			os_atomic_inc_long(&input->refs);
+			da_push_back(audio->full_inputs, &input);
+		}
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
+
+	if (audio->full_inputs.num)
+		wait_for_full_inputs(audio, timestamp);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio,
+		uint32_t active_mixes)
 {
-	size_t float_size = bytes / sizeof(float);
+	const struct audio_kernels *kernels = audio_kernels_get();
+	size_t float_size = audio_block_floats(audio);
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val >  1.0f) ?  1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			kernels->clamp(mix->buffer[plane], float_size);
 	}
 }
 
 static void input_and_output(struct audio_output *audio,
 		uint64_t audio_time, uint64_t prev_time)
 {
-	size_t bytes = AUDIO_OUTPUT_FRAMES * audio->block_size;
 	struct audio_output_data data[MAX_AUDIO_MIXES];
 	uint32_t active_mixes = 0;
 	uint64_t new_ts = 0;
@@ -201,8 +298,8 @@ static void input_and_output(struct audio_output *audio,
 	memset(data, 0, sizeof(data));
 
 #ifdef DEBUG_AUDIO
-	blog(LOG_DEBUG, "audio_time: %llu, prev_time: %llu, bytes: %lu",
-			audio_time, prev_time, bytes);
+	blog(LOG_DEBUG, "audio_time: %llu, prev_time: %llu",
+			audio_time, prev_time);
 #endif
 
 	/* get mixers */
@@ -213,12 +310,12 @@ static void input_and_output(struct audio_output *audio,
 	}
 	pthread_mutex_unlock(&audio->input_mutex);
 
-	/* clear mix buffers */
+	/* clear mix buffers, only the planes in use need clearing */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		memset(mix->buffer[0], 0, AUDIO_OUTPUT_FRAMES *
-				MAX_AUDIO_CHANNELS * sizeof(float));
+				audio->block_size * audio->planes);
 
 		for (size_t i = 0; i < audio->planes; i++)
 			data[mix_idx].data[i] = mix->buffer[i];
@@ -231,11 +328,13 @@ static void input_and_output(struct audio_output *audio,
 		return;
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, active_mixes);
 
 	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if (active_mixes & (1 << i))
+			do_audio_output(audio, i, new_ts);
+	}
 }
 
 static void *audio_thread(void *param)
@@ -246,9 +345,6 @@ static void *audio_thread(void *param)
 	uint64_t start_time = os_gettime_ns();
 	uint64_t prev_time = start_time;
 	uint64_t audio_time = prev_time;
-	uint32_t audio_wait_time =
-		(uint32_t)(audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES) /
-				1000000);
 
 	os_set_thread_name("audio-io: audio thread");
 
@@ -256,22 +352,21 @@ static void *audio_thread(void *param)
 		profile_store_name(obs_get_profiler_name_store(),
 				"audio_thread(%s)", audio->info.name);
 
+	/* the thread wakes up once per tick, so the time between calls of
+	 * this root is the tick jitter */
+	profile_register_root(audio_thread_name,
+			audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES));
+
 	while (os_event_try(audio->stop_event) == EAGAIN) {
-		uint64_t cur_time;
+		samples += AUDIO_OUTPUT_FRAMES;
+		audio_time = start_time + audio_frames_to_ns(rate, samples);
 
-		os_sleep_ms(audio_wait_time);
+		os_sleepto_ns(audio_time);
 
 		profile_start(audio_thread_name);
 
-		cur_time = os_gettime_ns();
-		while (audio_time <= cur_time) {
-			samples += AUDIO_OUTPUT_FRAMES;
-			audio_time = start_time +
-				audio_frames_to_ns(rate, samples);
-
-			input_and_output(audio, audio_time, prev_time);
-			prev_time = audio_time;
-		}
+		input_and_output(audio, audio_time, prev_time);
+		prev_time = audio_time;
 
 		profile_end(audio_thread_name);
 
@@ -283,13 +378,90 @@ static void *audio_thread(void *param)
 
 /* ------------------------------------------------------------------------- */
 
+static inline void input_pop_block(struct audio_input *input)
+{
+	os_atomic_set_long(&input->read_pos,
+			input_queue_next(input->read_pos));
+	os_sem_post(input->space_sem);
+}
+
+static inline void input_receive_block(struct audio_input *input)
+{
+	struct audio_output *audio = input->audio;
+	size_t plane_floats = audio_block_floats(audio);
+	float *block = audio_input_block(input, input->read_pos);
+	struct audio_data data;
+
+	for (size_t i = 0; i < audio->planes; i++)
+		data.data[i] = (uint8_t*)(block + i * plane_floats);
+	data.frames = AUDIO_OUTPUT_FRAMES;
+	data.timestamp = input->timestamps[input->read_pos &
+		(MAX_INPUT_QUEUE - 1)];
+
+	if (resample_audio_output(input, &data))
+		input->callback(input->param, input->mix_idx, &data);
+}
+
+static void *audio_input_thread(void *param)
+{
+	struct audio_input *input = param;
+
+	os_set_thread_name("audio-io: input thread");
+
+	const char *input_thread_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				"audio_input_thread(%s:%d)",
+				input->audio->info.name, (int)input->mix_idx);
+
+	while (os_sem_wait(input->block_sem) == 0) {
+		if (os_atomic_load_bool(&input->stop))
+			break;
+		if (!input_queue_size(input))
+			continue;
+
+		profile_start(input_thread_name);
+		input_receive_block(input);
+		input_pop_block(input);
+		profile_end(input_thread_name);
+
+		profile_reenable_thread();
+	}
+
+	audio_input_release(input);
+	return NULL;
+}
+
+/* call with input_mutex held */
+static inline void audio_input_stop(struct audio_input *input)
+{
+	os_atomic_set_bool(&input->stop, true);
+	os_sem_post(input->block_sem);
+	os_sem_post(input->space_sem);
+}
+
+/* an input can disconnect itself from its own callback, in which case its
+ * thread cleans up after itself once the callback returns */
+static void audio_input_destroy(struct audio_input *input)
+{
+	if (input->thread_active) {
+		if (pthread_equal(pthread_self(), input->thread))
+			pthread_detach(input->thread);
+		else
+			pthread_join(input->thread, NULL);
+	}
+
+	audio_input_release(input);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static size_t audio_get_input_idx(const audio_t *audio, size_t mix_idx,
 		audio_output_callback_t callback, void *param)
 {
 	const struct audio_mix *mix = &audio->mixes[mix_idx];
 
 	for (size_t i = 0; i < mix->inputs.num; i++) {
-		struct audio_input *input = mix->inputs.array+i;
+		struct audio_input *input = mix->inputs.array[i];
 
 		if (input->callback == callback && input->param == param)
 			return i;
@@ -326,6 +498,26 @@ static inline bool audio_input_init(struct audio_input *input,
 		input->resampler = NULL;
 	}
 
+	input->blocks = bmalloc(MAX_INPUT_QUEUE * audio->planes *
+			audio_block_floats(audio) * sizeof(float));
+
+	if (os_sem_init(&input->block_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&input->space_sem, 0) != 0)
+		return false;
+
+	/* one reference for the mix, one for the input thread */
+	input->audio = audio;
+	input->refs  = 2;
+
+	input->thread_active = pthread_create(&input->thread, NULL,
+			audio_input_thread, input) == 0;
+	if (!input->thread_active) {
+		blog(LOG_ERROR, "audio_input_init: Failed to create input "
+		                "thread");
+		return false;
+	}
+
 	return true;
 }
 
@@ -341,30 +533,33 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 
 	if (audio_get_input_idx(audio, mi, callback, param) == DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mi];
-		struct audio_input input;
-		input.callback = callback;
-		input.param    = param;
+		struct audio_input *input = bzalloc(sizeof(*input));
+		input->callback = callback;
+		input->param    = param;
+		input->mix_idx  = mi;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format = audio->info.format;
-			input.conversion.speakers = audio->info.speakers;
-			input.conversion.samples_per_sec =
+			input->conversion.format = audio->info.format;
+			input->conversion.speakers = audio->info.speakers;
+			input->conversion.samples_per_sec =
 				audio->info.samples_per_sec;
 		}
 
-		if (input.conversion.format == AUDIO_FORMAT_UNKNOWN)
-			input.conversion.format = audio->info.format;
-		if (input.conversion.speakers == SPEAKERS_UNKNOWN)
-			input.conversion.speakers = audio->info.speakers;
-		if (input.conversion.samples_per_sec == 0)
-			input.conversion.samples_per_sec =
+		if (input->conversion.format == AUDIO_FORMAT_UNKNOWN)
+			input->conversion.format = audio->info.format;
+		if (input->conversion.speakers == SPEAKERS_UNKNOWN)
+			input->conversion.speakers = audio->info.speakers;
+		if (input->conversion.samples_per_sec == 0)
+			input->conversion.samples_per_sec =
 				audio->info.samples_per_sec;
 
-		success = audio_input_init(&input, audio);
+		success = audio_input_init(input, audio);
 		if (success)
 			da_push_back(mix->inputs, &input);
+		else
+			audio_input_free(input);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -375,6 +570,8 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 		audio_output_callback_t callback, void *param)
 {
+	struct audio_input *input = NULL;
+
 	if (!audio || mix_idx >= MAX_AUDIO_MIXES) return;
 
 	pthread_mutex_lock(&audio->input_mutex);
@@ -382,11 +579,15 @@ void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 	size_t idx = audio_get_input_idx(audio, mix_idx, callback, param);
 	if (idx != DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
-		audio_input_free(mix->inputs.array+idx);
+		input = mix->inputs.array[idx];
+		audio_input_stop(input);
 		da_erase(mix->inputs, idx);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
+
+	if (input)
+		audio_input_destroy(input);
 }
 
 static inline bool valid_audio_params(const struct audio_output_info *info)
@@ -404,6 +605,8 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	if (!valid_audio_params(info))
 		return AUDIO_OUTPUT_INVALIDPARAM;
 
+	audio_kernels_init();
+
 	out = bzalloc(sizeof(struct audio_output));
 	if (!out)
 		goto fail;
@@ -451,12 +654,21 @@ void audio_output_close(audio_t *audio)
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		for (size_t i = 0; i < mix->inputs.num; i++)
-			audio_input_free(mix->inputs.array+i);
+		for (size_t i = 0; i < mix->inputs.num; i++) {
+			struct audio_input *input = mix->inputs.array[i];
+
+			pthread_mutex_lock(&audio->input_mutex);
+			audio_input_stop(input);
+			pthread_mutex_unlock(&audio->input_mutex);
+
+			audio_input_destroy(input);
+		}
 
 		da_free(mix->inputs);
 	}
 
+	da_free(audio->full_inputs);
+
 	os_event_destroy(audio->stop_event);
 	bfree(audio);
 }
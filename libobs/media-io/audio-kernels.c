@@ -0,0 +1,386 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include "../util/base.h"
+#include "audio-kernels.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || \
+    defined(__i386__) || defined(__x86_64__)
+#define KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX
+#else
+#include <cpuid.h>
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* plain C, also used for the tails of the vector versions                   */
+
+static void accumulate_c(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void scale_c(float *data, float vol, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= vol;
+}
+
+static void multiply_c(float *data, const float *vol, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= vol[i];
+}
+
+static void clamp_c(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = data[i];
+		val = (val >  1.0f) ?  1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+static const struct audio_kernels kernels_c = {
+	"C",
+	accumulate_c,
+	scale_c,
+	multiply_c,
+	clamp_c
+};
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef KERNELS_X86
+
+/* min/max take the second operand unless the first compares less/greater,
+ * so with the limit first NaNs pass through exactly like clamp_c */
+
+static void accumulate_sse(float *dst, const float *src, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+
+	for (size_t i = 0; i < vec_count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+					_mm_loadu_ps(src + i)));
+
+	accumulate_c(dst + vec_count, src + vec_count, count - vec_count);
+}
+
+static void scale_sse(float *data, float vol, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+	__m128 vol_val = _mm_set1_ps(vol);
+
+	for (size_t i = 0; i < vec_count; i += 4)
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i),
+					vol_val));
+
+	scale_c(data + vec_count, vol, count - vec_count);
+}
+
+static void multiply_sse(float *data, const float *vol, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+
+	for (size_t i = 0; i < vec_count; i += 4)
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i),
+					_mm_loadu_ps(vol + i)));
+
+	multiply_c(data + vec_count, vol + vec_count, count - vec_count);
+}
+
+static void clamp_sse(float *data, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+	__m128 max_val = _mm_set1_ps(1.0f);
+	__m128 min_val = _mm_set1_ps(-1.0f);
+
+	for (size_t i = 0; i < vec_count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_min_ps(max_val, val);
+		val = _mm_max_ps(min_val, val);
+		_mm_storeu_ps(data + i, val);
+	}
+
+	clamp_c(data + vec_count, count - vec_count);
+}
+
+static const struct audio_kernels kernels_sse = {
+	"SSE",
+	accumulate_sse,
+	scale_sse,
+	multiply_sse,
+	clamp_sse
+};
+
+TARGET_AVX
+static void accumulate_avx(float *dst, const float *src, size_t count)
+{
+	size_t vec_count = count & ~(size_t)7;
+
+	for (size_t i = 0; i < vec_count; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(
+					_mm256_loadu_ps(dst + i),
+					_mm256_loadu_ps(src + i)));
+
+	_mm256_zeroupper();
+	accumulate_c(dst + vec_count, src + vec_count, count - vec_count);
+}
+
+TARGET_AVX
+static void scale_avx(float *data, float vol, size_t count)
+{
+	size_t vec_count = count & ~(size_t)7;
+	__m256 vol_val = _mm256_set1_ps(vol);
+
+	for (size_t i = 0; i < vec_count; i += 8)
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(
+					_mm256_loadu_ps(data + i), vol_val));
+
+	_mm256_zeroupper();
+	scale_c(data + vec_count, vol, count - vec_count);
+}
+
+TARGET_AVX
+static void multiply_avx(float *data, const float *vol, size_t count)
+{
+	size_t vec_count = count & ~(size_t)7;
+
+	for (size_t i = 0; i < vec_count; i += 8)
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(
+					_mm256_loadu_ps(data + i),
+					_mm256_loadu_ps(vol + i)));
+
+	_mm256_zeroupper();
+	multiply_c(data + vec_count, vol + vec_count, count - vec_count);
+}
+
+TARGET_AVX
+static void clamp_avx(float *data, size_t count)
+{
+	size_t vec_count = count & ~(size_t)7;
+	__m256 max_val = _mm256_set1_ps(1.0f);
+	__m256 min_val = _mm256_set1_ps(-1.0f);
+
+	for (size_t i = 0; i < vec_count; i += 8) {
+		__m256 val = _mm256_loadu_ps(data + i);
+		val = _mm256_min_ps(max_val, val);
+		val = _mm256_max_ps(min_val, val);
+		_mm256_storeu_ps(data + i, val);
+	}
+
+	_mm256_zeroupper();
+	clamp_c(data + vec_count, count - vec_count);
+}
+
+static const struct audio_kernels kernels_avx = {
+	"AVX",
+	accumulate_avx,
+	scale_avx,
+	multiply_avx,
+	clamp_avx
+};
+
+/* AVX needs both CPU support and the OS saving the YMM registers */
+static bool cpu_has_avx(void)
+{
+	unsigned int ecx;
+	unsigned int xcr0;
+
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	ecx = (unsigned int)info[2];
+#else
+	unsigned int eax, ebx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+#endif
+
+	if ((ecx & (1 << 27)) == 0 || (ecx & (1 << 28)) == 0)
+		return false;
+
+#ifdef _MSC_VER
+	xcr0 = (unsigned int)_xgetbv(0);
+#else
+	__asm__ volatile ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+#endif
+
+	return (xcr0 & 6) == 6;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef KERNELS_NEON
+
+static void accumulate_neon(float *dst, const float *src, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+
+	for (size_t i = 0; i < vec_count; i += 4)
+		vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i),
+					vld1q_f32(src + i)));
+
+	accumulate_c(dst + vec_count, src + vec_count, count - vec_count);
+}
+
+static void scale_neon(float *data, float vol, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+
+	for (size_t i = 0; i < vec_count; i += 4)
+		vst1q_f32(data + i, vmulq_n_f32(vld1q_f32(data + i), vol));
+
+	scale_c(data + vec_count, vol, count - vec_count);
+}
+
+static void multiply_neon(float *data, const float *vol, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+
+	for (size_t i = 0; i < vec_count; i += 4)
+		vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i),
+					vld1q_f32(vol + i)));
+
+	multiply_c(data + vec_count, vol + vec_count, count - vec_count);
+}
+
+static void clamp_neon(float *data, size_t count)
+{
+	size_t vec_count = count & ~(size_t)3;
+	float32x4_t max_val = vdupq_n_f32(1.0f);
+	float32x4_t min_val = vdupq_n_f32(-1.0f);
+
+	for (size_t i = 0; i < vec_count; i += 4) {
+		float32x4_t val = vld1q_f32(data + i);
+		val = vminq_f32(max_val, val);
+		val = vmaxq_f32(min_val, val);
+		vst1q_f32(data + i, val);
+	}
+
+	clamp_c(data + vec_count, count - vec_count);
+}
+
+static const struct audio_kernels kernels_neon = {
+	"NEON",
+	accumulate_neon,
+	scale_neon,
+	multiply_neon,
+	clamp_neon
+};
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+#define CHECK_FLOATS 71
+
+static void fill_check_data(float *data, uint32_t seed)
+{
+	static const float special[] = {
+		1.0f, -1.0f, 0.0f, -0.0f, 1.0000001f, -1.0000001f,
+		1e-40f, -1e-40f, INFINITY, -INFINITY, NAN
+	};
+
+	for (size_t i = 0; i < CHECK_FLOATS; i++) {
+		seed = seed * 1664525 + 1013904223;
+		data[i] = (float)(int32_t)seed / 536870912.0f;
+	}
+
+	for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++)
+		data[i * 5 + (seed & 3)] = special[i];
+}
+
+static bool kernels_match(const struct audio_kernels *k)
+{
+	float src[CHECK_FLOATS];
+	float expected[CHECK_FLOATS];
+	float result[CHECK_FLOATS];
+
+	fill_check_data(src, 0x1234);
+
+#define CHECK_KERNEL(call_c, call_k) \
+	do { \
+		fill_check_data(expected, 0xabcd); \
+		memcpy(result, expected, sizeof(result)); \
+		call_c; \
+		call_k; \
+		if (memcmp(expected, result, sizeof(result)) != 0) \
+			return false; \
+	} while (false)
+
+	CHECK_KERNEL(kernels_c.accumulate(expected, src, CHECK_FLOATS),
+	             k->accumulate(result, src, CHECK_FLOATS));
+	CHECK_KERNEL(kernels_c.scale(expected, 0.7071f, CHECK_FLOATS),
+	             k->scale(result, 0.7071f, CHECK_FLOATS));
+	CHECK_KERNEL(kernels_c.multiply(expected, src, CHECK_FLOATS),
+	             k->multiply(result, src, CHECK_FLOATS));
+	CHECK_KERNEL(kernels_c.clamp(expected, CHECK_FLOATS),
+	             k->clamp(result, CHECK_FLOATS));
+
+#undef CHECK_KERNEL
+	return true;
+}
+
+static const struct audio_kernels *kernels = &kernels_c;
+
+/* picks the kernels once, before the audio thread starts.  they're checked
+ * against the C versions first so a broken build falls back instead of
+ * changing the output */
+void audio_kernels_init(void)
+{
+	const struct audio_kernels *best = &kernels_c;
+
+	if (kernels != &kernels_c)
+		return;
+
+#if defined(KERNELS_X86)
+	best = cpu_has_avx() ? &kernels_avx : &kernels_sse;
+#elif defined(KERNELS_NEON)
+	best = &kernels_neon;
+#endif
+
+	if (best != &kernels_c && !kernels_match(best)) {
+		blog(LOG_WARNING, "audio_kernels_init: %s kernels don't match "
+		                  "the C kernels, not using them", best->name);
+		best = &kernels_c;
+	}
+
+	blog(LOG_INFO, "Audio kernels: %s", best->name);
+	kernels = best;
+}
+
+const struct audio_kernels *audio_kernels_get(void)
+{
+	return kernels;
+}
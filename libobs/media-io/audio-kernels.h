@@ -0,0 +1,53 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Float sample kernels used for mixing, volume and clamping.  The fastest
+ * implementation the CPU supports is picked once by audio_kernels_init, and
+ * every implementation gives bit-identical results to the plain C one.
+ */
+
+struct audio_kernels {
+	const char *name;
+
+	/* dst[i] += src[i] */
+	void (*accumulate)(float *dst, const float *src, size_t count);
+
+	/* data[i] *= vol */
+	void (*scale)(float *data, float vol, size_t count);
+
+	/* data[i] *= vol[i] */
+	void (*multiply)(float *data, const float *vol, size_t count);
+
+	/* data[i] = clamp(data[i], -1.0f, 1.0f) */
+	void (*clamp)(float *data, size_t count);
+};
+
+EXPORT void audio_kernels_init(void);
+EXPORT const struct audio_kernels *audio_kernels_get(void);
+
+#ifdef __cplusplus
+}
+#endif
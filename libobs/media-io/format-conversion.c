@@ -15,9 +15,23 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <string.h>
+#include "../util/base.h"
+#include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
 #include "format-conversion.h"
 #include <xmmintrin.h>
 #include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
 
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
@@ -89,7 +103,7 @@ static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
-void compress_uyvx_to_i420(
+static void compress_uyvx_to_i420_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -127,7 +141,7 @@ void compress_uyvx_to_i420(
 	}
 }
 
-void compress_uyvx_to_nv12(
+static void compress_uyvx_to_nv12_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -163,7 +177,7 @@ void compress_uyvx_to_nv12(
 	}
 }
 
-void convert_uyvx_to_i444(
+static void convert_uyvx_to_i444_sse2(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
@@ -202,7 +216,7 @@ void convert_uyvx_to_i444(
 	}
 }
 
-void decompress_420(
+static void decompress_420_c(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
@@ -237,7 +251,7 @@ void decompress_420(
 	}
 }
 
-void decompress_nv12(
+static void decompress_nv12_c(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
@@ -271,7 +285,7 @@ void decompress_nv12(
 	}
 }
 
-void decompress_422(
+static void decompress_422_c(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize,
@@ -322,3 +336,1041 @@ void decompress_422(
 		}
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+/* SSE2 versions of the decompression functions                              */
+
+static void decompress_420_sse2(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = in_linesize[0]/2;
+	uint32_t vec_width  = width_d2 & ~3;
+	uint32_t height_d2  = end_y/2;
+	__m128i  zero       = _mm_setzero_si128();
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
+		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x;
+
+		lum0 = input[0] + y * 2 * in_linesize[0];
+		lum1 = lum0 + in_linesize[0];
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+		for (x = 0; x < vec_width; x += 4) {
+			__m128i u  = _mm_cvtsi32_si128(
+					*(const int*)(chroma0 + x));
+			__m128i v  = _mm_cvtsi32_si128(
+					*(const int*)(chroma1 + x));
+			__m128i uv = _mm_unpacklo_epi8(v, u);
+			__m128i l0 = _mm_unpacklo_epi8(
+					_mm_loadl_epi64((const __m128i*)
+						(lum0 + x*2)), zero);
+			__m128i l1 = _mm_unpacklo_epi8(
+					_mm_loadl_epi64((const __m128i*)
+						(lum1 + x*2)), zero);
+
+			uv = _mm_unpacklo_epi16(uv, uv);
+
+			_mm_storeu_si128((__m128i*)(output0 + x*2),
+					_mm_unpacklo_epi16(uv, l0));
+			_mm_storeu_si128((__m128i*)(output0 + x*2 + 4),
+					_mm_unpackhi_epi16(uv, l0));
+			_mm_storeu_si128((__m128i*)(output1 + x*2),
+					_mm_unpacklo_epi16(uv, l1));
+			_mm_storeu_si128((__m128i*)(output1 + x*2 + 4),
+					_mm_unpackhi_epi16(uv, l1));
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out = (chroma0[x] << 8) | chroma1[x];
+
+			output0[x*2]   = (lum0[x*2]   << 16) | out;
+			output0[x*2+1] = (lum0[x*2+1] << 16) | out;
+			output1[x*2]   = (lum1[x*2]   << 16) | out;
+			output1[x*2+1] = (lum1[x*2+1] << 16) | out;
+		}
+	}
+}
+
+static void decompress_nv12_sse2(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
+	uint32_t vec_width  = width_d2 & ~3;
+	uint32_t height_d2  = end_y/2;
+	__m128i  zero       = _mm_setzero_si128();
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint16_t *chroma;
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x;
+
+		chroma = (const uint16_t*)(input[1] + y * in_linesize[1]);
+		lum0 = input[0] + y * 2 * in_linesize[0];
+		lum1 = lum0 + in_linesize[0];
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+		for (x = 0; x < vec_width; x += 4) {
+			/* each pixel is lum | (chroma << 8), built from a low
+			 * word of lum | u << 8 and a high word of v */
+			__m128i c  = _mm_loadl_epi64(
+					(const __m128i*)(chroma + x));
+			__m128i u  = _mm_slli_epi16(c, 8);
+			__m128i v  = _mm_srli_epi16(c, 8);
+			__m128i l0 = _mm_unpacklo_epi8(
+					_mm_loadl_epi64((const __m128i*)
+						(lum0 + x*2)), zero);
+			__m128i l1 = _mm_unpacklo_epi8(
+					_mm_loadl_epi64((const __m128i*)
+						(lum1 + x*2)), zero);
+
+			u  = _mm_unpacklo_epi16(u, u);
+			v  = _mm_unpacklo_epi16(v, v);
+			l0 = _mm_or_si128(l0, u);
+			l1 = _mm_or_si128(l1, u);
+
+			_mm_storeu_si128((__m128i*)(output0 + x*2),
+					_mm_unpacklo_epi16(l0, v));
+			_mm_storeu_si128((__m128i*)(output0 + x*2 + 4),
+					_mm_unpackhi_epi16(l0, v));
+			_mm_storeu_si128((__m128i*)(output1 + x*2),
+					_mm_unpacklo_epi16(l1, v));
+			_mm_storeu_si128((__m128i*)(output1 + x*2 + 4),
+					_mm_unpackhi_epi16(l1, v));
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out = chroma[x] << 8;
+
+			output0[x*2]   = lum0[x*2]   | out;
+			output0[x*2+1] = lum0[x*2+1] | out;
+			output1[x*2]   = lum1[x*2]   | out;
+			output1[x*2+1] = lum1[x*2+1] | out;
+		}
+	}
+}
+
+static void decompress_422_sse2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2  = min_uint32(in_linesize, out_linesize)/2;
+	uint32_t vec_width = width_d2 & ~3;
+	uint32_t keep      = leading_lum ? 0xFFFFFF00 : 0xFFFF00FF;
+	uint32_t take      = leading_lum ? 0x000000FF : 0x0000FF00;
+	__m128i  keep_mask = _mm_set1_epi32((int)keep);
+	__m128i  take_mask = _mm_set1_epi32((int)take);
+	uint32_t y;
+
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32 =
+			(const uint32_t*)(input + y*in_linesize);
+		uint32_t *output32 = (uint32_t*)(output + y*out_linesize);
+		uint32_t x;
+
+		for (x = 0; x < vec_width; x += 4) {
+			__m128i dw  = _mm_loadu_si128(
+					(const __m128i*)(input32 + x));
+			__m128i dup = _mm_or_si128(
+					_mm_and_si128(dw, keep_mask),
+					_mm_and_si128(_mm_srli_epi32(dw, 16),
+						take_mask));
+
+			_mm_storeu_si128((__m128i*)(output32 + x*2),
+					_mm_unpacklo_epi32(dw, dup));
+			_mm_storeu_si128((__m128i*)(output32 + x*2 + 4),
+					_mm_unpackhi_epi32(dw, dup));
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t dw = input32[x];
+
+			output32[x*2]   = dw;
+			output32[x*2+1] = (dw & keep) | ((dw >> 16) & take);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* AVX2 versions, 8 pixels at a time for compression and 16 for              */
+/* decompression.  the remainder of each line goes through the SSE2 code.    */
+
+/* picks one byte out of each 32bit pixel of both lanes, and returns the
+ * eight bytes in pixel order */
+#define gather_bytes_avx2(line, shuf) \
+	_mm_unpacklo_epi32( \
+		_mm256_castsi256_si128(_mm256_shuffle_epi8(line, shuf)), \
+		_mm256_extracti128_si256(_mm256_shuffle_epi8(line, shuf), 1))
+
+#define store_plane_avx2(plane, pos0, pos1, line1, line2, shuf)               \
+do {                                                                          \
+	_mm_storel_epi64((__m128i*)(plane+pos0),                              \
+			gather_bytes_avx2(line1, shuf));                      \
+	_mm_storel_epi64((__m128i*)(plane+pos1),                              \
+			gather_bytes_avx2(line2, shuf));                      \
+} while (false)
+
+/* averages each 2x2 block of u and v, leaving the averages of pixel pairs
+ * 0-1 and 2-3 in the low bytes of 32bit elements 0 and 2 of each lane */
+#define average_uv_avx2(line1, line2, uv_mask)                                \
+	_mm256_srai_epi16(_mm256_add_epi16(                                   \
+		_mm256_add_epi16(                                             \
+			_mm256_and_si256(line1, uv_mask),                     \
+			_mm256_and_si256(line2, uv_mask)),                    \
+		_mm256_shuffle_epi32(_mm256_add_epi16(                        \
+			_mm256_and_si256(line1, uv_mask),                     \
+			_mm256_and_si256(line2, uv_mask)),                    \
+			_MM_SHUFFLE(2, 3, 0, 1))), 2)
+
+#define LANE_SHUFFLE(b0, b1, b2, b3) \
+	_mm256_setr_epi8( \
+		b0, b1, b2, b3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, \
+		b0, b1, b2, b3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)
+
+TARGET_AVX2
+static void compress_uyvx_to_i420_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t vec_width    = width & ~7;
+	uint32_t y;
+
+	__m128i lum_mask  = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask   = _mm_set1_epi16(0x00FF);
+	__m256i uv_mask8  = _mm256_set1_epi16(0x00FF);
+	__m256i lum_shuf  = LANE_SHUFFLE(1, 5, 9, 13);
+	__m256i uv_shuf   = LANE_SHUFFLE(0, 8, 2, 10);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < vec_width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			__m256i line1, line2, avg_val;
+			__m128i uv;
+
+			line1 = _mm256_loadu_si256((const __m256i*)img);
+			line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+
+			store_plane_avx2(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_shuf);
+
+			/* each lane holds u u v v, interleaving the lanes'
+			 * words gives all four u then all four v */
+			avg_val = _mm256_shuffle_epi8(
+					average_uv_avx2(line1, line2, uv_mask8),
+					uv_shuf);
+			uv = _mm_unpacklo_epi16(
+					_mm256_castsi256_si128(avg_val),
+					_mm256_extracti128_si256(avg_val, 1));
+
+			*(uint32_t*)(u_plane + chroma_y_pos + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(uv);
+			*(uint32_t*)(v_plane + chroma_y_pos + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(
+						_mm_srli_si128(uv, 4));
+		}
+
+		for (; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_load_si128((const __m128i*)img);
+			__m128i line2 = _mm_load_si128(
+					(const __m128i*)(img + in_linesize));
+
+			pack_shift(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask, 1);
+			pack_ch_2plane(u_plane, v_plane,
+					chroma_y_pos + (x>>1),
+					line1, line2, uv_mask);
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET_AVX2
+static void compress_uyvx_to_nv12_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t *lum_plane    = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t vec_width    = width & ~7;
+	uint32_t y;
+
+	__m128i lum_mask  = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask   = _mm_set1_epi16(0x00FF);
+	__m256i uv_mask8  = _mm256_set1_epi16(0x00FF);
+	__m256i lum_shuf  = LANE_SHUFFLE(1, 5, 9, 13);
+	__m256i uv_shuf   = LANE_SHUFFLE(0, 2, 8, 10);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < vec_width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			__m256i line1, line2, avg_val;
+
+			line1 = _mm256_loadu_si256((const __m256i*)img);
+			line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+
+			store_plane_avx2(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_shuf);
+
+			avg_val = average_uv_avx2(line1, line2, uv_mask8);
+			_mm_storel_epi64(
+				(__m128i*)(chroma_plane + chroma_y_pos + x),
+				gather_bytes_avx2(avg_val, uv_shuf));
+		}
+
+		for (; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_load_si128((const __m128i*)img);
+			__m128i line2 = _mm_load_si128(
+					(const __m128i*)(img + in_linesize));
+
+			pack_shift(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask, 1);
+			pack_ch_1plane(chroma_plane, chroma_y_pos + x,
+					line1, line2, uv_mask);
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET_AVX2
+static void convert_uyvx_to_i444_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t vec_width    = width & ~7;
+	uint32_t y;
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i u_mask   = _mm_set1_epi32(0x000000FF);
+	__m128i v_mask   = _mm_set1_epi32(0x00FF0000);
+	__m256i lum_shuf = LANE_SHUFFLE(1, 5, 9, 13);
+	__m256i u_shuf   = LANE_SHUFFLE(0, 4, 8, 12);
+	__m256i v_shuf   = LANE_SHUFFLE(2, 6, 10, 14);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y      * in_linesize;
+		uint32_t lum_y_pos    = y      * out_linesize[0];
+		uint32_t x;
+
+		for (x = 0; x < vec_width; x += 8) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+			__m256i line1, line2;
+
+			line1 = _mm256_loadu_si256((const __m256i*)img);
+			line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+
+			store_plane_avx2(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_shuf);
+			store_plane_avx2(u_plane, lum_pos0, lum_pos1,
+					line1, line2, u_shuf);
+			store_plane_avx2(v_plane, lum_pos0, lum_pos1,
+					line1, line2, v_shuf);
+		}
+
+		for (; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+
+			__m128i line1 = _mm_load_si128((const __m128i*)img);
+			__m128i line2 = _mm_load_si128(
+					(const __m128i*)(img + in_linesize));
+
+			pack_shift(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask, 1);
+			pack_val(u_plane, lum_pos0, lum_pos1,
+					line1, line2, u_mask);
+			pack_shift(v_plane, lum_pos0, lum_pos1,
+					line1, line2, v_mask, 2);
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET_AVX2
+static void decompress_420_avx2(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = in_linesize[0]/2;
+	uint32_t vec_width  = width_d2 & ~7;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
+		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x;
+
+		lum0 = input[0] + y * 2 * in_linesize[0];
+		lum1 = lum0 + in_linesize[0];
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+		for (x = 0; x < vec_width; x += 8) {
+			__m128i u  = _mm_loadl_epi64(
+					(const __m128i*)(chroma0 + x));
+			__m128i v  = _mm_loadl_epi64(
+					(const __m128i*)(chroma1 + x));
+			__m128i uv = _mm_unpacklo_epi8(v, u);
+			__m128i l0 = _mm_loadu_si128(
+					(const __m128i*)(lum0 + x*2));
+			__m128i l1 = _mm_loadu_si128(
+					(const __m128i*)(lum1 + x*2));
+			__m256i uv_lo = _mm256_cvtepu16_epi32(
+					_mm_unpacklo_epi16(uv, uv));
+			__m256i uv_hi = _mm256_cvtepu16_epi32(
+					_mm_unpackhi_epi16(uv, uv));
+
+#define store_420_avx2(out, lum, uv_val, offset) \
+	_mm256_storeu_si256((__m256i*)(out + x*2 + offset), _mm256_or_si256( \
+		_mm256_slli_epi32(_mm256_cvtepu8_epi32(lum), 16), uv_val))
+
+			store_420_avx2(output0, l0, uv_lo, 0);
+			store_420_avx2(output0, _mm_srli_si128(l0, 8), uv_hi, 8);
+			store_420_avx2(output1, l1, uv_lo, 0);
+			store_420_avx2(output1, _mm_srli_si128(l1, 8), uv_hi, 8);
+#undef store_420_avx2
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out = (chroma0[x] << 8) | chroma1[x];
+
+			output0[x*2]   = (lum0[x*2]   << 16) | out;
+			output0[x*2+1] = (lum0[x*2+1] << 16) | out;
+			output1[x*2]   = (lum1[x*2]   << 16) | out;
+			output1[x*2+1] = (lum1[x*2+1] << 16) | out;
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET_AVX2
+static void decompress_nv12_avx2(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
+	uint32_t vec_width  = width_d2 & ~7;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint16_t *chroma;
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x;
+
+		chroma = (const uint16_t*)(input[1] + y * in_linesize[1]);
+		lum0 = input[0] + y * 2 * in_linesize[0];
+		lum1 = lum0 + in_linesize[0];
+		output0 = (uint32_t*)(output + y * 2 * out_linesize);
+		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+		for (x = 0; x < vec_width; x += 8) {
+			__m128i c  = _mm_loadu_si128(
+					(const __m128i*)(chroma + x));
+			__m128i l0 = _mm_loadu_si128(
+					(const __m128i*)(lum0 + x*2));
+			__m128i l1 = _mm_loadu_si128(
+					(const __m128i*)(lum1 + x*2));
+			__m256i c_lo = _mm256_slli_epi32(_mm256_cvtepu16_epi32(
+					_mm_unpacklo_epi16(c, c)), 8);
+			__m256i c_hi = _mm256_slli_epi32(_mm256_cvtepu16_epi32(
+					_mm_unpackhi_epi16(c, c)), 8);
+
+#define store_nv12_avx2(out, lum, c_val, offset) \
+	_mm256_storeu_si256((__m256i*)(out + x*2 + offset), _mm256_or_si256( \
+		_mm256_cvtepu8_epi32(lum), c_val))
+
+			store_nv12_avx2(output0, l0, c_lo, 0);
+			store_nv12_avx2(output0, _mm_srli_si128(l0, 8), c_hi, 8);
+			store_nv12_avx2(output1, l1, c_lo, 0);
+			store_nv12_avx2(output1, _mm_srli_si128(l1, 8), c_hi, 8);
+#undef store_nv12_avx2
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out = chroma[x] << 8;
+
+			output0[x*2]   = lum0[x*2]   | out;
+			output0[x*2+1] = lum0[x*2+1] | out;
+			output1[x*2]   = lum1[x*2]   | out;
+			output1[x*2+1] = lum1[x*2+1] | out;
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET_AVX2
+static void decompress_422_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	uint32_t width_d2  = min_uint32(in_linesize, out_linesize)/2;
+	uint32_t vec_width = width_d2 & ~7;
+	uint32_t keep      = leading_lum ? 0xFFFFFF00 : 0xFFFF00FF;
+	uint32_t take      = leading_lum ? 0x000000FF : 0x0000FF00;
+	__m256i  keep_mask = _mm256_set1_epi32((int)keep);
+	__m256i  take_mask = _mm256_set1_epi32((int)take);
+	uint32_t y;
+
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32 =
+			(const uint32_t*)(input + y*in_linesize);
+		uint32_t *output32 = (uint32_t*)(output + y*out_linesize);
+		uint32_t x;
+
+		for (x = 0; x < vec_width; x += 8) {
+			__m256i dw  = _mm256_loadu_si256(
+					(const __m256i*)(input32 + x));
+			__m256i dup = _mm256_or_si256(
+					_mm256_and_si256(dw, keep_mask),
+					_mm256_and_si256(
+						_mm256_srli_epi32(dw, 16),
+						take_mask));
+			__m256i lo  = _mm256_unpacklo_epi32(dw, dup);
+			__m256i hi  = _mm256_unpackhi_epi32(dw, dup);
+
+			/* unpacking works within lanes, so swap the middle
+			 * halves back into pixel order */
+			_mm256_storeu_si256((__m256i*)(output32 + x*2),
+					_mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)(output32 + x*2 + 8),
+					_mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t dw = input32[x];
+
+			output32[x*2]   = dw;
+			output32[x*2+1] = (dw & keep) | ((dw >> 16) & take);
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct conversion_funcs {
+	const char *name;
+
+	void (*compress_i420)(const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output[], const uint32_t out_linesize[]);
+	void (*compress_nv12)(const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output[], const uint32_t out_linesize[]);
+	void (*convert_i444)(const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output[], const uint32_t out_linesize[]);
+
+	void (*decompress_420)(const uint8_t *const input[],
+			const uint32_t in_linesize[],
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output, uint32_t out_linesize);
+	void (*decompress_nv12)(const uint8_t *const input[],
+			const uint32_t in_linesize[],
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output, uint32_t out_linesize);
+	void (*decompress_422)(const uint8_t *input, uint32_t in_linesize,
+			uint32_t start_y, uint32_t end_y,
+			uint8_t *output, uint32_t out_linesize,
+			bool leading_lum);
+};
+
+/* compression has always required SSE2, so the reference set keeps it and
+ * only the decompression is plain C */
+static const struct conversion_funcs funcs_c = {
+	"C",
+	compress_uyvx_to_i420_sse2,
+	compress_uyvx_to_nv12_sse2,
+	convert_uyvx_to_i444_sse2,
+	decompress_420_c,
+	decompress_nv12_c,
+	decompress_422_c
+};
+
+static const struct conversion_funcs funcs_sse2 = {
+	"SSE2",
+	compress_uyvx_to_i420_sse2,
+	compress_uyvx_to_nv12_sse2,
+	convert_uyvx_to_i444_sse2,
+	decompress_420_sse2,
+	decompress_nv12_sse2,
+	decompress_422_sse2
+};
+
+static const struct conversion_funcs funcs_avx2 = {
+	"AVX2",
+	compress_uyvx_to_i420_avx2,
+	compress_uyvx_to_nv12_avx2,
+	convert_uyvx_to_i444_avx2,
+	decompress_420_avx2,
+	decompress_nv12_avx2,
+	decompress_422_avx2
+};
+
+/* AVX2 needs the CPU flag, plus the OS saving the YMM registers */
+static bool cpu_has_avx2(void)
+{
+	unsigned int ecx, ebx;
+	unsigned int xcr0;
+
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	ecx = (unsigned int)info[2];
+	__cpuidex(info, 7, 0);
+	ebx = (unsigned int)info[1];
+#else
+	unsigned int eax, edx;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return false;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+	__cpuid_count(7, 0, eax, ebx, edx, edx);
+#endif
+
+	if ((ecx & (1 << 27)) == 0 || (ebx & (1 << 5)) == 0)
+		return false;
+
+#ifdef _MSC_VER
+	xcr0 = (unsigned int)_xgetbv(0);
+#else
+	__asm__ volatile ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+#endif
+
+	return (xcr0 & 6) == 6;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* odd sized so every vector loop also has to run its tail */
+#define CHECK_WIDTH  44
+#define CHECK_HEIGHT 6
+
+struct check_frame {
+	uint8_t  *packed;
+	uint8_t  *planes[3];
+	uint32_t linesize[3];
+	uint8_t  *expected;
+	uint8_t  *result;
+};
+
+static void fill_check_bytes(uint8_t *data, size_t size, uint32_t seed)
+{
+	for (size_t i = 0; i < size; i++) {
+		seed = seed * 1664525 + 1013904223;
+		data[i] = (uint8_t)(seed >> 24);
+	}
+}
+
+#define CHECK_SIZE (CHECK_WIDTH * CHECK_HEIGHT * 4)
+
+static bool compress_matches(uint8_t *input,
+		void (*ref)(const uint8_t*, uint32_t, uint32_t, uint32_t,
+			uint8_t*[], const uint32_t[]),
+		void (*func)(const uint8_t*, uint32_t, uint32_t, uint32_t,
+			uint8_t*[], const uint32_t[]),
+		uint8_t *expected, uint8_t *result, uint32_t chroma_linesize)
+{
+	uint32_t linesize[3] = {CHECK_WIDTH, chroma_linesize, chroma_linesize};
+	size_t   plane_size  = CHECK_WIDTH * CHECK_HEIGHT;
+	uint8_t  *exp_planes[3];
+	uint8_t  *res_planes[3];
+
+	for (size_t i = 0; i < 3; i++) {
+		exp_planes[i] = expected + plane_size * i;
+		res_planes[i] = result   + plane_size * i;
+	}
+
+	memset(expected, 0, CHECK_SIZE);
+	memset(result,   0, CHECK_SIZE);
+
+	ref(input, CHECK_WIDTH * 4, 0, CHECK_HEIGHT, exp_planes, linesize);
+	func(input, CHECK_WIDTH * 4, 0, CHECK_HEIGHT, res_planes, linesize);
+	return memcmp(expected, result, CHECK_SIZE) == 0;
+}
+
+static bool funcs_match(const struct conversion_funcs *funcs)
+{
+	uint8_t *input    = bmalloc(CHECK_SIZE);
+	uint8_t *expected = bmalloc(CHECK_SIZE);
+	uint8_t *result   = bmalloc(CHECK_SIZE);
+	const uint8_t *planes[3];
+	uint32_t linesize[3];
+	bool match = true;
+
+	fill_check_bytes(input, CHECK_SIZE, 0x1234);
+
+	match = match && compress_matches(input, funcs_c.compress_i420,
+			funcs->compress_i420, expected, result, CHECK_WIDTH / 2);
+	match = match && compress_matches(input, funcs_c.compress_nv12,
+			funcs->compress_nv12, expected, result, CHECK_WIDTH);
+	match = match && compress_matches(input, funcs_c.convert_i444,
+			funcs->convert_i444, expected, result, CHECK_WIDTH);
+
+	planes[0]   = input;
+	planes[1]   = input + CHECK_WIDTH * CHECK_HEIGHT;
+	planes[2]   = planes[1] + CHECK_WIDTH * CHECK_HEIGHT / 2;
+	linesize[0] = CHECK_WIDTH;
+	linesize[1] = CHECK_WIDTH / 2;
+	linesize[2] = CHECK_WIDTH / 2;
+
+#define CHECK_DECOMPRESS(call_c, call_f) \
+	do { \
+		memset(expected, 0, CHECK_SIZE); \
+		memset(result,   0, CHECK_SIZE); \
+		call_c; \
+		call_f; \
+		match = match && memcmp(expected, result, CHECK_SIZE) == 0; \
+	} while (false)
+
+	CHECK_DECOMPRESS(
+		funcs_c.decompress_420(planes, linesize, 0, CHECK_HEIGHT,
+			expected, CHECK_WIDTH * 4),
+		funcs->decompress_420(planes, linesize, 0, CHECK_HEIGHT,
+			result, CHECK_WIDTH * 4));
+
+	linesize[1] = CHECK_WIDTH;
+	CHECK_DECOMPRESS(
+		funcs_c.decompress_nv12(planes, linesize, 0, CHECK_HEIGHT,
+			expected, CHECK_WIDTH * 4),
+		funcs->decompress_nv12(planes, linesize, 0, CHECK_HEIGHT,
+			result, CHECK_WIDTH * 4));
+
+	/* 422 writes two texels per input texel, so keep to the rows that
+	 * fit in the check buffer */
+	CHECK_DECOMPRESS(
+		funcs_c.decompress_422(input, CHECK_WIDTH * 2, 0,
+			CHECK_HEIGHT / 2, expected, CHECK_WIDTH * 4, true),
+		funcs->decompress_422(input, CHECK_WIDTH * 2, 0,
+			CHECK_HEIGHT / 2, result, CHECK_WIDTH * 4, true));
+	CHECK_DECOMPRESS(
+		funcs_c.decompress_422(input, CHECK_WIDTH * 2, 0,
+			CHECK_HEIGHT / 2, expected, CHECK_WIDTH * 4, false),
+		funcs->decompress_422(input, CHECK_WIDTH * 2, 0,
+			CHECK_HEIGHT / 2, result, CHECK_WIDTH * 4, false));
+
+#undef CHECK_DECOMPRESS
+
+	bfree(input);
+	bfree(expected);
+	bfree(result);
+	return match;
+}
+
+static const struct conversion_funcs *funcs = &funcs_sse2;
+static bool funcs_selected = false;
+
+/* the functions are checked against the reference versions first so a
+ * broken build falls back instead of changing the output */
+static void select_funcs(void)
+{
+	const struct conversion_funcs *best = &funcs_sse2;
+
+	if (funcs_selected)
+		return;
+
+	if (cpu_has_avx2())
+		best = &funcs_avx2;
+
+	if (!funcs_match(best)) {
+		blog(LOG_WARNING, "format_conversion_init: %s conversion "
+		                  "doesn't match the reference conversion, "
+		                  "not using it", best->name);
+		best = funcs_match(&funcs_sse2) ? &funcs_sse2 : &funcs_c;
+	}
+
+	funcs = best;
+	funcs_selected = true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* band threads                                                              */
+
+#define MAX_BANDS     4
+#define MIN_BAND_ROWS 64
+
+struct band_thread {
+	pthread_t                thread;
+	os_sem_t                 *start_sem;
+
+	format_conversion_band_t band;
+	void                     *param;
+	uint32_t                 start_y;
+	uint32_t                 end_y;
+};
+
+struct band_pool {
+	pthread_mutex_t          run_mutex;
+	os_sem_t                 *done_sem;
+	struct band_thread       threads[MAX_BANDS - 1];
+	size_t                   num_threads;
+	volatile bool            stop;
+};
+
+static struct band_pool pool;
+
+static void *band_thread(void *param)
+{
+	struct band_thread *thread = param;
+
+	os_set_thread_name("format-conversion: band thread");
+
+	while (os_sem_wait(thread->start_sem) == 0) {
+		if (pool.stop)
+			break;
+
+		thread->band(thread->param, thread->start_y, thread->end_y);
+		os_sem_post(pool.done_sem);
+	}
+
+	return NULL;
+}
+
+static void stop_band_threads(void)
+{
+	pool.stop = true;
+
+	for (size_t i = 0; i < pool.num_threads; i++)
+		os_sem_post(pool.threads[i].start_sem);
+	for (size_t i = 0; i < pool.num_threads; i++) {
+		pthread_join(pool.threads[i].thread, NULL);
+		os_sem_destroy(pool.threads[i].start_sem);
+	}
+
+	if (pool.done_sem)
+		pthread_mutex_destroy(&pool.run_mutex);
+	os_sem_destroy(pool.done_sem);
+	memset(&pool, 0, sizeof(pool));
+}
+
+static bool start_band_threads(size_t num_threads)
+{
+	if (pthread_mutex_init(&pool.run_mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&pool.done_sem, 0) != 0) {
+		pthread_mutex_destroy(&pool.run_mutex);
+		return false;
+	}
+
+	for (size_t i = 0; i < num_threads; i++) {
+		struct band_thread *thread = &pool.threads[i];
+
+		if (os_sem_init(&thread->start_sem, 0) != 0)
+			break;
+		if (pthread_create(&thread->thread, NULL, band_thread,
+					thread) != 0) {
+			os_sem_destroy(thread->start_sem);
+			thread->start_sem = NULL;
+			break;
+		}
+
+		pool.num_threads++;
+	}
+
+	return pool.num_threads > 0;
+}
+
+void format_conversion_init(void)
+{
+	size_t num_bands;
+
+	select_funcs();
+
+	if (pool.done_sem)
+		return;
+
+	num_bands = (size_t)os_get_physical_cores();
+	if (num_bands > MAX_BANDS)
+		num_bands = MAX_BANDS;
+
+	if (num_bands > 1 && !start_band_threads(num_bands - 1)) {
+		blog(LOG_WARNING, "format_conversion_init: failed to start "
+		                  "band threads, converting on one thread");
+		stop_band_threads();
+	}
+
+	blog(LOG_INFO, "Format conversion: %s, %d band(s)", funcs->name,
+			(int)pool.num_threads + 1);
+}
+
+void format_conversion_free(void)
+{
+	if (pool.done_sem)
+		stop_band_threads();
+}
+
+void format_conversion_run(format_conversion_band_t band, void *param,
+		uint32_t height)
+{
+	size_t   num_bands = pool.num_threads + 1;
+	size_t   posted    = 0;
+	uint32_t band_rows;
+
+	if (height / MIN_BAND_ROWS < num_bands)
+		num_bands = height / MIN_BAND_ROWS;
+
+	/* the video thread and the readback thread can both be converting,
+	 * whoever gets here second just converts on its own thread */
+	if (num_bands < 2 || pthread_mutex_trylock(&pool.run_mutex) != 0) {
+		band(param, 0, height);
+		return;
+	}
+
+	/* bands start on even rows so 420 chroma lines aren't split */
+	band_rows = (height + (uint32_t)num_bands - 1) / (uint32_t)num_bands;
+	band_rows = (band_rows + 1) & ~1;
+
+	for (size_t i = 1; i < num_bands; i++) {
+		struct band_thread *thread = &pool.threads[i - 1];
+		uint32_t start_y = (uint32_t)i * band_rows;
+
+		if (start_y >= height)
+			break;
+
+		thread->band    = band;
+		thread->param   = param;
+		thread->start_y = start_y;
+		thread->end_y   = min_uint32(start_y + band_rows, height);
+		os_sem_post(thread->start_sem);
+		posted++;
+	}
+
+	band(param, 0, band_rows);
+
+	while (posted--)
+		os_sem_wait(pool.done_sem);
+
+	pthread_mutex_unlock(&pool.run_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compress_uyvx_to_i420(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	funcs->compress_i420(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void compress_uyvx_to_nv12(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	funcs->compress_nv12(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void convert_uyvx_to_i444(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	funcs->convert_i444(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_420(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	funcs->decompress_420(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_nv12(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	funcs->decompress_nv12(input, in_linesize, start_y, end_y,
+			output, out_linesize);
+}
+
+void decompress_422(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	funcs->decompress_422(input, in_linesize, start_y, end_y,
+			output, out_linesize, leading_lum);
+}
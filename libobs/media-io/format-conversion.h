@@ -58,6 +58,22 @@ EXPORT void decompress_422(
 		uint8_t *output, uint32_t out_linesize,
 		bool leading_lum);
 
+/*
+ * The conversions above work on any range of rows, so large frames are split
+ * into bands of rows and converted on several threads at once.
+ * format_conversion_init picks the fastest functions the CPU supports and
+ * starts the band threads, format_conversion_free stops them again.
+ */
+
+typedef void (*format_conversion_band_t)(void *param,
+		uint32_t start_y, uint32_t end_y);
+
+EXPORT void format_conversion_init(void);
+EXPORT void format_conversion_free(void);
+
+EXPORT void format_conversion_run(format_conversion_band_t band, void *param,
+		uint32_t height);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,11 +32,22 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
+#define MAX_INPUT_QUEUE 64
 
+/* a cached frame stays locked until the video thread and every input it was
+ * queued to are done with it */
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
+	bool dispatched;
+	volatile long refs;
+};
+
+struct queued_frame {
+	struct video_data        frame;
+	struct cached_frame_info *cfi;
+	uint64_t                 queue_time;
 };
 
 struct video_input {
@@ -44,9 +55,29 @@ struct video_input {
 	video_scaler_t            *scaler;
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
 	int                       cur_frame;
+	bool                      frame_scaled;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
+
+	struct video_output       *video;
+	pthread_t                 thread;
+	bool                      thread_active;
+	os_sem_t                  *frame_sem;
+	os_sem_t                  *space_sem;
+	volatile bool             stop;
+	volatile long             refs;
+
+	/* written by the video thread, read by the input thread.  positions
+	 * wrap at twice the queue size so a full queue can be told apart from
+	 * an empty one */
+	struct queued_frame       queue[MAX_INPUT_QUEUE];
+	volatile long             write_pos;
+	volatile long             read_pos;
+
+	uint64_t                  latency_total;
+	uint64_t                  latency_max;
+	uint32_t                  frames_received;
 };
 
 static inline void video_input_free(struct video_input *input)
@@ -54,6 +85,15 @@ static inline void video_input_free(struct video_input *input)
 	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
 		video_frame_free(&input->frame[i]);
 	video_scaler_destroy(input->scaler);
+	os_sem_destroy(input->frame_sem);
+	os_sem_destroy(input->space_sem);
+	bfree(input);
+}
+
+static inline void video_input_release(struct video_input *input)
+{
+	if (os_atomic_dec_long(&input->refs) == 0)
+		video_input_free(input);
 }
 
 struct video_output {
@@ -67,15 +107,18 @@ struct video_output {
 	uint64_t                   frame_time;
 	uint32_t                   skipped_frames;
 	uint32_t                   total_frames;
+	uint32_t                   duplicate_frames;
 
 	bool                       initialized;
 
 	pthread_mutex_t            input_mutex;
-	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_input*) inputs;
+	DARRAY(struct video_input*) full_inputs;
 
 	size_t                     available_frames;
 	size_t                     first_added;
 	size_t                     last_added;
+	size_t                     first_used;
 	struct cached_frame_info   cache[MAX_CACHE_SIZE];
 };
 
@@ -89,6 +132,18 @@ static inline bool scale_video_output(struct video_input *input,
 	if (input->scaler) {
 		struct video_frame *frame;
 
+		/* the last scaled frame already holds the same image, so
+		 * there's no need to scale the duplicate again */
+		if (data->duplicate && input->frame_scaled) {
+			frame = &input->frame[input->cur_frame];
+
+			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+				data->data[i]     = frame->data[i];
+				data->linesize[i] = frame->linesize[i];
+			}
+			return true;
+		}
+
 		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
 			input->cur_frame = 0;
 
@@ -98,6 +153,7 @@ static inline bool scale_video_output(struct video_input *input,
 				frame->data, frame->linesize,
 				(const uint8_t * const*)data->data,
 				data->linesize);
+		input->frame_scaled = success;
 
 		if (success) {
 			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
@@ -112,38 +168,148 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
-static inline bool video_output_cur_frame(struct video_output *video)
+/* hands finished cache entries back to video_output_lock_frame in order.
+ * an input connected later than the others can finish with a newer frame
+ * first, so this never skips over a frame that is still in use.
+ * call with data_mutex held */
+static inline void release_cached_frames(struct video_output *video)
 {
-	struct cached_frame_info *frame_info;
-	bool complete;
-	bool skipped;
+	while (video->available_frames < video->info.cache_size) {
+		struct cached_frame_info *cfi = &video->cache[video->first_used];
 
-	/* -------------------------------- */
+		if (os_atomic_load_long(&cfi->refs) != 0)
+			break;
+
+		if (++video->first_used == video->info.cache_size)
+			video->first_used = 0;
+
+		if (++video->available_frames == video->info.cache_size)
+			video->last_added = video->first_added;
+	}
+}
 
+static inline void release_cached_frame(struct video_output *video,
+		struct cached_frame_info *cfi)
+{
 	pthread_mutex_lock(&video->data_mutex);
 
-	frame_info = &video->cache[video->first_added];
+	if (os_atomic_dec_long(&cfi->refs) == 0)
+		release_cached_frames(video);
 
 	pthread_mutex_unlock(&video->data_mutex);
+}
 
-	/* -------------------------------- */
+static inline long input_queue_next(long pos)
+{
+	return (pos + 1) & (MAX_INPUT_QUEUE * 2 - 1);
+}
+
+static inline long input_queue_size(struct video_input *input)
+{
+	return (os_atomic_load_long(&input->write_pos) -
+		os_atomic_load_long(&input->read_pos)) &
+		(MAX_INPUT_QUEUE * 2 - 1);
+}
+
+/* call with input_mutex held */
+static bool input_queue_push(struct video_input *input,
+		struct cached_frame_info *cfi, const struct video_data *frame,
+		uint64_t queue_time)
+{
+	struct queued_frame *qf;
+
+	if (input_queue_size(input) == MAX_INPUT_QUEUE)
+		return false;
+
+	qf = &input->queue[input->write_pos & (MAX_INPUT_QUEUE - 1)];
+	qf->frame      = *frame;
+	qf->cfi        = cfi;
+	qf->queue_time = queue_time;
+
+	/* the video thread still holds its own reference here */
+	os_atomic_inc_long(&cfi->refs);
+
+	os_atomic_set_long(&input->write_pos,
+			input_queue_next(input->write_pos));
+	os_sem_post(input->frame_sem);
+	return true;
+}
+
+/* inputs that are a whole queue behind hold up the video thread, but not
+ * while input_mutex is held, so they're still free to disconnect */
+static void wait_for_full_inputs(struct video_output *video,
+		struct cached_frame_info *cfi, const struct video_data *frame,
+		uint64_t queue_time)
+{
+	for (size_t i = 0; i < video->full_inputs.num; i++) {
+		struct video_input *input = video->full_inputs.array[i];
+		bool done = false;
+
+		while (!done && !video->stop) {
+			os_sem_wait(input->space_sem);
+
+			pthread_mutex_lock(&video->input_mutex);
+			done = os_atomic_load_bool(&input->stop) ||
+				input_queue_push(input, cfi, frame,
+						queue_time);
+			pthread_mutex_unlock(&video->input_mutex);
+		}
+
+		video_input_release(input);
+	}
+
+	video->full_inputs.num = 0;
+}
+
+static inline void dispatch_frame(struct video_output *video,
+		struct cached_frame_info *cfi, const struct video_data *frame)
+{
+	uint64_t queue_time = os_gettime_ns();
 
 	pthread_mutex_lock(&video->input_mutex);
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array+i;
-		struct video_data frame = frame_info->frame;
+		struct video_input *input = video->inputs.array[i];
 
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
+		if (!input_queue_push(input, cfi, frame, queue_time)) {
+			os_atomic_inc_long(&input->refs);
+			da_push_back(video->full_inputs, &input);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 
+	if (video->full_inputs.num)
+		wait_for_full_inputs(video, cfi, frame, queue_time);
+}
+
+static inline bool video_output_cur_frame(struct video_output *video)
+{
+	struct cached_frame_info *frame_info;
+	struct video_data frame;
+	bool complete;
+	bool skipped;
+
+	/* -------------------------------- */
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	frame_info = &video->cache[video->first_added];
+	frame = frame_info->frame;
+
+	pthread_mutex_unlock(&video->data_mutex);
+
+	/* -------------------------------- */
+
+	dispatch_frame(video, frame_info, &frame);
+
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->data_mutex);
 
+	if (frame_info->frame.duplicate)
+		++video->duplicate_frames;
+
 	frame_info->frame.timestamp += video->frame_time;
 	complete = --frame_info->count == 0;
 	skipped = frame_info->skipped > 0;
@@ -152,9 +318,14 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
-	} else if (skipped) {
+		frame_info->dispatched = true;
+		if (os_atomic_dec_long(&frame_info->refs) == 0)
+			release_cached_frames(video);
+	}
+
+	/* repeats of a frame handed back by video_output_lock_frame are all
+	 * skipped frames, including the last one */
+	if (skipped) {
 		--frame_info->skipped;
 		++video->skipped_frames;
 	}
@@ -196,6 +367,107 @@ static void *video_thread(void *param)
 
 /* ------------------------------------------------------------------------- */
 
+static inline void input_receive_frame(struct video_input *input,
+		struct queued_frame *qf)
+{
+	struct video_data frame = qf->frame;
+	uint64_t latency = os_gettime_ns() - qf->queue_time;
+
+	input->latency_total += latency;
+	if (latency > input->latency_max)
+		input->latency_max = latency;
+	input->frames_received++;
+
+	if (scale_video_output(input, &frame))
+		input->callback(input->param, &frame);
+}
+
+static inline void input_pop_frame(struct video_input *input)
+{
+	struct queued_frame *qf =
+		&input->queue[input->read_pos & (MAX_INPUT_QUEUE - 1)];
+	struct cached_frame_info *cfi = qf->cfi;
+
+	os_atomic_set_long(&input->read_pos,
+			input_queue_next(input->read_pos));
+	os_sem_post(input->space_sem);
+
+	release_cached_frame(input->video, cfi);
+}
+
+static inline void log_input_latency(struct video_input *input)
+{
+	if (!input->frames_received)
+		return;
+
+	blog(LOG_INFO, "video-io: input stopped, frame delivery latency "
+	               "for %"PRIu32" frames: %0.2f ms average, "
+	               "%0.2f ms max",
+	               input->frames_received,
+	               (double)input->latency_total /
+	               (double)input->frames_received / 1000000.0,
+	               (double)input->latency_max / 1000000.0);
+}
+
+static void *video_input_thread(void *param)
+{
+	struct video_input *input = param;
+
+	os_set_thread_name("video-io: input thread");
+
+	const char *input_thread_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				"video_input_thread(%s)",
+				input->video->info.name);
+
+	while (os_sem_wait(input->frame_sem) == 0) {
+		if (os_atomic_load_bool(&input->stop))
+			break;
+		if (!input_queue_size(input))
+			continue;
+
+		profile_start(input_thread_name);
+		input_receive_frame(input,
+			&input->queue[input->read_pos & (MAX_INPUT_QUEUE - 1)]);
+		input_pop_frame(input);
+		profile_end(input_thread_name);
+
+		profile_reenable_thread();
+	}
+
+	/* nothing else is queued once stop is set */
+	while (input_queue_size(input))
+		input_pop_frame(input);
+
+	log_input_latency(input);
+	video_input_release(input);
+	return NULL;
+}
+
+/* call with input_mutex held */
+static inline void video_input_stop(struct video_input *input)
+{
+	os_atomic_set_bool(&input->stop, true);
+	os_sem_post(input->frame_sem);
+	os_sem_post(input->space_sem);
+}
+
+/* an input can disconnect itself from its own callback, in which case its
+ * thread cleans up after itself once the callback returns */
+static void video_input_destroy(struct video_input *input)
+{
+	if (input->thread_active) {
+		if (pthread_equal(pthread_self(), input->thread))
+			pthread_detach(input->thread);
+		else
+			pthread_join(input->thread, NULL);
+	}
+
+	video_input_release(input);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline bool valid_video_params(const struct video_output_info *info)
 {
 	return info->height != 0 && info->width != 0 && info->fps_den != 0 &&
@@ -266,9 +538,17 @@ void video_output_close(video_t *video)
 
 	video_output_stop(video);
 
-	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array[i];
+
+		pthread_mutex_lock(&video->input_mutex);
+		video_input_stop(input);
+		pthread_mutex_unlock(&video->input_mutex);
+
+		video_input_destroy(input);
+	}
 	da_free(video->inputs);
+	da_free(video->full_inputs);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
 		video_frame_free((struct video_frame*)&video->cache[i]);
@@ -284,7 +564,7 @@ static size_t video_get_input_idx(const video_t *video,
 		void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array+i;
+		struct video_input *input = video->inputs.array[i];
 		if (input->callback == callback && input->param == param)
 			return i;
 	}
@@ -327,6 +607,23 @@ static inline bool video_input_init(struct video_input *input,
 					input->conversion.height);
 	}
 
+	if (os_sem_init(&input->frame_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&input->space_sem, 0) != 0)
+		return false;
+
+	/* one reference for the inputs array, one for the input thread */
+	input->video = video;
+	input->refs  = 2;
+
+	input->thread_active = pthread_create(&input->thread, NULL,
+			video_input_thread, input) == 0;
+	if (!input->thread_active) {
+		blog(LOG_ERROR, "video_input_init: Failed to create input "
+		                "thread");
+		return false;
+	}
+
 	return true;
 }
 
@@ -345,31 +642,33 @@ bool video_output_connect(video_t *video,
 	if (video->inputs.num == 0) {
 		video->skipped_frames = 0;
 		video->total_frames = 0;
+		video->duplicate_frames = 0;
 	}
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param    = param;
+		input->callback = callback;
+		input->param    = param;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format    = video->info.format;
-			input.conversion.width     = video->info.width;
-			input.conversion.height    = video->info.height;
+			input->conversion.format    = video->info.format;
+			input->conversion.width     = video->info.width;
+			input->conversion.height    = video->info.height;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
 
-		success = video_input_init(&input, video);
+		success = video_input_init(input, video);
 		if (success)
 			da_push_back(video->inputs, &input);
+		else
+			video_input_free(input);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -381,6 +680,8 @@ void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param)
 {
+	struct video_input *input = NULL;
+
 	if (!video || !callback)
 		return;
 
@@ -388,7 +689,8 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array+idx);
+		input = video->inputs.array[idx];
+		video_input_stop(input);
 		da_erase(video->inputs, idx);
 	}
 
@@ -404,9 +706,21 @@ void video_output_disconnect(video_t *video,
 					video->skipped_frames,
 					video->total_frames,
 					percentage_skipped);
+
+		if (video->duplicate_frames)
+			blog(LOG_INFO, "Video stopped, number of "
+					"duplicate frames: "
+					"%"PRIu32"/%"PRIu32" (%0.1f%%)",
+					video->duplicate_frames,
+					video->total_frames,
+					(double)video->duplicate_frames /
+					(double)video->total_frames * 100.0);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	if (input)
+		video_input_destroy(input);
 }
 
 bool video_output_active(const video_t *video)
@@ -431,8 +745,20 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 	pthread_mutex_lock(&video->data_mutex);
 
 	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
+		cfi = &video->cache[video->last_added];
+		cfi->count += count;
+		cfi->skipped += count;
+
+		/* the video thread may already be done with the newest frame
+		 * while slow inputs still hold it, so hand it back to the video
+		 * thread to send the repeats */
+		if (cfi->dispatched) {
+			cfi->dispatched = false;
+			os_atomic_inc_long(&cfi->refs);
+			video->first_added = video->last_added;
+			os_sem_post(video->update_semaphore);
+		}
+
 		locked = false;
 
 	} else {
@@ -445,6 +771,9 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 		cfi->frame.timestamp = timestamp;
 		cfi->count = count;
 		cfi->skipped = 0;
+		cfi->dispatched = false;
+		cfi->refs = 1;
+		cfi->frame.duplicate = false;
 
 		memcpy(frame, &cfi->frame, sizeof(*frame));
 
@@ -468,6 +797,18 @@ void video_output_unlock_frame(video_t *video)
 	pthread_mutex_unlock(&video->data_mutex);
 }
 
+/* Call between video_output_lock_frame and video_output_unlock_frame to flag
+ * the locked frame as identical to the previous one.  Inputs may then reuse
+ * their last converted frame or skip encoding it altogether. */
+void video_output_mark_duplicate_frame(video_t *video)
+{
+	if (!video) return;
+
+	pthread_mutex_lock(&video->data_mutex);
+	video->cache[video->last_added].frame.duplicate = true;
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
 uint64_t video_output_get_frame_time(const video_t *video)
 {
 	return video ? video->frame_time : 0;
@@ -528,3 +869,8 @@ uint32_t video_output_get_total_frames(const video_t *video)
 {
 	return video->total_frames;
 }
+
+uint32_t video_output_get_duplicate_frames(const video_t *video)
+{
+	return video ? video->duplicate_frames : 0;
+}
@@ -68,6 +68,9 @@ struct video_data {
 	uint8_t           *data[MAX_AV_PLANES];
 	uint32_t          linesize[MAX_AV_PLANES];
 	uint64_t          timestamp;
+
+	/* frame content is identical to the previously output frame */
+	bool              duplicate;
 };
 
 struct video_output_info {
@@ -153,6 +156,8 @@ EXPORT bool video_format_get_parameters(enum video_colorspace color_space,
 EXPORT int video_output_open(video_t **video, struct video_output_info *info);
 EXPORT void video_output_close(video_t *video);
 
+/* each connected input gets frames on its own thread, so a slow callback
+ * only delays its own frames until its queue fills up */
 EXPORT bool video_output_connect(video_t *video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
@@ -168,6 +173,7 @@ EXPORT const struct video_output_info *video_output_get_info(
 EXPORT bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 		int count, uint64_t timestamp);
 EXPORT void video_output_unlock_frame(video_t *video);
+EXPORT void video_output_mark_duplicate_frame(video_t *video);
 EXPORT uint64_t video_output_get_frame_time(const video_t *video);
 EXPORT void video_output_stop(video_t *video);
 EXPORT bool video_output_stopped(video_t *video);
@@ -179,6 +185,7 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
+EXPORT uint32_t video_output_get_duplicate_frames(const video_t *video);
 
 
 #ifdef __cplusplus
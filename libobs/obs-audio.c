@@ -17,6 +17,7 @@
 
 #include <inttypes.h>
 #include "obs-internal.h"
+#include "media-io/audio-kernels.h"
 
 struct ts_info {
 	uint64_t start;
@@ -47,6 +48,7 @@ static inline void mix_audio(struct audio_output_data *mixes,
 		obs_source_t *source, size_t channels, size_t sample_rate,
 		struct ts_info *ts)
 {
+	const struct audio_kernels *kernels = audio_kernels_get();
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
 
@@ -64,16 +66,11 @@ static inline void mix_audio(struct audio_output_data *mixes,
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+			float *mix = mixes[mix_idx].data[ch];
+			float *aud = source->audio_output_buf[mix_idx][ch];
 
-			mix += start_point;
-			end = aud + total_floats;
-
-			while (aud < end)
-				*(mix++) += *(aud++);
+			kernels->accumulate(mix + start_point, aud,
+					total_floats);
 		}
 	}
 }
@@ -49,6 +49,7 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	pthread_mutex_init_value(&encoder->init_mutex);
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
+	pthread_mutex_init_value(&encoder->settings_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -63,6 +64,8 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->settings_mutex, NULL) != 0)
+		return false;
 
 	if (encoder->info.get_defaults)
 		encoder->info.get_defaults(encoder->context.settings);
@@ -239,6 +242,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		pthread_mutex_destroy(&encoder->init_mutex);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		pthread_mutex_destroy(&encoder->settings_mutex);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
 			bfree((void*)encoder->info.id);
@@ -329,11 +333,23 @@ void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings)
 	if (!obs_encoder_valid(encoder, "obs_encoder_update"))
 		return;
 
+	pthread_mutex_lock(&encoder->settings_mutex);
 	obs_data_apply(encoder->context.settings, settings);
+	pthread_mutex_unlock(&encoder->settings_mutex);
+
+	if (!encoder->info.update || !encoder->context.data)
+		return;
 
-	if (encoder->info.update && encoder->context.data)
+	/* an active encoder is updated from its own thread before the next
+	 * frame so the update never runs in the middle of an encode */
+	if (encoder_active(encoder)) {
+		os_atomic_set_bool(&encoder->reconfigure_requested, true);
+	} else {
+		pthread_mutex_lock(&encoder->settings_mutex);
 		encoder->info.update(encoder->context.data,
 				encoder->context.settings);
+		pthread_mutex_unlock(&encoder->settings_mutex);
+	}
 }
 
 bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
@@ -721,7 +737,6 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 		struct encoder_callback *cb, struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
-	DARRAY(uint8_t)       data;
 	uint8_t               *sei;
 	size_t                size;
 
@@ -729,25 +744,22 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	if (!packet->keyframe)
 		return;
 
-	da_init(data);
-
 	if (!get_sei(encoder, &sei, &size) || !sei || !size) {
 		cb->new_packet(cb->param, packet);
 		cb->sent_first_packet = true;
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
-	da_push_back_array(data, packet->data, packet->size);
-
 	first_packet      = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	first_packet.size = size + packet->size;
+	first_packet.data = obs_packet_pool_alloc(first_packet.size);
+	memcpy(first_packet.data, sei, size);
+	memcpy(first_packet.data + size, packet->data, packet->size);
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -788,6 +800,13 @@ static inline void do_encode(struct obs_encoder *encoder,
 	pkt.timebase_den = encoder->timebase_den;
 	pkt.encoder = encoder;
 
+	if (os_atomic_set_bool(&encoder->reconfigure_requested, false)) {
+		pthread_mutex_lock(&encoder->settings_mutex);
+		encoder->info.update(encoder->context.data,
+				encoder->context.settings);
+		pthread_mutex_unlock(&encoder->settings_mutex);
+	}
+
 	profile_start(encoder->profile_encoder_encode_name);
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 			&received);
@@ -842,6 +861,13 @@ static void receive_video(void *param, struct video_data *frame)
 		}
 	}
 
+	/* the frame is identical to the last one, so only advance the pts and
+	 * let the next encoded frame carry the gap */
+	if (frame->duplicate && encoder->start_ts) {
+		encoder->cur_pts += encoder->timebase_num;
+		goto wait_for_audio;
+	}
+
 	memset(&enc_frame, 0, sizeof(struct encoder_frame));
 
 	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
@@ -1036,12 +1062,8 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 		const struct encoder_packet *src)
 {
-	long *p_refs;
-
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void*)(p_refs + 1);
-	*p_refs = 1;
+	dst->data = obs_packet_pool_alloc(src->size);
 	memcpy(dst->data, src->data, src->size);
 }
 
@@ -1078,7 +1100,7 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 	if (pkt->data) {
 		long *p_refs = ((long*)pkt->data) - 1;
 		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
+			obs_packet_pool_release(pkt->data);
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
@@ -30,6 +30,8 @@ extern "C" {
 #endif
 
 #define OBS_ENCODER_CAP_DEPRECATED             (1<<0)
+/** The bitrate can be changed with obs_encoder_update while encoding */
+#define OBS_ENCODER_CAP_DYN_BITRATE            (1<<1)
 
 /** Specifies the encoder type */
 enum obs_encoder_type {
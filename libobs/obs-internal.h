@@ -37,6 +37,10 @@
 #include "obs.h"
 
 #define NUM_TEXTURES 2
+#define MIN_STAGING_SURFACES 2
+#define MAX_STAGING_SURFACES 8
+#define DEFAULT_STAGING_SURFACES 3
+#define STATIC_FRAME_TILE_ROWS 16
 #define MICROSECOND_DEN 1000000
 
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
@@ -225,28 +229,83 @@ struct obs_vframe_info {
 	int count;
 };
 
+enum obs_staging_state {
+	OBS_STAGING_FREE,
+	OBS_STAGING_STAGED,
+	OBS_STAGING_MAPPED
+};
+
+/* a mapped staging surface handed to the readback thread */
+struct obs_readback_frame {
+	struct video_data frame;
+	int count;
+	uint32_t surface;
+};
+
+/* format_conversion.effect params, looked up once when it's loaded since
+ * they're set for every frame */
+struct obs_conversion_params {
+	gs_eparam_t *image;
+	gs_eparam_t *u_plane_offset;
+	gs_eparam_t *v_plane_offset;
+	gs_eparam_t *width;
+	gs_eparam_t *height;
+	gs_eparam_t *width_i;
+	gs_eparam_t *height_i;
+	gs_eparam_t *width_d2;
+	gs_eparam_t *height_d2;
+	gs_eparam_t *width_d2_i;
+	gs_eparam_t *height_d2_i;
+	gs_eparam_t *input_height;
+	gs_eparam_t *input_width_i_d2;
+	gs_eparam_t *int_width;
+	gs_eparam_t *int_input_width;
+	gs_eparam_t *int_u_plane_offset;
+	gs_eparam_t *int_v_plane_offset;
+};
+
 struct obs_core_video {
 	graphics_t                      *graphics;
-	gs_stagesurf_t                  *copy_surfaces[NUM_TEXTURES];
 	gs_texture_t                    *render_textures[NUM_TEXTURES];
 	gs_texture_t                    *output_textures[NUM_TEXTURES];
 	gs_texture_t                    *convert_textures[NUM_TEXTURES];
 	bool                            textures_rendered[NUM_TEXTURES];
 	bool                            textures_output[NUM_TEXTURES];
-	bool                            textures_copied[NUM_TEXTURES];
 	bool                            textures_converted[NUM_TEXTURES];
 	struct circlebuf                vframe_info_buffer;
+
+	/* ring of staging surfaces, staged at staging_head and mapped in
+	 * order from staging_tail once their copy is done */
+	gs_stagesurf_t                  *copy_surfaces[MAX_STAGING_SURFACES];
+	enum obs_staging_state          staging_state[MAX_STAGING_SURFACES];
+	struct obs_vframe_info          staging_info[MAX_STAGING_SURFACES];
+	uint32_t                        num_staging_surfaces;
+	uint32_t                        staging_head;
+	uint32_t                        staging_tail;
+	uint32_t                        staging_pending;
+	struct obs_vframe_info          dropped_info;
+	uint32_t                        readback_dropped_frames;
+	uint32_t                        readback_forced_maps;
+
+	pthread_t                       readback_thread;
+	pthread_mutex_t                 readback_mutex;
+	os_sem_t                        *readback_sem;
+	struct circlebuf                readback_queue;
+	struct circlebuf                readback_done;
+	bool                            readback_thread_initialized;
+	volatile bool                   readback_stop;
+
 	gs_effect_t                     *default_effect;
 	gs_effect_t                     *default_rect_effect;
 	gs_effect_t                     *opaque_effect;
 	gs_effect_t                     *solid_effect;
 	gs_effect_t                     *conversion_effect;
+	struct obs_conversion_params    conversion_params;
 	gs_effect_t                     *bicubic_effect;
 	gs_effect_t                     *lanczos_effect;
 	gs_effect_t                     *bilinear_lowres_effect;
 	gs_effect_t                     *premultiplied_alpha_effect;
 	gs_samplerstate_t               *point_sampler;
-	gs_stagesurf_t                  *mapped_surface;
 	int                             cur_texture;
 
 	uint64_t                        video_time;
@@ -272,6 +331,13 @@ struct obs_core_video {
 	float                           color_matrix[16];
 	enum obs_scale_type             scale_type;
 
+	bool                            skip_static_frames;
+	uint64_t                        *frame_tile_hashes;
+	size_t                          frame_tile_count;
+	bool                            frame_tile_hashes_valid;
+	uint32_t                        static_frames;
+	uint32_t                        max_static_frames;
+
 	gs_texture_t                    *transparent_texture;
 
 	gs_effect_t                     *deinterlace_discard_effect;
@@ -401,6 +467,8 @@ struct obs_core {
 extern struct obs_core *obs;
 
 extern void *obs_graphics_thread(void *param);
+extern void *obs_readback_thread(void *param);
+extern void obs_video_device_loss_release(void *data);
 
 extern gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file);
 
@@ -560,6 +628,10 @@ struct obs_source {
 	/* used to temporarily disable sources if needed */
 	bool                            enabled;
 
+	/* incremented whenever the video of the source changes, see
+	 * obs_source_damage_tracked */
+	volatile long                   damage;
+
 	/* timing (if video is present, is based upon video) */
 	volatile bool                   timing_set;
 	volatile uint64_t               timing_adjust;
@@ -758,6 +830,10 @@ static inline enum gs_color_format convert_video_format(
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+
+/* whether changes to the video of the source are counted in source->damage,
+ * otherwise it has to be assumed to change every frame */
+extern bool obs_source_damage_tracked(obs_source_t *source);
 extern float obs_source_get_target_volume(obs_source_t *source,
 		obs_source_t *target);
 
@@ -792,14 +868,32 @@ enum delay_msg {
 	DELAY_MSG_STOP,
 };
 
+/* packets over the delay memory limit are spilled to a temporary file, the
+ * entry then only keeps the packet info and where the data went */
 struct delay_data {
 	enum delay_msg msg;
 	uint64_t ts;
 	struct encoder_packet packet;
+	bool spilled;
+	uint32_t spill_chunk;
+	uint32_t spill_offset;
 };
 
+struct delay_spill;
+
+#define DELAY_MEM_LIMIT_DEFAULT (256 * 1024 * 1024)
+
 typedef void (*encoded_callback_t)(void *data, struct encoder_packet *packet);
 
+/* packets waiting to be interleaved, sorted by dts.  kept in a ring so the
+ * oldest packets can be sent without moving the rest */
+struct packet_queue {
+	struct encoder_packet *array;
+	size_t                start;
+	size_t                num;
+	size_t                capacity;
+};
+
 struct obs_weak_output {
 	struct obs_weak_ref ref;
 	struct obs_output *output;
@@ -831,7 +925,7 @@ struct obs_output {
 	pthread_t                       end_data_capture_thread;
 	os_event_t                      *stopping_event;
 	pthread_mutex_t                 interleaved_mutex;
-	DARRAY(struct encoder_packet)   interleaved_packets;
+	struct packet_queue             interleaved_packets;
 	int                             stop_code;
 
 	int                             reconnect_retry_sec;
@@ -882,6 +976,9 @@ struct obs_output {
 	volatile long                   delay_restart_refs;
 	volatile bool                   delay_active;
 	volatile bool                   delay_capturing;
+	size_t                          delay_mem_limit;
+	size_t                          delay_mem_size;
+	struct delay_spill              *delay_spill;
 
 	char                            *last_error_message;
 };
@@ -949,6 +1046,13 @@ struct obs_encoder {
 	volatile bool                   active;
 	bool                            initialized;
 
+	/* settings changed while active, applied on the encode thread.
+	 * settings_mutex only guards context.settings between the two and is
+	 * never held while taking another lock, so it's safe to take from
+	 * the packet and encode paths */
+	volatile bool                   reconfigure_requested;
+	pthread_mutex_t                 settings_mutex;
+
 	/* indicates ownership of the info.id buffer */
 	bool                            owns_info_id;
 
@@ -1004,6 +1108,16 @@ extern void obs_encoder_remove_output(struct obs_encoder *encoder,
 
 void obs_encoder_destroy(obs_encoder_t *encoder);
 
+/* ------------------------------------------------------------------------- */
+/* encoder packet pool */
+
+extern bool obs_packet_pool_init(void);
+extern void obs_packet_pool_free(void);
+
+/* returns a payload with a reference count of 1 in front of it */
+extern void *obs_packet_pool_alloc(size_t size);
+extern void obs_packet_pool_release(void *data);
+
 /* ------------------------------------------------------------------------- */
 /* services */
 
@@ -16,8 +16,45 @@
 ******************************************************************************/
 
 #include <inttypes.h>
+#include "util/mapped-file.h"
 #include "obs-internal.h"
 
+/*
+ * A long delay holds a lot of packet data.  Once the data held in memory
+ * goes over the output's delay memory limit, new packets are written to a
+ * memory mapped temporary file instead, and the queue only keeps their
+ * timestamps, flags and where the data is.  Spilled packets are read back in
+ * to memory a little before they are due, so the file is never read on the
+ * output's critical path unless it's running behind.
+ *
+ * The file is split in to fixed size chunks that are reused once every
+ * packet in them has been sent, so it only grows to what the delay needs.
+ */
+
+#define SPILL_CHUNK_SIZE   (16 * 1024 * 1024)
+#define SPILL_READAHEAD_NS 1000000000ULL
+#define NO_CHUNK           0xFFFFFFFF
+
+struct spill_chunk {
+	uint32_t            live;
+};
+
+struct delay_spill {
+	os_mapped_file_t    *file;
+	DARRAY(struct spill_chunk) chunks;
+	DARRAY(uint32_t)    free_chunks;
+
+	uint32_t            write_chunk;
+	uint32_t            write_pos;
+	uint8_t             *write_view;
+
+	uint32_t            read_chunk;
+	uint8_t             *read_view;
+
+	uint64_t            packets;
+	uint64_t            bytes;
+};
+
 static inline bool delay_active(const struct obs_output *output)
 {
 	return os_atomic_load_bool(&output->delay_active);
@@ -28,6 +65,211 @@ static inline bool delay_capturing(const struct obs_output *output)
 	return os_atomic_load_bool(&output->delay_capturing);
 }
 
+/* ------------------------------------------------------------------------- */
+
+static void spill_free(struct obs_output *output)
+{
+	struct delay_spill *spill = output->delay_spill;
+
+	if (!spill)
+		return;
+
+	blog(LOG_INFO, "Output '%s': %"PRIu64" delayed packets "
+	               "(%"PRIu64" MB) went through the spill file, "
+	               "which grew to %d MB",
+	               output->context.name, spill->packets,
+	               spill->bytes / (1024 * 1024),
+	               (int)(spill->chunks.num * (SPILL_CHUNK_SIZE /
+				       (1024 * 1024))));
+
+	os_mapped_file_unmap(spill->write_view, SPILL_CHUNK_SIZE);
+	os_mapped_file_unmap(spill->read_view, SPILL_CHUNK_SIZE);
+	os_mapped_file_destroy(spill->file);
+	da_free(spill->chunks);
+	da_free(spill->free_chunks);
+	bfree(spill);
+
+	output->delay_spill = NULL;
+}
+
+static inline uint64_t chunk_offset(uint32_t chunk)
+{
+	return (uint64_t)chunk * SPILL_CHUNK_SIZE;
+}
+
+static void release_chunk(struct delay_spill *spill, uint32_t chunk)
+{
+	if (chunk == spill->read_chunk && spill->read_view) {
+		os_mapped_file_unmap(spill->read_view, SPILL_CHUNK_SIZE);
+		spill->read_view = NULL;
+	}
+
+	da_push_back(spill->free_chunks, &chunk);
+}
+
+static bool next_write_chunk(struct delay_spill *spill)
+{
+	uint32_t chunk;
+
+	if (spill->write_view) {
+		os_mapped_file_unmap(spill->write_view, SPILL_CHUNK_SIZE);
+		spill->write_view = NULL;
+
+		if (!spill->chunks.array[spill->write_chunk].live)
+			release_chunk(spill, spill->write_chunk);
+		spill->write_chunk = NO_CHUNK;
+	}
+
+	if (spill->free_chunks.num) {
+		chunk = spill->free_chunks.array[spill->free_chunks.num - 1];
+		da_pop_back(spill->free_chunks);
+	} else {
+		struct spill_chunk new_chunk = {0};
+
+		chunk = (uint32_t)spill->chunks.num;
+		if (!os_mapped_file_resize(spill->file,
+					chunk_offset(chunk + 1)))
+			return false;
+
+		da_push_back(spill->chunks, &new_chunk);
+	}
+
+	spill->write_view = os_mapped_file_map(spill->file,
+			chunk_offset(chunk), SPILL_CHUNK_SIZE);
+	if (!spill->write_view) {
+		da_push_back(spill->free_chunks, &chunk);
+		return false;
+	}
+
+	spill->write_chunk = chunk;
+	spill->write_pos = 0;
+	return true;
+}
+
+static bool spill_packet(struct obs_output *output, struct delay_data *dd,
+		const struct encoder_packet *packet)
+{
+	struct delay_spill *spill = output->delay_spill;
+
+	if (packet->size > SPILL_CHUNK_SIZE)
+		return false;
+
+	if (!spill) {
+		os_mapped_file_t *file = os_mapped_file_create_temp();
+		if (!file) {
+			blog(LOG_WARNING, "Output '%s': Could not create the "
+			                  "delay spill file, keeping delayed "
+			                  "packets in memory",
+			                  output->context.name);
+			output->delay_mem_limit = 0;
+			return false;
+		}
+
+		spill = bzalloc(sizeof(struct delay_spill));
+		spill->file = file;
+		spill->write_chunk = NO_CHUNK;
+		spill->read_chunk = NO_CHUNK;
+		output->delay_spill = spill;
+	}
+
+	if (!spill->write_view ||
+	    spill->write_pos + packet->size > SPILL_CHUNK_SIZE) {
+		if (!next_write_chunk(spill))
+			return false;
+	}
+
+	memcpy(spill->write_view + spill->write_pos, packet->data,
+			packet->size);
+
+	dd->packet.data  = NULL;
+	dd->spilled      = true;
+	dd->spill_chunk  = spill->write_chunk;
+	dd->spill_offset = spill->write_pos;
+
+	spill->chunks.array[spill->write_chunk].live++;
+	spill->write_pos += (uint32_t)packet->size;
+	spill->packets++;
+	spill->bytes += packet->size;
+	return true;
+}
+
+/* brings a spilled packet back in to memory, must be called with the delay
+ * mutex held */
+static bool reload_packet(struct obs_output *output, struct delay_data *dd)
+{
+	struct delay_spill *spill = output->delay_spill;
+	struct spill_chunk *chunk = spill->chunks.array + dd->spill_chunk;
+	bool success = true;
+
+	if (dd->spill_chunk == spill->write_chunk && spill->write_view) {
+		dd->packet.data = obs_packet_pool_alloc(dd->packet.size);
+		memcpy(dd->packet.data, spill->write_view + dd->spill_offset,
+				dd->packet.size);
+
+	} else {
+		if (!spill->read_view || spill->read_chunk != dd->spill_chunk) {
+			os_mapped_file_unmap(spill->read_view,
+					SPILL_CHUNK_SIZE);
+			spill->read_chunk = dd->spill_chunk;
+			spill->read_view = os_mapped_file_map(spill->file,
+					chunk_offset(dd->spill_chunk),
+					SPILL_CHUNK_SIZE);
+
+			/* packets come back in order, so the rest of the
+			 * chunk is going to be needed soon */
+			os_mapped_file_prefetch(spill->read_view,
+					SPILL_CHUNK_SIZE);
+		}
+
+		if (spill->read_view) {
+			dd->packet.data = obs_packet_pool_alloc(
+					dd->packet.size);
+			memcpy(dd->packet.data,
+					spill->read_view + dd->spill_offset,
+					dd->packet.size);
+		} else {
+			success = false;
+		}
+	}
+
+	dd->spilled = false;
+	if (success)
+		output->delay_mem_size += dd->packet.size;
+
+	if (--chunk->live == 0 && dd->spill_chunk != spill->write_chunk)
+		release_chunk(spill, dd->spill_chunk);
+
+	return success;
+}
+
+static void warn_reload_failed(struct obs_output *output,
+		const struct delay_data *dd)
+{
+	blog(LOG_WARNING, "Output '%s': Failed to read a delayed packet back "
+	                  "from the spill file (offset %"PRIu64", %"PRIu64
+	                  " bytes)", output->context.name,
+	                  chunk_offset(dd->spill_chunk) + dd->spill_offset,
+	                  (uint64_t)dd->packet.size);
+}
+
+static void read_ahead(struct obs_output *output, uint64_t t)
+{
+	size_t count = output->delay_data.size / sizeof(struct delay_data);
+
+	for (size_t i = 0; i < count; i++) {
+		struct delay_data *dd = circlebuf_data(&output->delay_data,
+				i * sizeof(struct delay_data));
+
+		if (dd->ts + output->active_delay_ns > t + SPILL_READAHEAD_NS)
+			break;
+
+		if (dd->spilled && !reload_packet(output, dd))
+			warn_reload_failed(output, dd);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline void push_packet(struct obs_output *output,
 		struct encoder_packet *packet, uint64_t t)
 {
@@ -35,10 +277,22 @@ static inline void push_packet(struct obs_output *output,
 
 	dd.msg = DELAY_MSG_PACKET;
 	dd.ts  = t;
-	obs_encoder_packet_create_instance(&dd.packet, packet);
+	dd.packet = *packet;
 
 	pthread_mutex_lock(&output->delay_mutex);
+
+	if (!output->delay_mem_limit ||
+	    output->delay_mem_size + packet->size <= output->delay_mem_limit ||
+	    !spill_packet(output, &dd, packet)) {
+		obs_encoder_packet_create_instance(&dd.packet, packet);
+		output->delay_mem_size += packet->size;
+	}
+
 	circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+
+	if (output->delay_spill)
+		read_ahead(output, t);
+
 	pthread_mutex_unlock(&output->delay_mutex);
 }
 
@@ -72,6 +326,8 @@ void obs_output_cleanup_delay(obs_output_t *output)
 		}
 	}
 
+	spill_free(output);
+	output->delay_mem_size = 0;
 	output->active_delay_ns = 0;
 	os_atomic_set_long(&output->delay_restart_refs, 0);
 }
@@ -97,9 +353,21 @@ static inline bool pop_packet(struct obs_output *output, uint64_t t)
 			output->active_delay_ns = elapsed_time;
 
 		} else if (elapsed_time > output->active_delay_ns) {
+			/* read ahead didn't get to it in time */
+			if (dd.spilled) {
+				struct delay_data *front = circlebuf_data(
+						&output->delay_data, 0);
+				if (!reload_packet(output, front))
+					warn_reload_failed(output, front);
+				dd = *front;
+			}
+
 			circlebuf_pop_front(&output->delay_data, NULL,
 					sizeof(dd));
 			popped = true;
+
+			if (dd.msg == DELAY_MSG_PACKET && dd.packet.data)
+				output->delay_mem_size -= dd.packet.size;
 		}
 	}
 
@@ -107,8 +375,13 @@ static inline bool pop_packet(struct obs_output *output, uint64_t t)
 
 	/* ------------------------------------------------ */
 
-	if (popped)
+	if (popped) {
+		/* lost to a spill file error, nothing left to send */
+		if (dd.msg == DELAY_MSG_PACKET && !dd.packet.data)
+			return true;
+
 		process_delay_data(output, &dd);
+	}
 
 	return popped;
 }
@@ -197,6 +470,17 @@ void obs_output_set_delay(obs_output_t *output, uint32_t delay_sec,
 	output->delay_flags = flags;
 }
 
+void obs_output_set_delay_memory_limit(obs_output_t *output,
+		uint32_t limit_mb)
+{
+	if (!obs_output_valid(output, "obs_output_set_delay_memory_limit"))
+		return;
+
+	pthread_mutex_lock(&output->delay_mutex);
+	output->delay_mem_limit = (size_t)limit_mb * 1024 * 1024;
+	pthread_mutex_unlock(&output->delay_mutex);
+}
+
 uint32_t obs_output_get_delay(const obs_output_t *output)
 {
 	return obs_output_valid(output, "obs_output_set_delay") ?
@@ -129,6 +129,7 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	}
 	output->video    = obs_get_video();
 	output->audio    = obs_get_audio();
+	output->delay_mem_limit = DELAY_MEM_LIMIT_DEFAULT;
 	if (output->info.get_defaults)
 		output->info.get_defaults(output->context.settings);
 
@@ -162,11 +163,69 @@ fail:
 	return NULL;
 }
 
+static inline struct encoder_packet *packet_queue_at(
+		struct packet_queue *queue, size_t idx)
+{
+	return queue->array + ((queue->start + idx) & (queue->capacity - 1));
+}
+
+#define interleaved_packet(output, idx) \
+	packet_queue_at(&(output)->interleaved_packets, idx)
+
+static void packet_queue_grow(struct packet_queue *queue)
+{
+	size_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+	struct encoder_packet *array = bmalloc(capacity * sizeof(*array));
+
+	for (size_t i = 0; i < queue->num; i++)
+		array[i] = *packet_queue_at(queue, i);
+
+	bfree(queue->array);
+	queue->array    = array;
+	queue->start    = 0;
+	queue->capacity = capacity;
+}
+
+/* moves whichever side of idx is shorter to make room for the packet */
+static void packet_queue_insert(struct packet_queue *queue, size_t idx,
+		const struct encoder_packet *packet)
+{
+	if (queue->num == queue->capacity)
+		packet_queue_grow(queue);
+
+	if (idx < queue->num / 2) {
+		queue->start = (queue->start - 1) & (queue->capacity - 1);
+		for (size_t i = 0; i < idx; i++)
+			*packet_queue_at(queue, i) =
+				*packet_queue_at(queue, i + 1);
+	} else {
+		for (size_t i = queue->num; i > idx; i--)
+			*packet_queue_at(queue, i) =
+				*packet_queue_at(queue, i - 1);
+	}
+
+	*packet_queue_at(queue, idx) = *packet;
+	queue->num++;
+}
+
+/* drops packets from the front without releasing them */
+static inline void packet_queue_pop(struct packet_queue *queue, size_t count)
+{
+	queue->start = (queue->start + count) & (queue->capacity - 1);
+	queue->num  -= count;
+}
+
+static inline void packet_queue_free(struct packet_queue *queue)
+{
+	bfree(queue->array);
+	memset(queue, 0, sizeof(*queue));
+}
+
 static inline void free_packets(struct obs_output *output)
 {
 	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array+i);
-	da_free(output->interleaved_packets);
+		obs_encoder_packet_release(interleaved_packet(output, i));
+	packet_queue_free(&output->interleaved_packets);
 }
 
 void obs_output_destroy(obs_output_t *output)
@@ -208,6 +267,7 @@ void obs_output_destroy(obs_output_t *output)
 		pthread_mutex_destroy(&output->interleaved_mutex);
 		pthread_mutex_destroy(&output->delay_mutex);
 		os_event_destroy(output->reconnect_stop_event);
+		obs_output_cleanup_delay(output);
 		obs_context_data_free(&output->context);
 		circlebuf_free(&output->delay_data);
 		if (output->owns_info_id)
@@ -970,7 +1030,6 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_t sei;
 	uint8_t *data;
 	size_t size;
-	long ref = 1;
 
 	DARRAY(uint8_t) out_data;
 
@@ -980,7 +1039,6 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_init(&sei);
 
 	da_init(out_data);
-	da_push_back_array(out_data, &ref, sizeof(ref));
 	da_push_back_array(out_data, out->data, out->size);
 
 	caption_frame_init(&cf);
@@ -998,8 +1056,10 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	obs_encoder_packet_release(out);
 
 	*out = backup;
-	out->data = (uint8_t*)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	out->data = obs_packet_pool_alloc(out_data.num);
+	out->size = out_data.num;
+	memcpy(out->data, out_data.array, out_data.num);
+	da_free(out_data);
 
 	sei_free(&sei);
 
@@ -1012,7 +1072,7 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet out = *interleaved_packet(output, 0);
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
@@ -1020,7 +1080,7 @@ static inline void send_interleaved(struct obs_output *output)
 	if (!has_higher_opposing_ts(output, &out))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	packet_queue_pop(&output->interleaved_packets, 1);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1082,7 +1142,7 @@ static size_t get_interleaved_start_idx(struct obs_output *output)
 
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			interleaved_packet(output, i);
 		int64_t diff;
 
 		if (packet->type != OBS_ENCODER_AUDIO) {
@@ -1118,7 +1178,7 @@ static int prune_premature_packets(struct obs_output *output)
 	}
 
 	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
+	video = interleaved_packet(output, video_idx);
 	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
@@ -1132,7 +1192,7 @@ static int prune_premature_packets(struct obs_output *output)
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
+		audio = interleaved_packet(output, audio_idx);
 		if (audio_idx > max_idx)
 			max_idx = audio_idx;
 
@@ -1148,11 +1208,11 @@ static void discard_to_idx(struct obs_output *output, size_t idx)
 {
 	for (size_t i = 0; i < idx; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			interleaved_packet(output, i);
 		obs_encoder_packet_release(packet);
 	}
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+	packet_queue_pop(&output->interleaved_packets, idx);
 }
 
 #define DEBUG_STARTING_PACKETS 0
@@ -1166,7 +1226,7 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			interleaved_packet(output, i);
 		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
 				packet->type == OBS_ENCODER_AUDIO ?
 				"audio" : "video", (int)packet->track_idx,
@@ -1194,7 +1254,7 @@ static int find_first_packet_type_idx(struct obs_output *output,
 {
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			interleaved_packet(output, i);
 
 		if (packet->type == type) {
 			if (type == OBS_ENCODER_AUDIO &&
@@ -1214,7 +1274,7 @@ static int find_last_packet_type_idx(struct obs_output *output,
 {
 	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
+			interleaved_packet(output, i - 1);
 
 		if (packet->type == type) {
 			if (type == OBS_ENCODER_AUDIO &&
@@ -1234,7 +1294,7 @@ static inline struct encoder_packet *find_first_packet_type(
 		size_t audio_idx)
 {
 	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return (idx != -1) ? interleaved_packet(output, idx) : NULL;
 }
 
 static inline struct encoder_packet *find_last_packet_type(
@@ -1242,7 +1302,7 @@ static inline struct encoder_packet *find_last_packet_type(
 		size_t audio_idx)
 {
 	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return (idx != -1) ? interleaved_packet(output, idx) : NULL;
 }
 
 static bool get_audio_and_video_packets(struct obs_output *output,
@@ -1322,44 +1382,50 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	/* apply new offsets to all existing packet DTS/PTS values */
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			interleaved_packet(output, i);
 		apply_interleaved_packet_offset(output, packet);
 	}
 
 	return true;
 }
 
+/* the queue is always sorted by dts when packets are inserted, so this finds
+ * the first packet with a higher dts, or an equal one if the new packet is
+ * video, which puts video before audio of the same dts */
 static inline void insert_interleaved_packet(struct obs_output *output,
 		struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
+	size_t low  = 0;
+	size_t high = output->interleaved_packets.num;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
 		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
+		cur_packet = interleaved_packet(output, mid);
 
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
+		if (out->dts_usec < cur_packet->dts_usec ||
+		    (out->dts_usec == cur_packet->dts_usec &&
+		     out->type == OBS_ENCODER_VIDEO))
+			high = mid;
+		else
+			low = mid + 1;
 	}
 
-	da_insert(output->interleaved_packets, idx, out);
+	packet_queue_insert(&output->interleaved_packets, low, out);
 }
 
 static void resort_interleaved_packets(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
+	struct packet_queue old_queue = output->interleaved_packets;
 
-	old_array.da = output->interleaved_packets.da;
 	memset(&output->interleaved_packets, 0,
 			sizeof(output->interleaved_packets));
 
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
+	for (size_t i = 0; i < old_queue.num; i++)
+		insert_interleaved_packet(output,
+				packet_queue_at(&old_queue, i));
 
-	da_free(old_array);
+	packet_queue_free(&old_queue);
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
@@ -1369,7 +1435,7 @@ static void discard_unused_audio_packets(struct obs_output *output,
 
 	for (; idx < output->interleaved_packets.num; idx++) {
 		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+			interleaved_packet(output, idx);
 
 		if (p->dts_usec >= dts_usec)
 			break;
@@ -2138,6 +2204,27 @@ int obs_output_get_connect_time_ms(obs_output_t *output)
 	return -1;
 }
 
+int obs_output_get_io_queue_depth(obs_output_t *output)
+{
+	if (!obs_output_valid(output, "obs_output_get_io_queue_depth"))
+		return -1;
+
+	if (output->info.get_io_queue_depth)
+		return output->info.get_io_queue_depth(output->context.data);
+	return -1;
+}
+
+int obs_output_get_io_write_latency_us(obs_output_t *output)
+{
+	if (!obs_output_valid(output, "obs_output_get_io_write_latency_us"))
+		return -1;
+
+	if (output->info.get_io_write_latency_us)
+		return output->info.get_io_write_latency_us(
+				output->context.data);
+	return -1;
+}
+
 const char *obs_output_get_last_error(obs_output_t *output)
 {
 	if (!obs_output_valid(output, "obs_output_get_last_error"))
@@ -71,6 +71,10 @@ struct obs_output_info {
 	/* only used with encoded outputs, separated with semicolon */
 	const char *encoded_video_codecs;
 	const char *encoded_audio_codecs;
+
+	/* file outputs that write in the background */
+	int (*get_io_queue_depth)(void *data);
+	int (*get_io_write_latency_us)(void *data);
 };
 
 EXPORT void obs_register_output_s(const struct obs_output_info *info,
@@ -0,0 +1,248 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stddef.h>
+#include "obs-internal.h"
+
+/*
+ * Encoder packet payloads are handed out in power of two size classes, and
+ * released payloads are kept on a free list per class instead of going back
+ * to the heap.  A recording or stream cycles through the same few sizes, so
+ * after the first few seconds almost every packet reuses an existing block.
+ *
+ * The reference count used by obs_encoder_packet_ref/release stays directly
+ * in front of the payload, so packets look the same as they always have.
+ */
+
+#define MIN_CLASS_SIZE    256
+#define NUM_CLASSES       15 /* 256 bytes to 4 megabytes */
+#define CLASS_CACHE_BYTES (2 * 1024 * 1024)
+#define CLASS_CACHE_MIN   4
+
+#define OVERSIZED_CLASS   -1
+
+struct packet_block {
+	struct packet_block *next;
+	int                 size_class;
+
+	/* must stay last, the payload follows it */
+	long                refs;
+};
+
+#define block_data(block) \
+	((uint8_t*)&(block)->refs + sizeof(long))
+#define data_block(data) \
+	((struct packet_block*)((uint8_t*)(data) - sizeof(long) - \
+		offsetof(struct packet_block, refs)))
+#define BLOCK_HEADER_SIZE \
+	(offsetof(struct packet_block, refs) + sizeof(long))
+
+struct packet_class {
+	pthread_mutex_t     mutex;
+	struct packet_block *free_blocks;
+	size_t              num_free;
+	size_t              max_free;
+
+	long                allocs;
+	long                reused;
+};
+
+struct packet_pool {
+	struct packet_class classes[NUM_CLASSES];
+	volatile long       oversized;
+	volatile bool       initialized;
+
+	/* across all classes, so the peak is a real point in time rather
+	 * than per-class peaks that happened at different times */
+	volatile long       in_use;
+	volatile long       peak_in_use;
+};
+
+static struct packet_pool pool;
+
+static inline size_t class_size(int size_class)
+{
+	return (size_t)MIN_CLASS_SIZE << size_class;
+}
+
+static inline int find_class(size_t size)
+{
+	for (int i = 0; i < NUM_CLASSES; i++) {
+		if (size <= class_size(i))
+			return i;
+	}
+
+	return OVERSIZED_CLASS;
+}
+
+bool obs_packet_pool_init(void)
+{
+	for (int i = 0; i < NUM_CLASSES; i++) {
+		struct packet_class *pc = &pool.classes[i];
+		size_t max_free = CLASS_CACHE_BYTES / class_size(i);
+
+		if (pthread_mutex_init(&pc->mutex, NULL) != 0) {
+			while (i-- > 0)
+				pthread_mutex_destroy(&pool.classes[i].mutex);
+			return false;
+		}
+
+		pc->max_free = max_free < CLASS_CACHE_MIN ?
+			CLASS_CACHE_MIN : max_free;
+	}
+
+	os_atomic_set_bool(&pool.initialized, true);
+	return true;
+}
+
+void obs_packet_pool_free(void)
+{
+	struct obs_packet_pool_stats stats;
+
+	if (!os_atomic_load_bool(&pool.initialized))
+		return;
+
+	obs_get_packet_pool_stats(&stats);
+	blog(LOG_INFO, "Packet pool: %ld allocations, %ld reused, "
+			"%ld oversized, peak of %ld packets in use",
+			stats.allocs, stats.reused, stats.oversized,
+			stats.peak_in_use);
+
+	os_atomic_set_bool(&pool.initialized, false);
+
+	for (int i = 0; i < NUM_CLASSES; i++) {
+		struct packet_class *pc = &pool.classes[i];
+
+		pthread_mutex_lock(&pc->mutex);
+		while (pc->free_blocks) {
+			struct packet_block *next = pc->free_blocks->next;
+			bfree(pc->free_blocks);
+			pc->free_blocks = next;
+		}
+		pthread_mutex_unlock(&pc->mutex);
+
+		pthread_mutex_destroy(&pc->mutex);
+	}
+
+	memset(&pool, 0, sizeof(pool));
+}
+
+static inline void update_peak(long in_use)
+{
+	long peak = os_atomic_load_long(&pool.peak_in_use);
+
+	while (in_use > peak && !os_atomic_compare_swap_long(
+				&pool.peak_in_use, peak, in_use))
+		peak = os_atomic_load_long(&pool.peak_in_use);
+}
+
+void *obs_packet_pool_alloc(size_t size)
+{
+	struct packet_block *block = NULL;
+	int size_class = OVERSIZED_CLASS;
+
+	if (os_atomic_load_bool(&pool.initialized))
+		size_class = find_class(size);
+
+	if (size_class == OVERSIZED_CLASS) {
+		if (os_atomic_load_bool(&pool.initialized))
+			os_atomic_inc_long(&pool.oversized);
+
+		block = bmalloc(BLOCK_HEADER_SIZE + size);
+
+	} else {
+		struct packet_class *pc = &pool.classes[size_class];
+
+		pthread_mutex_lock(&pc->mutex);
+
+		block = pc->free_blocks;
+		if (block) {
+			pc->free_blocks = block->next;
+			pc->num_free--;
+			pc->reused++;
+		}
+
+		pc->allocs++;
+
+		pthread_mutex_unlock(&pc->mutex);
+
+		update_peak(os_atomic_inc_long(&pool.in_use));
+
+		if (!block)
+			block = bmalloc(BLOCK_HEADER_SIZE +
+					class_size(size_class));
+	}
+
+	block->next       = NULL;
+	block->size_class = size_class;
+	block->refs       = 1;
+	return block_data(block);
+}
+
+void obs_packet_pool_release(void *data)
+{
+	struct packet_block *block = data_block(data);
+	struct packet_class *pc;
+
+	if (block->size_class == OVERSIZED_CLASS ||
+	    !os_atomic_load_bool(&pool.initialized)) {
+		bfree(block);
+		return;
+	}
+
+	pc = &pool.classes[block->size_class];
+	os_atomic_dec_long(&pool.in_use);
+
+	pthread_mutex_lock(&pc->mutex);
+
+	if (pc->num_free < pc->max_free) {
+		block->next = pc->free_blocks;
+		pc->free_blocks = block;
+		pc->num_free++;
+		block = NULL;
+	}
+
+	pthread_mutex_unlock(&pc->mutex);
+
+	bfree(block);
+}
+
+void obs_get_packet_pool_stats(struct obs_packet_pool_stats *stats)
+{
+	if (!stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!os_atomic_load_bool(&pool.initialized))
+		return;
+
+	for (int i = 0; i < NUM_CLASSES; i++) {
+		struct packet_class *pc = &pool.classes[i];
+
+		pthread_mutex_lock(&pc->mutex);
+		stats->allocs       += pc->allocs;
+		stats->reused       += pc->reused;
+		stats->cached_bytes += pc->num_free * class_size(i);
+		pthread_mutex_unlock(&pc->mutex);
+	}
+
+	stats->oversized   = os_atomic_load_long(&pool.oversized);
+	stats->allocs     += stats->oversized;
+	stats->in_use      = os_atomic_load_long(&pool.in_use);
+	stats->peak_in_use = os_atomic_load_long(&pool.peak_in_use);
+}
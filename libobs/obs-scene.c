@@ -65,8 +65,10 @@ static void *scene_create(obs_data_t *settings, struct obs_source *source)
 {
 	pthread_mutexattr_t attr;
 	struct obs_scene *scene = bmalloc(sizeof(struct obs_scene));
-	scene->source     = source;
-	scene->first_item = NULL;
+	scene->source        = source;
+	scene->first_item    = NULL;
+	scene->cache_render  = NULL;
+	scene->cache_damaged = true;
 
 	signal_handler_add_array(obs_source_get_signal_handler(source),
 			obs_scene_signals);
@@ -157,6 +159,12 @@ static void scene_destroy(void *data)
 
 	remove_all_items(scene);
 
+	if (scene->cache_render) {
+		obs_enter_graphics();
+		gs_texrender_destroy(scene->cache_render);
+		obs_leave_graphics();
+	}
+
 	pthread_mutex_destroy(&scene->video_mutex);
 	pthread_mutex_destroy(&scene->audio_mutex);
 	bfree(scene);
@@ -211,6 +219,7 @@ static inline void detach_sceneitem(struct obs_scene_item *item)
 	if (item->next)
 		item->next->prev = item->prev;
 
+	item->parent->cache_damaged = true;
 	item->parent = NULL;
 }
 
@@ -219,6 +228,7 @@ static inline void attach_sceneitem(struct obs_scene *parent,
 {
 	item->prev   = prev;
 	item->parent = parent;
+	parent->cache_damaged = true;
 
 	if (prev) {
 		item->next = prev->next;
@@ -326,6 +336,8 @@ static void update_item_transform(struct obs_scene_item *item)
 	if (os_atomic_load_long(&item->defer_update) > 0)
 		return;
 
+	os_atomic_set_bool(&item->damaged, true);
+
 	width = cx;
 	height = cy;
 
@@ -521,20 +533,279 @@ static void scene_video_tick(void *data, float seconds)
 	UNUSED_PARAMETER(seconds);
 }
 
+/* ------------------------------------------------------------------------- */
+/* scene texture caching */
+
+static bool scene_damaged(struct obs_scene *scene);
+
+static inline long get_source_damage(const struct obs_source *source)
+{
+	return os_atomic_load_long(&source->damage);
+}
+
+static inline bool item_cacheable(const struct obs_scene_item *item)
+{
+	return !item->user_visible || obs_source_damage_tracked(item->source);
+}
+
+/* whether the item has to be drawn again, damage is the source's current
+ * damage count */
+static bool item_changed(struct obs_scene_item *item, long damage)
+{
+	if (item->drawn != item->user_visible)
+		return true;
+	if (!item->user_visible)
+		return false;
+
+	if (os_atomic_load_bool(&item->damaged) || source_size_changed(item))
+		return true;
+	if (damage != item->drawn_damage)
+		return true;
+
+	return item_is_scene(item) &&
+		scene_damaged(obs_scene_from_source(item->source));
+}
+
+/* checks for changes a nested scene hasn't drawn yet */
+static bool scene_damaged(struct obs_scene *scene)
+{
+	struct obs_scene_item *item;
+	bool damaged;
+
+	if (!scene)
+		return true;
+
+	video_lock(scene);
+
+	damaged = scene->cache_damaged;
+	item = scene->first_item;
+
+	/* a removed source gets dropped from the scene on its next render,
+	 * which uncovers whatever it was drawn over */
+	while (item && !damaged) {
+		damaged = obs_source_removed(item->source) ||
+			!item_cacheable(item) ||
+			item_changed(item, get_source_damage(item->source));
+		item = item->next;
+	}
+
+	video_unlock(scene);
+	return damaged;
+}
+
+static void get_item_bounds(const struct obs_scene_item *item,
+		struct bounds *b)
+{
+	struct bounds box;
+
+	vec3_zero(&box.min);
+	vec3_set(&box.max,
+			(float)calc_cx(item, item->last_width),
+			(float)calc_cy(item, item->last_height),
+			0.0f);
+	bounds_transform(b, &box, &item->draw_transform);
+}
+
+static inline void add_damage(struct bounds *damage, bool *damaged,
+		const struct bounds *b)
+{
+	if (*damaged) {
+		bounds_merge(damage, damage, b);
+	} else {
+		bounds_copy(damage, b);
+		*damaged = true;
+	}
+}
+
+/* merges where the changed items were and are now, and marks every item as
+ * drawn the way it is now */
+static bool collect_damage(struct obs_scene *scene, struct bounds *damage)
+{
+	struct obs_scene_item *item = scene->first_item;
+	bool damaged = false;
+
+	while (item) {
+		long source_damage = get_source_damage(item->source);
+		bool changed = item_changed(item, source_damage);
+		bool visible = item->user_visible;
+		struct bounds cur;
+
+		os_atomic_set_bool(&item->damaged, false);
+
+		if (visible)
+			get_item_bounds(item, &cur);
+
+		if (changed) {
+			if (item->drawn)
+				add_damage(damage, &damaged,
+						&item->drawn_bounds);
+			if (visible)
+				add_damage(damage, &damaged, &cur);
+		}
+
+		if (visible)
+			bounds_copy(&item->drawn_bounds, &cur);
+		item->drawn        = visible;
+		item->drawn_damage = source_damage;
+
+		item = item->next;
+	}
+
+	return damaged;
+}
+
+/* the damaged pixels, with a pixel of margin for texture filtering */
+static bool get_damage_rect(const struct bounds *damage, uint32_t cx,
+		uint32_t cy, struct gs_rect *rect)
+{
+	float left   = floorf(damage->min.x) - 1.0f;
+	float top    = floorf(damage->min.y) - 1.0f;
+	float right  = ceilf(damage->max.x) + 1.0f;
+	float bottom = ceilf(damage->max.y) + 1.0f;
+
+	if (left < 0.0f)          left   = 0.0f;
+	if (top < 0.0f)           top    = 0.0f;
+	if (right > (float)cx)    right  = (float)cx;
+	if (bottom > (float)cy)   bottom = (float)cy;
+
+	if (left >= right || top >= bottom)
+		return false;
+
+	rect->x  = (int)left;
+	rect->y  = (int)top;
+	rect->cx = (int)right - rect->x;
+	rect->cy = (int)bottom - rect->y;
+	return true;
+}
+
+static void render_items(struct obs_scene *scene, const struct bounds *clip)
+{
+	struct obs_scene_item *item = scene->first_item;
+
+	while (item) {
+		if (item->user_visible && (!clip ||
+		    bounds_intersects(&item->drawn_bounds, clip, 1.0f)))
+			render_item(item);
+
+		item = item->next;
+	}
+}
+
+/* clears the area inside the scissor rect, gs_clear ignores it */
+static void clear_damage_rect(uint32_t cx, uint32_t cy)
+{
+	gs_effect_t *solid = obs->video.solid_effect;
+	gs_eparam_t *color = gs_effect_get_param_by_name(solid, "color");
+	struct vec4 clear_color;
+
+	vec4_zero(&clear_color);
+	gs_effect_set_vec4(color, &clear_color);
+
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	while (gs_effect_loop(solid, "Solid"))
+		gs_draw_sprite(NULL, 0, cx, cy);
+}
+
+static inline bool cache_size_matches(struct obs_scene *scene, uint32_t cx,
+		uint32_t cy)
+{
+	gs_texture_t *tex = gs_texrender_get_texture(scene->cache_render);
+	return tex && gs_texture_get_width(tex) == cx &&
+		gs_texture_get_height(tex) == cy;
+}
+
+/* redraws the changed part of the cached texture, returns false if the
+ * scene has to be drawn directly */
+static bool update_scene_cache(struct obs_scene *scene)
+{
+	uint32_t cx = obs->video.base_width;
+	uint32_t cy = obs->video.base_height;
+	bool full = scene->cache_damaged;
+	struct bounds damage;
+	struct gs_rect rect;
+
+	if (!cx || !cy)
+		return false;
+
+	if (!scene->cache_render) {
+		scene->cache_render = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+		if (!scene->cache_render)
+			return false;
+	}
+
+	if (!cache_size_matches(scene, cx, cy))
+		full = true;
+
+	if (!collect_damage(scene, &damage) && !full)
+		return true;
+
+	/* GL puts the scissor origin at the bottom, so it isn't used there */
+	if (!full && gs_get_device_type() == GS_DEVICE_OPENGL)
+		full = true;
+	if (!full && !get_damage_rect(&damage, cx, cy, &rect))
+		return true;
+
+	gs_texrender_reset(scene->cache_render);
+	if (!gs_texrender_begin(scene->cache_render, cx, cy))
+		return false;
+
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+	gs_blend_state_push();
+
+	if (full) {
+		struct vec4 clear_color;
+
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	} else {
+		gs_set_scissor_rect(&rect);
+		clear_damage_rect(cx, cy);
+	}
+
+	/* the texture ends up with premultiplied alpha, so drawing it is the
+	 * same as drawing the items directly */
+	gs_blend_function_separate(
+			GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA,
+			GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+	render_items(scene, full ? NULL : &damage);
+
+	if (!full)
+		gs_set_scissor_rect(NULL);
+
+	gs_blend_state_pop();
+	gs_texrender_end(scene->cache_render);
+
+	scene->cache_damaged = false;
+	os_atomic_inc_long(&scene->source->damage);
+	return true;
+}
+
+static void render_scene_cache(struct obs_scene *scene)
+{
+	gs_texture_t *tex = gs_texrender_get_texture(scene->cache_render);
+	gs_effect_t *effect = obs->video.default_effect;
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	while (gs_effect_loop(effect, "Draw"))
+		obs_source_draw(tex, 0, 0, 0, 0, false);
+
+	gs_blend_state_pop();
+}
+
 static void scene_video_render(void *data, gs_effect_t *effect)
 {
 	DARRAY(struct obs_scene_item*) remove_items;
 	struct obs_scene *scene = data;
 	struct obs_scene_item *item;
+	bool cacheable = true;
 
 	da_init(remove_items);
 
 	video_lock(scene);
 	item = scene->first_item;
 
-	gs_blend_state_push();
-	gs_reset_blend_state();
-
 	while (item) {
 		if (obs_source_removed(item->source)) {
 			struct obs_scene_item *del_item = item;
@@ -548,13 +819,25 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 		if (source_size_changed(item))
 			update_item_transform(item);
 
-		if (item->user_visible)
-			render_item(item);
+		if (!item_cacheable(item))
+			cacheable = false;
 
 		item = item->next;
 	}
 
-	gs_blend_state_pop();
+	/* items that can change at any time are drawn directly, as caching
+	 * them would only add a copy */
+	if (cacheable && update_scene_cache(scene)) {
+		render_scene_cache(scene);
+	} else {
+		gs_blend_state_push();
+		gs_reset_blend_state();
+		render_items(scene, NULL);
+		gs_blend_state_pop();
+
+		scene->cache_damaged = true;
+		os_atomic_inc_long(&scene->source->damage);
+	}
 
 	video_unlock(scene);
 
@@ -1876,6 +2159,7 @@ bool obs_scene_reorder_items(obs_scene_t *scene,
 	}
 
 	scene->first_item = item_order[0];
+	scene->cache_damaged = true;
 
 	obs_sceneitem_t *prev = NULL;
 	for (size_t i = 0; i < item_order_size; i++) {
@@ -20,6 +20,7 @@
 #include "obs.h"
 #include "obs-internal.h"
 #include "graphics/matrix4.h"
+#include "graphics/bounds.h"
 
 /* how obs scene! */
 
@@ -62,6 +63,13 @@ struct obs_scene_item {
 	struct matrix4        box_transform;
 	struct matrix4        draw_transform;
 
+	/* state of the item when the scene's cached texture was last drawn,
+	 * used to work out which part of the texture has to be redrawn */
+	volatile bool         damaged;
+	bool                  drawn;
+	long                  drawn_damage;
+	struct bounds         drawn_bounds;
+
 	enum obs_bounds_type  bounds_type;
 	uint32_t              bounds_align;
 	struct vec2           bounds;
@@ -86,4 +94,9 @@ struct obs_scene {
 	pthread_mutex_t       video_mutex;
 	pthread_mutex_t       audio_mutex;
 	struct obs_scene_item *first_item;
+
+	/* the items are drawn in to this and it's reused until one of them
+	 * changes */
+	gs_texrender_t        *cache_render;
+	bool                  cache_damaged;
 };
@@ -414,6 +414,8 @@ void obs_source_set_deinterlace_mode(obs_source_t *source,
 		source->deinterlace_effect = get_effect(mode);
 		obs_leave_graphics();
 	}
+
+	os_atomic_inc_long(&source->damage);
 }
 
 enum obs_deinterlace_mode obs_source_get_deinterlace_mode(
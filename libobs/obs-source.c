@@ -20,6 +20,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-kernels.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "callback/calldata.h"
@@ -39,6 +40,17 @@ static inline bool deinterlacing_enabled(const struct obs_source *source)
 	return source->deinterlace_mode != OBS_DEINTERLACE_MODE_DISABLE;
 }
 
+static inline void damage_source(struct obs_source *source)
+{
+	struct obs_source *parent = source->filter_parent;
+
+	os_atomic_inc_long(&source->damage);
+
+	/* a filter changes what the source it's on draws */
+	if (parent)
+		os_atomic_inc_long(&parent->damage);
+}
+
 struct obs_source_info *get_source_info(const char *id)
 {
 	for (size_t i = 0; i < obs->source_types.num; i++) {
@@ -786,6 +798,7 @@ static void obs_source_deferred_update(obs_source_t *source)
 				source->context.settings);
 
 	source->defer_update = false;
+	damage_source(source);
 }
 
 void obs_source_update(obs_source_t *source, obs_data_t *settings)
@@ -1004,9 +1017,11 @@ static void async_tick(obs_source_t *source)
 	source->last_sys_timestamp = sys_time;
 	pthread_mutex_unlock(&source->async_mutex);
 
-	if (source->cur_async_frame)
+	if (source->cur_async_frame) {
 		source->async_update_texture = set_async_texture_size(source,
 				source->cur_async_frame);
+		os_atomic_inc_long(&source->damage);
+	}
 }
 
 void obs_source_video_tick(obs_source_t *source, float seconds)
@@ -1510,18 +1525,6 @@ static const char *select_conversion_technique(enum video_format format)
 	return NULL;
 }
 
-static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
-{
-	gs_eparam_t *param = gs_effect_get_param_by_name(effect, name);
-	gs_effect_set_float(param, val);
-}
-
-static inline void set_eparami(gs_effect_t *effect, const char *name, int val)
-{
-	gs_eparam_t *param = gs_effect_get_param_by_name(effect, name);
-	gs_effect_set_int(param, val);
-}
-
 static bool update_async_texrender(struct obs_source *source,
 		const struct obs_source_frame *frame,
 		gs_texture_t *tex, gs_texrender_t *texrender)
@@ -1536,6 +1539,7 @@ static bool update_async_texrender(struct obs_source *source,
 	float convert_width  = (float)source->async_convert_width;
 
 	gs_effect_t *conv = obs->video.conversion_effect;
+	struct obs_conversion_params *params = &obs->video.conversion_params;
 	gs_technique_t *tech = gs_effect_get_technique(conv,
 			select_conversion_technique(frame->format));
 
@@ -1545,18 +1549,20 @@ static bool update_async_texrender(struct obs_source *source,
 	gs_technique_begin(tech);
 	gs_technique_begin_pass(tech, 0);
 
-	gs_effect_set_texture(gs_effect_get_param_by_name(conv, "image"), tex);
-	set_eparam(conv, "width",  (float)cx);
-	set_eparam(conv, "height", (float)cy);
-	set_eparam(conv, "width_d2",  cx * 0.5f);
-	set_eparam(conv, "width_d2_i",  1.0f / (cx * 0.5f));
-	set_eparam(conv, "input_width_i_d2",  (1.0f / convert_width)  * 0.5f);
-
-	set_eparami(conv, "int_width", (int)cx);
-	set_eparami(conv, "int_input_width", (int)source->async_convert_width);
-	set_eparami(conv, "int_u_plane_offset",
+	gs_effect_set_texture(params->image, tex);
+	gs_effect_set_float(params->width,  (float)cx);
+	gs_effect_set_float(params->height, (float)cy);
+	gs_effect_set_float(params->width_d2,  cx * 0.5f);
+	gs_effect_set_float(params->width_d2_i,  1.0f / (cx * 0.5f));
+	gs_effect_set_float(params->input_width_i_d2,
+			(1.0f / convert_width)  * 0.5f);
+
+	gs_effect_set_int(params->int_width, (int)cx);
+	gs_effect_set_int(params->int_input_width,
+			(int)source->async_convert_width);
+	gs_effect_set_int(params->int_u_plane_offset,
 			(int)source->async_plane_offset[0]);
-	set_eparami(conv, "int_v_plane_offset",
+	gs_effect_set_int(params->int_v_plane_offset,
 			(int)source->async_plane_offset[1]);
 
 	gs_ortho(0.f, (float)cx, 0.f, (float)cy, -100.f, 100.f);
@@ -1571,11 +1577,46 @@ static bool update_async_texrender(struct obs_source *source,
 	return true;
 }
 
+struct decompress_frame_data {
+	const struct obs_source_frame *frame;
+	enum convert_type             type;
+	uint8_t                       *ptr;
+	uint32_t                      linesize;
+};
+
+static void decompress_frame_band(void *param,
+		uint32_t start_y, uint32_t end_y)
+{
+	struct decompress_frame_data  *data  = param;
+	const struct obs_source_frame *frame = data->frame;
+
+	if (data->type == CONVERT_420)
+		decompress_420((const uint8_t* const*)frame->data,
+				frame->linesize,
+				start_y, end_y, data->ptr, data->linesize);
+
+	else if (data->type == CONVERT_NV12)
+		decompress_nv12((const uint8_t* const*)frame->data,
+				frame->linesize,
+				start_y, end_y, data->ptr, data->linesize);
+
+	else if (data->type == CONVERT_422_Y)
+		decompress_422(frame->data[0], frame->linesize[0],
+				start_y, end_y, data->ptr, data->linesize,
+				true);
+
+	else if (data->type == CONVERT_422_U)
+		decompress_422(frame->data[0], frame->linesize[0],
+				start_y, end_y, data->ptr, data->linesize,
+				false);
+}
+
 bool update_async_texture(struct obs_source *source,
 		const struct obs_source_frame *frame,
 		gs_texture_t *tex, gs_texrender_t *texrender)
 {
 	enum convert_type type      = get_convert_type(frame->format);
+	struct decompress_frame_data data;
 	uint8_t           *ptr;
 	uint32_t          linesize;
 
@@ -1600,23 +1641,11 @@ bool update_async_texture(struct obs_source *source,
 	if (!gs_texture_map(tex, &ptr, &linesize))
 		return false;
 
-	if (type == CONVERT_420)
-		decompress_420((const uint8_t* const*)frame->data,
-				frame->linesize,
-				0, frame->height, ptr, linesize);
-
-	else if (type == CONVERT_NV12)
-		decompress_nv12((const uint8_t* const*)frame->data,
-				frame->linesize,
-				0, frame->height, ptr, linesize);
-
-	else if (type == CONVERT_422_Y)
-		decompress_422(frame->data[0], frame->linesize[0],
-				0, frame->height, ptr, linesize, true);
-
-	else if (type == CONVERT_422_U)
-		decompress_422(frame->data[0], frame->linesize[0],
-				0, frame->height, ptr, linesize, false);
+	data.frame    = frame;
+	data.type     = type;
+	data.ptr      = ptr;
+	data.linesize = linesize;
+	format_conversion_run(decompress_frame_band, &data, frame->height);
 
 	gs_texture_unmap(tex);
 	return true;
@@ -1964,6 +1993,7 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 	da_insert(source->filters, 0, &filter);
 
 	pthread_mutex_unlock(&source->filter_mutex);
+	os_atomic_inc_long(&source->damage);
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
@@ -1999,6 +2029,7 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 	da_erase(source->filters, idx);
 
 	pthread_mutex_unlock(&source->filter_mutex);
+	os_atomic_inc_long(&source->damage);
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
@@ -2125,6 +2156,7 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 	pthread_mutex_lock(&source->filter_mutex);
 	success = move_filter_dir(source, filter, movement);
 	pthread_mutex_unlock(&source->filter_mutex);
+	os_atomic_inc_long(&source->damage);
 
 	if (success)
 		obs_source_dosignal(source, NULL, "reorder_filters");
@@ -2376,6 +2408,47 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source,
 	return new_frame;
 }
 
+void obs_source_damage(obs_source_t *source)
+{
+	if (!obs_source_valid(source, "obs_source_damage"))
+		return;
+
+	damage_source(source);
+}
+
+bool obs_source_damage_tracked(obs_source_t *source)
+{
+	uint32_t flags = source->info.output_flags;
+	bool tracked = true;
+
+	/* filters are drawn with the source, so they have to report their
+	 * changes too */
+	pthread_mutex_lock(&source->filter_mutex);
+	for (size_t i = 0; i < source->filters.num; i++) {
+		obs_source_t *filter = source->filters.array[i];
+
+		if ((filter->info.output_flags & OBS_SOURCE_DAMAGE) == 0) {
+			tracked = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	if (!tracked)
+		return false;
+
+	/* scenes count it when they draw something different */
+	if (source->info.type == OBS_SOURCE_TYPE_SCENE)
+		return true;
+	if (source->info.type != OBS_SOURCE_TYPE_INPUT)
+		return false;
+
+	if ((flags & OBS_SOURCE_ASYNC) != 0)
+		return !deinterlacing_enabled(source);
+
+	return (flags & OBS_SOURCE_DAMAGE) != 0;
+}
+
 void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame)
 {
@@ -2384,6 +2457,7 @@ void obs_source_output_video(obs_source_t *source,
 
 	if (!frame) {
 		source->async_active = false;
+		os_atomic_inc_long(&source->damage);
 		return;
 	}
 
@@ -2436,6 +2510,7 @@ void obs_source_preload_video(obs_source_t *source,
 			source->async_texrender);
 
 	source->last_frame_ts = frame->timestamp;
+	os_atomic_inc_long(&source->damage);
 
 	obs_leave_graphics();
 }
@@ -2448,6 +2523,7 @@ void obs_source_show_preloaded_video(obs_source_t *source)
 		return;
 
 	source->async_active = true;
+	os_atomic_inc_long(&source->damage);
 
 	pthread_mutex_lock(&source->audio_buf_mutex);
 	sys_ts = os_gettime_ns();
@@ -3537,6 +3613,7 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 		return;
 
 	source->enabled = enabled;
+	damage_source(source);
 
 	calldata_init_fixed(&data, stack, sizeof(stack));
 	calldata_set_ptr(&data, "source", source);
@@ -3755,24 +3832,18 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
 		size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_kernels_get()->scale(source->audio_output_buf[mix][0], vol,
+			AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 		size_t channels, float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
+	const struct audio_kernels *kernels = audio_kernels_get();
 
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		kernels->multiply(source->audio_output_buf[mix][ch], vol_data,
+				AUDIO_OUTPUT_FRAMES);
 }
 
 static inline void apply_audio_action(obs_source_t *source,
@@ -135,6 +135,20 @@ enum obs_source_type {
  */
 #define OBS_SOURCE_CAP_DISABLED (1<<10)
 
+/**
+ * Source reports when its video changes
+ *
+ * When used, the source calls obs_source_damage whenever it would render
+ * something different than before, and scenes keep reusing what they last
+ * drew of it until then.  Video sources without this flag are redrawn every
+ * frame.  Async video sources are tracked by libobs and don't need it.
+ *
+ * Settings updates count as a change.  Filters with this flag change the
+ * source they're on when they call obs_source_damage, and a source with any
+ * filter that doesn't have it is redrawn every frame.
+ */
+#define OBS_SOURCE_DAMAGE (1<<11)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
@@ -102,14 +102,6 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 	gs_set_viewport(0, 0, width, height);
 }
 
-static inline void unmap_last_surface(struct obs_core_video *video)
-{
-	if (video->mapped_surface) {
-		gs_stagesurface_unmap(video->mapped_surface);
-		video->mapped_surface = NULL;
-	}
-}
-
 static const char *render_main_texture_name = "render_main_texture";
 static inline void render_main_texture(struct obs_core_video *video,
 		int cur_texture)
@@ -243,12 +235,6 @@ end:
 	profile_end(render_output_texture_name);
 }
 
-static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
-{
-	gs_eparam_t *param = gs_effect_get_param_by_name(effect, name);
-	gs_effect_set_float(param, val);
-}
-
 static const char *render_convert_texture_name = "render_convert_texture";
 static void render_convert_texture(struct obs_core_video *video,
 		int cur_texture, int prev_texture)
@@ -262,26 +248,29 @@ static void render_convert_texture(struct obs_core_video *video,
 	size_t       passes, i;
 
 	gs_effect_t    *effect  = video->conversion_effect;
-	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
+	struct obs_conversion_params *params = &video->conversion_params;
 	gs_technique_t *tech    = gs_effect_get_technique(effect,
 			video->conversion_tech);
 
 	if (!video->textures_output[prev_texture])
 		goto end;
 
-	set_eparam(effect, "u_plane_offset", (float)video->plane_offsets[1]);
-	set_eparam(effect, "v_plane_offset", (float)video->plane_offsets[2]);
-	set_eparam(effect, "width",  fwidth);
-	set_eparam(effect, "height", fheight);
-	set_eparam(effect, "width_i",  1.0f / fwidth);
-	set_eparam(effect, "height_i", 1.0f / fheight);
-	set_eparam(effect, "width_d2",  fwidth  * 0.5f);
-	set_eparam(effect, "height_d2", fheight * 0.5f);
-	set_eparam(effect, "width_d2_i",  1.0f / (fwidth  * 0.5f));
-	set_eparam(effect, "height_d2_i", 1.0f / (fheight * 0.5f));
-	set_eparam(effect, "input_height", (float)video->conversion_height);
-
-	gs_effect_set_texture(image, texture);
+	gs_effect_set_float(params->u_plane_offset,
+			(float)video->plane_offsets[1]);
+	gs_effect_set_float(params->v_plane_offset,
+			(float)video->plane_offsets[2]);
+	gs_effect_set_float(params->width,  fwidth);
+	gs_effect_set_float(params->height, fheight);
+	gs_effect_set_float(params->width_i,  1.0f / fwidth);
+	gs_effect_set_float(params->height_i, 1.0f / fheight);
+	gs_effect_set_float(params->width_d2,  fwidth  * 0.5f);
+	gs_effect_set_float(params->height_d2, fheight * 0.5f);
+	gs_effect_set_float(params->width_d2_i,  1.0f / (fwidth  * 0.5f));
+	gs_effect_set_float(params->height_d2_i, 1.0f / (fheight * 0.5f));
+	gs_effect_set_float(params->input_height,
+			(float)video->conversion_height);
+
+	gs_effect_set_texture(params->image, texture);
 
 	gs_set_render_target(target, NULL);
 	set_render_size(video->output_width, video->conversion_height);
@@ -303,15 +292,49 @@ end:
 	profile_end(render_convert_texture_name);
 }
 
+static inline uint32_t next_staging_surface(struct obs_core_video *video,
+		uint32_t idx)
+{
+	return ++idx == video->num_staging_surfaces ? 0 : idx;
+}
+
+/* frames that never make it out have their time folded in to the next frame
+ * that does, the same as a lagged frame */
+static inline void merge_vframe_info(struct obs_vframe_info *dst,
+		const struct obs_vframe_info *src)
+{
+	if (!dst->count || src->timestamp < dst->timestamp)
+		dst->timestamp = src->timestamp;
+	dst->count += src->count;
+}
+
+static inline void pop_vframe_info(struct obs_core_video *video,
+		struct obs_vframe_info *info)
+{
+	if (video->vframe_info_buffer.size >= sizeof(*info)) {
+		circlebuf_pop_front(&video->vframe_info_buffer, info,
+				sizeof(*info));
+	} else {
+		info->timestamp = video->video_time;
+		info->count = 1;
+	}
+
+	if (video->dropped_info.count) {
+		merge_vframe_info(info, &video->dropped_info);
+		video->dropped_info.count = 0;
+	}
+}
+
 static const char *stage_output_texture_name = "stage_output_texture";
 static inline void stage_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+		int prev_texture)
 {
 	profile_start(stage_output_texture_name);
 
 	gs_texture_t   *texture;
 	bool        texture_ready;
-	gs_stagesurf_t *copy = video->copy_surfaces[cur_texture];
+	uint32_t    idx = video->staging_head;
+	struct obs_vframe_info info;
 
 	if (video->gpu_conversion) {
 		texture = video->convert_textures[prev_texture];
@@ -321,14 +344,24 @@ static inline void stage_output_texture(struct obs_core_video *video,
 		texture_ready = video->textures_output[prev_texture];
 	}
 
-	unmap_last_surface(video);
-
 	if (!texture_ready)
 		goto end;
 
-	gs_stage_texture(copy, texture);
+	pop_vframe_info(video, &info);
+
+	/* the readback thread is still holding every surface */
+	if (video->staging_state[idx] != OBS_STAGING_FREE) {
+		merge_vframe_info(&video->dropped_info, &info);
+		video->readback_dropped_frames++;
+		goto end;
+	}
+
+	gs_stage_texture(video->copy_surfaces[idx], texture);
 
-	video->textures_copied[cur_texture] = true;
+	video->staging_state[idx] = OBS_STAGING_STAGED;
+	video->staging_info[idx] = info;
+	video->staging_head = next_staging_surface(video, idx);
+	video->staging_pending++;
 
 end:
 	profile_end(stage_output_texture_name);
@@ -347,7 +380,7 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	if (video->gpu_conversion)
 		render_convert_texture(video, cur_texture, prev_texture);
 
-	stage_output_texture(video, cur_texture, prev_texture);
+	stage_output_texture(video, prev_texture);
 
 	gs_set_render_target(NULL, NULL);
 	gs_enable_blending(true);
@@ -355,19 +388,144 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	gs_end_scene();
 }
 
-static inline bool download_frame(struct obs_core_video *video,
-		int prev_texture, struct video_data *frame)
+/* unmaps the surfaces the readback thread is done with */
+static void release_readback_surfaces(struct obs_core_video *video)
 {
-	gs_stagesurf_t *surface = video->copy_surfaces[prev_texture];
+	uint32_t idx;
 
-	if (!video->textures_copied[prev_texture])
-		return false;
+	pthread_mutex_lock(&video->readback_mutex);
 
-	if (!gs_stagesurface_map(surface, &frame->data[0], &frame->linesize[0]))
-		return false;
+	while (video->readback_done.size) {
+		circlebuf_pop_front(&video->readback_done, &idx, sizeof(idx));
 
-	video->mapped_surface = surface;
-	return true;
+		gs_stagesurface_unmap(video->copy_surfaces[idx]);
+		video->staging_state[idx] = OBS_STAGING_FREE;
+	}
+
+	pthread_mutex_unlock(&video->readback_mutex);
+}
+
+/* the device is about to be rebuilt, which releases every staging surface.
+ * frames the readback thread hasn't picked up are dropped, but the one it's
+ * copying is read straight from the mapped surface so that one has to finish
+ * before anything is unmapped */
+void obs_video_device_loss_release(void *data)
+{
+	struct obs_core_video *video = data;
+	struct obs_readback_frame readback;
+	size_t mapped = 0;
+
+	pthread_mutex_lock(&video->readback_mutex);
+
+	while (video->readback_queue.size) {
+		struct obs_vframe_info info;
+
+		circlebuf_pop_front(&video->readback_queue, &readback,
+				sizeof(readback));
+		circlebuf_push_back(&video->readback_done, &readback.surface,
+				sizeof(readback.surface));
+
+		info.timestamp = readback.frame.timestamp;
+		info.count = readback.count;
+		merge_vframe_info(&video->dropped_info, &info);
+		video->readback_dropped_frames++;
+	}
+
+	pthread_mutex_unlock(&video->readback_mutex);
+
+	for (uint32_t i = 0; i < video->num_staging_surfaces; i++) {
+		if (video->staging_state[i] == OBS_STAGING_MAPPED)
+			mapped++;
+	}
+
+	for (;;) {
+		size_t done;
+
+		pthread_mutex_lock(&video->readback_mutex);
+		done = video->readback_done.size / sizeof(uint32_t);
+		pthread_mutex_unlock(&video->readback_mutex);
+
+		if (done >= mapped)
+			break;
+
+		os_sleep_ms(1);
+	}
+
+	release_readback_surfaces(video);
+
+	/* copies still in flight are lost with the device */
+	while (video->staging_pending) {
+		uint32_t idx = video->staging_tail;
+
+		merge_vframe_info(&video->dropped_info,
+				&video->staging_info[idx]);
+		video->staging_state[idx] = OBS_STAGING_FREE;
+		video->staging_tail = next_staging_surface(video, idx);
+		video->staging_pending--;
+		video->readback_dropped_frames++;
+	}
+}
+
+static const char *map_staging_surface_name = "map_staging_surface";
+static const char *map_wait_staging_surface_name = "map_wait_staging_surface";
+
+/* maps staged surfaces in order once their copy is done and hands them to the
+ * readback thread.  the oldest one only gets mapped before its copy is done
+ * when the ring would otherwise fill up, which is also what happens when the
+ * graphics subsystem can't tell if a copy is done */
+static void map_staged_surfaces(struct obs_core_video *video)
+{
+	while (video->staging_pending) {
+		uint32_t idx = video->staging_tail;
+		gs_stagesurf_t *surface = video->copy_surfaces[idx];
+		struct obs_readback_frame readback;
+		const char *profile_name;
+		bool ready;
+		bool mapped;
+
+		ready = gs_stagesurface_ready(surface);
+		if (!ready && video->staging_pending + 1 <
+				video->num_staging_surfaces)
+			break;
+
+		memset(&readback, 0, sizeof(readback));
+
+		profile_name = ready ? map_staging_surface_name :
+			map_wait_staging_surface_name;
+		profile_start(profile_name);
+		mapped = gs_stagesurface_map(surface, &readback.frame.data[0],
+				&readback.frame.linesize[0]);
+		profile_end(profile_name);
+
+		if (!ready)
+			video->readback_forced_maps++;
+
+		video->staging_tail = next_staging_surface(video, idx);
+		video->staging_pending--;
+
+		if (!mapped) {
+			merge_vframe_info(video->staging_pending ?
+					&video->staging_info[video->staging_tail] :
+					&video->dropped_info,
+					&video->staging_info[idx]);
+			video->staging_state[idx] = OBS_STAGING_FREE;
+			video->readback_dropped_frames++;
+			continue;
+		}
+
+		video->staging_state[idx] = OBS_STAGING_MAPPED;
+
+		readback.frame.timestamp = video->staging_info[idx].timestamp;
+		readback.count = video->staging_info[idx].count;
+		readback.surface = idx;
+
+		pthread_mutex_lock(&video->readback_mutex);
+		circlebuf_push_back(&video->readback_queue, &readback,
+				sizeof(readback));
+		pthread_mutex_unlock(&video->readback_mutex);
+
+		os_sem_post(video->readback_sem);
+	}
 }
 
 static inline uint32_t calc_linesize(uint32_t pos, uint32_t linesize)
@@ -450,31 +608,53 @@ static void set_gpu_converted_data(struct obs_core_video *video,
 	}
 }
 
-static void convert_frame(
-		struct video_frame *output, const struct video_data *input,
-		const struct video_output_info *info)
+struct convert_frame_data {
+	struct video_frame             *output;
+	const struct video_data        *input;
+	const struct video_output_info *info;
+};
+
+static void convert_frame_band(void *param, uint32_t start_y, uint32_t end_y)
 {
+	struct convert_frame_data      *data   = param;
+	struct video_frame             *output = data->output;
+	const struct video_data        *input  = data->input;
+	const struct video_output_info *info   = data->info;
+
 	if (info->format == VIDEO_FORMAT_I420) {
 		compress_uyvx_to_i420(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else if (info->format == VIDEO_FORMAT_NV12) {
 		compress_uyvx_to_nv12(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else if (info->format == VIDEO_FORMAT_I444) {
 		convert_uyvx_to_i444(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
+	}
+}
 
-	} else {
+static void convert_frame(
+		struct video_frame *output, const struct video_data *input,
+		const struct video_output_info *info)
+{
+	struct convert_frame_data data = {output, input, info};
+
+	if (info->format != VIDEO_FORMAT_I420 &&
+	    info->format != VIDEO_FORMAT_NV12 &&
+	    info->format != VIDEO_FORMAT_I444) {
 		blog(LOG_ERROR, "convert_frame: unsupported texture format");
+		return;
 	}
+
+	format_conversion_run(convert_frame_band, &data, info->height);
 }
 
 static inline void copy_rgbx_frame(
@@ -508,6 +688,9 @@ static inline void output_video_data(struct obs_core_video *video,
 	locked = video_output_lock_frame(video->video, &output_frame, count,
 			input_frame->timestamp);
 	if (locked) {
+		if (input_frame->duplicate)
+			video_output_mark_duplicate_frame(video->video);
+
 		if (video->gpu_conversion) {
 			set_gpu_converted_data(video, &output_frame,
 					input_frame, info);
@@ -519,7 +702,81 @@ static inline void output_video_data(struct obs_core_video *video,
 		}
 
 		video_output_unlock_frame(video->video);
+	} else {
+		/* the frame was dropped, so outputs never saw the content the
+		 * static frame detection last hashed */
+		video->frame_tile_hashes_valid = false;
+	}
+}
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME        0x100000001B3ULL
+
+/* row sizes are always a multiple of 16 bytes (output width is aligned to 4
+ * pixels of 4 bytes each), so the row can be hashed a qword at a time */
+static inline uint64_t hash_frame_row(uint64_t hash, const uint8_t *row,
+		uint32_t size)
+{
+	const uint8_t *end = row + size;
+
+	while (row < end) {
+		uint64_t val;
+		memcpy(&val, row, sizeof(val));
+
+		hash = (hash ^ val) * FNV_PRIME;
+		hash ^= hash >> 32;
+		row += sizeof(val);
+	}
+
+	return hash;
+}
+
+static bool frame_is_static(struct obs_core_video *video,
+		const struct video_data *frame)
+{
+	uint32_t row_size = video->output_width * 4;
+	uint32_t rows     = video->gpu_conversion ?
+		video->conversion_height : video->output_height;
+	bool     changed  = !video->frame_tile_hashes_valid;
+
+	for (size_t tile = 0; tile < video->frame_tile_count; tile++) {
+		uint32_t y     = (uint32_t)tile * STATIC_FRAME_TILE_ROWS;
+		uint32_t y_end = y + STATIC_FRAME_TILE_ROWS;
+		uint64_t hash  = FNV_OFFSET_BASIS;
+		const uint8_t *row = frame->data[0] + y * frame->linesize[0];
+
+		if (y_end > rows)
+			y_end = rows;
+
+		for (; y < y_end; y++) {
+			hash = hash_frame_row(hash, row, row_size);
+			row += frame->linesize[0];
+		}
+
+		if (hash != video->frame_tile_hashes[tile]) {
+			video->frame_tile_hashes[tile] = hash;
+			changed = true;
+		}
+	}
+
+	video->frame_tile_hashes_valid = true;
+	return !changed;
+}
+
+static inline bool detect_static_frame(struct obs_core_video *video,
+		const struct video_data *frame)
+{
+	if (!frame_is_static(video, frame)) {
+		video->static_frames = 0;
+		return false;
+	}
+
+	if (++video->static_frames > video->max_static_frames) {
+		video->static_frames = 0;
+		return false;
 	}
+
+	return true;
 }
 
 static inline void video_sleep(struct obs_core_video *video,
@@ -551,28 +808,26 @@ static const char *output_frame_gs_context_name = "gs_context(video->graphics)";
 static const char *output_frame_render_video_name = "render_video";
 static const char *output_frame_download_frame_name = "download_frame";
 static const char *output_frame_gs_flush_name = "gs_flush";
-static const char *output_frame_output_video_data_name = "output_video_data";
 static inline void output_frame(void)
 {
 	struct obs_core_video *video = &obs->video;
 	int cur_texture  = video->cur_texture;
 	int prev_texture = cur_texture == 0 ? NUM_TEXTURES-1 : cur_texture-1;
-	struct video_data frame;
-	bool frame_ready;
-
-	memset(&frame, 0, sizeof(struct video_data));
 
 	profile_start(output_frame_gs_context_name);
 	gs_enter_context(video->graphics);
 
+	/* map before staging so surfaces finished with this frame can take
+	 * the new one */
+	profile_start(output_frame_download_frame_name);
+	release_readback_surfaces(video);
+	map_staged_surfaces(video);
+	profile_end(output_frame_download_frame_name);
+
 	profile_start(output_frame_render_video_name);
 	render_video(video, cur_texture, prev_texture);
 	profile_end(output_frame_render_video_name);
 
-	profile_start(output_frame_download_frame_name);
-	frame_ready = download_frame(video, prev_texture, &frame);
-	profile_end(output_frame_download_frame_name);
-
 	profile_start(output_frame_gs_flush_name);
 	gs_flush();
 	profile_end(output_frame_gs_flush_name);
@@ -580,19 +835,66 @@ static inline void output_frame(void)
 	gs_leave_context();
 	profile_end(output_frame_gs_context_name);
 
-	if (frame_ready) {
-		struct obs_vframe_info vframe_info;
-		circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
-				sizeof(vframe_info));
+	if (++video->cur_texture == NUM_TEXTURES)
+		video->cur_texture = 0;
+}
+
+static const char *readback_thread_name = "obs_readback_thread";
+static const char *readback_output_video_data_name = "output_video_data";
+static const char *readback_detect_static_frame_name = "detect_static_frame";
+
+/* copies mapped frames out to the video output, so the graphics thread
+ * never waits on the copy */
+void *obs_readback_thread(void *param)
+{
+	struct obs_core_video *video = &obs->video;
+
+	os_set_thread_name("libobs: readback thread");
+
+	profile_register_root(readback_thread_name,
+			video_output_get_frame_time(video->video));
+
+	while (os_sem_wait(video->readback_sem) == 0) {
+		struct obs_readback_frame readback;
+
+		if (video->readback_stop)
+			break;
+
+		/* frames dropped for a device rebuild leave their post behind */
+		pthread_mutex_lock(&video->readback_mutex);
+		if (!video->readback_queue.size) {
+			pthread_mutex_unlock(&video->readback_mutex);
+			continue;
+		}
+		circlebuf_pop_front(&video->readback_queue, &readback,
+				sizeof(readback));
+		pthread_mutex_unlock(&video->readback_mutex);
+
+		profile_start(readback_thread_name);
+
+		if (video->skip_static_frames) {
+			profile_start(readback_detect_static_frame_name);
+			readback.frame.duplicate = detect_static_frame(video,
+					&readback.frame);
+			profile_end(readback_detect_static_frame_name);
+		}
+
+		profile_start(readback_output_video_data_name);
+		output_video_data(video, &readback.frame, readback.count);
+		profile_end(readback_output_video_data_name);
+
+		profile_end(readback_thread_name);
+
+		profile_reenable_thread();
 
-		frame.timestamp = vframe_info.timestamp;
-		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
-		profile_end(output_frame_output_video_data_name);
+		pthread_mutex_lock(&video->readback_mutex);
+		circlebuf_push_back(&video->readback_done, &readback.surface,
+				sizeof(readback.surface));
+		pthread_mutex_unlock(&video->readback_mutex);
 	}
 
-	if (++video->cur_texture == NUM_TEXTURES)
-		video->cur_texture = 0;
+	UNUSED_PARAMETER(param);
+	return NULL;
 }
 
 #define NBSP "\xC2\xA0"
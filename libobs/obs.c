@@ -19,6 +19,7 @@
 
 #include "graphics/matrix4.h"
 #include "callback/calldata.h"
+#include "media-io/format-conversion.h"
 
 #include "obs.h"
 #include "obs-internal.h"
@@ -190,13 +191,15 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 		video->conversion_height : ovi->output_height;
 	size_t i;
 
-	for (i = 0; i < NUM_TEXTURES; i++) {
+	for (i = 0; i < video->num_staging_surfaces; i++) {
 		video->copy_surfaces[i] = gs_stagesurface_create(
 				ovi->output_width, output_height, GS_RGBA);
 
 		if (!video->copy_surfaces[i])
 			return false;
+	}
 
+	for (i = 0; i < NUM_TEXTURES; i++) {
 		video->render_textures[i] = gs_texture_create(
 				ovi->base_width, ovi->base_height,
 				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
@@ -226,6 +229,35 @@ gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file)
 	return *effect;
 }
 
+#define GET_CONVERSION_PARAM(name) \
+	params->name = gs_effect_get_param_by_name(effect, #name)
+
+static void get_conversion_params(struct obs_core_video *video)
+{
+	struct obs_conversion_params *params = &video->conversion_params;
+	gs_effect_t *effect = video->conversion_effect;
+
+	GET_CONVERSION_PARAM(image);
+	GET_CONVERSION_PARAM(u_plane_offset);
+	GET_CONVERSION_PARAM(v_plane_offset);
+	GET_CONVERSION_PARAM(width);
+	GET_CONVERSION_PARAM(height);
+	GET_CONVERSION_PARAM(width_i);
+	GET_CONVERSION_PARAM(height_i);
+	GET_CONVERSION_PARAM(width_d2);
+	GET_CONVERSION_PARAM(height_d2);
+	GET_CONVERSION_PARAM(width_d2_i);
+	GET_CONVERSION_PARAM(height_d2_i);
+	GET_CONVERSION_PARAM(input_height);
+	GET_CONVERSION_PARAM(input_width_i_d2);
+	GET_CONVERSION_PARAM(int_width);
+	GET_CONVERSION_PARAM(int_input_width);
+	GET_CONVERSION_PARAM(int_u_plane_offset);
+	GET_CONVERSION_PARAM(int_v_plane_offset);
+}
+
+#undef GET_CONVERSION_PARAM
+
 static int obs_init_graphics(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -249,6 +281,7 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 	}
 
 	gs_enter_context(video->graphics);
+	gs_set_shader_cache_path(ovi->shader_cache_path);
 
 	char *filename = find_libobs_data_file("default.effect");
 	video->default_effect = gs_effect_create_from_file(filename,
@@ -276,6 +309,7 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 	video->conversion_effect = gs_effect_create_from_file(filename,
 			NULL);
 	bfree(filename);
+	get_conversion_params(video);
 
 	filename = find_libobs_data_file("bicubic_scale.effect");
 	video->bicubic_effect = gs_effect_create_from_file(filename,
@@ -347,6 +381,43 @@ static inline void set_video_matrix(struct obs_core_video *video,
 	memcpy(video->color_matrix, &mat, sizeof(float) * 16);
 }
 
+static void obs_init_static_frame_detection(struct obs_video_info *ovi)
+{
+	struct obs_core_video *video = &obs->video;
+	uint32_t rows = video->gpu_conversion ?
+		video->conversion_height : ovi->output_height;
+
+	video->skip_static_frames = ovi->skip_static_frames;
+	video->static_frames = 0;
+	video->frame_tile_hashes_valid = false;
+
+	if (!video->skip_static_frames)
+		return;
+
+	/* always let at least one frame per second through so outputs keep
+	 * interleaving audio and players keep seeking properly */
+	video->max_static_frames = ovi->fps_num / ovi->fps_den;
+	if (!video->max_static_frames)
+		video->max_static_frames = 1;
+
+	video->frame_tile_count = (rows + STATIC_FRAME_TILE_ROWS - 1) /
+		STATIC_FRAME_TILE_ROWS;
+	video->frame_tile_hashes = bzalloc(video->frame_tile_count *
+			sizeof(uint64_t));
+}
+
+static uint32_t get_staging_depth(const struct obs_video_info *ovi)
+{
+	uint32_t depth = ovi->staging_depth ?
+		ovi->staging_depth : DEFAULT_STAGING_SURFACES;
+
+	if (depth < MIN_STAGING_SURFACES)
+		return MIN_STAGING_SURFACES;
+	if (depth > MAX_STAGING_SURFACES)
+		return MAX_STAGING_SURFACES;
+	return depth;
+}
+
 static int obs_init_video(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -361,6 +432,8 @@ static int obs_init_video(struct obs_video_info *ovi)
 	video->gpu_conversion = ovi->gpu_conversion;
 	video->scale_type     = ovi->scale_type;
 
+	video->num_staging_surfaces = get_staging_depth(ovi);
+
 	set_video_matrix(video, ovi);
 
 	errorcode = video_output_open(&video->video, &vi);
@@ -375,6 +448,11 @@ static int obs_init_video(struct obs_video_info *ovi)
 		return OBS_VIDEO_FAIL;
 	}
 
+	if (pthread_mutex_init(&video->readback_mutex, NULL) != 0)
+		return OBS_VIDEO_FAIL;
+	if (os_sem_init(&video->readback_sem, 0) != 0)
+		return OBS_VIDEO_FAIL;
+
 	gs_enter_context(video->graphics);
 
 	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
@@ -382,8 +460,25 @@ static int obs_init_video(struct obs_video_info *ovi)
 	if (!obs_init_textures(ovi))
 		return OBS_VIDEO_FAIL;
 
+	struct gs_device_loss loss_callbacks = {
+		.device_loss_release = obs_video_device_loss_release,
+		.data = video
+	};
+	gs_register_loss_callbacks(&loss_callbacks);
+
 	gs_leave_context();
 
+	obs_init_static_frame_detection(ovi);
+	format_conversion_init();
+
+	video->readback_stop = false;
+	errorcode = pthread_create(&video->readback_thread, NULL,
+			obs_readback_thread, obs);
+	if (errorcode != 0)
+		return OBS_VIDEO_FAIL;
+
+	video->readback_thread_initialized = true;
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_graphics_thread, obs);
 	if (errorcode != 0)
@@ -407,6 +502,13 @@ static void stop_video(void)
 		}
 	}
 
+	if (video->readback_thread_initialized) {
+		video->readback_stop = true;
+		os_sem_post(video->readback_sem);
+		pthread_join(video->readback_thread, &thread_retval);
+		video->readback_thread_initialized = false;
+	}
+
 }
 
 static void obs_free_video(void)
@@ -422,18 +524,22 @@ static void obs_free_video(void)
 
 		gs_enter_context(video->graphics);
 
-		if (video->mapped_surface) {
-			gs_stagesurface_unmap(video->mapped_surface);
-			video->mapped_surface = NULL;
+		gs_unregister_loss_callbacks(video);
+
+		for (size_t i = 0; i < MAX_STAGING_SURFACES; i++) {
+			if (video->staging_state[i] == OBS_STAGING_MAPPED)
+				gs_stagesurface_unmap(video->copy_surfaces[i]);
+			gs_stagesurface_destroy(video->copy_surfaces[i]);
+
+			video->copy_surfaces[i] = NULL;
+			video->staging_state[i] = OBS_STAGING_FREE;
 		}
 
 		for (size_t i = 0; i < NUM_TEXTURES; i++) {
-			gs_stagesurface_destroy(video->copy_surfaces[i]);
 			gs_texture_destroy(video->render_textures[i]);
 			gs_texture_destroy(video->convert_textures[i]);
 			gs_texture_destroy(video->output_textures[i]);
 
-			video->copy_surfaces[i]    = NULL;
 			video->render_textures[i]  = NULL;
 			video->convert_textures[i] = NULL;
 			video->output_textures[i]  = NULL;
@@ -441,18 +547,42 @@ static void obs_free_video(void)
 
 		gs_leave_context();
 
+		if (video->readback_dropped_frames ||
+		    video->readback_forced_maps)
+			blog(LOG_INFO, "Video readback: %"PRIu32" frame(s) "
+			               "dropped, %"PRIu32" surface(s) mapped "
+			               "before their copy finished",
+			               video->readback_dropped_frames,
+			               video->readback_forced_maps);
+
 		circlebuf_free(&video->vframe_info_buffer);
+		circlebuf_free(&video->readback_queue);
+		circlebuf_free(&video->readback_done);
+		os_sem_destroy(video->readback_sem);
+		pthread_mutex_destroy(&video->readback_mutex);
+		video->readback_sem = NULL;
+
+		bfree(video->frame_tile_hashes);
+		video->frame_tile_hashes = NULL;
+		video->frame_tile_count = 0;
+		video->frame_tile_hashes_valid = false;
+
+		format_conversion_free();
 
 		memset(&video->textures_rendered, 0,
 				sizeof(video->textures_rendered));
 		memset(&video->textures_output, 0,
 				sizeof(video->textures_output));
-		memset(&video->textures_copied, 0,
-				sizeof(video->textures_copied));
 		memset(&video->textures_converted, 0,
 				sizeof(video->textures_converted));
 
 		video->cur_texture = 0;
+		video->staging_head = 0;
+		video->staging_tail = 0;
+		video->staging_pending = 0;
+		video->readback_dropped_frames = 0;
+		video->readback_forced_maps = 0;
+		memset(&video->dropped_info, 0, sizeof(video->dropped_info));
 	}
 }
 
@@ -762,6 +892,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 
 	if (!obs_init_data())
 		return false;
+	if (!obs_packet_pool_init())
+		return false;
 	if (!obs_init_handlers())
 		return false;
 	if (!obs_init_hotkeys())
@@ -847,6 +979,7 @@ void obs_shutdown(void)
 	obs_free_video();
 	obs_free_hotkeys();
 	obs_free_graphics();
+	obs_packet_pool_free();
 	proc_handler_destroy(obs->procs);
 	signal_handler_destroy(obs->signals);
 	obs->procs = NULL;
@@ -981,12 +1114,16 @@ int obs_reset_video(struct obs_video_info *ovi)
 	               "\toutput resolution: %dx%d\n"
 	               "\tdownscale filter:  %s\n"
 	               "\tfps:               %d/%d\n"
-	               "\tformat:            %s",
+	               "\tformat:            %s\n"
+	               "\tskip static:       %s\n"
+	               "\tstaging depth:     %u",
 	               ovi->base_width, ovi->base_height,
 	               ovi->output_width, ovi->output_height,
 	               scale_type_name,
 	               ovi->fps_num, ovi->fps_den,
-		       get_video_format_name(ovi->output_format));
+		       get_video_format_name(ovi->output_format),
+		       ovi->skip_static_frames ? "true" : "false",
+		       get_staging_depth(ovi));
 
 	return obs_init_video(ovi);
 }
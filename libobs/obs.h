@@ -175,6 +175,25 @@ struct obs_video_info {
 	enum video_range_type range;       /**< YUV range (if YUV) */
 
 	enum obs_scale_type scale_type;    /**< How to scale if scaling */
+
+	/**
+	 * Detect frames identical to the previous one and flag them as
+	 * duplicates so outputs and encoders can skip them
+	 */
+	bool                skip_static_frames;
+
+	/**
+	 * Number of staging surfaces the output frames are read back
+	 * through, 0 for the default.  Deeper rings give the GPU more time
+	 * to finish each copy before the graphics thread maps it
+	 */
+	uint32_t            staging_depth;
+
+	/**
+	 * Directory compiled shaders are cached in between runs, or NULL to
+	 * always compile them
+	 */
+	const char          *shader_cache_path;
 };
 #endif
 
@@ -1020,6 +1039,12 @@ EXPORT void obs_source_draw_set_color_matrix(
 EXPORT void obs_source_draw(gs_texture_t *image, int x, int y,
 		uint32_t cx, uint32_t cy, bool flip);
 
+/**
+ * Marks the video of a source with the OBS_SOURCE_DAMAGE flag as changed, so
+ * scenes draw it again on the next frame
+ */
+EXPORT void obs_source_damage(obs_source_t *source);
+
 /** Outputs asynchronous video data.  Set to NULL to deactivate the texture */
 EXPORT void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame);
@@ -1432,6 +1457,14 @@ EXPORT void obs_output_stop(obs_output_t *output);
 EXPORT void obs_output_set_delay(obs_output_t *output, uint32_t delay_sec,
 		uint32_t flags);
 
+/**
+ * Sets how much delayed packet data is kept in memory, in megabytes.  Past
+ * that, packets wait in a temporary file until they're due.  Zero keeps
+ * everything in memory.
+ */
+EXPORT void obs_output_set_delay_memory_limit(obs_output_t *output,
+		uint32_t limit_mb);
+
 /** Gets the currently set delay value, in seconds. */
 EXPORT uint32_t obs_output_get_delay(const obs_output_t *output);
 
@@ -1569,6 +1602,14 @@ EXPORT void obs_output_output_caption_text1(obs_output_t *output,
 EXPORT float obs_output_get_congestion(obs_output_t *output);
 EXPORT int obs_output_get_connect_time_ms(obs_output_t *output);
 
+/**
+ * For outputs that write files in the background, returns the number of
+ * buffers waiting to be written and the time the last write took, or -1 if
+ * the output doesn't report them.
+ */
+EXPORT int obs_output_get_io_queue_depth(obs_output_t *output);
+EXPORT int obs_output_get_io_write_latency_us(obs_output_t *output);
+
 EXPORT bool obs_output_reconnecting(const obs_output_t *output);
 
 /** Pass a string of the last output error, for UI use */
@@ -1733,7 +1774,8 @@ EXPORT obs_properties_t *obs_encoder_properties(const obs_encoder_t *encoder);
 
 /**
  * Updates the settings of the encoder context.  Usually used for changing
- * bitrate while active
+ * bitrate while active, in which case the encoder applies the change on its
+ * own thread before encoding the next frame
  */
 EXPORT void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings);
 
@@ -1785,6 +1827,22 @@ EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
 		struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+/**
+ * Packet payload pool counters, allocations include the reused ones.
+ * in_use and peak_in_use count pooled payloads across every size class,
+ * oversized payloads aren't included
+ */
+struct obs_packet_pool_stats {
+	long   allocs;
+	long   reused;
+	long   oversized;
+	long   in_use;
+	long   peak_in_use;
+	size_t cached_bytes;
+};
+
+EXPORT void obs_get_packet_pool_stats(struct obs_packet_pool_stats *stats);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020 Zaodao(Dalian) Education Technology Co., Ltd.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "bmem.h"
+#include "dstr.h"
+#include "mapped-file.h"
+
+struct os_mapped_file {
+	int      fd;
+	uint64_t size;
+};
+
+os_mapped_file_t *os_mapped_file_create_temp(void)
+{
+	const char *dir = getenv("TMPDIR");
+	struct os_mapped_file *mf;
+	struct dstr path = {0};
+	int fd;
+
+	if (!dir || !*dir)
+		dir = "/tmp";
+
+	dstr_printf(&path, "%s/obs-XXXXXX", dir);
+	fd = mkstemp(path.array);
+
+	/* nothing else needs the name, the file goes away with the fd */
+	if (fd != -1)
+		unlink(path.array);
+	dstr_free(&path);
+
+	if (fd == -1)
+		return NULL;
+
+	mf = bzalloc(sizeof(struct os_mapped_file));
+	mf->fd = fd;
+	return mf;
+}
+
+void os_mapped_file_destroy(os_mapped_file_t *mf)
+{
+	if (!mf)
+		return;
+
+	close(mf->fd);
+	bfree(mf);
+}
+
+bool os_mapped_file_resize(os_mapped_file_t *mf, uint64_t size)
+{
+	if (!mf)
+		return false;
+	if (size <= mf->size)
+		return true;
+
+	if (ftruncate(mf->fd, (off_t)size) != 0)
+		return false;
+
+	mf->size = size;
+	return true;
+}
+
+size_t os_mapped_file_alignment(void)
+{
+	return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+void *os_mapped_file_map(os_mapped_file_t *mf, uint64_t offset, size_t size)
+{
+	void *view;
+
+	if (!mf || offset + size > mf->size)
+		return NULL;
+
+	view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mf->fd,
+			(off_t)offset);
+	return view == MAP_FAILED ? NULL : view;
+}
+
+void os_mapped_file_unmap(void *view, size_t size)
+{
+	if (view)
+		munmap(view, size);
+}
+
+void os_mapped_file_prefetch(void *view, size_t size)
+{
+	uintptr_t page = (uintptr_t)os_mapped_file_alignment();
+	uintptr_t start = (uintptr_t)view & ~(page - 1);
+
+	if (view && size)
+		madvise((void*)start, size + ((uintptr_t)view - start),
+				MADV_WILLNEED);
+}
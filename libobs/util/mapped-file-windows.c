@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2020 Zaodao(Dalian) Education Technology Co., Ltd.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "bmem.h"
+#include "mapped-file.h"
+
+struct os_mapped_file {
+	HANDLE   file;
+	HANDLE   mapping;
+	uint64_t size;
+};
+
+/* PrefetchVirtualMemory is windows 8 and up, so it's loaded by hand */
+struct prefetch_range {
+	void     *address;
+	SIZE_T   size;
+};
+
+typedef BOOL (WINAPI *PREFETCHVIRTUALMEMORY)(HANDLE process,
+		ULONG_PTR count, struct prefetch_range *ranges, ULONG flags);
+
+os_mapped_file_t *os_mapped_file_create_temp(void)
+{
+	wchar_t dir[MAX_PATH];
+	wchar_t path[MAX_PATH];
+	struct os_mapped_file *mf;
+	HANDLE file;
+
+	if (!GetTempPathW(MAX_PATH, dir))
+		return NULL;
+	if (!GetTempFileNameW(dir, L"obs", 0, path))
+		return NULL;
+
+	file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+			NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		DeleteFileW(path);
+		return NULL;
+	}
+
+	mf = bzalloc(sizeof(struct os_mapped_file));
+	mf->file = file;
+	return mf;
+}
+
+void os_mapped_file_destroy(os_mapped_file_t *mf)
+{
+	if (!mf)
+		return;
+
+	if (mf->mapping)
+		CloseHandle(mf->mapping);
+	CloseHandle(mf->file);
+	bfree(mf);
+}
+
+bool os_mapped_file_resize(os_mapped_file_t *mf, uint64_t size)
+{
+	HANDLE mapping;
+
+	if (!mf)
+		return false;
+	if (size <= mf->size)
+		return true;
+
+	/* a mapping bigger than the file extends the file.  views of the old
+	 * mapping keep it alive and see the same pages */
+	mapping = CreateFileMappingW(mf->file, NULL, PAGE_READWRITE,
+			(DWORD)(size >> 32), (DWORD)size, NULL);
+	if (!mapping)
+		return false;
+
+	if (mf->mapping)
+		CloseHandle(mf->mapping);
+	mf->mapping = mapping;
+	mf->size = size;
+	return true;
+}
+
+size_t os_mapped_file_alignment(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (size_t)info.dwAllocationGranularity;
+}
+
+void *os_mapped_file_map(os_mapped_file_t *mf, uint64_t offset, size_t size)
+{
+	if (!mf || !mf->mapping || offset + size > mf->size)
+		return NULL;
+
+	return MapViewOfFile(mf->mapping, FILE_MAP_READ | FILE_MAP_WRITE,
+			(DWORD)(offset >> 32), (DWORD)offset, size);
+}
+
+void os_mapped_file_unmap(void *view, size_t size)
+{
+	if (view)
+		UnmapViewOfFile(view);
+
+	UNUSED_PARAMETER(size);
+}
+
+void os_mapped_file_prefetch(void *view, size_t size)
+{
+	static PREFETCHVIRTUALMEMORY prefetch = NULL;
+	static bool loaded = false;
+	struct prefetch_range range = {view, size};
+
+	if (!loaded) {
+		HMODULE kernel32 = GetModuleHandleW(L"kernel32");
+		if (kernel32)
+			prefetch = (PREFETCHVIRTUALMEMORY)GetProcAddress(
+					kernel32, "PrefetchVirtualMemory");
+		loaded = true;
+	}
+
+	if (prefetch && view && size)
+		prefetch(GetCurrentProcess(), 1, &range, 0);
+}
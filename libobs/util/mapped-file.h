@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2020 Zaodao(Dalian) Education Technology Co., Ltd.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Temporary file that is accessed through memory mapped views, for data that
+ * is too big to keep in RAM.  The file has no visible name once created and
+ * is removed by the system when it's destroyed, even after a crash.
+ */
+
+struct os_mapped_file;
+typedef struct os_mapped_file os_mapped_file_t;
+
+EXPORT os_mapped_file_t *os_mapped_file_create_temp(void);
+EXPORT void os_mapped_file_destroy(os_mapped_file_t *mf);
+
+/* only grows the file, existing views stay valid */
+EXPORT bool os_mapped_file_resize(os_mapped_file_t *mf, uint64_t size);
+
+/* view offsets have to be a multiple of this */
+EXPORT size_t os_mapped_file_alignment(void);
+
+EXPORT void *os_mapped_file_map(os_mapped_file_t *mf, uint64_t offset,
+		size_t size);
+EXPORT void os_mapped_file_unmap(void *view, size_t size);
+
+/* asks the system to start reading a range of a view in to memory */
+EXPORT void os_mapped_file_prefetch(void *view, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
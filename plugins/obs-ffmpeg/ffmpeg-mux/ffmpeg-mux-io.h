@@ -0,0 +1,691 @@
+/*
+ * Copyright (c) 2020 Zaodao(Dalian) Education Technology Co., Ltd.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Write-behind file output for the muxers.  The muxer's writes are copied
+ * into a ring of large page aligned buffers, and full buffers are written
+ * out by a separate thread with positional writes.  A disk that stalls for a
+ * while (antivirus scanners, slow USB drives) then shows up as queue depth
+ * instead of blocking the muxer, and through it the encoders.
+ *
+ * Seeks only start a new buffer at the new offset, buffers are written in
+ * order so later patches still land on top of earlier data.  Space is
+ * reserved ahead of the write position, writes of whole aligned buffers can
+ * bypass the page cache, and syncs are batched to one per interval.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavformat/avformat.h>
+#include "ffmpeg-mux.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define FFM_IO_ALIGN            4096
+#define FFM_IO_MAX_BUFFERS      32
+#define FFM_IO_AVIO_BUFFER      (64 * 1024)
+
+struct ffm_io_params {
+	size_t  buffer_size;
+	int     num_buffers;
+	int64_t prealloc;
+	bool    direct;
+	int     sync_interval_ms;
+};
+
+struct ffm_io_buffer {
+	uint8_t *data;
+	size_t  size;
+	int64_t offset;
+};
+
+struct ffm_io {
+	struct ffm_io_params params;
+	struct ffm_io_stats  own_stats;
+	struct ffm_io_stats  *stats;
+
+#ifdef _WIN32
+	HANDLE               file;
+	HANDLE               direct_file;
+	HANDLE               thread;
+	CRITICAL_SECTION     mutex;
+	CONDITION_VARIABLE   cond;
+#else
+	int                  file;
+	int                  direct_file;
+	pthread_t            thread;
+	pthread_mutex_t      mutex;
+	pthread_cond_t       cond;
+#endif
+	bool                 thread_created;
+
+	/* buffers are used round robin, the queued ones are the queue_count
+	 * buffers in front of cur */
+	struct ffm_io_buffer buffers[FFM_IO_MAX_BUFFERS];
+	int                  cur;
+	int                  queue_count;
+	size_t               cur_limit;
+	bool                 stop;
+	volatile bool        error;
+
+	/* muxer side */
+	int64_t              pos;
+	int64_t              end;
+
+	/* writer side */
+	int64_t              allocated;
+	uint64_t             last_sync_us;
+
+	int (*io_open)(struct AVFormatContext *s, AVIOContext **pb,
+			const char *url, int flags, AVDictionary **options);
+};
+
+/* ------------------------------------------------------------------------- */
+/* platform                                                                  */
+
+static inline uint64_t ffm_io_time_us(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64_t)(count.QuadPart / freq.QuadPart * 1000000 +
+			count.QuadPart % freq.QuadPart * 1000000 /
+			freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static inline void ffm_io_stat_max(volatile uint32_t *stat, uint32_t val)
+{
+	if (val > *stat)
+		*stat = val;
+}
+
+#ifdef _WIN32
+#define ffm_io_lock(io)      EnterCriticalSection(&(io)->mutex)
+#define ffm_io_unlock(io)    LeaveCriticalSection(&(io)->mutex)
+#define ffm_io_wait(io)      SleepConditionVariableCS(&(io)->cond, \
+		&(io)->mutex, INFINITE)
+#define ffm_io_broadcast(io) WakeAllConditionVariable(&(io)->cond)
+#define FFM_IO_INVALID       INVALID_HANDLE_VALUE
+
+static inline HANDLE ffm_io_open_file(const char *path, bool direct)
+{
+	wchar_t *wpath;
+	HANDLE file;
+	int len;
+
+	len = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+	if (!len)
+		return INVALID_HANDLE_VALUE;
+
+	wpath = malloc(len * sizeof(wchar_t));
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, len);
+
+	/* the direct handle is a second handle on the file created first */
+	file = CreateFileW(wpath, GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, direct ? OPEN_EXISTING : CREATE_ALWAYS,
+			direct ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH :
+			FILE_ATTRIBUTE_NORMAL, NULL);
+
+	free(wpath);
+	return file;
+}
+
+static inline void ffm_io_close_file(HANDLE file)
+{
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+
+static inline bool ffm_io_pwrite(HANDLE file, const uint8_t *data,
+		size_t size, int64_t offset)
+{
+	while (size) {
+		OVERLAPPED ov = {0};
+		DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		DWORD written = 0;
+
+		ov.Offset     = (DWORD)offset;
+		ov.OffsetHigh = (DWORD)(offset >> 32);
+
+		if (!WriteFile(file, data, chunk, &written, &ov) || !written)
+			return false;
+
+		data   += written;
+		size   -= written;
+		offset += written;
+	}
+
+	return true;
+}
+
+/* reserves space without moving the end of the file, so a crash never
+ * leaves a tail of zeros behind.  SetFileValidData isn't used, it needs
+ * the manage volume privilege and exposes old disk contents */
+static inline bool ffm_io_reserve(HANDLE file, int64_t size)
+{
+	FILE_ALLOCATION_INFO info;
+
+	info.AllocationSize.QuadPart = size;
+	return !!SetFileInformationByHandle(file, FileAllocationInfo, &info,
+			sizeof(info));
+}
+
+static inline void ffm_io_truncate(HANDLE file, int64_t size)
+{
+	FILE_END_OF_FILE_INFO info;
+
+	info.EndOfFile.QuadPart = size;
+	SetFileInformationByHandle(file, FileEndOfFileInfo, &info,
+			sizeof(info));
+}
+
+static inline void ffm_io_sync_file(HANDLE file)
+{
+	FlushFileBuffers(file);
+}
+
+static inline void *ffm_io_alloc_buffer(size_t size)
+{
+	return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+			PAGE_READWRITE);
+}
+
+static inline void ffm_io_free_buffer(void *ptr)
+{
+	if (ptr)
+		VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+#else
+#define ffm_io_lock(io)      pthread_mutex_lock(&(io)->mutex)
+#define ffm_io_unlock(io)    pthread_mutex_unlock(&(io)->mutex)
+#define ffm_io_wait(io)      pthread_cond_wait(&(io)->cond, &(io)->mutex)
+#define ffm_io_broadcast(io) pthread_cond_broadcast(&(io)->cond)
+#define FFM_IO_INVALID       -1
+
+static inline int ffm_io_open_file(const char *path, bool direct)
+{
+	int fd;
+
+	if (!direct)
+		return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				0644);
+
+#if defined(O_DIRECT)
+	fd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+#elif defined(F_NOCACHE)
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd != -1 && fcntl(fd, F_NOCACHE, 1) == -1) {
+		close(fd);
+		fd = -1;
+	}
+#else
+	fd = -1;
+#endif
+	return fd;
+}
+
+static inline void ffm_io_close_file(int fd)
+{
+	if (fd != -1)
+		close(fd);
+}
+
+static inline bool ffm_io_pwrite(int fd, const uint8_t *data, size_t size,
+		int64_t offset)
+{
+	while (size) {
+		ssize_t ret = pwrite(fd, data, size, (off_t)offset);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+
+		data   += ret;
+		size   -= (size_t)ret;
+		offset += ret;
+	}
+
+	return true;
+}
+
+static inline bool ffm_io_reserve(int fd, int64_t size)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+	return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == 0;
+#else
+	(void)fd;
+	(void)size;
+	return false;
+#endif
+}
+
+static inline void ffm_io_truncate(int fd, int64_t size)
+{
+	while (ftruncate(fd, (off_t)size) == -1 && errno == EINTR);
+}
+
+static inline void ffm_io_sync_file(int fd)
+{
+#if defined(__linux__)
+	fdatasync(fd);
+#else
+	fsync(fd);
+#endif
+}
+
+static inline void *ffm_io_alloc_buffer(size_t size)
+{
+	void *ptr;
+	return posix_memalign(&ptr, FFM_IO_ALIGN, size) == 0 ? ptr : NULL;
+}
+
+static inline void ffm_io_free_buffer(void *ptr)
+{
+	free(ptr);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* writer thread                                                             */
+
+static inline void ffm_io_default_params(struct ffm_io_params *params)
+{
+	params->buffer_size      = FFM_IO_DEFAULT_BUFFER_KB * 1024;
+	params->num_buffers      = FFM_IO_DEFAULT_BUFFERS;
+	params->prealloc         = (int64_t)FFM_IO_DEFAULT_PREALLOC_MB *
+	                           1024 * 1024;
+	params->direct           = false;
+	params->sync_interval_ms = 0;
+}
+
+static inline bool ffm_io_write_buffer(struct ffm_io *io,
+		struct ffm_io_buffer *buf)
+{
+	int64_t buf_end = buf->offset + (int64_t)buf->size;
+	bool direct = io->direct_file != FFM_IO_INVALID &&
+		(buf->offset % FFM_IO_ALIGN) == 0 &&
+		(buf->size % FFM_IO_ALIGN) == 0;
+	uint64_t start;
+	uint32_t latency;
+	bool success;
+
+	if (io->params.prealloc && buf_end > io->allocated) {
+		io->allocated = buf_end + io->params.prealloc;
+		if (!ffm_io_reserve(io->file, io->allocated))
+			io->params.prealloc = 0;
+	}
+
+	start = ffm_io_time_us();
+	success = ffm_io_pwrite(direct ? io->direct_file : io->file,
+			buf->data, buf->size, buf->offset);
+
+	if (io->params.sync_interval_ms &&
+	    start - io->last_sync_us >=
+	    (uint64_t)io->params.sync_interval_ms * 1000) {
+		ffm_io_sync_file(io->file);
+		io->last_sync_us = start;
+		io->stats->syncs++;
+	}
+
+	latency = (uint32_t)(ffm_io_time_us() - start);
+	io->stats->write_latency_us = latency;
+	ffm_io_stat_max(&io->stats->max_write_latency_us, latency);
+	io->stats->writes++;
+	return success;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI ffm_io_thread(LPVOID data)
+#else
+static void *ffm_io_thread(void *data)
+#endif
+{
+	struct ffm_io *io = data;
+	int n = io->params.num_buffers;
+
+	io->last_sync_us = ffm_io_time_us();
+
+	for (;;) {
+		struct ffm_io_buffer *buf;
+		bool success;
+
+		ffm_io_lock(io);
+		while (!io->queue_count && !io->stop)
+			ffm_io_wait(io);
+
+		if (!io->queue_count) {
+			ffm_io_unlock(io);
+			break;
+		}
+
+		buf = &io->buffers[(io->cur - io->queue_count + n) % n];
+		ffm_io_unlock(io);
+
+		success = ffm_io_write_buffer(io, buf);
+
+		ffm_io_lock(io);
+		if (!success)
+			io->error = true;
+		buf->size = 0;
+		io->queue_count--;
+		io->stats->queue_depth = (uint32_t)io->queue_count;
+		ffm_io_broadcast(io);
+		ffm_io_unlock(io);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* new buffers end on an aligned offset so the ones after a seek can still
+ * be written directly */
+static inline void ffm_io_start_buffer(struct ffm_io *io)
+{
+	struct ffm_io_buffer *buf = &io->buffers[io->cur];
+
+	buf->offset   = io->pos;
+	buf->size     = 0;
+	io->cur_limit = io->params.buffer_size -
+		(size_t)(io->pos % FFM_IO_ALIGN);
+}
+
+/* hands the current buffer to the writer thread and waits for a free one */
+static inline bool ffm_io_submit(struct ffm_io *io)
+{
+	struct ffm_io_buffer *buf = &io->buffers[io->cur];
+	int n = io->params.num_buffers;
+	int64_t buf_end = buf->offset + (int64_t)buf->size;
+
+	if (!buf->size)
+		return !io->error;
+
+	if (buf_end > io->end)
+		io->end = buf_end;
+
+	ffm_io_lock(io);
+	io->queue_count++;
+	io->stats->queue_depth = (uint32_t)io->queue_count;
+	ffm_io_stat_max(&io->stats->peak_queue_depth,
+			(uint32_t)io->queue_count);
+	io->cur = (io->cur + 1) % n;
+	ffm_io_broadcast(io);
+
+	if (io->queue_count == n && !io->error) {
+		io->stats->stalls++;
+		while (io->queue_count == n && !io->error)
+			ffm_io_wait(io);
+	}
+	ffm_io_unlock(io);
+
+	ffm_io_start_buffer(io);
+	return !io->error;
+}
+
+static inline bool ffm_io_write(struct ffm_io *io, const uint8_t *data,
+		size_t size)
+{
+	while (size) {
+		struct ffm_io_buffer *buf = &io->buffers[io->cur];
+		size_t space = io->cur_limit - buf->size;
+		size_t chunk = size < space ? size : space;
+
+		memcpy(buf->data + buf->size, data, chunk);
+		buf->size += chunk;
+		io->pos   += chunk;
+		data      += chunk;
+		size      -= chunk;
+
+		if (buf->size == io->cur_limit && !ffm_io_submit(io))
+			return false;
+	}
+
+	return !io->error;
+}
+
+/* waits until everything written so far has reached the file */
+static inline bool ffm_io_flush(struct ffm_io *io)
+{
+	if (!ffm_io_submit(io))
+		return false;
+
+	ffm_io_lock(io);
+	while (io->queue_count && !io->error)
+		ffm_io_wait(io);
+	ffm_io_unlock(io);
+
+	return !io->error;
+}
+
+static inline int64_t ffm_io_seek(struct ffm_io *io, int64_t offset,
+		int whence)
+{
+	int64_t cur_end = io->buffers[io->cur].offset +
+		(int64_t)io->buffers[io->cur].size;
+	int64_t size = cur_end > io->end ? cur_end : io->end;
+
+	switch (whence & ~AVSEEK_FORCE) {
+	case AVSEEK_SIZE: return size;
+	case SEEK_SET:    break;
+	case SEEK_CUR:    offset += io->pos; break;
+	case SEEK_END:    offset += size; break;
+	default:          return AVERROR(EINVAL);
+	}
+
+	if (offset < 0)
+		return AVERROR(EINVAL);
+	if (offset == io->pos)
+		return offset;
+
+	if (!ffm_io_submit(io))
+		return AVERROR(EIO);
+
+	io->pos = offset;
+	ffm_io_start_buffer(io);
+	return offset;
+}
+
+static inline void ffm_io_free(struct ffm_io *io)
+{
+	for (int i = 0; i < FFM_IO_MAX_BUFFERS; i++)
+		ffm_io_free_buffer(io->buffers[i].data);
+
+	ffm_io_close_file(io->direct_file);
+	ffm_io_close_file(io->file);
+
+#ifdef _WIN32
+	DeleteCriticalSection(&io->mutex);
+#else
+	pthread_mutex_destroy(&io->mutex);
+	pthread_cond_destroy(&io->cond);
+#endif
+	memset(io, 0, sizeof(*io));
+}
+
+/* stats may point to memory shared with another process, otherwise they are
+ * kept in the ffm_io itself */
+static inline bool ffm_io_open(struct ffm_io *io, const char *path,
+		const struct ffm_io_params *params, struct ffm_io_stats *stats)
+{
+	memset(io, 0, sizeof(*io));
+	io->params      = *params;
+	io->stats       = stats ? stats : &io->own_stats;
+	io->file        = FFM_IO_INVALID;
+	io->direct_file = FFM_IO_INVALID;
+
+	if (io->params.num_buffers < 2)
+		io->params.num_buffers = 2;
+	if (io->params.num_buffers > FFM_IO_MAX_BUFFERS)
+		io->params.num_buffers = FFM_IO_MAX_BUFFERS;
+	io->params.buffer_size = (io->params.buffer_size + FFM_IO_ALIGN - 1) &
+		~(size_t)(FFM_IO_ALIGN - 1);
+	if (io->params.buffer_size < FFM_IO_AVIO_BUFFER)
+		io->params.buffer_size = FFM_IO_AVIO_BUFFER;
+
+#ifdef _WIN32
+	InitializeCriticalSection(&io->mutex);
+	InitializeConditionVariable(&io->cond);
+#else
+	pthread_mutex_init(&io->mutex, NULL);
+	pthread_cond_init(&io->cond, NULL);
+#endif
+
+	io->file = ffm_io_open_file(path, false);
+	if (io->file == FFM_IO_INVALID)
+		goto fail;
+
+	/* unbuffered writes are optional, everything else still works
+	 * without the second handle */
+	if (io->params.direct)
+		io->direct_file = ffm_io_open_file(path, true);
+
+	for (int i = 0; i < io->params.num_buffers; i++) {
+		io->buffers[i].data = ffm_io_alloc_buffer(
+				io->params.buffer_size);
+		if (!io->buffers[i].data)
+			goto fail;
+	}
+
+	ffm_io_start_buffer(io);
+
+#ifdef _WIN32
+	io->thread = CreateThread(NULL, 0, ffm_io_thread, io, 0, NULL);
+	io->thread_created = !!io->thread;
+#else
+	io->thread_created = pthread_create(&io->thread, NULL, ffm_io_thread,
+			io) == 0;
+#endif
+	if (!io->thread_created)
+		goto fail;
+
+	return true;
+
+fail:
+	ffm_io_free(io);
+	return false;
+}
+
+/* writes out what's left, trims the reserved space and closes the file */
+static inline bool ffm_io_close(struct ffm_io *io)
+{
+	bool success = ffm_io_submit(io);
+
+	ffm_io_lock(io);
+	io->stop = true;
+	ffm_io_broadcast(io);
+	ffm_io_unlock(io);
+
+#ifdef _WIN32
+	WaitForSingleObject(io->thread, INFINITE);
+	CloseHandle(io->thread);
+#else
+	pthread_join(io->thread, NULL);
+#endif
+
+	if (io->allocated > io->end)
+		ffm_io_truncate(io->file, io->end);
+	if (io->params.sync_interval_ms)
+		ffm_io_sync_file(io->file);
+
+	success = success && !io->error;
+	ffm_io_free(io);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+/* AVIOContext glue                                                          */
+
+static int ffm_io_avio_write(void *opaque, uint8_t *buf, int size)
+{
+	return ffm_io_write(opaque, buf, (size_t)size) ? size : AVERROR(EIO);
+}
+
+static int64_t ffm_io_avio_seek(void *opaque, int64_t offset, int whence)
+{
+	return ffm_io_seek(opaque, offset, whence);
+}
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+/* mov faststart reads the file back through a second context, so
+ * everything has to be on disk before anything else gets opened */
+static int ffm_io_avio_open(struct AVFormatContext *s, AVIOContext **pb,
+		const char *url, int flags, AVDictionary **options)
+{
+	struct ffm_io *io = s->opaque;
+
+	if (s->pb)
+		avio_flush(s->pb);
+	ffm_io_flush(io);
+	return io->io_open(s, pb, url, flags, options);
+}
+#endif
+
+/* makes the format context write through io instead of opening the file */
+static inline bool ffm_io_attach(struct ffm_io *io, AVFormatContext *s)
+{
+	uint8_t *buf = av_malloc(FFM_IO_AVIO_BUFFER);
+	if (!buf)
+		return false;
+
+	s->pb = avio_alloc_context(buf, FFM_IO_AVIO_BUFFER, 1, io, NULL,
+			ffm_io_avio_write, ffm_io_avio_seek);
+	if (!s->pb) {
+		av_free(buf);
+		return false;
+	}
+
+	s->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+	s->opaque   = io;
+	io->io_open = s->io_open;
+	s->io_open  = ffm_io_avio_open;
+#endif
+	return true;
+}
+
+static inline void ffm_io_detach(AVFormatContext *s)
+{
+	if (s->pb) {
+		avio_flush(s->pb);
+		av_freep(&s->pb->buffer);
+		av_freep(&s->pb);
+	}
+}
@@ -0,0 +1,500 @@
+/*
+ * Copyright (c) 2020 Zaodao(Dalian) Education Technology Co., Ltd.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Single producer/single consumer shared memory ring used to send packets
+ * from obs-ffmpeg-mux to the ffmpeg-mux process instead of writing them to
+ * its stdin.  Each record is an ffm_packet_info followed by its payload.
+ *
+ * The producer publishes a whole record at once by advancing write_pos and
+ * then rings the data doorbell; the consumer advances read_pos once it's done
+ * with a record and rings the space doorbell.  Positions are free-running
+ * 32-bit counters, the capacity is always a power of two.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "ffmpeg-mux.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER < 1900 && !defined(snprintf)
+#define snprintf _snprintf
+#endif
+
+#define FFM_RING_MAGIC          0x4E524646 /* "FFRN" */
+#define FFM_RING_NAME_MAX       64
+#define FFM_RING_DEFAULT_SIZE   (32 * 1024 * 1024)
+#define FFM_RING_WAIT_MS        100
+
+struct ffm_ring_header {
+	uint32_t          magic;
+	uint32_t          capacity;
+	volatile uint32_t write_pos;
+	volatile uint32_t read_pos;
+	volatile uint32_t closed;
+	volatile uint32_t attached;
+
+	/* filled in by the consumer */
+	struct ffm_io_stats io;
+};
+
+struct ffm_ring {
+	struct ffm_ring_header *header;
+	uint8_t                *data;
+	size_t                 map_size;
+	char                   name[FFM_RING_NAME_MAX];
+	bool                   owner;
+
+#ifdef _WIN32
+	HANDLE                 map;
+	HANDLE                 data_event;
+	HANDLE                 space_event;
+#else
+	sem_t                  *data_event;
+	sem_t                  *space_event;
+#endif
+};
+
+/* ------------------------------------------------------------------------- */
+/* atomics                                                                   */
+
+static inline uint32_t ffm_ring_load(volatile uint32_t *ptr)
+{
+#ifdef _WIN32
+	return (uint32_t)InterlockedCompareExchange((volatile LONG*)ptr, 0, 0);
+#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void ffm_ring_store(volatile uint32_t *ptr, uint32_t val)
+{
+#ifdef _WIN32
+	InterlockedExchange((volatile LONG*)ptr, (LONG)val);
+#else
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* platform objects                                                          */
+
+#ifdef _WIN32
+static inline HANDLE ffm_ring_event(const char *name, const char *suffix,
+		bool create)
+{
+	wchar_t wname[FFM_RING_NAME_MAX + 8];
+	char full_name[FFM_RING_NAME_MAX + 8];
+
+	snprintf(full_name, sizeof(full_name), "%s-%s", name, suffix);
+	MultiByteToWideChar(CP_UTF8, 0, full_name, -1, wname,
+			FFM_RING_NAME_MAX + 8);
+
+	return create ?
+		CreateEventW(NULL, false, false, wname) :
+		OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, false, wname);
+}
+
+static inline void ffm_ring_signal(HANDLE event)
+{
+	SetEvent(event);
+}
+
+static inline void ffm_ring_wait(HANDLE event)
+{
+	WaitForSingleObject(event, FFM_RING_WAIT_MS);
+}
+
+static inline bool ffm_ring_map(struct ffm_ring *ring, size_t size,
+		bool create)
+{
+	wchar_t wname[FFM_RING_NAME_MAX];
+
+	MultiByteToWideChar(CP_UTF8, 0, ring->name, -1, wname,
+			FFM_RING_NAME_MAX);
+
+	ring->map = create ?
+		CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+				0, (DWORD)size, wname) :
+		OpenFileMappingW(FILE_MAP_ALL_ACCESS, false, wname);
+	if (!ring->map)
+		return false;
+
+	ring->header = MapViewOfFile(ring->map, FILE_MAP_ALL_ACCESS, 0, 0,
+			size);
+	return !!ring->header;
+}
+
+static inline void ffm_ring_unmap(struct ffm_ring *ring)
+{
+	if (ring->header)
+		UnmapViewOfFile(ring->header);
+	if (ring->map)
+		CloseHandle(ring->map);
+	if (ring->data_event)
+		CloseHandle(ring->data_event);
+	if (ring->space_event)
+		CloseHandle(ring->space_event);
+}
+
+#else
+static inline sem_t *ffm_ring_event(const char *name, const char *suffix,
+		bool create)
+{
+	char full_name[FFM_RING_NAME_MAX + 8];
+	sem_t *sem;
+
+	snprintf(full_name, sizeof(full_name), "/%s-%s", name, suffix);
+	sem = create ?
+		sem_open(full_name, O_CREAT | O_EXCL, 0600, 0) :
+		sem_open(full_name, 0);
+	return sem == SEM_FAILED ? NULL : sem;
+}
+
+static inline void ffm_ring_signal(sem_t *event)
+{
+	sem_post(event);
+}
+
+static inline void ffm_ring_wait(sem_t *event)
+{
+	struct timespec ts;
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	ts.tv_sec  = tv.tv_sec;
+	ts.tv_nsec = tv.tv_usec * 1000 + FFM_RING_WAIT_MS * 1000000L;
+	ts.tv_sec += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+
+	while (sem_timedwait(event, &ts) != 0 && errno == EINTR);
+}
+
+static inline bool ffm_ring_map(struct ffm_ring *ring, size_t size,
+		bool create)
+{
+	char path[FFM_RING_NAME_MAX + 1];
+	void *ptr;
+	int fd;
+
+	snprintf(path, sizeof(path), "/%s", ring->name);
+	fd = create ?
+		shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0600) :
+		shm_open(path, O_RDWR, 0);
+	if (fd == -1)
+		return false;
+
+	if (create && ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return false;
+	}
+
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED)
+		return false;
+
+	ring->header = ptr;
+	return true;
+}
+
+static inline void ffm_ring_unmap(struct ffm_ring *ring)
+{
+	char path[FFM_RING_NAME_MAX + 8];
+
+	if (ring->header)
+		munmap(ring->header, ring->map_size);
+	if (ring->data_event)
+		sem_close(ring->data_event);
+	if (ring->space_event)
+		sem_close(ring->space_event);
+
+	/* names only need to live until the consumer has opened them */
+	if (ring->owner) {
+		snprintf(path, sizeof(path), "/%s", ring->name);
+		shm_unlink(path);
+		snprintf(path, sizeof(path), "/%s-data", ring->name);
+		sem_unlink(path);
+		snprintf(path, sizeof(path), "/%s-space", ring->name);
+		sem_unlink(path);
+	}
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static inline unsigned long ffm_ring_process_id(void)
+{
+#ifdef _WIN32
+	return (unsigned long)GetCurrentProcessId();
+#else
+	return (unsigned long)getpid();
+#endif
+}
+
+/* semaphores can hold several pending wakeups, so timeouts use the clock */
+static inline uint32_t ffm_ring_time_ms(void)
+{
+#ifdef _WIN32
+	return (uint32_t)GetTickCount();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif
+}
+
+static inline void ffm_ring_free(struct ffm_ring *ring)
+{
+	ffm_ring_unmap(ring);
+	memset(ring, 0, sizeof(*ring));
+}
+
+/* capacity is rounded up to a power of two */
+static inline bool ffm_ring_create(struct ffm_ring *ring, const char *name,
+		uint32_t capacity)
+{
+	uint32_t size = 1;
+
+	while (size < capacity)
+		size <<= 1;
+
+	memset(ring, 0, sizeof(*ring));
+	snprintf(ring->name, sizeof(ring->name), "%s", name);
+	ring->owner = true;
+	ring->map_size = sizeof(struct ffm_ring_header) + size;
+
+	if (!ffm_ring_map(ring, ring->map_size, true))
+		goto fail;
+
+	ring->data_event  = ffm_ring_event(name, "data", true);
+	ring->space_event = ffm_ring_event(name, "space", true);
+	if (!ring->data_event || !ring->space_event)
+		goto fail;
+
+	ring->data = (uint8_t*)(ring->header + 1);
+	ring->header->capacity  = size;
+	ring->header->write_pos = 0;
+	ring->header->read_pos  = 0;
+	ring->header->closed    = 0;
+	ring->header->attached  = 0;
+	ffm_ring_store(&ring->header->magic, FFM_RING_MAGIC);
+	return true;
+
+fail:
+	ffm_ring_free(ring);
+	return false;
+}
+
+static inline bool ffm_ring_open(struct ffm_ring *ring, const char *name)
+{
+	uint32_t capacity;
+
+	memset(ring, 0, sizeof(*ring));
+	snprintf(ring->name, sizeof(ring->name), "%s", name);
+
+	/* map the header first to find out the full size */
+	ring->map_size = sizeof(struct ffm_ring_header);
+	if (!ffm_ring_map(ring, ring->map_size, false))
+		goto fail;
+
+	if (ffm_ring_load(&ring->header->magic) != FFM_RING_MAGIC)
+		goto fail;
+
+	capacity = ring->header->capacity;
+	ffm_ring_unmap(ring);
+	ring->header = NULL;
+#ifdef _WIN32
+	ring->map = NULL;
+#endif
+
+	ring->map_size = sizeof(struct ffm_ring_header) + capacity;
+	if (!ffm_ring_map(ring, ring->map_size, false))
+		goto fail;
+
+	ring->data_event  = ffm_ring_event(name, "data", false);
+	ring->space_event = ffm_ring_event(name, "space", false);
+	if (!ring->data_event || !ring->space_event)
+		goto fail;
+
+	ring->data = (uint8_t*)(ring->header + 1);
+
+	ffm_ring_store(&ring->header->attached, 1);
+	ffm_ring_signal(ring->space_event);
+	return true;
+
+fail:
+	ffm_ring_free(ring);
+	return false;
+}
+
+/* waits for the consumer process to open the ring */
+static inline bool ffm_ring_wait_attached(struct ffm_ring *ring,
+		uint32_t timeout_ms)
+{
+	uint32_t start = ffm_ring_time_ms();
+
+	while (!ffm_ring_load(&ring->header->attached)) {
+		if (ffm_ring_time_ms() - start >= timeout_ms)
+			return false;
+
+		ffm_ring_wait(ring->space_event);
+	}
+
+	return true;
+}
+
+static inline uint32_t ffm_ring_used(struct ffm_ring *ring)
+{
+	return ffm_ring_load(&ring->header->write_pos) -
+		ffm_ring_load(&ring->header->read_pos);
+}
+
+static inline void ffm_ring_copy_in(struct ffm_ring *ring, uint32_t pos,
+		const void *src, uint32_t size)
+{
+	uint32_t mask   = ring->header->capacity - 1;
+	uint32_t offset = pos & mask;
+	uint32_t first  = ring->header->capacity - offset;
+
+	if (first > size)
+		first = size;
+
+	memcpy(ring->data + offset, src, first);
+	memcpy(ring->data, (const uint8_t*)src + first, size - first);
+}
+
+static inline void ffm_ring_copy_out(struct ffm_ring *ring, uint32_t pos,
+		void *dst, uint32_t size)
+{
+	uint32_t mask   = ring->header->capacity - 1;
+	uint32_t offset = pos & mask;
+	uint32_t first  = ring->header->capacity - offset;
+
+	if (first > size)
+		first = size;
+
+	memcpy(dst, ring->data + offset, first);
+	memcpy((uint8_t*)dst + first, ring->data, size - first);
+}
+
+/*
+ * Writes head and body as a single record.  Blocks while the ring is full,
+ * and gives up if the consumer hasn't freed any space within stall_ms
+ * (usually because the consumer process has died).
+ */
+static inline bool ffm_ring_write(struct ffm_ring *ring,
+		const void *head, uint32_t head_size,
+		const void *body, uint32_t body_size, uint32_t stall_ms)
+{
+	uint32_t size = head_size + body_size;
+	uint32_t pos  = ring->header->write_pos;
+	uint32_t last_read = ffm_ring_load(&ring->header->read_pos);
+	uint32_t last_time = ffm_ring_time_ms();
+
+	if (size > ring->header->capacity)
+		return false;
+
+	while (ring->header->capacity - ffm_ring_used(ring) < size) {
+		uint32_t read_pos;
+
+		ffm_ring_wait(ring->space_event);
+
+		read_pos = ffm_ring_load(&ring->header->read_pos);
+		if (read_pos != last_read) {
+			last_read = read_pos;
+			last_time = ffm_ring_time_ms();
+		} else if (ffm_ring_time_ms() - last_time >= stall_ms) {
+			return false;
+		}
+	}
+
+	ffm_ring_copy_in(ring, pos, head, head_size);
+	if (body_size)
+		ffm_ring_copy_in(ring, pos + head_size, body, body_size);
+
+	ffm_ring_store(&ring->header->write_pos, pos + size);
+	ffm_ring_signal(ring->data_event);
+	return true;
+}
+
+static inline void ffm_ring_close(struct ffm_ring *ring)
+{
+	ffm_ring_store(&ring->header->closed, 1);
+	ffm_ring_signal(ring->data_event);
+}
+
+/*
+ * Waits until at least size bytes can be read.  Returns false once the
+ * producer has closed the ring and everything has been read, or when
+ * alive() reports that the producer went away.
+ */
+static inline bool ffm_ring_wait_data(struct ffm_ring *ring, uint32_t size,
+		bool (*alive)(void))
+{
+	while (ffm_ring_used(ring) < size) {
+		if (ffm_ring_load(&ring->header->closed)) {
+			/* close may race with the last write */
+			return ffm_ring_used(ring) >= size;
+		}
+		if (alive && !alive())
+			return false;
+
+		ffm_ring_wait(ring->data_event);
+	}
+
+	return true;
+}
+
+/* returns a direct pointer if the next size bytes don't wrap around */
+static inline uint8_t *ffm_ring_peek(struct ffm_ring *ring, uint32_t size)
+{
+	uint32_t mask   = ring->header->capacity - 1;
+	uint32_t offset = ring->header->read_pos & mask;
+
+	return offset + size <= ring->header->capacity ?
+		ring->data + offset : NULL;
+}
+
+static inline void ffm_ring_read(struct ffm_ring *ring, void *dst,
+		uint32_t size)
+{
+	ffm_ring_copy_out(ring, ring->header->read_pos, dst, size);
+}
+
+static inline void ffm_ring_consume(struct ffm_ring *ring, uint32_t size)
+{
+	ffm_ring_store(&ring->header->read_pos,
+			ring->header->read_pos + size);
+	ffm_ring_signal(ring->space_event);
+}
@@ -20,12 +20,18 @@
 #include <windows.h>
 #define inline __inline
 
+#else
+#define _GNU_SOURCE
+#include <signal.h>
+#include <sys/types.h>
 #endif
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "ffmpeg-mux.h"
+#include "ffmpeg-mux-ring.h"
+#include "ffmpeg-mux-io.h"
 
 #include <libavformat/avformat.h>
 
@@ -81,6 +87,8 @@ struct main_params {
 	int fps_den;
 	char *acodec;
 	char *muxer_settings;
+	char *ring_name;
+	int parent_pid;
 };
 
 struct audio_params {
@@ -105,6 +113,9 @@ struct ffmpeg_mux {
 	struct header          *audio_header;
 	int                    num_audio_streams;
 	bool                   initialized;
+	struct ffm_ring        ring;
+	struct ffm_io          io;
+	bool                   write_behind;
 	char error[4096];
 };
 
@@ -116,8 +127,16 @@ static void header_free(struct header *header)
 static void free_avformat(struct ffmpeg_mux *ffm)
 {
 	if (ffm->output) {
-		if ((ffm->output->oformat->flags & AVFMT_NOFILE) == 0)
+		if (ffm->write_behind) {
+			ffm_io_detach(ffm->output);
+			if (!ffm_io_close(&ffm->io))
+				printf("Failed to write '%s'\n",
+						ffm->params.file);
+			ffm->write_behind = false;
+
+		} else if ((ffm->output->oformat->flags & AVFMT_NOFILE) == 0) {
 			avio_close(ffm->output->pb);
+		}
 
 		avformat_free_context(ffm->output);
 		ffm->output = NULL;
@@ -154,6 +173,10 @@ static void ffmpeg_mux_free(struct ffmpeg_mux *ffm)
 		free(ffm->audio);
 	}
 
+	if (ffm->ring.header) {
+		ffm_ring_free(&ffm->ring);
+	}
+
 	memset(ffm, 0, sizeof(*ffm));
 }
 
@@ -258,6 +281,14 @@ static bool init_params(int *argc, char ***argv, struct main_params *params,
 
 	get_opt_str(argc, argv, &params->muxer_settings, "muxer settings");
 
+	/* optional shared memory transport, stdin is used otherwise */
+	if (*argc) {
+		if (!get_opt_str(argc, argv, &params->ring_name, "ring name"))
+			return false;
+		if (!get_opt_int(argc, argv, &params->parent_pid, "parent pid"))
+			return false;
+	}
+
 	return true;
 }
 
@@ -401,6 +432,43 @@ static void ffmpeg_mux_header(struct ffmpeg_mux *ffm, uint8_t *data,
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+
+#ifdef _WIN32
+static HANDLE parent_process = NULL;
+#else
+static pid_t parent_pid = 0;
+#endif
+
+static void init_parent_process(int pid)
+{
+#ifdef _WIN32
+	parent_process = OpenProcess(SYNCHRONIZE, false, (DWORD)pid);
+#else
+	parent_pid = (pid_t)pid;
+#endif
+}
+
+static bool parent_alive(void)
+{
+#ifdef _WIN32
+	return !parent_process ||
+		WaitForSingleObject(parent_process, 0) == WAIT_TIMEOUT;
+#else
+	return !parent_pid || kill(parent_pid, 0) == 0;
+#endif
+}
+
+static size_t ring_read(struct ffm_ring *ring, void *data, size_t size)
+{
+	if (!ffm_ring_wait_data(ring, (uint32_t)size, parent_alive))
+		return 0;
+
+	ffm_ring_read(ring, data, (uint32_t)size);
+	ffm_ring_consume(ring, (uint32_t)size);
+	return size;
+}
+
 static size_t safe_read(void *vdata, size_t size)
 {
 	uint8_t *data = vdata;
@@ -418,15 +486,23 @@ static size_t safe_read(void *vdata, size_t size)
 	return total;
 }
 
+static inline size_t read_data(struct ffmpeg_mux *ffm, void *data,
+		size_t size)
+{
+	return ffm->ring.header ?
+		ring_read(&ffm->ring, data, size) :
+		safe_read(data, size);
+}
+
 static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
 {
 	struct ffm_packet_info info = {0};
 
-	bool success = safe_read(&info, sizeof(info)) == sizeof(info);
+	bool success = read_data(ffm, &info, sizeof(info)) == sizeof(info);
 	if (success) {
 		uint8_t *data = malloc(info.size);
 
-		if (safe_read(data, info.size) == info.size) {
+		if (read_data(ffm, data, info.size) == info.size) {
 			ffmpeg_mux_header(ffm, data, &info);
 		} else {
 			success = false;
@@ -459,17 +535,84 @@ static inline bool ffmpeg_mux_get_extra_data(struct ffmpeg_mux *ffm)
 #pragma warning(disable : 4996)
 #endif
 
+/* the write-behind settings are passed along with the muxer settings as
+ * ffm_io_* keys, they're taken out before the rest goes to the muxer */
+static bool get_io_params(AVDictionary **dict, struct ffm_io_params *params)
+{
+	AVDictionaryEntry *entry;
+	bool found = false;
+
+	ffm_io_default_params(params);
+
+	while ((entry = av_dict_get(*dict, "ffm_io_", NULL,
+					AV_DICT_IGNORE_SUFFIX))) {
+		char key[64];
+		int val = atoi(entry->value);
+
+		snprintf(key, sizeof(key), "%s", entry->key);
+
+		if (strcmp(key, "ffm_io_buffer_kb") == 0)
+			params->buffer_size = (size_t)val * 1024;
+		else if (strcmp(key, "ffm_io_buffers") == 0)
+			params->num_buffers = val;
+		else if (strcmp(key, "ffm_io_prealloc_mb") == 0)
+			params->prealloc = (int64_t)val * 1024 * 1024;
+		else if (strcmp(key, "ffm_io_direct") == 0)
+			params->direct = val != 0;
+		else if (strcmp(key, "ffm_io_sync_ms") == 0)
+			params->sync_interval_ms = val;
+
+		av_dict_set(dict, key, NULL, 0);
+		found = true;
+	}
+
+	return found;
+}
+
 static inline int open_output_file(struct ffmpeg_mux *ffm)
 {
 	AVOutputFormat *format = ffm->output->oformat;
+	struct ffm_io_params io_params;
+	bool write_behind;
 	int ret;
 
-	if ((format->flags & AVFMT_NOFILE) == 0) {
+	AVDictionary *dict = NULL;
+	if ((ret = av_dict_parse_string(&dict, ffm->params.muxer_settings,
+				"=", " ", 0))) {
+		printf("Failed to parse muxer settings: %s\n%s",
+				av_err2str(ret), ffm->params.muxer_settings);
+
+		av_dict_free(&dict);
+	}
+
+	write_behind = get_io_params(&dict, &io_params);
+
+	if ((format->flags & AVFMT_NOFILE) == 0 && write_behind) {
+		struct ffm_io_stats *stats = ffm->ring.header ?
+			&ffm->ring.header->io : NULL;
+
+		if (!ffm_io_open(&ffm->io, ffm->params.file, &io_params,
+					stats)) {
+			printf("Couldn't open '%s'", ffm->params.file);
+			av_dict_free(&dict);
+			return FFM_ERROR;
+		}
+
+		if (!ffm_io_attach(&ffm->io, ffm->output)) {
+			ffm_io_close(&ffm->io);
+			av_dict_free(&dict);
+			return FFM_ERROR;
+		}
+
+		ffm->write_behind = true;
+
+	} else if ((format->flags & AVFMT_NOFILE) == 0) {
 		ret = avio_open(&ffm->output->pb, ffm->params.file,
 				AVIO_FLAG_WRITE);
 		if (ret < 0) {
 			printf("Couldn't open '%s', %s",
 					ffm->params.file, av_err2str(ret));
+			av_dict_free(&dict);
 			return FFM_ERROR;
 		}
 	}
@@ -478,15 +621,6 @@ static inline int open_output_file(struct ffmpeg_mux *ffm)
 			sizeof(ffm->output->filename));
 	ffm->output->filename[sizeof(ffm->output->filename) - 1] = 0;
 
-	AVDictionary *dict = NULL;
-	if ((ret = av_dict_parse_string(&dict, ffm->params.muxer_settings,
-				"=", " ", 0))) {
-		printf("Failed to parse muxer settings: %s\n%s",
-				av_err2str(ret), ffm->params.muxer_settings);
-
-		av_dict_free(&dict);
-	}
-
 	if (av_dict_count(dict) > 0) {
 		printf("Using muxer settings:");
 
@@ -563,6 +697,16 @@ static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
 			calloc(1, sizeof(struct header) * ffm->params.tracks);
 	}
 
+	if (ffm->params.ring_name) {
+		init_parent_process(ffm->params.parent_pid);
+
+		if (!ffm_ring_open(&ffm->ring, ffm->params.ring_name)) {
+			printf("Couldn't open shared memory ring '%s'\n",
+					ffm->params.ring_name);
+			return FFM_ERROR;
+		}
+	}
+
 	av_register_all();
 
 	if (!ffmpeg_mux_get_extra_data(ffm))
@@ -640,6 +784,30 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 	return av_interleaved_write_frame(ffm->output, &packet) >= 0;
 }
 
+/* packets are muxed straight from shared memory unless they wrap around */
+static bool ffmpeg_mux_ring_packet(struct ffmpeg_mux *ffm,
+		struct resize_buf *rb)
+{
+	struct ffm_packet_info info;
+	uint8_t *data;
+
+	if (ring_read(&ffm->ring, &info, sizeof(info)) != sizeof(info))
+		return false;
+	if (!ffm_ring_wait_data(&ffm->ring, info.size, parent_alive))
+		return false;
+
+	data = ffm_ring_peek(&ffm->ring, info.size);
+	if (!data) {
+		resize_buf_resize(rb, info.size);
+		ffm_ring_read(&ffm->ring, rb->buf, info.size);
+		data = rb->buf;
+	}
+
+	ffmpeg_mux_packet(ffm, data, &info);
+	ffm_ring_consume(&ffm->ring, info.size);
+	return true;
+}
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef _WIN32
@@ -682,13 +850,18 @@ int main(int argc, char *argv[])
 		return ret;
 	}
 
-	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
-		resize_buf_resize(&rb, info.size);
+	if (ffm.ring.header) {
+		while (ffmpeg_mux_ring_packet(&ffm, &rb));
 
-		if (safe_read(rb.buf, info.size) == info.size) {
-			ffmpeg_mux_packet(&ffm, rb.buf, &info);
-		} else {
-			fail = true;
+	} else {
+		while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
+			resize_buf_resize(&rb, info.size);
+
+			if (safe_read(rb.buf, info.size) == info.size) {
+				ffmpeg_mux_packet(&ffm, rb.buf, &info);
+			} else {
+				fail = true;
+			}
 		}
 	}
 
@@ -696,6 +869,9 @@ int main(int argc, char *argv[])
 	resize_buf_free(&rb);
 
 #ifdef _WIN32
+	if (parent_process)
+		CloseHandle(parent_process);
+
 	for (int i = 0; i < argc; i++)
 		free(argv[i]);
 	free(argv);
@@ -35,3 +35,19 @@ struct ffm_packet_info {
 	enum ffm_packet_type type;
 	bool                 keyframe;
 };
+
+#define FFM_IO_DEFAULT_BUFFER_KB   2048
+#define FFM_IO_DEFAULT_BUFFERS     8
+#define FFM_IO_DEFAULT_PREALLOC_MB 64
+
+/* write-behind statistics, kept in the shared memory ring when there is one
+ * so the output can report them */
+struct ffm_io_stats {
+	volatile uint32_t    queue_depth;
+	volatile uint32_t    peak_queue_depth;
+	volatile uint32_t    write_latency_us;
+	volatile uint32_t    max_write_latency_us;
+	volatile uint32_t    writes;
+	volatile uint32_t    stalls;
+	volatile uint32_t    syncs;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <util/dstr.h>
+
+/*
+ * Fragmented MP4 writes the moov up front and then the media as a series
+ * of self contained fragments.  Everything up to the last flushed fragment
+ * stays playable if the process dies, and stopping only has to write a
+ * small index instead of rewriting the whole file for faststart.
+ */
+
+#define FRAGMENT_DEFAULT_DURATION_MS 2000
+
+static inline bool ffmpeg_fragment_supported(const char *format_name,
+		const char *path)
+{
+	const char *ext;
+
+	if (format_name && *format_name)
+		return astrcmpi(format_name, "mp4") == 0 ||
+		       astrcmpi(format_name, "mov") == 0;
+
+	ext = path ? strrchr(path, '.') : NULL;
+	return ext && (astrcmpi(ext, ".mp4") == 0 ||
+	               astrcmpi(ext, ".mov") == 0 ||
+	               astrcmpi(ext, ".m4v") == 0);
+}
+
+/* later keys override earlier ones, so this replaces any movflags (such as
+ * faststart) already in the muxer settings.  flush_packets pushes each
+ * fragment out to the file as soon as the muxer completes it */
+static inline void ffmpeg_fragment_muxer_settings(struct dstr *mux,
+		int duration_ms)
+{
+	if (duration_ms <= 0)
+		duration_ms = FRAGMENT_DEFAULT_DURATION_MS;
+
+	if (!dstr_is_empty(mux))
+		dstr_cat_ch(mux, ' ');
+
+	dstr_catf(mux, "movflags=frag_keyframe+empty_moov+default_base_moof "
+			"frag_duration=%d flush_packets=1",
+			duration_ms * 1000);
+}
@@ -22,9 +22,11 @@
 #include <util/pipe.h>
 #include <util/darray.h>
 #include <util/platform.h>
-#include <util/circlebuf.h>
 #include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-ring.h"
+#include "obs-ffmpeg-fragment.h"
+#include "obs-ffmpeg-replay.h"
 
 #include <libavformat/avformat.h>
 
@@ -35,11 +37,17 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+#define RING_ATTACH_TIMEOUT_MS 3000
+#define RING_STALL_TIMEOUT_MS  30000
+
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
+	struct ffm_ring   ring;
 	int64_t           stop_ts;
 	uint64_t          total_bytes;
+	volatile long     io_queue_depth;
+	volatile long     io_write_latency_us;
 	struct dstr       path;
 	bool              sent_headers;
 	volatile bool     active;
@@ -47,16 +55,15 @@ struct ffmpeg_muxer {
 	volatile bool     capturing;
 
 	/* replay buffer */
-	struct circlebuf  packets;
-	int64_t           cur_size;
-	int64_t           cur_time;
+	struct replay_store store;
 	int64_t           max_size;
 	int64_t           max_time;
 	int64_t           save_ts;
-	int               keyframes;
+	int64_t           save_duration;
 	obs_hotkey_id     hotkey;
 
-	DARRAY(struct encoder_packet) mux_packets;
+	uint64_t                      mux_start;
+	uint64_t                      mux_end;
 	pthread_t                     mux_thread;
 	bool                          mux_thread_joinable;
 	volatile bool                 muxing;
@@ -68,33 +75,48 @@ static const char *ffmpeg_mux_getname(void *type)
 	return obs_module_text("FFmpegMuxer");
 }
 
-static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
+/* the helper has exited by now, so these are the final numbers */
+static void log_io_stats(struct ffmpeg_muxer *stream)
 {
-	while (stream->packets.size > 0) {
-		struct encoder_packet pkt;
-		circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-		obs_encoder_packet_release(&pkt);
+	struct ffm_io_stats *io = &stream->ring.header->io;
+
+	if (!io->writes)
+		return;
+
+	info("Write-behind: %u writes, peak queue depth %u, max write "
+	     "latency %u ms, %u stalls, %u syncs",
+	     io->writes, io->peak_queue_depth,
+	     io->max_write_latency_us / 1000, io->stalls, io->syncs);
+}
+
+static int stop_pipe(struct ffmpeg_muxer *stream)
+{
+	int ret;
+
+	if (stream->ring.header)
+		ffm_ring_close(&stream->ring);
+
+	ret = os_process_pipe_destroy(stream->pipe);
+	stream->pipe = NULL;
+
+	if (stream->ring.header) {
+		log_io_stats(stream);
+		ffm_ring_free(&stream->ring);
 	}
 
-	circlebuf_free(&stream->packets);
-	stream->cur_size = 0;
-	stream->cur_time = 0;
-	stream->max_size = 0;
-	stream->max_time = 0;
-	stream->save_ts = 0;
-	stream->keyframes = 0;
+	os_atomic_set_long(&stream->io_queue_depth, 0);
+	os_atomic_set_long(&stream->io_write_latency_us, 0);
+	return ret;
 }
 
 static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 
-	replay_buffer_clear(stream);
 	if (stream->mux_thread_joinable)
 		pthread_join(stream->mux_thread, NULL);
-	da_free(stream->mux_packets);
 
-	os_process_pipe_destroy(stream->pipe);
+	stop_pipe(stream);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
@@ -210,6 +232,25 @@ static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
 
 	dstr_copy(&mux, obs_data_get_string(settings, "muxer_settings"));
 
+	if (obs_data_get_bool(settings, "fragmented") &&
+	    ffmpeg_fragment_supported(NULL,
+		    obs_data_get_string(settings, "path")))
+		ffmpeg_fragment_muxer_settings(&mux, (int)obs_data_get_int(
+				settings, "fragment_duration_ms"));
+
+	if (obs_data_get_bool(settings, "write_behind"))
+		dstr_catf(&mux, "%sffm_io_buffer_kb=%d ffm_io_buffers=%d "
+				"ffm_io_prealloc_mb=%d ffm_io_direct=%d "
+				"ffm_io_sync_ms=%d",
+				mux.len ? " " : "",
+				(int)obs_data_get_int(settings, "io_buffer_kb"),
+				(int)obs_data_get_int(settings, "io_buffers"),
+				(int)obs_data_get_int(settings,
+					"io_prealloc_mb"),
+				obs_data_get_bool(settings, "direct_io"),
+				(int)obs_data_get_int(settings,
+					"io_sync_interval_ms"));
+
 	log_muxer_params(stream, mux.array);
 
 	dstr_replace(&mux, "\"", "\\\"");
@@ -261,12 +302,54 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 	add_muxer_params(cmd, stream);
 }
 
+static bool create_ring(struct ffmpeg_muxer *stream, struct dstr *cmd)
+{
+	static volatile long ring_id = 0;
+	unsigned long pid = ffm_ring_process_id();
+	struct dstr name = {0};
+	bool success;
+
+	dstr_printf(&name, "obs-ffmpeg-mux-%lu-%ld", pid,
+			os_atomic_inc_long(&ring_id));
+
+	success = ffm_ring_create(&stream->ring, name.array,
+			FFM_RING_DEFAULT_SIZE);
+	if (success)
+		dstr_catf(cmd, "\"%s\" %lu", name.array, pid);
+
+	dstr_free(&name);
+	return success;
+}
+
 static inline void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 {
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	bool shared_memory = obs_data_get_bool(settings, "shared_memory");
 	struct dstr cmd;
+
+	obs_data_release(settings);
+
 	build_command_line(stream, &cmd, path);
+
+	if (shared_memory && !create_ring(stream, &cmd))
+		warn("Failed to create shared memory ring, using pipe");
+
 	stream->pipe = os_process_pipe_create(cmd.array, "w");
 	dstr_free(&cmd);
+
+	if (!stream->pipe || !stream->ring.header)
+		return;
+
+	/* older or failing helpers will never attach, fall back to stdin */
+	if (!ffm_ring_wait_attached(&stream->ring, RING_ATTACH_TIMEOUT_MS)) {
+		warn("ffmpeg-mux did not attach to shared memory ring, "
+		     "using pipe");
+		stop_pipe(stream);
+
+		build_command_line(stream, &cmd, path);
+		stream->pipe = os_process_pipe_create(cmd.array, "w");
+		dstr_free(&cmd);
+	}
 }
 
 static bool ffmpeg_mux_start(void *data)
@@ -326,8 +409,7 @@ static int deactivate(struct ffmpeg_muxer *stream)
 	int ret = -1;
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = stop_pipe(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -382,6 +464,24 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 		.keyframe = packet->keyframe
 	};
 
+	if (stream->ring.header) {
+		if (!ffm_ring_write(&stream->ring, &info, sizeof(info),
+					packet->data, (uint32_t)packet->size,
+					RING_STALL_TIMEOUT_MS)) {
+			warn("Failed to write packet to shared memory ring");
+			signal_failure(stream);
+			return false;
+		}
+
+		stream->total_bytes += packet->size;
+
+		os_atomic_set_long(&stream->io_queue_depth,
+				(long)stream->ring.header->io.queue_depth);
+		os_atomic_set_long(&stream->io_write_latency_us,
+				(long)stream->ring.header->io.write_latency_us);
+		return true;
+	}
+
 	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)&info,
 			sizeof(info));
 	if (ret != sizeof(info)) {
@@ -484,12 +584,45 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 	return props;
 }
 
+static void ffmpeg_mux_io_defaults(obs_data_t *s)
+{
+	obs_data_set_default_bool(s, "write_behind", true);
+	obs_data_set_default_int(s, "io_buffer_kb", FFM_IO_DEFAULT_BUFFER_KB);
+	obs_data_set_default_int(s, "io_buffers", FFM_IO_DEFAULT_BUFFERS);
+	obs_data_set_default_int(s, "io_prealloc_mb",
+			FFM_IO_DEFAULT_PREALLOC_MB);
+	obs_data_set_default_bool(s, "direct_io", false);
+	obs_data_set_default_int(s, "io_sync_interval_ms", 0);
+}
+
+static void ffmpeg_mux_defaults(obs_data_t *s)
+{
+	obs_data_set_default_bool(s, "shared_memory", true);
+	obs_data_set_default_bool(s, "fragmented", false);
+	obs_data_set_default_int(s, "fragment_duration_ms",
+			FRAGMENT_DEFAULT_DURATION_MS);
+	ffmpeg_mux_io_defaults(s);
+}
+
 static uint64_t ffmpeg_mux_total_bytes(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 	return stream->total_bytes;
 }
 
+/* only known when the helper is fed through shared memory */
+static int ffmpeg_mux_io_queue_depth(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	return (int)os_atomic_load_long(&stream->io_queue_depth);
+}
+
+static int ffmpeg_mux_io_write_latency(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	return (int)os_atomic_load_long(&stream->io_write_latency_us);
+}
+
 struct obs_output_info ffmpeg_muxer = {
 	.id             = "ffmpeg_muxer",
 	.flags          = OBS_OUTPUT_AV |
@@ -502,7 +635,10 @@ struct obs_output_info ffmpeg_muxer = {
 	.stop           = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
 	.get_total_bytes= ffmpeg_mux_total_bytes,
-	.get_properties = ffmpeg_mux_properties
+	.get_defaults   = ffmpeg_mux_defaults,
+	.get_properties = ffmpeg_mux_properties,
+	.get_io_queue_depth      = ffmpeg_mux_io_queue_depth,
+	.get_io_write_latency_us = ffmpeg_mux_io_write_latency
 };
 
 /* ------------------------------------------------------------------------ */
@@ -521,8 +657,10 @@ static void replay_buffer_hotkey(void *data, obs_hotkey_id id,
 	UNUSED_PARAMETER(pressed);
 
 	struct ffmpeg_muxer *stream = data;
-	if (os_atomic_load_bool(&stream->active))
+	if (os_atomic_load_bool(&stream->active)) {
+		stream->save_duration = 0;
 		stream->save_ts = os_gettime_ns() / 1000LL;
+	}
 }
 
 static void save_replay_proc(void *data, calldata_t *cd)
@@ -531,6 +669,19 @@ static void save_replay_proc(void *data, calldata_t *cd)
 	UNUSED_PARAMETER(cd);
 }
 
+/* saves only the last few seconds of what's buffered, starting from the
+ * keyframe before that point */
+static void save_last_replay_proc(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+	long long seconds = calldata_int(cd, "seconds");
+
+	if (os_atomic_load_bool(&stream->active)) {
+		stream->save_duration = seconds > 0 ? seconds * 1000000LL : 0;
+		stream->save_ts = os_gettime_ns() / 1000LL;
+	}
+}
+
 static void get_last_replay(void *data, calldata_t *cd)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -544,6 +695,11 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
+	if (!replay_store_init(&stream->store)) {
+		bfree(stream);
+		return NULL;
+	}
+
 	stream->hotkey = obs_hotkey_register_output(output,
 			"ReplayBuffer.Save",
 			obs_module_text("ReplayBuffer.Save"),
@@ -551,6 +707,8 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 
 	proc_handler_t *ph = obs_output_get_proc_handler(output);
 	proc_handler_add(ph, "void save()", save_replay_proc, stream);
+	proc_handler_add(ph, "void save_last(in int seconds)",
+			save_last_replay_proc, stream);
 	proc_handler_add(ph, "void get_last_replay(out string path)",
 			get_last_replay, stream);
 
@@ -562,6 +720,13 @@ static void replay_buffer_destroy(void *data)
 	struct ffmpeg_muxer *stream = data;
 	if (stream->hotkey)
 		obs_hotkey_unregister(stream->hotkey);
+
+	if (stream->mux_thread_joinable) {
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+
+	replay_store_free(&stream->store);
 	ffmpeg_mux_destroy(data);
 }
 
@@ -579,6 +744,16 @@ static bool replay_buffer_start(void *data)
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
 	obs_data_release(s);
 
+	/* the store is only cleared here rather than when the previous run
+	 * stopped, so a save still reading from it is never waited on from
+	 * the packet thread */
+	if (stream->mux_thread_joinable) {
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+
+	replay_store_clear(&stream->store);
+
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
 	stream->total_bytes = 0;
@@ -587,101 +762,20 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
-{
-	struct encoder_packet pkt;
-	bool keyframe;
-
-	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
-
-	if (keyframe)
-		stream->keyframes--;
-
-	if (!stream->packets.size) {
-		stream->cur_size = 0;
-		stream->cur_time = 0;
-	} else {
-		struct encoder_packet first;
-		circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
-	}
-
-	obs_encoder_packet_release(&pkt);
-	return keyframe;
-}
-
-static inline void purge(struct ffmpeg_muxer *stream)
-{
-	if (purge_front(stream)) {
-		struct encoder_packet pkt;
-
-		for (;;) {
-			circlebuf_peek_front(&stream->packets, &pkt,
-					sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
-
-			purge_front(stream);
-		}
-	}
-}
-
-static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
-		struct encoder_packet *pkt)
-{
-	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
-			return;
-
-		while ((stream->cur_size + (int64_t)pkt->size) >
-				stream->max_size)
-			purge(stream);
-	}
-
-	if (!stream->packets.size || stream->keyframes <= 2)
-		return;
-
-	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
-		purge(stream);
-}
-
-static void insert_packet(struct darray *array, struct encoder_packet *packet,
-		int64_t video_offset, int64_t *audio_offsets,
-		int64_t video_dts_offset, int64_t *audio_dts_offsets)
-{
-	struct encoder_packet pkt;
-	DARRAY(struct encoder_packet) packets;
-	packets.da = *array;
-	size_t idx;
-
-	obs_encoder_packet_ref(&pkt, packet);
-
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_dts_offset;
-		pkt.pts -= video_dts_offset;
-	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
-	}
-
-	for (idx = packets.num; idx > 0; idx--) {
-		struct encoder_packet *p = packets.array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
-			break;
-	}
-
-	da_insert(packets, idx, &pkt);
-	*array = packets.da;
-}
-
+/* packets are stored in the interleaved order they arrived in, so they're
+ * written straight from the file with only the timestamps shifted to start
+ * at zero */
 static void *replay_buffer_mux_thread(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
+	struct replay_reader reader = {0};
+	bool found_video = false;
+	bool found_audio[MAX_AUDIO_MIXES] = {0};
+	int64_t video_offset = 0;
+	int64_t video_dts_offset = 0;
+	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
+	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+	bool success = true;
 
 	start_pipe(stream, stream->path.array);
 
@@ -696,61 +790,72 @@ static void *replay_buffer_mux_thread(void *data)
 		goto error;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
-		obs_encoder_packet_release(pkt);
+	for (uint64_t seq = stream->mux_start; seq < stream->mux_end; seq++) {
+		struct encoder_packet pkt;
+
+		if (!replay_store_read(&stream->store, &reader, seq, &pkt)) {
+			warn("Failed to read packet from the replay buffer");
+			success = false;
+			break;
+		}
+
+		if (pkt.type == OBS_ENCODER_VIDEO) {
+			if (!found_video) {
+				video_offset = pkt.dts_usec;
+				video_dts_offset = pkt.dts;
+				found_video = true;
+			}
+
+			pkt.dts_usec -= video_offset;
+			pkt.dts -= video_dts_offset;
+			pkt.pts -= video_dts_offset;
+		} else {
+			size_t idx = pkt.track_idx;
+
+			if (!found_audio[idx]) {
+				found_audio[idx] = true;
+				audio_offsets[idx] = pkt.dts_usec;
+				audio_dts_offsets[idx] = pkt.dts;
+			}
+
+			pkt.dts_usec -= audio_offsets[idx];
+			pkt.dts -= audio_dts_offsets[idx];
+			pkt.pts -= audio_dts_offsets[idx];
+		}
+
+		if (!write_packet(stream, &pkt)) {
+			success = false;
+			break;
+		}
 	}
 
-	info("Wrote replay buffer to '%s'", stream->path.array);
+	if (success)
+		info("Wrote replay buffer to '%s'", stream->path.array);
+	else
+		warn("Replay buffer save to '%s' is incomplete",
+				stream->path.array);
 
 error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
-	da_free(stream->mux_packets);
+	replay_reader_free(&reader);
+	replay_store_unpin(&stream->store);
+	stop_pipe(stream);
 	os_atomic_set_bool(&stream->muxing, false);
 	return NULL;
 }
 
-static void replay_buffer_save(struct ffmpeg_muxer *stream)
+static void replay_buffer_save(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
+	replay_store_range(&stream->store, &stream->mux_start,
+			&stream->mux_end);
 
-	da_reserve(stream->mux_packets, num_packets);
+	if (stream->save_duration)
+		stream->mux_start = replay_store_find_keyframe(&stream->store,
+				packet->dts_usec - stream->save_duration);
 
-	/* ---------------------------- */
-	/* reorder packets */
-
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_dts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
-
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_offset = pkt->dts_usec;
-				video_dts_offset = pkt->dts;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
-		}
-
-		insert_packet(&stream->mux_packets.da, pkt,
-				video_offset, audio_offsets,
-				video_dts_offset, audio_dts_offsets);
-	}
+	/* no copy of the packets is made, the save only keeps them from
+	 * being purged until it has read them */
+	replay_store_pin(&stream->store, stream->mux_start);
 
 	/* ---------------------------- */
 	/* generate filename */
@@ -777,6 +882,11 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->muxing, true);
 	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
 			replay_buffer_mux_thread, stream) == 0;
+
+	if (!stream->mux_thread_joinable) {
+		replay_store_unpin(&stream->store);
+		os_atomic_set_bool(&stream->muxing, false);
+	}
 }
 
 static void deactivate_replay_buffer(struct ffmpeg_muxer *stream)
@@ -787,13 +897,12 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->active, false);
 	os_atomic_set_bool(&stream->sent_headers, false);
 	os_atomic_set_bool(&stream->stopping, false);
-	replay_buffer_clear(stream);
+	stream->save_ts = 0;
 }
 
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
-	struct encoder_packet pkt;
 
 	if (!active(stream))
 		return;
@@ -805,17 +914,11 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
-
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
+	replay_store_purge(&stream->store, stream->max_size, stream->max_time,
+			packet);
 
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
-
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
-		stream->keyframes++;
+	if (!replay_store_push(&stream->store, packet))
+		return;
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
 		if (os_atomic_load_bool(&stream->muxing))
@@ -827,7 +930,7 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 
 		stream->save_ts = 0;
-		replay_buffer_save(stream);
+		replay_buffer_save(stream, packet);
 	}
 }
 
@@ -838,6 +941,8 @@ static void replay_buffer_defaults(obs_data_t *s)
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
+	obs_data_set_default_bool(s, "shared_memory", true);
+	ffmpeg_mux_io_defaults(s);
 }
 
 struct obs_output_info replay_buffer = {
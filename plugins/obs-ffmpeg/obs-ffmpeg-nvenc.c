@@ -232,6 +232,28 @@ static bool nvenc_update(void *data, obs_data_t *settings)
 	return nvenc_init_codec(enc);
 }
 
+/* only the bitrate can change once the codec is open.  libavcodec's nvenc
+ * picks up the new rate on the next frame when the driver supports dynamic
+ * bitrate, otherwise the change is ignored */
+static bool nvenc_reconfigure(void *data, obs_data_t *settings)
+{
+	struct nvenc_encoder *enc = data;
+
+	const char *rc = obs_data_get_string(settings, "rate_control");
+	int64_t bitrate = obs_data_get_int(settings, "bitrate");
+
+	if (astrcmpi(rc, "cqp") == 0 || astrcmpi(rc, "lossless") == 0)
+		return true;
+
+	if (astrcmpi(rc, "vbr") != 0) {
+		enc->context->rc_max_rate = bitrate * 1000;
+		enc->context->rc_min_rate = bitrate * 1000;
+	}
+
+	enc->context->bit_rate = bitrate * 1000;
+	return true;
+}
+
 static void nvenc_destroy(void *data)
 {
 	struct nvenc_encoder *enc = data;
@@ -539,10 +561,12 @@ struct obs_encoder_info nvenc_encoder_info = {
 	.id             = "ffmpeg_nvenc",
 	.type           = OBS_ENCODER_VIDEO,
 	.codec          = "h264",
+	.caps           = OBS_ENCODER_CAP_DYN_BITRATE,
 	.get_name       = nvenc_getname,
 	.create         = nvenc_create,
 	.destroy        = nvenc_destroy,
 	.encode         = nvenc_encode,
+	.update         = nvenc_reconfigure,
 	.get_defaults   = nvenc_defaults,
 	.get_properties = nvenc_properties,
 	.get_extra_data = nvenc_extra_data,
@@ -21,6 +21,7 @@
 #include <util/dstr.h>
 #include <util/darray.h>
 #include <util/platform.h>
+#include <media-io/video-frame.h>
 
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
@@ -30,6 +31,8 @@
 #include "obs-ffmpeg-formats.h"
 #include "closest-pixel-format.h"
 #include "obs-ffmpeg-compat.h"
+#include "obs-ffmpeg-fragment.h"
+#include "ffmpeg-mux/ffmpeg-mux-io.h"
 
 struct ffmpeg_cfg {
 	const char         *url;
@@ -52,6 +55,10 @@ struct ffmpeg_cfg {
 	int                scale_height;
 	int                width;
 	int                height;
+
+	bool               write_behind;
+	struct ffm_io_params io_params;
+	struct ffm_io_stats  *io_stats;
 };
 
 struct ffmpeg_data {
@@ -61,6 +68,7 @@ struct ffmpeg_data {
 	AVCodec            *vcodec;
 	AVFormatContext    *output;
 	struct SwsContext  *swscale;
+	struct ffm_io      *io;
 
 	int64_t            total_frames;
 	AVFrame            *vframe;
@@ -82,6 +90,15 @@ struct ffmpeg_data {
 	bool               initialized;
 };
 
+/* frames waiting for the video encode thread.  when it falls further behind
+ * than this, new frames are dropped instead of holding up the video thread */
+#define VIDEO_QUEUE_FRAMES 8
+
+struct video_queue_frame {
+	struct video_frame frame;
+	int64_t            pts;
+};
+
 struct ffmpeg_output {
 	obs_output_t       *output;
 	volatile bool      active;
@@ -91,6 +108,7 @@ struct ffmpeg_output {
 	pthread_t          start_thread;
 
 	uint64_t           total_bytes;
+	struct ffm_io_stats io_stats;
 
 	uint64_t           audio_start_ts;
 	uint64_t           video_start_ts;
@@ -104,6 +122,26 @@ struct ffmpeg_output {
 	os_event_t         *stop_event;
 
 	DARRAY(AVPacket)   packets;
+
+	/* encoding runs on its own threads, the video and audio callbacks
+	 * only copy the data in */
+	bool               encode_threads_active;
+	volatile bool      encode_stop;
+
+	pthread_mutex_t    video_mutex;
+	pthread_t          video_thread;
+	os_sem_t           *video_sem;
+	struct video_queue_frame video_queue[VIDEO_QUEUE_FRAMES];
+	size_t             video_queue_head;
+	size_t             video_queue_count;
+	enum video_format  video_format;
+	uint32_t           video_height;
+	bool               last_frame_dropped;
+	volatile long      dropped_frames;
+
+	pthread_mutex_t    audio_mutex;
+	pthread_t          audio_thread;
+	os_sem_t           *audio_sem;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -397,7 +435,31 @@ static inline bool open_output_file(struct ffmpeg_data *data)
 		dstr_free(&str);
 	}
 
-	if ((format->flags & AVFMT_NOFILE) == 0) {
+	/* only plain files go through the write-behind buffers */
+	if ((format->flags & AVFMT_NOFILE) == 0 && data->config.write_behind &&
+	    !strstr(data->config.url, "://")) {
+		data->io = bzalloc(sizeof(struct ffm_io));
+
+		if (!ffm_io_open(data->io, data->config.url,
+					&data->config.io_params,
+					data->config.io_stats)) {
+			blog(LOG_WARNING, "Couldn't open '%s'",
+					data->config.url);
+			bfree(data->io);
+			data->io = NULL;
+			av_dict_free(&dict);
+			return false;
+		}
+
+		if (!ffm_io_attach(data->io, data->output)) {
+			ffm_io_close(data->io);
+			bfree(data->io);
+			data->io = NULL;
+			av_dict_free(&dict);
+			return false;
+		}
+
+	} else if ((format->flags & AVFMT_NOFILE) == 0) {
 		ret = avio_open2(&data->output->pb, data->config.url,
 				AVIO_FLAG_WRITE, NULL, &dict);
 		if (ret < 0) {
@@ -460,6 +522,18 @@ static void close_audio(struct ffmpeg_data *data)
 	av_frame_free(&data->aframe);
 }
 
+static void log_io_stats(const struct ffm_io_stats *io)
+{
+	if (!io || !io->writes)
+		return;
+
+	blog(LOG_INFO, "Write-behind: %u writes, peak queue depth %u, max "
+	               "write latency %u ms, %u stalls, %u syncs",
+	               io->writes, io->peak_queue_depth,
+	               io->max_write_latency_us / 1000, io->stalls,
+	               io->syncs);
+}
+
 static void ffmpeg_data_free(struct ffmpeg_data *data)
 {
 	if (data->initialized)
@@ -471,8 +545,18 @@ static void ffmpeg_data_free(struct ffmpeg_data *data)
 		close_audio(data);
 
 	if (data->output) {
-		if ((data->output->oformat->flags & AVFMT_NOFILE) == 0)
+		if (data->io) {
+			ffm_io_detach(data->output);
+			if (!ffm_io_close(data->io))
+				blog(LOG_WARNING, "Failed to write '%s'",
+						data->config.url);
+			bfree(data->io);
+
+			log_io_stats(data->config.io_stats);
+
+		} else if ((data->output->oformat->flags & AVFMT_NOFILE) == 0) {
 			avio_close(data->output->pb);
+		}
 
 		avformat_free_context(data->output);
 	}
@@ -606,14 +690,24 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_output *data = bzalloc(sizeof(struct ffmpeg_output));
 	pthread_mutex_init_value(&data->write_mutex);
+	pthread_mutex_init_value(&data->video_mutex);
+	pthread_mutex_init_value(&data->audio_mutex);
 	data->output = output;
 
 	if (pthread_mutex_init(&data->write_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->video_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&data->audio_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_AUTO) != 0)
 		goto fail;
 	if (os_sem_init(&data->write_sem, 0) != 0)
 		goto fail;
+	if (os_sem_init(&data->video_sem, 0) != 0)
+		goto fail;
+	if (os_sem_init(&data->audio_sem, 0) != 0)
+		goto fail;
 
 	av_log_set_callback(ffmpeg_log_callback);
 
@@ -622,7 +716,12 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 
 fail:
 	pthread_mutex_destroy(&data->write_mutex);
+	pthread_mutex_destroy(&data->video_mutex);
+	pthread_mutex_destroy(&data->audio_mutex);
 	os_event_destroy(data->stop_event);
+	os_sem_destroy(data->write_sem);
+	os_sem_destroy(data->video_sem);
+	os_sem_destroy(data->audio_sem);
 	bfree(data);
 	return NULL;
 }
@@ -641,13 +740,17 @@ static void ffmpeg_output_destroy(void *data)
 		ffmpeg_output_full_stop(output);
 
 		pthread_mutex_destroy(&output->write_mutex);
+		pthread_mutex_destroy(&output->video_mutex);
+		pthread_mutex_destroy(&output->audio_mutex);
 		os_sem_destroy(output->write_sem);
+		os_sem_destroy(output->video_sem);
+		os_sem_destroy(output->audio_sem);
 		os_event_destroy(output->stop_event);
 		bfree(data);
 	}
 }
 
-static inline void copy_data(AVFrame *pic, const struct video_data *frame,
+static inline void copy_data(AVFrame *pic, const struct video_frame *frame,
 		int height, enum AVPixelFormat format)
 {
 	int h_chroma_shift, v_chroma_shift;
@@ -673,14 +776,10 @@ static inline void copy_data(AVFrame *pic, const struct video_data *frame,
 	}
 }
 
-static void receive_video(void *param, struct video_data *frame)
+static void encode_video(struct ffmpeg_output *output,
+		const struct video_frame *frame, int64_t pts)
 {
-	struct ffmpeg_output *output = param;
-	struct ffmpeg_data   *data   = &output->ff_data;
-
-	// codec doesn't support video or none configured
-	if (!data->video)
-		return;
+	struct ffmpeg_data *data = &output->ff_data;
 
 	AVCodecContext *context = data->video->codec;
 	AVPacket packet = {0};
@@ -688,11 +787,6 @@ static void receive_video(void *param, struct video_data *frame)
 
 	av_init_packet(&packet);
 
-	if (!output->video_start_ts)
-		output->video_start_ts = frame->timestamp;
-	if (!data->start_timestamp)
-		data->start_timestamp = frame->timestamp;
-
 	if (!!data->swscale)
 		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
 				(const int*)frame->linesize,
@@ -714,7 +808,7 @@ static void receive_video(void *param, struct video_data *frame)
 
 	} else {
 #endif
-		data->vframe->pts = data->total_frames;
+		data->vframe->pts = pts;
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
 		ret = avcodec_send_frame(context, data->vframe);
 		if (ret == 0)
@@ -729,7 +823,7 @@ static void receive_video(void *param, struct video_data *frame)
 				&got_packet);
 #endif
 		if (ret < 0) {
-			blog(LOG_WARNING, "receive_video: Error encoding "
+			blog(LOG_WARNING, "encode_video: Error encoding "
 			                  "video: %s", av_err2str(ret));
 			return;
 		}
@@ -754,11 +848,98 @@ static void receive_video(void *param, struct video_data *frame)
 	}
 #endif
 	if (ret != 0) {
-		blog(LOG_WARNING, "receive_video: Error writing video: %s",
+		blog(LOG_WARNING, "encode_video: Error writing video: %s",
 				av_err2str(ret));
 	}
+}
+
+static void *video_encode_thread(void *param)
+{
+	struct ffmpeg_output *output = param;
+
+	os_set_thread_name("ffmpeg-output: video encode thread");
+
+	while (os_sem_wait(output->video_sem) == 0) {
+		struct video_queue_frame *queued;
+
+		pthread_mutex_lock(&output->video_mutex);
+		queued = output->video_queue_count ?
+			&output->video_queue[output->video_queue_head] : NULL;
+		pthread_mutex_unlock(&output->video_mutex);
+
+		/* frames queued before the stop are still encoded */
+		if (!queued) {
+			if (os_atomic_load_bool(&output->encode_stop))
+				break;
+			continue;
+		}
+
+		/* the slot stays counted until it's encoded, so the video
+		 * thread can't write over it in the meantime */
+		encode_video(output, &queued->frame, queued->pts);
+
+		pthread_mutex_lock(&output->video_mutex);
+		output->video_queue_head =
+			(output->video_queue_head + 1) % VIDEO_QUEUE_FRAMES;
+		output->video_queue_count--;
+		pthread_mutex_unlock(&output->video_mutex);
+	}
+
+	return NULL;
+}
+
+static void receive_video(void *param, struct video_data *frame)
+{
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+	struct video_queue_frame *queued = NULL;
+	struct video_frame src;
+
+	// codec doesn't support video or none configured
+	if (!data->video)
+		return;
+
+	if (!output->video_start_ts)
+		output->video_start_ts = frame->timestamp;
+	if (!data->start_timestamp)
+		data->start_timestamp = frame->timestamp;
+
+	/* identical to the last encoded frame, only advance the pts */
+	if (frame->duplicate && data->total_frames &&
+	    !output->last_frame_dropped) {
+		data->total_frames++;
+		return;
+	}
+
+	pthread_mutex_lock(&output->video_mutex);
+	if (output->video_queue_count < VIDEO_QUEUE_FRAMES) {
+		size_t idx = (output->video_queue_head +
+				output->video_queue_count) % VIDEO_QUEUE_FRAMES;
+		queued = &output->video_queue[idx];
+	}
+	pthread_mutex_unlock(&output->video_mutex);
+
+	/* the encoder has fallen behind.  the pts still advances so the
+	 * frame shows up as a gap instead of throwing off audio sync */
+	if (!queued) {
+		os_atomic_inc_long(&output->dropped_frames);
+		output->last_frame_dropped = true;
+		data->total_frames++;
+		return;
+	}
 
-	data->total_frames++;
+	memcpy(src.data, frame->data, sizeof(src.data));
+	memcpy(src.linesize, frame->linesize, sizeof(src.linesize));
+	video_frame_copy(&queued->frame, &src, output->video_format,
+			output->video_height);
+	queued->pts = data->total_frames++;
+	output->last_frame_dropped = false;
+
+	pthread_mutex_lock(&output->video_mutex);
+	output->video_queue_count++;
+	pthread_mutex_unlock(&output->video_mutex);
+
+	os_sem_post(output->video_sem);
 }
 
 static void encode_audio(struct ffmpeg_output *output,
@@ -848,19 +1029,82 @@ static bool prepare_audio(struct ffmpeg_data *data,
 	return true;
 }
 
+/* the last partial frame is padded out with silence */
+static void encode_remaining_audio(struct ffmpeg_output *output,
+		AVCodecContext *context)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+	size_t frame_size_bytes = (size_t)data->frame_size * data->audio_size;
+	size_t remaining;
+
+	pthread_mutex_lock(&output->audio_mutex);
+	remaining = data->excess_frames[0].size;
+	if (remaining) {
+		for (size_t i = 0; i < data->audio_planes; i++) {
+			circlebuf_pop_front(&data->excess_frames[i],
+					data->samples[i], remaining);
+			memset(data->samples[i] + remaining, 0,
+					frame_size_bytes - remaining);
+		}
+	}
+	pthread_mutex_unlock(&output->audio_mutex);
+
+	if (remaining)
+		encode_audio(output, context, data->audio_size);
+}
+
+/* audio is never dropped, the pts comes from the sample count */
+static void *audio_encode_thread(void *param)
+{
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+	AVCodecContext *context = data->audio->codec;
+	size_t frame_size_bytes = (size_t)data->frame_size * data->audio_size;
+
+	os_set_thread_name("ffmpeg-output: audio encode thread");
+
+	while (os_sem_wait(output->audio_sem) == 0) {
+		bool stop = os_atomic_load_bool(&output->encode_stop);
+
+		for (;;) {
+			bool ready;
+
+			pthread_mutex_lock(&output->audio_mutex);
+			ready = data->excess_frames[0].size >= frame_size_bytes;
+			if (ready) {
+				for (size_t i = 0; i < data->audio_planes; i++)
+					circlebuf_pop_front(
+						&data->excess_frames[i],
+						data->samples[i],
+						frame_size_bytes);
+			}
+			pthread_mutex_unlock(&output->audio_mutex);
+
+			if (!ready)
+				break;
+
+			encode_audio(output, context, data->audio_size);
+		}
+
+		if (stop) {
+			encode_remaining_audio(output, context);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
 static void receive_audio(void *param, struct audio_data *frame)
 {
 	struct ffmpeg_output *output = param;
 	struct ffmpeg_data   *data   = &output->ff_data;
-	size_t frame_size_bytes;
 	struct audio_data in;
 
 	// codec doesn't support audio or none configured
 	if (!data->audio)
 		return;
 
-	AVCodecContext *context = data->audio->codec;
-
 	if (!data->start_timestamp)
 		return;
 	if (!prepare_audio(data, frame, &in))
@@ -869,19 +1113,13 @@ static void receive_audio(void *param, struct audio_data *frame)
 	if (!output->audio_start_ts)
 		output->audio_start_ts = in.timestamp;
 
-	frame_size_bytes = (size_t)data->frame_size * data->audio_size;
-
+	pthread_mutex_lock(&output->audio_mutex);
 	for (size_t i = 0; i < data->audio_planes; i++)
 		circlebuf_push_back(&data->excess_frames[i], in.data[i],
 				in.frames * data->audio_size);
+	pthread_mutex_unlock(&output->audio_mutex);
 
-	while (data->excess_frames[0].size >= frame_size_bytes) {
-		for (size_t i = 0; i < data->audio_planes; i++)
-			circlebuf_pop_front(&data->excess_frames[i],
-					data->samples[i], frame_size_bytes);
-
-		encode_audio(output, context, data->audio_size);
-	}
+	os_sem_post(output->audio_sem);
 }
 
 static uint64_t get_packet_sys_dts(struct ffmpeg_output *output,
@@ -989,11 +1227,167 @@ static inline const char *get_string_or_null(obs_data_t *settings,
 	return value;
 }
 
+static bool start_encode_threads(struct ffmpeg_output *output,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	os_atomic_set_bool(&output->encode_stop, false);
+
+	if (data->video) {
+		output->video_format = format;
+		output->video_height = height;
+		output->video_queue_head = 0;
+		output->video_queue_count = 0;
+		output->last_frame_dropped = false;
+
+		for (size_t i = 0; i < VIDEO_QUEUE_FRAMES; i++)
+			video_frame_init(&output->video_queue[i].frame,
+					format, width, height);
+
+		if (pthread_create(&output->video_thread, NULL,
+					video_encode_thread, output) != 0)
+			return false;
+	}
+
+	if (data->audio) {
+		if (pthread_create(&output->audio_thread, NULL,
+					audio_encode_thread, output) != 0) {
+			if (data->video) {
+				os_atomic_set_bool(&output->encode_stop, true);
+				os_sem_post(output->video_sem);
+				pthread_join(output->video_thread, NULL);
+			}
+			return false;
+		}
+	}
+
+	output->encode_threads_active = true;
+	return true;
+}
+
+/* the encode threads finish whatever was queued before they exit */
+static void stop_encode_threads(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	if (output->encode_threads_active) {
+		long dropped = os_atomic_load_long(&output->dropped_frames);
+
+		os_atomic_set_bool(&output->encode_stop, true);
+
+		if (data->video) {
+			os_sem_post(output->video_sem);
+			pthread_join(output->video_thread, NULL);
+		}
+		if (data->audio) {
+			os_sem_post(output->audio_sem);
+			pthread_join(output->audio_thread, NULL);
+		}
+
+		output->encode_threads_active = false;
+
+		if (dropped)
+			blog(LOG_INFO, "ffmpeg_output: %ld video frame(s) "
+			               "dropped because the encoder fell behind",
+			               dropped);
+	}
+
+	for (size_t i = 0; i < VIDEO_QUEUE_FRAMES; i++)
+		video_frame_free(&output->video_queue[i].frame);
+	output->video_queue_count = 0;
+}
+
+/* codecs that buffer frames (b-frames, lookahead) still hold packets once
+ * the encode threads have stopped */
+static void flush_encoder(struct ffmpeg_output *output, AVStream *stream)
+{
+	AVCodecContext *context = stream->codec;
+	int got_packet = 1;
+
+	if ((context->codec->capabilities & CODEC_CAP_DELAY) == 0)
+		return;
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
+	if (avcodec_send_frame(context, NULL) < 0)
+		return;
+#endif
+
+	while (got_packet) {
+		AVPacket packet = {0};
+		int ret;
+
+		av_init_packet(&packet);
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
+		ret = avcodec_receive_packet(context, &packet);
+		got_packet = (ret == 0);
+#else
+		if (context->codec_type == AVMEDIA_TYPE_VIDEO)
+			ret = avcodec_encode_video2(context, &packet, NULL,
+					&got_packet);
+		else
+			ret = avcodec_encode_audio2(context, &packet, NULL,
+					&got_packet);
+		if (ret < 0)
+			got_packet = 0;
+#endif
+		if (!got_packet)
+			break;
+
+		packet.pts = rescale_ts(packet.pts, context, stream->time_base);
+		packet.dts = rescale_ts(packet.dts, context, stream->time_base);
+		packet.duration = (int)av_rescale_q(packet.duration,
+				context->time_base, stream->time_base);
+		packet.stream_index = stream->index;
+
+		pthread_mutex_lock(&output->write_mutex);
+		da_push_back(output->packets, &packet);
+		pthread_mutex_unlock(&output->write_mutex);
+	}
+}
+
+/* writes what the write thread didn't get to before it exited, up to the
+ * stop timestamp */
+static void write_remaining_packets(struct ffmpeg_output *output)
+{
+	bool failed = false;
+
+	pthread_mutex_lock(&output->write_mutex);
+
+	for (size_t i = 0; i < output->packets.num; i++) {
+		AVPacket *packet = output->packets.array + i;
+
+		if (failed || (stopping(output) &&
+		    get_packet_sys_dts(output, packet) >= output->stop_ts)) {
+			av_free_packet(packet);
+			continue;
+		}
+
+		output->total_bytes += packet->size;
+
+		int ret = av_interleaved_write_frame(output->ff_data.output,
+				packet);
+		if (ret < 0) {
+			av_free_packet(packet);
+			blog(LOG_WARNING, "write_remaining_packets: Error "
+			                  "writing packet: %s",
+			                  av_err2str(ret));
+			failed = true;
+		}
+	}
+
+	output->packets.num = 0;
+
+	pthread_mutex_unlock(&output->write_mutex);
+}
+
 static bool try_connect(struct ffmpeg_output *output)
 {
 	video_t *video = obs_output_video(output->output);
 	const struct video_output_info *voi = video_output_get_info(video);
 	struct ffmpeg_cfg config;
+	struct dstr muxer_settings = {0};
 	obs_data_t *settings;
 	bool success;
 	int ret;
@@ -1001,12 +1395,22 @@ static bool try_connect(struct ffmpeg_output *output)
 	settings = obs_output_get_settings(output->output);
 
 	obs_data_set_default_int(settings, "gop_size", 120);
+	obs_data_set_default_int(settings, "fragment_duration_ms",
+			FRAGMENT_DEFAULT_DURATION_MS);
+	obs_data_set_default_bool(settings, "write_behind", true);
+	obs_data_set_default_int(settings, "io_buffer_kb",
+			FFM_IO_DEFAULT_BUFFER_KB);
+	obs_data_set_default_int(settings, "io_buffers",
+			FFM_IO_DEFAULT_BUFFERS);
+	obs_data_set_default_int(settings, "io_prealloc_mb",
+			FFM_IO_DEFAULT_PREALLOC_MB);
 
 	config.url = obs_data_get_string(settings, "url");
 	config.format_name = get_string_or_null(settings, "format_name");
 	config.format_mime_type = get_string_or_null(settings,
 			"format_mime_type");
-	config.muxer_settings = obs_data_get_string(settings, "muxer_settings");
+	dstr_copy(&muxer_settings,
+			obs_data_get_string(settings, "muxer_settings"));
 	config.video_bitrate = (int)obs_data_get_int(settings, "video_bitrate");
 	config.audio_bitrate = (int)obs_data_get_int(settings, "audio_bitrate");
 	config.gop_size = (int)obs_data_get_int(settings, "gop_size");
@@ -1025,6 +1429,19 @@ static bool try_connect(struct ffmpeg_output *output)
 	config.format = obs_to_ffmpeg_video_format(
 			video_output_get_format(video));
 
+	config.write_behind = obs_data_get_bool(settings, "write_behind");
+	config.io_params.buffer_size = (size_t)obs_data_get_int(settings,
+			"io_buffer_kb") * 1024;
+	config.io_params.num_buffers = (int)obs_data_get_int(settings,
+			"io_buffers");
+	config.io_params.prealloc = obs_data_get_int(settings,
+			"io_prealloc_mb") * 1024 * 1024;
+	config.io_params.direct = obs_data_get_bool(settings, "direct_io");
+	config.io_params.sync_interval_ms = (int)obs_data_get_int(settings,
+			"io_sync_interval_ms");
+	config.io_stats = &output->io_stats;
+	memset(&output->io_stats, 0, sizeof(output->io_stats));
+
 	if (format_is_yuv(voi->format)) {
 		config.color_range = voi->range == VIDEO_RANGE_FULL ?
 			AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
@@ -1037,9 +1454,19 @@ static bool try_connect(struct ffmpeg_output *output)
 
 	if (config.format == AV_PIX_FMT_NONE) {
 		blog(LOG_DEBUG, "invalid pixel format used for FFmpeg output");
+		dstr_free(&muxer_settings);
 		return false;
 	}
 
+	if (obs_data_get_bool(settings, "fragmented") &&
+	    ffmpeg_fragment_supported(config.format_name, config.url))
+		ffmpeg_fragment_muxer_settings(&muxer_settings,
+				(int)obs_data_get_int(settings,
+					"fragment_duration_ms"));
+
+	config.muxer_settings = muxer_settings.array ?
+		muxer_settings.array : "";
+
 	if (!config.scale_width)
 		config.scale_width = config.width;
 	if (!config.scale_height)
@@ -1047,6 +1474,7 @@ static bool try_connect(struct ffmpeg_output *output)
 
 	success = ffmpeg_data_init(&output->ff_data, &config);
 	obs_data_release(settings);
+	dstr_free(&muxer_settings);
 
 	if (!success)
 		return false;
@@ -1068,10 +1496,19 @@ static bool try_connect(struct ffmpeg_output *output)
 		return false;
 	}
 
+	output->write_thread_active = true;
+
+	if (!start_encode_threads(output, video_output_get_format(video),
+				(uint32_t)config.width, (uint32_t)config.height)) {
+		blog(LOG_WARNING, "ffmpeg_output_start: failed to create "
+		                  "encode threads.");
+		ffmpeg_output_full_stop(output);
+		return false;
+	}
+
 	obs_output_set_video_conversion(output->output, NULL);
 	obs_output_set_audio_conversion(output->output, &aci);
 	obs_output_begin_data_capture(output->output, 0);
-	output->write_thread_active = true;
 	return true;
 }
 
@@ -1099,6 +1536,7 @@ static bool ffmpeg_output_start(void *data)
 	output->audio_start_ts = 0;
 	output->video_start_ts = 0;
 	output->total_bytes = 0;
+	output->dropped_frames = 0;
 
 	ret = pthread_create(&output->start_thread, NULL, start_thread, output);
 	return (output->connecting = (ret == 0));
@@ -1130,6 +1568,20 @@ static void ffmpeg_output_stop(void *data, uint64_t ts)
 
 static void ffmpeg_deactivate(struct ffmpeg_output *output)
 {
+	struct ffmpeg_data *data = &output->ff_data;
+
+	/* the write thread has already given up on the file if it failed */
+	bool drain = output->write_thread_active && data->initialized;
+
+	stop_encode_threads(output);
+
+	if (drain) {
+		if (data->video)
+			flush_encoder(output, data->video);
+		if (data->audio)
+			flush_encoder(output, data->audio);
+	}
+
 	if (output->write_thread_active) {
 		os_event_signal(output->stop_event);
 		os_sem_post(output->write_sem);
@@ -1137,6 +1589,9 @@ static void ffmpeg_deactivate(struct ffmpeg_output *output)
 		output->write_thread_active = false;
 	}
 
+	if (drain)
+		write_remaining_packets(output);
+
 	pthread_mutex_lock(&output->write_mutex);
 
 	for (size_t i = 0; i < output->packets.num; i++)
@@ -1154,6 +1609,24 @@ static uint64_t ffmpeg_output_total_bytes(void *data)
 	return output->total_bytes;
 }
 
+static int ffmpeg_output_dropped_frames(void *data)
+{
+	struct ffmpeg_output *output = data;
+	return (int)os_atomic_load_long(&output->dropped_frames);
+}
+
+static int ffmpeg_output_io_queue_depth(void *data)
+{
+	struct ffmpeg_output *output = data;
+	return (int)output->io_stats.queue_depth;
+}
+
+static int ffmpeg_output_io_write_latency(void *data)
+{
+	struct ffmpeg_output *output = data;
+	return (int)output->io_stats.write_latency_us;
+}
+
 struct obs_output_info ffmpeg_output = {
 	.id        = "ffmpeg_output",
 	.flags     = OBS_OUTPUT_AUDIO | OBS_OUTPUT_VIDEO,
@@ -1165,4 +1638,7 @@ struct obs_output_info ffmpeg_output = {
 	.raw_video = receive_video,
 	.raw_audio = receive_audio,
 	.get_total_bytes = ffmpeg_output_total_bytes,
+	.get_dropped_frames = ffmpeg_output_dropped_frames,
+	.get_io_queue_depth      = ffmpeg_output_io_queue_depth,
+	.get_io_write_latency_us = ffmpeg_output_io_write_latency,
 };
@@ -0,0 +1,354 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-ffmpeg-replay.h"
+
+#define CHUNK_SIZE (32 * 1024 * 1024)
+#define NO_CHUNK   0xFFFFFFFF
+
+#define entry_at(rs, seq) \
+	((struct replay_entry*)circlebuf_data(&(rs)->entries, \
+		(size_t)((seq) - (rs)->first_seq) * \
+		sizeof(struct replay_entry)))
+#define keyframe_at(rs, idx) \
+	(*(uint64_t*)circlebuf_data(&(rs)->keyframes, \
+		(idx) * sizeof(uint64_t)))
+
+static inline size_t num_entries(struct replay_store *rs)
+{
+	return rs->entries.size / sizeof(struct replay_entry);
+}
+
+static inline size_t num_keyframes(struct replay_store *rs)
+{
+	return rs->keyframes.size / sizeof(uint64_t);
+}
+
+static inline uint64_t chunk_offset(uint32_t chunk)
+{
+	return (uint64_t)chunk * CHUNK_SIZE;
+}
+
+bool replay_store_init(struct replay_store *rs)
+{
+	memset(rs, 0, sizeof(*rs));
+	rs->write_chunk = NO_CHUNK;
+	return pthread_mutex_init(&rs->mutex, NULL) == 0;
+}
+
+static void reset(struct replay_store *rs)
+{
+	os_mapped_file_unmap(rs->write_view, CHUNK_SIZE);
+	os_mapped_file_destroy(rs->file);
+
+	circlebuf_free(&rs->entries);
+	circlebuf_free(&rs->keyframes);
+	da_free(rs->chunks);
+	da_free(rs->free_chunks);
+
+	rs->file        = NULL;
+	rs->file_failed = false;
+	rs->first_seq   = 0;
+	rs->write_chunk = NO_CHUNK;
+	rs->write_pos   = 0;
+	rs->write_view  = NULL;
+	rs->cur_size    = 0;
+	rs->pinned      = false;
+}
+
+void replay_store_free(struct replay_store *rs)
+{
+	reset(rs);
+	pthread_mutex_destroy(&rs->mutex);
+}
+
+void replay_store_clear(struct replay_store *rs)
+{
+	pthread_mutex_lock(&rs->mutex);
+	reset(rs);
+	pthread_mutex_unlock(&rs->mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool next_write_chunk(struct replay_store *rs)
+{
+	uint32_t chunk;
+
+	if (rs->write_view) {
+		os_mapped_file_unmap(rs->write_view, CHUNK_SIZE);
+		rs->write_view = NULL;
+
+		if (!rs->chunks.array[rs->write_chunk].live)
+			da_push_back(rs->free_chunks, &rs->write_chunk);
+		rs->write_chunk = NO_CHUNK;
+	}
+
+	if (rs->free_chunks.num) {
+		chunk = rs->free_chunks.array[rs->free_chunks.num - 1];
+		da_pop_back(rs->free_chunks);
+	} else {
+		struct replay_chunk new_chunk = {0};
+
+		chunk = (uint32_t)rs->chunks.num;
+		if (!os_mapped_file_resize(rs->file, chunk_offset(chunk + 1)))
+			return false;
+
+		da_push_back(rs->chunks, &new_chunk);
+	}
+
+	rs->write_view = os_mapped_file_map(rs->file, chunk_offset(chunk),
+			CHUNK_SIZE);
+	if (!rs->write_view) {
+		da_push_back(rs->free_chunks, &chunk);
+		return false;
+	}
+
+	rs->write_chunk = chunk;
+	rs->write_pos = 0;
+	return true;
+}
+
+bool replay_store_push(struct replay_store *rs,
+		const struct encoder_packet *packet)
+{
+	struct replay_entry entry = {
+		.pts          = packet->pts,
+		.dts          = packet->dts,
+		.dts_usec     = packet->dts_usec,
+		.timebase_num = packet->timebase_num,
+		.timebase_den = packet->timebase_den,
+		.size         = (uint32_t)packet->size,
+		.type         = (uint8_t)packet->type,
+		.track_idx    = (uint8_t)packet->track_idx,
+		.keyframe     = packet->keyframe
+	};
+	bool success = false;
+
+	if (packet->size > CHUNK_SIZE)
+		return false;
+
+	pthread_mutex_lock(&rs->mutex);
+
+	if (!rs->file) {
+		if (rs->file_failed)
+			goto unlock;
+
+		rs->file = os_mapped_file_create_temp();
+		if (!rs->file) {
+			blog(LOG_WARNING, "replay_store_push: Could not create "
+			                  "the replay buffer file");
+			rs->file_failed = true;
+			goto unlock;
+		}
+	}
+
+	if (!rs->write_view || rs->write_pos + packet->size > CHUNK_SIZE) {
+		if (!next_write_chunk(rs))
+			goto unlock;
+	}
+
+	memcpy(rs->write_view + rs->write_pos, packet->data, packet->size);
+	entry.chunk  = rs->write_chunk;
+	entry.offset = rs->write_pos;
+
+	rs->write_pos += (uint32_t)packet->size;
+	rs->chunks.array[rs->write_chunk].live++;
+	rs->cur_size += (int64_t)packet->size;
+
+	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe) {
+		uint64_t seq = rs->first_seq + num_entries(rs);
+		circlebuf_push_back(&rs->keyframes, &seq, sizeof(seq));
+	}
+
+	circlebuf_push_back(&rs->entries, &entry, sizeof(entry));
+	success = true;
+
+unlock:
+	pthread_mutex_unlock(&rs->mutex);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void pop_front(struct replay_store *rs)
+{
+	struct replay_entry entry;
+	struct replay_chunk *chunk;
+
+	circlebuf_pop_front(&rs->entries, &entry, sizeof(entry));
+
+	if (num_keyframes(rs) && keyframe_at(rs, 0) == rs->first_seq)
+		circlebuf_pop_front(&rs->keyframes, NULL, sizeof(uint64_t));
+
+	rs->first_seq++;
+	rs->cur_size -= (int64_t)entry.size;
+
+	chunk = rs->chunks.array + entry.chunk;
+	if (--chunk->live == 0 && entry.chunk != rs->write_chunk)
+		da_push_back(rs->free_chunks, &entry.chunk);
+}
+
+/* drops everything up to the next keyframe after the front */
+static bool purge_gop(struct replay_store *rs)
+{
+	size_t idx = 0;
+	uint64_t next;
+
+	if (num_keyframes(rs) <= 2)
+		return false;
+
+	if (keyframe_at(rs, 0) == rs->first_seq)
+		idx = 1;
+
+	next = keyframe_at(rs, idx);
+	if (rs->pinned && next > rs->pin_seq)
+		return false;
+
+	while (rs->first_seq < next)
+		pop_front(rs);
+	return true;
+}
+
+void replay_store_purge(struct replay_store *rs, int64_t max_size,
+		int64_t max_time, const struct encoder_packet *incoming)
+{
+	pthread_mutex_lock(&rs->mutex);
+
+	if (max_size) {
+		while (rs->cur_size + (int64_t)incoming->size > max_size) {
+			if (!purge_gop(rs))
+				break;
+		}
+	}
+
+	while (num_entries(rs) &&
+	       incoming->dts_usec - entry_at(rs, rs->first_seq)->dts_usec >
+	       max_time) {
+		if (!purge_gop(rs))
+			break;
+	}
+
+	pthread_mutex_unlock(&rs->mutex);
+}
+
+void replay_store_range(struct replay_store *rs, uint64_t *first,
+		uint64_t *end)
+{
+	pthread_mutex_lock(&rs->mutex);
+	*first = rs->first_seq;
+	*end = rs->first_seq + num_entries(rs);
+	pthread_mutex_unlock(&rs->mutex);
+}
+
+uint64_t replay_store_find_keyframe(struct replay_store *rs, int64_t dts_usec)
+{
+	uint64_t seq;
+	size_t lo = 0;
+	size_t hi;
+
+	pthread_mutex_lock(&rs->mutex);
+
+	seq = rs->first_seq;
+	hi = num_keyframes(rs);
+
+	/* first keyframe after dts_usec, the one before it is the start */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint64_t kf = keyframe_at(rs, mid);
+
+		if (entry_at(rs, kf)->dts_usec <= dts_usec)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo > 0)
+		seq = keyframe_at(rs, lo - 1);
+
+	pthread_mutex_unlock(&rs->mutex);
+	return seq;
+}
+
+void replay_store_pin(struct replay_store *rs, uint64_t seq)
+{
+	pthread_mutex_lock(&rs->mutex);
+	rs->pin_seq = seq;
+	rs->pinned = true;
+	pthread_mutex_unlock(&rs->mutex);
+}
+
+void replay_store_unpin(struct replay_store *rs)
+{
+	pthread_mutex_lock(&rs->mutex);
+	rs->pinned = false;
+	pthread_mutex_unlock(&rs->mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool replay_store_read(struct replay_store *rs, struct replay_reader *reader,
+		uint64_t seq, struct encoder_packet *packet)
+{
+	struct replay_entry entry;
+	bool success = false;
+
+	pthread_mutex_lock(&rs->mutex);
+
+	if (seq < rs->first_seq || seq >= rs->first_seq + num_entries(rs))
+		goto unlock;
+
+	entry = *entry_at(rs, seq);
+
+	/* everything before this has been written out and can go */
+	if (rs->pinned)
+		rs->pin_seq = seq;
+
+	if (!reader->view || reader->chunk != entry.chunk) {
+		os_mapped_file_unmap(reader->view, CHUNK_SIZE);
+		reader->chunk = entry.chunk;
+		reader->view = os_mapped_file_map(rs->file,
+				chunk_offset(entry.chunk), CHUNK_SIZE);
+		if (!reader->view)
+			goto unlock;
+
+		os_mapped_file_prefetch(reader->view, CHUNK_SIZE);
+	}
+
+	memset(packet, 0, sizeof(*packet));
+	packet->data         = reader->view + entry.offset;
+	packet->size         = entry.size;
+	packet->pts          = entry.pts;
+	packet->dts          = entry.dts;
+	packet->dts_usec     = entry.dts_usec;
+	packet->timebase_num = entry.timebase_num;
+	packet->timebase_den = entry.timebase_den;
+	packet->type         = (enum obs_encoder_type)entry.type;
+	packet->track_idx    = entry.track_idx;
+	packet->keyframe     = entry.keyframe;
+	success = true;
+
+unlock:
+	pthread_mutex_unlock(&rs->mutex);
+	return success;
+}
+
+void replay_reader_free(struct replay_reader *reader)
+{
+	os_mapped_file_unmap(reader->view, CHUNK_SIZE);
+	reader->view = NULL;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <obs.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/threading.h>
+#include <util/mapped-file.h>
+
+/*
+ * Replay buffer packet storage.  Packet data goes in to a memory mapped
+ * temporary file split in to fixed size chunks, and only a small index entry
+ * per packet stays in memory along with the positions of the video keyframes.
+ * Chunks are reused once everything in them has been purged, so the file
+ * stays at about the size of the retained packets and long retention times
+ * don't cost memory.
+ *
+ * Packets are referred to by sequence number.  A save pins its starting
+ * sequence number so nothing it still has to read can be purged, and reads
+ * the packet data straight from the file.
+ */
+
+struct replay_entry {
+	int64_t             pts;
+	int64_t             dts;
+	int64_t             dts_usec;
+	int32_t             timebase_num;
+	int32_t             timebase_den;
+	uint32_t            size;
+	uint32_t            chunk;
+	uint32_t            offset;
+	uint8_t             type;
+	uint8_t             track_idx;
+	bool                keyframe;
+};
+
+struct replay_chunk {
+	uint32_t            live;
+};
+
+struct replay_store {
+	pthread_mutex_t     mutex;
+	os_mapped_file_t    *file;
+	bool                file_failed;
+
+	struct circlebuf    entries;   /* struct replay_entry */
+	struct circlebuf    keyframes; /* uint64_t sequence numbers */
+	uint64_t            first_seq;
+
+	DARRAY(struct replay_chunk) chunks;
+	DARRAY(uint32_t)    free_chunks;
+	uint32_t            write_chunk;
+	uint32_t            write_pos;
+	uint8_t             *write_view;
+
+	int64_t             cur_size;
+	uint64_t            pin_seq;
+	bool                pinned;
+};
+
+struct replay_reader {
+	uint32_t            chunk;
+	uint8_t             *view;
+};
+
+extern bool replay_store_init(struct replay_store *rs);
+extern void replay_store_free(struct replay_store *rs);
+extern void replay_store_clear(struct replay_store *rs);
+
+extern bool replay_store_push(struct replay_store *rs,
+		const struct encoder_packet *packet);
+
+/* drops whole GOPs from the front, always keeping at least two keyframes,
+ * until the incoming packet fits in the size and time limits */
+extern void replay_store_purge(struct replay_store *rs, int64_t max_size,
+		int64_t max_time, const struct encoder_packet *incoming);
+
+/* the range of stored packets, [*first, *end) */
+extern void replay_store_range(struct replay_store *rs, uint64_t *first,
+		uint64_t *end);
+
+/* the last keyframe at or before dts_usec, or the first packet if there is
+ * none */
+extern uint64_t replay_store_find_keyframe(struct replay_store *rs,
+		int64_t dts_usec);
+
+extern void replay_store_pin(struct replay_store *rs, uint64_t seq);
+extern void replay_store_unpin(struct replay_store *rs);
+
+/* fills in the packet with its data pointing in to the reader's view of the
+ * file.  the data stays valid until the next read with the same reader.
+ * reads have to go forward, the pin follows them */
+extern bool replay_store_read(struct replay_store *rs,
+		struct replay_reader *reader, uint64_t seq,
+		struct encoder_packet *packet);
+extern void replay_reader_free(struct replay_reader *reader);
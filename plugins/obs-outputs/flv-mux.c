@@ -257,6 +257,29 @@ static void flv_audio(struct serializer *s, int32_t dts_offset,
 	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
 }
 
+size_t flv_packet_prefix(struct encoder_packet *packet, int32_t dts_offset,
+		bool is_header, uint8_t *prefix, uint8_t *type, int32_t *time_ms)
+{
+	*time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int32_t offset = get_ms_time(packet, packet->pts - packet->dts);
+
+		*type = RTMP_PACKET_TYPE_VIDEO;
+		prefix[0] = packet->keyframe ? 0x17 : 0x27;
+		prefix[1] = is_header ? 0 : 1;
+		prefix[2] = (uint8_t)(offset >> 16);
+		prefix[3] = (uint8_t)(offset >> 8);
+		prefix[4] = (uint8_t)offset;
+		return 5;
+	}
+
+	*type = RTMP_PACKET_TYPE_AUDIO;
+	prefix[0] = 0xaf;
+	prefix[1] = is_header ? 0 : 1;
+	return 2;
+}
+
 void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 		uint8_t **output, size_t *size, bool is_header)
 {
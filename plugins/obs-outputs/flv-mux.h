@@ -32,3 +32,11 @@ extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 		uint8_t **output, size_t *size, bool is_header);
+
+#define FLV_PACKET_PREFIX_MAX 5
+
+/* writes the codec bytes that precede the payload in an FLV tag body, for
+ * senders that put the tag fields on the wire themselves */
+extern size_t flv_packet_prefix(struct encoder_packet *packet,
+		int32_t dts_offset, bool is_header, uint8_t *prefix,
+		uint8_t *type, int32_t *time_ms);
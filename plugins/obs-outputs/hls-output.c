@@ -0,0 +1,657 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <util/darray.h>
+#include <util/threading.h>
+#include <util/array-serializer.h>
+#include <inttypes.h>
+#include "ts-mux.h"
+
+/*
+ * Writes the stream as MPEG-TS segments plus a rolling m3u8 playlist in to a
+ * local directory, so a plain web server or a CDN sync agent can publish it.
+ *
+ * Segments are cut on video keyframes once the target duration is reached,
+ * no re-encoding is involved.  A segment is muxed in to memory on the packet
+ * thread and handed off whole to the I/O thread, which writes it under a
+ * temporary name, renames it in to place and only then updates the playlist.
+ * Anything watching the directory never sees a partial segment.
+ */
+
+#define do_log(level, format, ...) \
+	blog(level, "[hls output: '%s'] " format, \
+			obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+/* keeps early audio and b-frame pts/dts reordering above zero */
+#define TS_START_OFFSET   TS_CLOCK_RATE
+
+/* segments waiting on the disk before it gets reported as too slow */
+#define IO_QUEUE_WARNING  4
+
+struct hls_segment {
+	unsigned                 seq;
+	double                   duration;
+	struct array_output_data data;
+};
+
+struct hls_entry {
+	unsigned                 seq;
+	double                   duration;
+	bool                     discontinuity;
+};
+
+struct hls_output {
+	obs_output_t             *output;
+	struct dstr              path;
+	struct dstr              name;
+	int                      target_duration;
+	int                      list_size;
+	bool                     delete_segments;
+
+	volatile bool            active;
+	volatile bool            stopping;
+	uint64_t                 stop_ts;
+	bool                     sent_headers;
+
+	pthread_mutex_t          mutex;
+
+	/* muxing, packet thread only */
+	struct ts_mux            mux;
+	bool                     got_first_video;
+	int64_t                  start_dts;
+	int64_t                  last_dts;
+	unsigned                 seq;
+	bool                     segment_open;
+	int64_t                  segment_start;
+	size_t                   last_segment_size;
+	struct array_output_data segment;
+	struct serializer        segment_s;
+
+	/* segment hand-off */
+	pthread_t                io_thread;
+	bool                     io_thread_active;
+	pthread_mutex_t          io_mutex;
+	os_sem_t                 *io_sem;
+	DARRAY(struct hls_segment) io_queue;
+	volatile bool            io_exit;
+	size_t                   peak_queue;
+
+	/* playlist, I/O thread only */
+	DARRAY(struct hls_entry) entries;
+	int                      playlist_target;
+	bool                     target_exceeded;
+	bool                     discontinuity;
+	unsigned                 segments_written;
+	unsigned                 write_failures;
+	uint64_t                 bytes_written;
+};
+
+static inline bool stopping(struct hls_output *stream)
+{
+	return os_atomic_load_bool(&stream->stopping);
+}
+
+static inline bool active(struct hls_output *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static const char *hls_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("HLSOutput");
+}
+
+/* ------------------------------------------------------------------------- */
+/* I/O thread                                                                */
+
+static inline void segment_path(struct hls_output *stream, struct dstr *dst,
+		unsigned seq)
+{
+	dstr_printf(dst, "%s/%s%u.ts", stream->path.array, stream->name.array,
+			seq);
+}
+
+static void write_playlist(struct hls_output *stream, bool ended)
+{
+	struct dstr playlist = {0};
+	struct dstr m3u8 = {0};
+
+	dstr_cat(&m3u8, "#EXTM3U\n#EXT-X-VERSION:3\n");
+	dstr_catf(&m3u8, "#EXT-X-TARGETDURATION:%d\n",
+			stream->playlist_target);
+	dstr_catf(&m3u8, "#EXT-X-MEDIA-SEQUENCE:%u\n",
+			stream->entries.num ? stream->entries.array[0].seq : 0);
+	if (!stream->list_size)
+		dstr_cat(&m3u8, "#EXT-X-PLAYLIST-TYPE:EVENT\n");
+
+	for (size_t i = 0; i < stream->entries.num; i++) {
+		struct hls_entry *entry = stream->entries.array + i;
+
+		if (entry->discontinuity)
+			dstr_cat(&m3u8, "#EXT-X-DISCONTINUITY\n");
+		dstr_catf(&m3u8, "#EXTINF:%.3f,\n%s%u.ts\n",
+				entry->duration, stream->name.array,
+				entry->seq);
+	}
+
+	if (ended)
+		dstr_cat(&m3u8, "#EXT-X-ENDLIST\n");
+
+	dstr_printf(&playlist, "%s/%s.m3u8", stream->path.array,
+			stream->name.array);
+
+	if (!os_quick_write_utf8_file_safe(playlist.array, m3u8.array,
+				m3u8.len, false, "tmp", NULL))
+		warn("Unable to write playlist '%s'", playlist.array);
+
+	dstr_free(&playlist);
+	dstr_free(&m3u8);
+}
+
+static bool write_segment_file(struct hls_output *stream,
+		struct hls_segment *segment)
+{
+	struct dstr path = {0};
+	struct dstr temp_path = {0};
+	size_t size = segment->data.bytes.num;
+	bool success = false;
+	FILE *file;
+
+	segment_path(stream, &path, segment->seq);
+	dstr_copy_dstr(&temp_path, &path);
+	dstr_cat(&temp_path, ".tmp");
+
+	file = os_fopen(temp_path.array, "wb");
+	if (!file) {
+		warn("Unable to open segment '%s'", temp_path.array);
+		goto exit;
+	}
+
+	success = fwrite(segment->data.bytes.array, 1, size, file) == size;
+	success = fclose(file) == 0 && success;
+
+	if (success)
+		success = os_rename(temp_path.array, path.array) == 0;
+
+	if (!success) {
+		warn("Unable to write segment '%s'", path.array);
+		os_unlink(temp_path.array);
+	}
+
+exit:
+	dstr_free(&temp_path);
+	dstr_free(&path);
+	return success;
+}
+
+/* segments that leave the playlist stay on disk for another playlist length
+ * so players that just loaded the old playlist can still fetch them */
+static void delete_old_segment(struct hls_output *stream, unsigned seq)
+{
+	unsigned keep = (unsigned)stream->list_size * 2;
+	struct dstr path = {0};
+
+	if (!stream->delete_segments || !stream->list_size || seq < keep)
+		return;
+
+	segment_path(stream, &path, seq - keep);
+	os_unlink(path.array);
+	dstr_free(&path);
+}
+
+static void process_segment(struct hls_output *stream,
+		struct hls_segment *segment)
+{
+	struct hls_entry entry = {
+		.seq           = segment->seq,
+		.duration      = segment->duration
+	};
+	int duration = (int)floor(segment->duration + 0.5);
+
+	if (!write_segment_file(stream, segment)) {
+		stream->write_failures++;
+		stream->discontinuity = true;
+		return;
+	}
+
+	stream->segments_written++;
+	stream->bytes_written += segment->data.bytes.num;
+
+	entry.discontinuity = stream->discontinuity;
+	stream->discontinuity = false;
+	da_push_back(stream->entries, &entry);
+
+	if (stream->list_size &&
+	    stream->entries.num > (size_t)stream->list_size)
+		da_erase(stream->entries, 0);
+
+	/* the target duration can't change in a live playlist, so an overrun
+	 * can only be reported */
+	if (duration > stream->playlist_target && !stream->target_exceeded) {
+		warn("Segment %u is %.3f seconds, longer than the %d second "
+		     "target duration", segment->seq, segment->duration,
+		     stream->playlist_target);
+		stream->target_exceeded = true;
+	}
+
+	write_playlist(stream, false);
+	delete_old_segment(stream, segment->seq);
+}
+
+static void *io_thread(void *data)
+{
+	struct hls_output *stream = data;
+
+	os_set_thread_name("hls-output: io_thread");
+
+	for (;;) {
+		struct hls_segment segment;
+
+		os_sem_wait(stream->io_sem);
+
+		pthread_mutex_lock(&stream->io_mutex);
+		if (!stream->io_queue.num) {
+			bool done = os_atomic_load_bool(&stream->io_exit);
+			pthread_mutex_unlock(&stream->io_mutex);
+
+			if (done)
+				break;
+			continue;
+		}
+
+		segment = stream->io_queue.array[0];
+		da_erase(stream->io_queue, 0);
+		pthread_mutex_unlock(&stream->io_mutex);
+
+		process_segment(stream, &segment);
+		array_output_serializer_free(&segment.data);
+	}
+
+	write_playlist(stream, true);
+
+	info("HLS output complete: %u segments, %"PRIu64" bytes, "
+	     "%u failed writes, peak queue %d", stream->segments_written,
+	     stream->bytes_written, stream->write_failures,
+	     (int)stream->peak_queue);
+	return NULL;
+}
+
+/* the thread writes what's still queued and the final playlist, then exits
+ * on its own */
+static inline void signal_io_thread_exit(struct hls_output *stream)
+{
+	if (!os_atomic_set_bool(&stream->io_exit, true))
+		os_sem_post(stream->io_sem);
+}
+
+static void stop_io_thread(struct hls_output *stream)
+{
+	if (!stream->io_thread_active)
+		return;
+
+	signal_io_thread_exit(stream);
+	pthread_join(stream->io_thread, NULL);
+	stream->io_thread_active = false;
+
+	/* only left over if the thread never got to them */
+	for (size_t i = 0; i < stream->io_queue.num; i++)
+		array_output_serializer_free(&stream->io_queue.array[i].data);
+	da_free(stream->io_queue);
+	da_free(stream->entries);
+}
+
+/* ------------------------------------------------------------------------- */
+/* muxing                                                                    */
+
+static void open_segment(struct hls_output *stream, int64_t dts)
+{
+	array_output_serializer_init(&stream->segment_s, &stream->segment);
+
+	/* segments stay about the same size, so start at the last one's */
+	da_reserve(stream->segment.bytes, stream->last_segment_size);
+
+	ts_mux_write_tables(&stream->mux, &stream->segment_s);
+	stream->segment_start = dts;
+	stream->segment_open = true;
+}
+
+static void close_segment(struct hls_output *stream, int64_t end_dts)
+{
+	struct hls_segment segment = {
+		.seq      = stream->seq++,
+		.duration = (double)(end_dts - stream->segment_start) /
+			(double)TS_CLOCK_RATE
+	};
+	size_t queued;
+
+	segment.data = stream->segment;
+	stream->last_segment_size = segment.data.bytes.num;
+	stream->segment_open = false;
+	memset(&stream->segment, 0, sizeof(stream->segment));
+
+	pthread_mutex_lock(&stream->io_mutex);
+	da_push_back(stream->io_queue, &segment);
+	queued = stream->io_queue.num;
+	pthread_mutex_unlock(&stream->io_mutex);
+
+	os_sem_post(stream->io_sem);
+
+	if (queued > stream->peak_queue) {
+		stream->peak_queue = queued;
+		if (queued == IO_QUEUE_WARNING)
+			warn("%d segments waiting to be written, the disk "
+			     "is not keeping up", (int)queued);
+	}
+}
+
+static void write_headers(struct hls_output *stream)
+{
+	obs_output_t  *context  = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, 0);
+	uint8_t *video_header = NULL;
+	uint8_t *audio_config = NULL;
+	size_t video_size = 0;
+	size_t audio_size = 0;
+
+	obs_encoder_get_extra_data(vencoder, &video_header, &video_size);
+	obs_encoder_get_extra_data(aencoder, &audio_config, &audio_size);
+
+	ts_mux_init(&stream->mux, video_header, video_size,
+			audio_config, audio_size);
+}
+
+static void write_packet(struct hls_output *stream,
+		struct encoder_packet *packet)
+{
+	bool video = packet->type == OBS_ENCODER_VIDEO;
+	int64_t dts = ts_mux_time(packet, packet->dts);
+	int64_t pts = ts_mux_time(packet, packet->pts);
+
+	if (!stream->got_first_video) {
+		/* segments have to start on a keyframe */
+		if (!video || !packet->keyframe)
+			return;
+
+		stream->start_dts = dts;
+		stream->got_first_video = true;
+	}
+
+	dts = dts - stream->start_dts + TS_START_OFFSET;
+	pts = pts - stream->start_dts + TS_START_OFFSET;
+	if (dts < 0)
+		return;
+
+	if (video && packet->keyframe) {
+		int64_t elapsed = dts - stream->segment_start;
+		int64_t target = (int64_t)stream->target_duration *
+			TS_CLOCK_RATE;
+
+		if (stream->segment_open && elapsed >= target)
+			close_segment(stream, dts);
+		if (!stream->segment_open)
+			open_segment(stream, dts);
+	}
+
+	if (!stream->segment_open)
+		return;
+
+	if (video)
+		stream->last_dts = dts;
+
+	ts_mux_write_packet(&stream->mux, &stream->segment_s, packet, pts,
+			dts);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void hls_output_stop(void *data, uint64_t ts);
+
+static void hls_output_destroy(void *data)
+{
+	struct hls_output *stream = data;
+
+	stop_io_thread(stream);
+	ts_mux_free(&stream->mux);
+	array_output_serializer_free(&stream->segment);
+
+	os_sem_destroy(stream->io_sem);
+	pthread_mutex_destroy(&stream->io_mutex);
+	pthread_mutex_destroy(&stream->mutex);
+	dstr_free(&stream->path);
+	dstr_free(&stream->name);
+	bfree(stream);
+}
+
+static void *hls_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct hls_output *stream = bzalloc(sizeof(struct hls_output));
+	stream->output = output;
+	pthread_mutex_init_value(&stream->mutex);
+	pthread_mutex_init_value(&stream->io_mutex);
+
+	if (pthread_mutex_init(&stream->mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&stream->io_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&stream->io_sem, 0) != 0)
+		goto fail;
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+
+fail:
+	hls_output_destroy(stream);
+	return NULL;
+}
+
+/* segments are only cut on keyframes, so each one runs to the first keyframe
+ * at or past target_duration.  the playlist's target duration can't change
+ * once it's published, so it's fixed here to cover that */
+static int get_playlist_target(struct hls_output *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t *settings = obs_encoder_get_settings(vencoder);
+	int keyint = (int)obs_data_get_int(settings, "keyint_sec");
+	int target = stream->target_duration;
+
+	obs_data_release(settings);
+
+	if (keyint <= 0) {
+		warn("The video encoder has no fixed keyframe interval, "
+		     "segments may run past the %d second target duration",
+		     target);
+		return target;
+	}
+
+	return (target + keyint - 1) / keyint * keyint;
+}
+
+static bool hls_output_start(void *data)
+{
+	struct hls_output *stream = data;
+	obs_data_t *settings;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	/* the previous run's I/O thread is only joined here or in destroy, so
+	 * the packet thread never waits on the disk */
+	stop_io_thread(stream);
+	ts_mux_free(&stream->mux);
+	array_output_serializer_free(&stream->segment);
+
+	stream->sent_headers = false;
+	stream->got_first_video = false;
+	stream->segment_open = false;
+	stream->last_segment_size = 0;
+	stream->seq = 0;
+	stream->peak_queue = 0;
+	stream->playlist_target = 0;
+	stream->target_exceeded = false;
+	stream->discontinuity = false;
+	stream->segments_written = 0;
+	stream->write_failures = 0;
+	stream->bytes_written = 0;
+	os_atomic_set_bool(&stream->stopping, false);
+	os_atomic_set_bool(&stream->io_exit, false);
+
+	settings = obs_output_get_settings(stream->output);
+	dstr_copy(&stream->path, obs_data_get_string(settings, "path"));
+	dstr_copy(&stream->name, obs_data_get_string(settings, "name"));
+	stream->target_duration =
+		(int)obs_data_get_int(settings, "target_duration");
+	stream->list_size = (int)obs_data_get_int(settings, "list_size");
+	stream->delete_segments =
+		obs_data_get_bool(settings, "delete_segments");
+	obs_data_release(settings);
+
+	dstr_replace(&stream->path, "\\", "/");
+	if (dstr_end(&stream->path) == '/')
+		dstr_resize(&stream->path, stream->path.len - 1);
+	if (dstr_is_empty(&stream->name))
+		dstr_copy(&stream->name, "stream");
+	if (stream->target_duration < 1)
+		stream->target_duration = 1;
+	if (stream->list_size < 0)
+		stream->list_size = 0;
+	stream->playlist_target = get_playlist_target(stream);
+
+	if (dstr_is_empty(&stream->path) ||
+	    os_mkdirs(stream->path.array) == MKDIR_ERROR) {
+		warn("Unable to create directory '%s'", stream->path.array);
+		return false;
+	}
+
+	if (pthread_create(&stream->io_thread, NULL, io_thread, stream) != 0) {
+		warn("Failed to create I/O thread");
+		return false;
+	}
+	stream->io_thread_active = true;
+
+	os_atomic_set_bool(&stream->active, true);
+	obs_output_begin_data_capture(stream->output, 0);
+
+	info("Writing HLS segments to '%s/%s.m3u8' (%d second segments, "
+	     "%d in playlist)...", stream->path.array, stream->name.array,
+	     stream->target_duration, stream->list_size);
+	return true;
+}
+
+static void hls_output_stop(void *data, uint64_t ts)
+{
+	struct hls_output *stream = data;
+	stream->stop_ts = ts / 1000;
+	os_atomic_set_bool(&stream->stopping, true);
+}
+
+static void hls_output_actual_stop(struct hls_output *stream)
+{
+	os_atomic_set_bool(&stream->active, false);
+
+	if (stream->segment_open)
+		close_segment(stream, stream->last_dts);
+
+	/* runs on the packet thread, so the I/O thread finishes the last
+	 * segments and the playlist in the background */
+	signal_io_thread_exit(stream);
+	obs_output_end_data_capture(stream->output);
+}
+
+static void hls_output_data(void *data, struct encoder_packet *packet)
+{
+	struct hls_output *stream = data;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if (!active(stream))
+		goto unlock;
+
+	if (stopping(stream)) {
+		if (packet->sys_dts_usec >= (int64_t)stream->stop_ts) {
+			hls_output_actual_stop(stream);
+			goto unlock;
+		}
+	}
+
+	if (!stream->sent_headers) {
+		write_headers(stream);
+		stream->sent_headers = true;
+	}
+
+	write_packet(stream, packet);
+
+unlock:
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static void hls_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_string(defaults, "name", "stream");
+	obs_data_set_default_int(defaults, "target_duration", 4);
+	obs_data_set_default_int(defaults, "list_size", 6);
+	obs_data_set_default_bool(defaults, "delete_segments", true);
+}
+
+static obs_properties_t *hls_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_path(props, "path",
+			obs_module_text("HLSOutput.Directory"),
+			OBS_PATH_DIRECTORY, NULL, NULL);
+	obs_properties_add_text(props, "name",
+			obs_module_text("HLSOutput.Name"),
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, "target_duration",
+			obs_module_text("HLSOutput.TargetDuration"),
+			1, 30, 1);
+	obs_properties_add_int(props, "list_size",
+			obs_module_text("HLSOutput.ListSize"),
+			0, 100, 1);
+	obs_properties_add_bool(props, "delete_segments",
+			obs_module_text("HLSOutput.DeleteSegments"));
+	return props;
+}
+
+struct obs_output_info hls_output_info = {
+	.id                   = "hls_output",
+	.flags                = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name             = hls_output_getname,
+	.create               = hls_output_create,
+	.destroy              = hls_output_destroy,
+	.start                = hls_output_start,
+	.stop                 = hls_output_stop,
+	.encoded_packet       = hls_output_data,
+	.get_defaults         = hls_output_defaults,
+	.get_properties       = hls_output_properties
+};
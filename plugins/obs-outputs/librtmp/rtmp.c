@@ -3962,22 +3962,12 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+static int
+EnsureChannelOut(RTMP *r, int channel)
 {
-    const RTMPPacket *prevPacket;
-    uint32_t last = 0;
-    int nSize;
-    int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
-    uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
-
-    if (packet->m_nChannel >= r->m_channelsAllocatedOut)
+    if (channel >= r->m_channelsAllocatedOut)
     {
-        int n = packet->m_nChannel + 10;
+        int n = channel + 10;
         RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
         if (!packets)
         {
@@ -3990,6 +3980,24 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
         r->m_channelsAllocatedOut = n;
     }
+    return TRUE;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    const RTMPPacket *prevPacket;
+    uint32_t last = 0;
+    int nSize;
+    int hSize, cSize;
+    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    uint32_t t;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    if (!EnsureChannelOut(r, packet->m_nChannel))
+        return FALSE;
 
     prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
     if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
@@ -5284,3 +5292,262 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* Media messages -----------------------------------------------------------
+ * RTMP_Write takes a whole FLV tag, parses the tag header back out, copies
+ * the body into a packet and chunks that.  RTMP_SendMediaPacket takes the
+ * message fields directly and sends the chunk headers and the caller's
+ * buffers as one gather list instead. */
+
+#define MEDIA_MAX_SEGMENTS 64
+
+typedef struct RTMPSegment
+{
+    const char *buf;
+    int len;
+} RTMPSegment;
+
+static int
+SockBuf_SendV(RTMPSockBuf *sb, RTMPSegment *segs, int count)
+{
+#ifdef _WIN32
+    WSABUF bufs[MEDIA_MAX_SEGMENTS];
+    DWORD sent = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        bufs[i].buf = (char *)segs[i].buf;
+        bufs[i].len = (ULONG)segs[i].len;
+    }
+    if (WSASend(sb->sb_socket, bufs, count, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    struct iovec iov[MEDIA_MAX_SEGMENTS];
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        iov[i].iov_base = (void *)segs[i].buf;
+        iov[i].iov_len = (size_t)segs[i].len;
+    }
+    return (int)writev(sb->sb_socket, iov, count);
+#endif
+}
+
+static int
+WriteV(RTMP *r, RTMPSegment *segs, int count)
+{
+    int i, direct = !(r->m_bCustomSend && r->m_customSendFunc);
+
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        direct = FALSE;
+#if !defined(NO_SSL)
+    if (r->m_sb.sb_ssl)
+        direct = FALSE;
+#endif
+#endif
+
+    if (!direct)
+    {
+        for (i = 0; i < count; i++)
+            if (!WriteN(r, segs[i].buf, segs[i].len))
+                return FALSE;
+        return TRUE;
+    }
+
+    while (count > 0)
+    {
+        int nBytes = SockBuf_SendV(&r->m_sb, segs, count);
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            r->last_error_code = sockerr;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* drop what went out, a partial write can end mid segment */
+        while (count > 0 && nBytes >= segs->len)
+        {
+            nBytes -= segs->len;
+            segs++;
+            count--;
+        }
+        if (count > 0)
+        {
+            segs->buf += nBytes;
+            segs->len -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
+/* HTTP tunnels send the whole message in a single post, so the segments
+ * are collected into one buffer and written at the end */
+static int
+FlushSegments(RTMP *r, RTMPSegment *segs, int count, char **httpBuf,
+              int *httpLen)
+{
+    char *buf;
+    int i, len = *httpLen;
+
+    if (!(r->Link.protocol & RTMP_FEATURE_HTTP))
+        return WriteV(r, segs, count);
+
+    for (i = 0; i < count; i++)
+        len += segs[i].len;
+
+    buf = realloc(*httpBuf, len);
+    if (!buf)
+        return FALSE;
+    *httpBuf = buf;
+
+    for (i = 0; i < count; i++)
+    {
+        memcpy(buf + *httpLen, segs[i].buf, segs[i].len);
+        *httpLen += segs[i].len;
+    }
+    return TRUE;
+}
+
+int
+RTMP_SendMediaPacket(RTMP *r, uint8_t packetType, uint32_t timestamp,
+                     const char *prefix, int prefixSize,
+                     const char *body, int bodySize, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    const RTMPPacket *prevPacket;
+    RTMPSegment segs[MEDIA_MAX_SEGMENTS];
+    char header[RTMP_MAX_HEADER_SIZE], *hptr, *hend;
+    char *httpBuf = NULL, cont;
+    uint32_t last = 0, t;
+    int nSize, nSegs = 0, remaining, offset = 0, httpLen = 0, ret;
+    int chunkSize = r->m_outChunkSize;
+
+    /* same header choice RTMP_Write makes from the FLV tag */
+    packet.m_nChannel = 0x04;
+    packet.m_headerType = timestamp ? RTMP_PACKET_SIZE_MEDIUM : RTMP_PACKET_SIZE_LARGE;
+    packet.m_packetType = packetType;
+    packet.m_nTimeStamp = timestamp;
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_nBodySize = prefixSize + bodySize;
+
+    if (!EnsureChannelOut(r, packet.m_nChannel))
+        return FALSE;
+
+    prevPacket = r->m_vecChannelsOut[packet.m_nChannel];
+    if (prevPacket && packet.m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet.m_nBodySize
+                && prevPacket->m_packetType == packet.m_packetType)
+            packet.m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet.m_nTimeStamp
+                && packet.m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet.m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    nSize = packetSize[packet.m_headerType];
+    t = packet.m_nTimeStamp - last;
+
+    hptr = header;
+    hend = header + sizeof(header);
+    *hptr++ = (char)(packet.m_headerType << 6 | packet.m_nChannel);
+
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet.m_nBodySize);
+        *hptr++ = packet.m_packetType;
+    }
+
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet.m_nInfoField2);
+
+    if (nSize > 1 && t >= 0xffffff)
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+
+    cont = (char)(0xc0 | packet.m_nChannel);
+
+    segs[nSegs].buf = header;
+    segs[nSegs].len = (int)(hptr - header);
+    nSegs++;
+
+    remaining = packet.m_nBodySize;
+    while (remaining > 0)
+    {
+        int chunk = remaining < chunkSize ? remaining : chunkSize;
+
+        /* a chunk can need a header and two pieces of payload */
+        if (nSegs + 3 > MEDIA_MAX_SEGMENTS)
+        {
+            if (!FlushSegments(r, segs, nSegs, &httpBuf, &httpLen))
+            {
+                free(httpBuf);
+                return FALSE;
+            }
+            nSegs = 0;
+        }
+
+        if (offset > 0)
+        {
+            segs[nSegs].buf = &cont;
+            segs[nSegs].len = 1;
+            nSegs++;
+        }
+
+        remaining -= chunk;
+        while (chunk > 0)
+        {
+            int len;
+
+            if (offset < prefixSize)
+            {
+                len = prefixSize - offset;
+                if (len > chunk)
+                    len = chunk;
+                segs[nSegs].buf = prefix + offset;
+            }
+            else
+            {
+                len = chunk;
+                segs[nSegs].buf = body + (offset - prefixSize);
+            }
+            segs[nSegs].len = len;
+            nSegs++;
+
+            offset += len;
+            chunk -= len;
+        }
+    }
+
+    ret = FlushSegments(r, segs, nSegs, &httpBuf, &httpLen);
+    if (ret && httpBuf)
+        ret = WriteN(r, httpBuf, httpLen);
+    free(httpBuf);
+    if (!ret)
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+    return TRUE;
+}
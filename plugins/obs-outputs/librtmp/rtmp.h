@@ -414,6 +414,12 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
 
+    /* sends one audio/video message built from a small codec prefix and the
+     * payload, chunked straight onto the socket without copying either */
+    int RTMP_SendMediaPacket(RTMP *r, uint8_t packetType, uint32_t timestamp,
+                             const char *prefix, int prefixSize,
+                             const char *body, int bodySize, int streamIdx);
+
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
                      int age);
@@ -13,6 +13,7 @@ OBS_MODULE_USE_DEFAULT_LOCALE("obs-outputs", "en-US")
 extern struct obs_output_info rtmp_output_info;
 extern struct obs_output_info null_output_info;
 extern struct obs_output_info flv_output_info;
+extern struct obs_output_info hls_output_info;
 #if COMPILE_FTL
 extern struct obs_output_info ftl_output_info;
 #endif
@@ -27,6 +28,7 @@ bool obs_module_load(void)
 	obs_register_output(&rtmp_output_info);
 	obs_register_output(&null_output_info);
 	obs_register_output(&flv_output_info);
+	obs_register_output(&hls_output_info);
 #if COMPILE_FTL
 	obs_register_output(&ftl_output_info);
 #endif
@@ -0,0 +1,408 @@
+#ifndef _WIN32
+#include "rtmp-stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/* os_event_t can't be waited on together with the socket, so the threads
+ * feeding the write buffer also poke a non-blocking pipe */
+
+static bool set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1 &&
+		fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+bool socket_thread_posix_init(struct rtmp_stream *stream)
+{
+	if (pipe(stream->wake_fds) != 0) {
+		stream->wake_fds[0] = stream->wake_fds[1] = -1;
+		return false;
+	}
+
+	if (!set_nonblocking(stream->wake_fds[0]) ||
+	    !set_nonblocking(stream->wake_fds[1])) {
+		socket_thread_posix_free(stream);
+		return false;
+	}
+
+	return true;
+}
+
+void socket_thread_posix_free(struct rtmp_stream *stream)
+{
+	for (size_t i = 0; i < 2; i++) {
+		if (stream->wake_fds[i] != -1) {
+			close(stream->wake_fds[i]);
+			stream->wake_fds[i] = -1;
+		}
+	}
+}
+
+void socket_thread_posix_wake(struct rtmp_stream *stream)
+{
+	char val = 0;
+
+	/* a full pipe already has a wake up pending */
+	if (stream->wake_fds[1] != -1)
+		while (write(stream->wake_fds[1], &val, 1) == -1 &&
+		       errno == EINTR)
+			;
+}
+
+static void drain_wake_pipe(struct rtmp_stream *stream)
+{
+	char discard[64];
+
+	while (read(stream->wake_fds[0], discard, sizeof(discard)) > 0)
+		;
+}
+
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_len = 0;
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static bool socket_event(struct rtmp_stream *stream, short revents,
+		bool *can_write, uint64_t last_send_time)
+{
+	if (revents & POLLOUT)
+		*can_write = true;
+
+	if (revents & POLLIN) {
+		char discard[16384];
+		int err_code;
+		bool fatal = false;
+
+		for (;;) {
+			ssize_t ret = recv(stream->rtmp.m_sb.sb_socket,
+					discard, sizeof(discard), 0);
+			if (ret == -1) {
+				err_code = errno;
+				if (err_code == EAGAIN ||
+				    err_code == EWOULDBLOCK)
+					break;
+				if (err_code == EINTR)
+					continue;
+
+				fatal = true;
+			} else if (ret == 0) {
+				/* reported as a close below */
+				revents |= POLLHUP;
+				break;
+			}
+
+			if (fatal) {
+				blog(LOG_ERROR, "socket_thread_posix: "
+						"Socket error, recv() returned "
+						"%d, errno %d",
+						(int)ret, err_code);
+				stream->rtmp.last_error_code = err_code;
+				fatal_sock_shutdown(stream);
+				return false;
+			}
+		}
+	}
+
+	if (revents & (POLLHUP | POLLERR | POLLNVAL)) {
+		int err_code = 0;
+		socklen_t size = sizeof(err_code);
+
+		getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_ERROR,
+				&err_code, &size);
+
+		if (last_send_time) {
+			uint32_t diff =
+				(os_gettime_ns() / 1000000) - last_send_time;
+
+			blog(LOG_ERROR, "socket_thread_posix: Socket closed, "
+					"%u ms since last send "
+					"(buffer: %d / %d)",
+					diff,
+					(int)stream->write_buf_len,
+					(int)stream->write_buf_size);
+		}
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			blog(LOG_ERROR, "socket_thread_posix: Aborting due "
+					"to socket close during shutdown, "
+					"%d bytes lost, error %d",
+					(int)stream->write_buf_len, err_code);
+		else
+			blog(LOG_ERROR, "socket_thread_posix: Aborting due "
+					"to socket close, error %d", err_code);
+
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	return true;
+}
+
+/* linux has no ideal send backlog notification, so the window is checked
+ * once a second instead.  like the windows ISB, the congestion window times
+ * the segment size estimates what has to be in flight to fill the link */
+#define SEND_WINDOW_CHECK_MS 1000
+
+static void ideal_send_backlog_check(struct rtmp_stream *stream)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+	struct tcp_info tcp_info;
+	socklen_t size = sizeof(tcp_info);
+	int cur_tcp_bufsize;
+	int ideal_send_backlog;
+	int ret;
+
+	ret = getsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP, TCP_INFO,
+			&tcp_info, &size);
+	if (ret != 0) {
+		blog(LOG_ERROR, "socket_thread_posix: getsockopt(TCP_INFO) "
+				"failed, errno %d, send window optimization "
+				"disabled", errno);
+		stream->disable_send_window_optimization = true;
+		return;
+	}
+
+	ideal_send_backlog = (int)(tcp_info.tcpi_snd_cwnd *
+			tcp_info.tcpi_snd_mss);
+
+	size = sizeof(cur_tcp_bufsize);
+	ret = getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+			&cur_tcp_bufsize, &size);
+	if (ret != 0) {
+		blog(LOG_ERROR, "socket_thread_posix: getsockopt(SO_SNDBUF) "
+				"failed, errno %d", errno);
+		return;
+	}
+
+	/* the kernel reports twice the size it was given */
+	if (cur_tcp_bufsize / 2 < ideal_send_backlog) {
+		setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+				&ideal_send_backlog,
+				sizeof(ideal_send_backlog));
+
+		blog(LOG_INFO, "socket_thread_posix: Increasing send buffer "
+				"to ISB %d (buffer: %d / %d)",
+				ideal_send_backlog,
+				(int)stream->write_buf_len,
+				(int)stream->write_buf_size);
+	}
+#else
+	UNUSED_PARAMETER(stream);
+#endif
+}
+
+enum data_ret {
+	RET_BREAK,
+	RET_FATAL,
+	RET_CONTINUE
+};
+
+static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
+		uint64_t *last_send_time, size_t latency_packet_size,
+		int delay_time)
+{
+	bool exit_loop = false;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (!stream->write_buf_len) {
+		/* expected occasionally, see socket_thread_windows */
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		return RET_BREAK;
+	}
+
+	ssize_t ret;
+	if (stream->low_latency_mode) {
+		size_t send_len = latency_packet_size < stream->write_buf_len ?
+			latency_packet_size : stream->write_buf_len;
+
+		ret = send(stream->rtmp.m_sb.sb_socket,
+				stream->write_buf, send_len, SEND_FLAGS);
+	} else {
+		ret = send(stream->rtmp.m_sb.sb_socket,
+				stream->write_buf, stream->write_buf_len,
+				SEND_FLAGS);
+	}
+
+	if (ret > 0) {
+		if (stream->write_buf_len - ret)
+			memmove(stream->write_buf,
+					stream->write_buf + ret,
+					stream->write_buf_len - ret);
+		stream->write_buf_len -= ret;
+
+		*last_send_time = os_gettime_ns() / 1000000;
+
+		os_event_signal(stream->buffer_space_available_event);
+	} else {
+		int err_code = 0;
+
+		if (ret == -1) {
+			err_code = errno;
+
+			if (err_code == EINTR) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				return RET_CONTINUE;
+			}
+
+			if (err_code == EAGAIN || err_code == EWOULDBLOCK) {
+				*can_write = false;
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				return RET_BREAK;
+			}
+		}
+
+		/* connection closed, or connection was aborted /
+		 * socket closed / etc, that's a fatal error. */
+		blog(LOG_ERROR, "socket_thread_posix: "
+				"Socket error, send() returned %d, "
+				"errno %d",
+				(int)ret, err_code);
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	/* finish writing for now */
+	if (stream->write_buf_len <= 1000)
+		exit_loop = true;
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (delay_time)
+		os_sleep_ms(delay_time);
+
+	return exit_loop ? RET_BREAK : RET_CONTINUE;
+}
+
+#define LATENCY_FACTOR 20
+#define SHUTDOWN_POLL_MS 10
+
+static inline void socket_thread_posix_internal(struct rtmp_stream *stream)
+{
+	bool can_write = false;
+
+	int delay_time;
+	size_t latency_packet_size;
+	uint64_t last_send_time = 0;
+	uint64_t last_window_check = 0;
+
+	os_set_thread_name("rtmp-stream: socket_thread_posix");
+
+	if (stream->low_latency_mode) {
+		delay_time = 1000 / LATENCY_FACTOR;
+		latency_packet_size = stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		latency_packet_size = stream->write_buf_size;
+		delay_time = 0;
+	}
+
+	if (stream->disable_send_window_optimization)
+		blog(LOG_INFO, "socket_thread_posix: Send window "
+				"optimization disabled by user.");
+
+	for (;;) {
+		struct pollfd fds[2];
+		int timeout = -1;
+		int ret;
+
+		if (!stream->disable_send_window_optimization) {
+			uint64_t now = os_gettime_ns() / 1000000;
+
+			if (now - last_window_check >= SEND_WINDOW_CHECK_MS) {
+				ideal_send_backlog_check(stream);
+				last_window_check = now;
+			}
+			timeout = SEND_WINDOW_CHECK_MS;
+		}
+
+		if (os_event_try(stream->send_thread_signaled_exit) != EAGAIN) {
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			if (stream->write_buf_len == 0) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				os_event_reset(stream->send_thread_signaled_exit);
+				break;
+			}
+
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+
+			/* nothing else wakes us up while the rest drains */
+			timeout = SHUTDOWN_POLL_MS;
+		}
+
+		/* only ask for POLLOUT while a send would have blocked,
+		 * otherwise poll would return immediately every time */
+		fds[0].fd = stream->rtmp.m_sb.sb_socket;
+		fds[0].events = POLLIN | (can_write ? 0 : POLLOUT);
+		fds[0].revents = 0;
+		fds[1].fd = stream->wake_fds[0];
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+
+		ret = poll(fds, 2, timeout);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+
+			blog(LOG_ERROR, "socket_thread_posix: Aborting due "
+					"to poll failure, errno %d", errno);
+			fatal_sock_shutdown(stream);
+			return;
+		}
+
+		if (fds[1].revents & POLLIN)
+			drain_wake_pipe(stream);
+
+		if (fds[0].revents) {
+			if (!socket_event(stream, fds[0].revents, &can_write,
+						last_send_time))
+				return;
+		}
+
+		if (can_write) {
+			for (;;) {
+				enum data_ret ret = write_data(
+						stream,
+						&can_write,
+						&last_send_time,
+						latency_packet_size,
+						delay_time);
+
+				switch (ret) {
+				case RET_BREAK:
+					goto exit_write_loop;
+				case RET_FATAL:
+					return;
+				case RET_CONTINUE:;
+				}
+			}
+		}
+		exit_write_loop:;
+	}
+
+	blog(LOG_INFO, "socket_thread_posix: Normal exit");
+}
+
+void *socket_thread_posix(void *data)
+{
+	struct rtmp_stream *stream = data;
+	socket_thread_posix_internal(stream);
+	return NULL;
+}
+#endif
@@ -103,6 +103,8 @@ static void rtmp_stream_destroy(void *data)
 	os_sem_destroy(stream->send_sem);
 	pthread_mutex_destroy(&stream->packets_mutex);
 	circlebuf_free(&stream->packets);
+	pthread_mutex_destroy(&stream->dbr_mutex);
+	circlebuf_free(&stream->dbr_frames);
 #ifdef TEST_FRAMEDROPS
 	circlebuf_free(&stream->droptest_info);
 #endif
@@ -112,17 +114,41 @@ static void rtmp_stream_destroy(void *data)
 	os_event_destroy(stream->socket_available_event);
 	os_event_destroy(stream->send_thread_signaled_exit);
 	pthread_mutex_destroy(&stream->write_buf_mutex);
+#ifndef _WIN32
+	socket_thread_posix_free(stream);
+#endif
 
 	if (stream->write_buf)
 		bfree(stream->write_buf);
 	bfree(stream);
 }
 
+static void get_dynamic_bitrate_proc(void *data, calldata_t *cd)
+{
+	struct rtmp_stream *stream = data;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	calldata_set_bool(cd, "enabled", stream->dbr_enabled);
+	calldata_set_int(cd, "current_bitrate", stream->dbr_cur_bitrate);
+	calldata_set_int(cd, "original_bitrate", stream->dbr_orig_bitrate);
+	calldata_set_int(cd, "decreases", stream->dbr_decreases);
+	calldata_set_int(cd, "increases", stream->dbr_increases);
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	pthread_mutex_lock(&stream->dbr_mutex);
+	calldata_set_int(cd, "estimated_bitrate", stream->dbr_est_bitrate);
+	pthread_mutex_unlock(&stream->dbr_mutex);
+}
+
 static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+	pthread_mutex_init_value(&stream->dbr_mutex);
+#ifndef _WIN32
+	stream->wake_fds[0] = stream->wake_fds[1] = -1;
+#endif
 
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetCallback(log_rtmp);
@@ -130,6 +156,8 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 
 	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&stream->dbr_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 
@@ -158,6 +186,19 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 		warn("Failed to initialize socket exit event");
 		goto fail;
 	}
+#ifndef _WIN32
+	if (!socket_thread_posix_init(stream)) {
+		warn("Failed to initialize socket wake pipe");
+		goto fail;
+	}
+#endif
+
+	proc_handler_add(obs_output_get_proc_handler(output),
+			"void get_dynamic_bitrate(out bool enabled, "
+			"out int current_bitrate, out int original_bitrate, "
+			"out int estimated_bitrate, out int decreases, "
+			"out int increases)",
+			get_dynamic_bitrate_proc, stream);
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -323,6 +364,9 @@ retry_send:
 	pthread_mutex_unlock(&stream->write_buf_mutex);
 
 	os_event_signal (stream->buffer_has_data_event);
+#ifndef _WIN32
+	socket_thread_posix_wake(stream);
+#endif
 
 	return len;
 }
@@ -330,7 +374,9 @@ retry_send:
 static int send_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet, bool is_header, size_t idx)
 {
-	uint8_t *data;
+	uint8_t prefix[FLV_PACKET_PREFIX_MAX];
+	uint8_t type;
+	int32_t time_ms;
 	size_t  size;
 	int     recv_size = 0;
 	int     ret = 0;
@@ -349,15 +395,25 @@ static int send_packet(struct rtmp_stream *stream,
 		}
 	}
 
-	flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset,
-			&data, &size, is_header);
+	if (packet->data && packet->size) {
+		size = flv_packet_prefix(packet,
+				is_header ? 0 : stream->start_dts_offset,
+				is_header, prefix, &type, &time_ms);
+		size += packet->size;
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size, (int)idx);
-	bfree(data);
+		/* the FLV tag only carries 31 bits of timestamp */
+		ret = RTMP_SendMediaPacket(&stream->rtmp, type,
+				(uint32_t)time_ms & 0x7FFFFFFF,
+				(const char*)prefix, (int)(size - packet->size),
+				(const char*)packet->data, (int)packet->size,
+				(int)idx) ? (int)size : -1;
+	} else {
+		size = 0;
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -441,6 +497,223 @@ static void set_output_error(struct rtmp_stream *stream)
 	obs_output_set_last_error(stream->output, msg);
 }
 
+/* ------------------------------------------------------------------------- */
+/* dynamic bitrate                                                           */
+
+/* how much video has to sit in the queue, and for how long, before the
+ * bitrate is lowered.  a lowered bitrate is given the same time to drain the
+ * queue before it's lowered again */
+#define DBR_TRIGGER_USEC (200ULL * 1000ULL)
+#define DBR_SUSTAIN_NS (1000ULL * 1000000ULL)
+
+/* time without congestion before probing back up */
+#define DBR_INC_TIMER (4ULL * 1000000000ULL)
+
+#define DBR_MIN_BITRATE 50
+
+#define MIN_ESTIMATE_DURATION_MS 1000
+#define MAX_ESTIMATE_DURATION_MS 2000
+
+/* estimates the video bitrate the connection can take from how fast the
+ * send thread got through the last couple of seconds of packets.  while the
+ * queue is backed up the send thread never waits, so this is the throughput
+ * of the link itself */
+static void dbr_add_frame(struct rtmp_stream *stream, struct dbr_frame *back)
+{
+	struct dbr_frame front;
+	uint64_t dur;
+
+	circlebuf_push_back(&stream->dbr_frames, back, sizeof(*back));
+	stream->dbr_data_size += back->size;
+
+	for (;;) {
+		circlebuf_peek_front(&stream->dbr_frames, &front,
+				sizeof(front));
+
+		dur = (back->send_end - front.send_beg) / 1000000;
+		if (dur < MAX_ESTIMATE_DURATION_MS)
+			break;
+
+		stream->dbr_data_size -= front.size;
+		circlebuf_pop_front(&stream->dbr_frames, NULL, sizeof(front));
+	}
+
+	if (dur < MIN_ESTIMATE_DURATION_MS) {
+		stream->dbr_est_bitrate = 0;
+		return;
+	}
+
+	stream->dbr_est_bitrate =
+		(long)(stream->dbr_data_size * 8 / dur) - stream->audio_bitrate;
+	if (stream->dbr_est_bitrate < DBR_MIN_BITRATE)
+		stream->dbr_est_bitrate = DBR_MIN_BITRATE;
+}
+
+/* this runs on whichever encoder thread delivered the packet, or the send
+ * thread.  obs_encoder_update only queues the change while the encoder is
+ * active, and the video encoder applies it on its own thread before its next
+ * frame */
+static void dbr_set_bitrate(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t *settings = obs_data_create();
+
+	obs_data_set_int(settings, "bitrate", stream->dbr_cur_bitrate);
+	obs_encoder_update(vencoder, settings);
+
+	obs_data_release(settings);
+}
+
+static bool dbr_bitrate_lowered(struct rtmp_stream *stream)
+{
+	long min_bitrate = stream->dbr_orig_bitrate / 4;
+	long new_bitrate;
+	long est_bitrate;
+
+	if (min_bitrate < DBR_MIN_BITRATE)
+		min_bitrate = DBR_MIN_BITRATE;
+
+	pthread_mutex_lock(&stream->dbr_mutex);
+	est_bitrate = stream->dbr_est_bitrate / 100 * 100;
+	pthread_mutex_unlock(&stream->dbr_mutex);
+
+	/* a probe up that didn't hold goes straight back to the last
+	 * bitrate that did */
+	if (stream->dbr_prev_bitrate &&
+	    stream->dbr_prev_bitrate < stream->dbr_cur_bitrate)
+		new_bitrate = stream->dbr_prev_bitrate;
+	else if (est_bitrate && est_bitrate < stream->dbr_cur_bitrate)
+		new_bitrate = est_bitrate;
+	else
+		new_bitrate = stream->dbr_cur_bitrate * 3 / 4;
+
+	if (new_bitrate < min_bitrate)
+		new_bitrate = min_bitrate;
+	if (new_bitrate >= stream->dbr_cur_bitrate)
+		return false;
+
+	stream->dbr_prev_bitrate = 0;
+	stream->dbr_cur_bitrate = new_bitrate;
+	stream->dbr_decreases++;
+
+	info("Congested, lowering bitrate to %ld kb/s (estimate %ld kb/s)",
+			new_bitrate, est_bitrate);
+	return true;
+}
+
+static void dbr_check_congestion(struct rtmp_stream *stream,
+		int64_t buffer_duration_usec)
+{
+	uint64_t now = os_gettime_ns();
+
+	if (buffer_duration_usec < (int64_t)DBR_TRIGGER_USEC) {
+		stream->dbr_congested_ts = 0;
+		return;
+	}
+
+	stream->dbr_inc_timeout = now + DBR_INC_TIMER;
+
+	if (!stream->dbr_congested_ts) {
+		stream->dbr_congested_ts = now;
+		return;
+	}
+
+	if (now - stream->dbr_congested_ts < DBR_SUSTAIN_NS)
+		return;
+
+	if (dbr_bitrate_lowered(stream))
+		dbr_set_bitrate(stream);
+
+	stream->dbr_congested_ts = now;
+}
+
+static void dbr_check_increase(struct rtmp_stream *stream)
+{
+	uint64_t now;
+
+	if (stream->dbr_cur_bitrate >= stream->dbr_orig_bitrate)
+		return;
+
+	now = os_gettime_ns();
+	if (now < stream->dbr_inc_timeout)
+		return;
+
+	stream->dbr_prev_bitrate = stream->dbr_cur_bitrate;
+	stream->dbr_cur_bitrate += stream->dbr_inc_bitrate;
+	if (stream->dbr_cur_bitrate > stream->dbr_orig_bitrate)
+		stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
+
+	stream->dbr_inc_timeout = now + DBR_INC_TIMER;
+	stream->dbr_increases++;
+
+	info("Raising bitrate to %ld kb/s", stream->dbr_cur_bitrate);
+	dbr_set_bitrate(stream);
+}
+
+static bool dbr_init(struct rtmp_stream *stream, obs_data_t *settings)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_encoder_t *aencoder =
+		obs_output_get_audio_encoder(stream->output, 0);
+	obs_data_t *vsettings;
+	obs_data_t *asettings;
+	const char *rc;
+	bool cbr;
+
+	if (!obs_data_get_bool(settings, OPT_DYN_BITRATE) || !vencoder)
+		return false;
+
+	if ((obs_get_encoder_caps(obs_encoder_get_id(vencoder)) &
+	     OBS_ENCODER_CAP_DYN_BITRATE) == 0) {
+		info("Dynamic bitrate disabled, the encoder doesn't support "
+		     "it");
+		return false;
+	}
+
+	vsettings = obs_encoder_get_settings(vencoder);
+	rc = obs_data_get_string(vsettings, "rate_control");
+	cbr = astrcmpi(rc, "CQP") != 0 && astrcmpi(rc, "ICQ") != 0 &&
+		astrcmpi(rc, "CRF") != 0 && astrcmpi(rc, "LOSSLESS") != 0;
+	stream->dbr_orig_bitrate = (long)obs_data_get_int(vsettings,
+			"bitrate");
+	obs_data_release(vsettings);
+
+	if (!cbr || stream->dbr_orig_bitrate <= 0) {
+		info("Dynamic bitrate disabled, the encoder isn't using a "
+		     "bitrate based rate control");
+		return false;
+	}
+
+	stream->audio_bitrate = 0;
+	if (aencoder) {
+		asettings = obs_encoder_get_settings(aencoder);
+		stream->audio_bitrate = (long)obs_data_get_int(asettings,
+				"bitrate");
+		obs_data_release(asettings);
+	}
+
+	stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
+	stream->dbr_prev_bitrate = 0;
+	stream->dbr_inc_bitrate = stream->dbr_orig_bitrate / 10;
+	if (stream->dbr_inc_bitrate < DBR_MIN_BITRATE)
+		stream->dbr_inc_bitrate = DBR_MIN_BITRATE;
+	stream->dbr_congested_ts = 0;
+	stream->dbr_inc_timeout = 0;
+	stream->dbr_decreases = 0;
+	stream->dbr_increases = 0;
+
+	pthread_mutex_lock(&stream->dbr_mutex);
+	circlebuf_free(&stream->dbr_frames);
+	stream->dbr_data_size = 0;
+	stream->dbr_est_bitrate = 0;
+	pthread_mutex_unlock(&stream->dbr_mutex);
+
+	info("Dynamic bitrate enabled, %ld kb/s", stream->dbr_orig_bitrate);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static void *send_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -449,6 +722,8 @@ static void *send_thread(void *data)
 
 	while (os_sem_wait(stream->send_sem) == 0) {
 		struct encoder_packet packet;
+		struct dbr_frame dbr_frame;
+		int sent;
 
 		if (stopping(stream) && stream->stop_ts == 0) {
 			break;
@@ -471,10 +746,23 @@ static void *send_thread(void *data)
 			}
 		}
 
-		if (send_packet(stream, &packet, false, packet.track_idx) < 0) {
+		if (stream->dbr_enabled)
+			dbr_frame.send_beg = os_gettime_ns();
+
+		sent = send_packet(stream, &packet, false, packet.track_idx);
+		if (sent < 0) {
 			os_atomic_set_bool(&stream->disconnected, true);
 			break;
 		}
+
+		if (stream->dbr_enabled) {
+			dbr_frame.send_end = os_gettime_ns();
+			dbr_frame.size = (size_t)sent;
+
+			pthread_mutex_lock(&stream->dbr_mutex);
+			dbr_add_frame(stream, &dbr_frame);
+			pthread_mutex_unlock(&stream->dbr_mutex);
+		}
 	}
 
 	if (disconnected(stream)) {
@@ -486,11 +774,24 @@ static void *send_thread(void *data)
 	if (stream->new_socket_loop) {
 		os_event_signal(stream->send_thread_signaled_exit);
 		os_event_signal(stream->buffer_has_data_event);
+#ifndef _WIN32
+		socket_thread_posix_wake(stream);
+#endif
 		pthread_join(stream->socket_thread, NULL);
 		stream->socket_thread_active = false;
 		stream->rtmp.m_bCustomSend = false;
 	}
 
+	/* the encoder may outlive the stream (e.g. shared with a recording),
+	 * so don't leave it at a lowered bitrate */
+	pthread_mutex_lock(&stream->packets_mutex);
+	if (stream->dbr_enabled &&
+	    stream->dbr_cur_bitrate != stream->dbr_orig_bitrate) {
+		stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
+		dbr_set_bitrate(stream);
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+
 	set_output_error(stream);
 	RTMP_Close(&stream->rtmp);
 
@@ -699,8 +1000,8 @@ static int init_send(struct rtmp_stream *stream)
 		ret = pthread_create(&stream->socket_thread, NULL,
 				socket_thread_windows, stream);
 #else
-		warn("New socket loop not supported on this platform");
-		return OBS_OUTPUT_ERROR;
+		ret = pthread_create(&stream->socket_thread, NULL,
+				socket_thread_posix, stream);
 #endif
 
 		if (ret != 0) {
@@ -907,6 +1208,10 @@ static bool init_connect(struct rtmp_stream *stream)
 	stream->low_latency_mode = obs_data_get_bool(settings,
 			OPT_LOWLATENCY_ENABLED);
 
+	pthread_mutex_lock(&stream->packets_mutex);
+	stream->dbr_enabled = dbr_init(stream, settings);
+	pthread_mutex_unlock(&stream->packets_mutex);
+
 	obs_data_release(settings);
 	return true;
 }
@@ -1042,8 +1347,10 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 		stream->drop_threshold_usec;
 
 	if (num_packets < 5) {
-		if (!pframes)
+		if (!pframes) {
 			stream->congestion = 0.0f;
+			stream->dbr_congested_ts = 0;
+		}
 		return;
 	}
 
@@ -1057,6 +1364,11 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 	if (!pframes) {
 		stream->congestion = (float)buffer_duration_usec /
 			(float)drop_threshold;
+
+		/* lowering the bitrate comes first, dropping frames is what
+		 * happens if that wasn't enough */
+		if (stream->dbr_enabled)
+			dbr_check_congestion(stream, buffer_duration_usec);
 	}
 
 	if (buffer_duration_usec > drop_threshold) {
@@ -1071,6 +1383,9 @@ static bool add_video_packet(struct rtmp_stream *stream,
 	check_to_drop_frames(stream, false);
 	check_to_drop_frames(stream, true);
 
+	if (stream->dbr_enabled)
+		dbr_check_increase(stream);
+
 	/* if currently dropping frames, drop packets until it reaches the
 	 * desired priority */
 	if (packet->drop_priority < stream->min_priority) {
@@ -1129,6 +1444,7 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_bool(defaults, OPT_DYN_BITRATE, false);
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -1160,6 +1476,8 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 			obs_module_text("RTMPStream.NewSocketLoop"));
 	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
 			obs_module_text("RTMPStream.LowLatencyMode"));
+	obs_properties_add_bool(props, OPT_DYN_BITRATE,
+			obs_module_text("RTMPStream.DynamicBitrate"));
 
 	return props;
 }
@@ -30,6 +30,7 @@
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_DYN_BITRATE "dyn_bitrate"
 
 //#define TEST_FRAMEDROPS
 
@@ -44,6 +45,12 @@ struct droptest_info {
 };
 #endif
 
+struct dbr_frame {
+	uint64_t send_beg;
+	uint64_t send_end;
+	size_t size;
+};
+
 struct rtmp_stream {
 	obs_output_t     *output;
 
@@ -84,6 +91,22 @@ struct rtmp_stream {
 	uint64_t         total_bytes_sent;
 	int              dropped_frames;
 
+	/* dynamic bitrate variables */
+	bool             dbr_enabled;
+	pthread_mutex_t  dbr_mutex;
+	struct circlebuf dbr_frames;
+	size_t           dbr_data_size;
+	uint64_t         dbr_congested_ts;
+	uint64_t         dbr_inc_timeout;
+	long             audio_bitrate;
+	long             dbr_est_bitrate;
+	long             dbr_orig_bitrate;
+	long             dbr_prev_bitrate;
+	long             dbr_cur_bitrate;
+	long             dbr_inc_bitrate;
+	int              dbr_decreases;
+	int              dbr_increases;
+
 #ifdef TEST_FRAMEDROPS
 	struct circlebuf droptest_info;
 	size_t           droptest_size;
@@ -104,8 +127,16 @@ struct rtmp_stream {
 	os_event_t       *buffer_has_data_event;
 	os_event_t       *socket_available_event;
 	os_event_t       *send_thread_signaled_exit;
+#ifndef _WIN32
+	int              wake_fds[2];
+#endif
 };
 
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#else
+void *socket_thread_posix(void *data);
+bool socket_thread_posix_init(struct rtmp_stream *stream);
+void socket_thread_posix_free(struct rtmp_stream *stream);
+void socket_thread_posix_wake(struct rtmp_stream *stream);
 #endif
@@ -0,0 +1,346 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-avc.h>
+#include "ts-mux.h"
+
+/* only one h264 video stream and one aac audio stream are muxed, the same
+ * as flv-mux.  the PMT always lists exactly those two, so any other codec or
+ * a second audio track can't be carried */
+
+#define TS_PACKET_SIZE    188
+#define TS_PAYLOAD_SIZE   184
+
+#define PID_PAT           0x0000
+#define PID_PMT           0x1000
+#define PID_VIDEO         0x0100
+#define PID_AUDIO         0x0101
+
+#define STREAM_TYPE_H264  0x1B
+#define STREAM_TYPE_AAC   0x0F
+
+#define STREAM_ID_VIDEO   0xE0
+#define STREAM_ID_AUDIO   0xC0
+
+#define ADTS_HEADER_SIZE  7
+
+static const uint8_t aud_nal[] = {0, 0, 0, 1, OBS_NAL_AUD, 0xF0};
+
+/* ------------------------------------------------------------------------- */
+
+static uint32_t mpeg_crc32(const uint8_t *data, size_t size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= (uint32_t)data[i] << 24;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80000000) ?
+				(crc << 1) ^ 0x04C11DB7 : crc << 1;
+	}
+
+	return crc;
+}
+
+static inline uint8_t *put_ts_header(uint8_t *p, uint16_t pid, bool start,
+		bool adaptation, uint8_t *cc)
+{
+	*(p++) = 0x47;
+	*(p++) = (start ? 0x40 : 0x00) | (uint8_t)(pid >> 8);
+	*(p++) = (uint8_t)pid;
+	*(p++) = (adaptation ? 0x30 : 0x10) | (*cc & 0xF);
+	*cc = (*cc + 1) & 0xF;
+	return p;
+}
+
+static void write_section(struct serializer *s, uint16_t pid, uint8_t *cc,
+		const uint8_t *section, size_t size)
+{
+	uint8_t packet[TS_PACKET_SIZE];
+	uint8_t *p = put_ts_header(packet, pid, true, false, cc);
+	uint32_t crc = mpeg_crc32(section, size);
+
+	*(p++) = 0; /* pointer field */
+	memcpy(p, section, size);
+	p += size;
+	*(p++) = (uint8_t)(crc >> 24);
+	*(p++) = (uint8_t)(crc >> 16);
+	*(p++) = (uint8_t)(crc >> 8);
+	*(p++) = (uint8_t)crc;
+
+	memset(p, 0xFF, packet + TS_PACKET_SIZE - p);
+	s_write(s, packet, TS_PACKET_SIZE);
+}
+
+void ts_mux_write_tables(struct ts_mux *mux, struct serializer *s)
+{
+	/* section lengths count everything after the length field,
+	 * including the crc */
+	const uint8_t pat[] = {
+		0x00, 0xB0, 13,
+		0x00, 0x01, 0xC1, 0x00, 0x00,
+		0x00, 0x01, 0xE0 | (PID_PMT >> 8), PID_PMT & 0xFF
+	};
+	const uint8_t pmt[] = {
+		0x02, 0xB0, 23,
+		0x00, 0x01, 0xC1, 0x00, 0x00,
+		0xE0 | (PID_VIDEO >> 8), PID_VIDEO & 0xFF,
+		0xF0, 0x00,
+		STREAM_TYPE_H264, 0xE0 | (PID_VIDEO >> 8), PID_VIDEO & 0xFF,
+		0xF0, 0x00,
+		STREAM_TYPE_AAC,  0xE0 | (PID_AUDIO >> 8), PID_AUDIO & 0xFF,
+		0xF0, 0x00
+	};
+
+	write_section(s, PID_PAT, &mux->cc_pat, pat, sizeof(pat));
+	write_section(s, PID_PMT, &mux->cc_pmt, pmt, sizeof(pmt));
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint8_t *put_timestamp(uint8_t *p, uint8_t prefix, int64_t ts)
+{
+	uint64_t val = (uint64_t)ts & 0x1FFFFFFFFULL;
+
+	*(p++) = prefix | (uint8_t)((val >> 29) & 0x0E) | 1;
+	*(p++) = (uint8_t)(val >> 22);
+	*(p++) = (uint8_t)((val >> 14) & 0xFE) | 1;
+	*(p++) = (uint8_t)(val >> 7);
+	*(p++) = (uint8_t)((val << 1) & 0xFE) | 1;
+	return p;
+}
+
+static inline uint8_t *put_pcr(uint8_t *p, int64_t pcr)
+{
+	uint64_t base = (uint64_t)pcr & 0x1FFFFFFFFULL;
+
+	*(p++) = (uint8_t)(base >> 25);
+	*(p++) = (uint8_t)(base >> 17);
+	*(p++) = (uint8_t)(base >> 9);
+	*(p++) = (uint8_t)(base >> 1);
+	*(p++) = (uint8_t)((base & 1) << 7) | 0x7E;
+	*(p++) = 0;
+	return p;
+}
+
+/* splits a whole PES packet in to transport packets.  the first one carries
+ * the PCR and random access flag, the last one is padded out with adaptation
+ * field stuffing */
+static void write_pes(struct serializer *s, uint16_t pid, uint8_t *cc,
+		const uint8_t *data, size_t size, bool keyframe, int64_t pcr)
+{
+	bool first = true;
+
+	while (size) {
+		uint8_t packet[TS_PACKET_SIZE];
+		uint8_t *p;
+		size_t fields = 0;
+		size_t payload;
+		size_t af_size = 0;
+
+		if (first && (keyframe || pcr >= 0))
+			fields = 1 + (pcr >= 0 ? 6 : 0);
+
+		payload = TS_PAYLOAD_SIZE - (fields ? 1 + fields : 0);
+		if (payload > size)
+			payload = size;
+		if (payload < TS_PAYLOAD_SIZE)
+			af_size = TS_PAYLOAD_SIZE - payload;
+
+		p = put_ts_header(packet, pid, first, af_size != 0, cc);
+
+		if (af_size) {
+			uint8_t *af_end = p + af_size;
+
+			*(p++) = (uint8_t)(af_size - 1);
+			if (af_size > 1) {
+				uint8_t flags = 0;
+				if (first && keyframe)
+					flags |= 0x40;
+				if (first && pcr >= 0)
+					flags |= 0x10;
+
+				*(p++) = flags;
+				if (flags & 0x10)
+					p = put_pcr(p, pcr);
+			}
+
+			memset(p, 0xFF, af_end - p);
+			p = af_end;
+		}
+
+		memcpy(p, data, payload);
+		s_write(s, packet, TS_PACKET_SIZE);
+
+		data += payload;
+		size -= payload;
+		first = false;
+	}
+}
+
+static void pes_header(struct ts_mux *mux, uint8_t stream_id,
+		size_t payload_size, int64_t pts, int64_t dts)
+{
+	bool has_dts = pts != dts;
+	uint8_t header[19];
+	uint8_t *p = header;
+	size_t header_data = has_dts ? 10 : 5;
+	size_t length = 3 + header_data + payload_size;
+
+	/* video PES packets are usually too big for the length field,
+	 * zero means unbounded */
+	if (stream_id == STREAM_ID_VIDEO || length > 0xFFFF)
+		length = 0;
+
+	*(p++) = 0;
+	*(p++) = 0;
+	*(p++) = 1;
+	*(p++) = stream_id;
+	*(p++) = (uint8_t)(length >> 8);
+	*(p++) = (uint8_t)length;
+	*(p++) = 0x80;
+	*(p++) = has_dts ? 0xC0 : 0x80;
+	*(p++) = (uint8_t)header_data;
+
+	if (has_dts) {
+		p = put_timestamp(p, 0x30, pts);
+		p = put_timestamp(p, 0x10, dts);
+	} else {
+		p = put_timestamp(p, 0x20, pts);
+	}
+
+	da_resize(mux->pes, 0);
+	da_push_back_array(mux->pes, header, p - header);
+}
+
+static bool has_nal(const uint8_t *data, size_t size, int nal_type)
+{
+	const uint8_t *nal_start, *nal_end;
+	const uint8_t *end = data + size;
+
+	nal_start = obs_avc_find_startcode(data, end);
+	while (true) {
+		while (nal_start < end && !*(nal_start++));
+
+		if (nal_start == end)
+			break;
+
+		if ((nal_start[0] & 0x1F) == nal_type)
+			return true;
+
+		nal_end = obs_avc_find_startcode(nal_start, end);
+		nal_start = nal_end;
+	}
+
+	return false;
+}
+
+static void write_video(struct ts_mux *mux, struct serializer *s,
+		const struct encoder_packet *packet, int64_t pts, int64_t dts)
+{
+	bool add_aud = !has_nal(packet->data, packet->size, OBS_NAL_AUD);
+	bool add_header = packet->keyframe && mux->video_header &&
+		!has_nal(packet->data, packet->size, OBS_NAL_SPS);
+
+	pes_header(mux, STREAM_ID_VIDEO, 0, pts, dts);
+
+	/* HLS players expect an access unit delimiter first, and every
+	 * keyframe has to carry its own SPS/PPS since any segment can be the
+	 * first one a player loads */
+	if (add_aud)
+		da_push_back_array(mux->pes, aud_nal, sizeof(aud_nal));
+	if (add_header)
+		da_push_back_array(mux->pes, mux->video_header,
+				mux->video_header_size);
+	da_push_back_array(mux->pes, packet->data, packet->size);
+
+	write_pes(s, PID_VIDEO, &mux->cc_video, mux->pes.array,
+			mux->pes.num, packet->keyframe, dts);
+}
+
+static void write_audio(struct ts_mux *mux, struct serializer *s,
+		const struct encoder_packet *packet, int64_t pts)
+{
+	size_t frame_size = ADTS_HEADER_SIZE + packet->size;
+	uint8_t adts[ADTS_HEADER_SIZE];
+
+	adts[0] = 0xFF;
+	adts[1] = 0xF1;
+	adts[2] = (uint8_t)(((mux->aac_object_type - 1) << 6) |
+			(mux->aac_freq_idx << 2) | (mux->aac_channels >> 2));
+	adts[3] = (uint8_t)(((mux->aac_channels & 3) << 6) |
+			(frame_size >> 11));
+	adts[4] = (uint8_t)(frame_size >> 3);
+	adts[5] = (uint8_t)(((frame_size & 7) << 5) | 0x1F);
+	adts[6] = 0xFC;
+
+	pes_header(mux, STREAM_ID_AUDIO, frame_size, pts, pts);
+	da_push_back_array(mux->pes, adts, ADTS_HEADER_SIZE);
+	da_push_back_array(mux->pes, packet->data, packet->size);
+
+	write_pes(s, PID_AUDIO, &mux->cc_audio, mux->pes.array,
+			mux->pes.num, false, -1);
+}
+
+void ts_mux_write_packet(struct ts_mux *mux, struct serializer *s,
+		const struct encoder_packet *packet, int64_t pts, int64_t dts)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		write_video(mux, s, packet, pts, dts);
+	else
+		write_audio(mux, s, packet, pts);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void ts_mux_init(struct ts_mux *mux,
+		const uint8_t *video_header, size_t video_header_size,
+		const uint8_t *audio_config, size_t audio_config_size)
+{
+	memset(mux, 0, sizeof(*mux));
+
+	if (video_header && video_header_size) {
+		mux->video_header = bmemdup(video_header, video_header_size);
+		mux->video_header_size = video_header_size;
+	}
+
+	/* AAC LC, 48khz stereo unless the encoder says otherwise */
+	mux->aac_object_type = 2;
+	mux->aac_freq_idx    = 3;
+	mux->aac_channels    = 2;
+
+	if (audio_config && audio_config_size >= 2) {
+		uint8_t object_type = audio_config[0] >> 3;
+		uint8_t freq_idx = ((audio_config[0] & 7) << 1) |
+			(audio_config[1] >> 7);
+
+		/* ADTS can only signal the first four object types and
+		 * the indexed sample rates */
+		if (object_type >= 1 && object_type <= 4)
+			mux->aac_object_type = object_type;
+		if (freq_idx < 13)
+			mux->aac_freq_idx = freq_idx;
+		mux->aac_channels = (audio_config[1] >> 3) & 0xF;
+	}
+}
+
+void ts_mux_free(struct ts_mux *mux)
+{
+	bfree(mux->video_header);
+	da_free(mux->pes);
+	memset(mux, 0, sizeof(*mux));
+}
@@ -0,0 +1,64 @@
+/******************************************************************************
+    Copyright (C) 2020 by Zaodao(Dalian) Education Technology Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <util/darray.h>
+#include <util/serializer.h>
+
+/* MPEG-TS muxing of h264 and aac encoder packets, as used by HLS segments.
+ * timestamps are in the 90khz transport stream clock */
+
+#define TS_CLOCK_RATE 90000
+
+struct ts_mux {
+	uint8_t         *video_header;
+	size_t          video_header_size;
+
+	uint8_t         aac_object_type;
+	uint8_t         aac_freq_idx;
+	uint8_t         aac_channels;
+
+	uint8_t         cc_pat;
+	uint8_t         cc_pmt;
+	uint8_t         cc_video;
+	uint8_t         cc_audio;
+
+	DARRAY(uint8_t) pes;
+};
+
+/* video_header is the annex-b SPS/PPS from the video encoder, audio_config
+ * the AudioSpecificConfig from the audio encoder */
+extern void ts_mux_init(struct ts_mux *mux,
+		const uint8_t *video_header, size_t video_header_size,
+		const uint8_t *audio_config, size_t audio_config_size);
+extern void ts_mux_free(struct ts_mux *mux);
+
+/* PAT and PMT, written at the start of every segment so each one can be
+ * decoded on its own */
+extern void ts_mux_write_tables(struct ts_mux *mux, struct serializer *s);
+
+extern void ts_mux_write_packet(struct ts_mux *mux, struct serializer *s,
+		const struct encoder_packet *packet, int64_t pts, int64_t dts);
+
+static inline int64_t ts_mux_time(const struct encoder_packet *packet,
+		int64_t val)
+{
+	return val * TS_CLOCK_RATE * packet->timebase_num /
+		packet->timebase_den;
+}
@@ -159,7 +159,12 @@ int qsv_param_apply_profile(qsv_param_t *, const char *profile)
 int qsv_encoder_reconfig(qsv_t *pContext, qsv_param_t *pParams)
 {
 	QSV_Encoder_Internal *pEncoder = (QSV_Encoder_Internal *)pContext;
-	mfxStatus sts = pEncoder->Reset(pParams);
+
+	/* bitrate changes (e.g. from the stream's bitrate controller) don't
+	 * need the session rebuilt */
+	mfxStatus sts = pEncoder->UpdateBitrate(pParams);
+	if (sts != MFX_ERR_NONE)
+		sts = pEncoder->Reset(pParams);
 
 	if (sts == MFX_ERR_NONE)
 		return 0;
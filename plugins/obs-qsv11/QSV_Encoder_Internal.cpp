@@ -167,6 +167,7 @@ mfxStatus QSV_Encoder_Internal::Open(qsv_param_t * pParams)
 
 	m_pmfxENC = new MFXVideoENCODE(m_session);
 
+	m_params = *pParams;
 	InitParams(pParams);
 
 	sts = m_pmfxENC->Query(&m_mfxEncParams, &m_mfxEncParams);
@@ -609,6 +610,41 @@ mfxStatus QSV_Encoder_Internal::ClearData()
 	return sts;
 }
 
+// Changes the bitrate of an open encoder without tearing it down.  Returns
+// MFX_ERR_UNSUPPORTED if anything other than the bitrate changed.
+mfxStatus QSV_Encoder_Internal::UpdateBitrate(qsv_param_t *pParams)
+{
+	qsv_param_t params = *pParams;
+	params.nTargetBitRate = m_params.nTargetBitRate;
+	params.nMaxBitRate = m_params.nMaxBitRate;
+	if (memcmp(&params, &m_params, sizeof(params)) != 0)
+		return MFX_ERR_UNSUPPORTED;
+
+	mfxVideoParam encParams = m_mfxEncParams;
+
+	switch (encParams.mfx.RateControlMethod) {
+	case MFX_RATECONTROL_CBR:
+	case MFX_RATECONTROL_AVBR:
+		encParams.mfx.TargetKbps = pParams->nTargetBitRate;
+		break;
+	case MFX_RATECONTROL_VBR:
+	case MFX_RATECONTROL_VCM:
+		encParams.mfx.TargetKbps = pParams->nTargetBitRate;
+		encParams.mfx.MaxKbps = pParams->nMaxBitRate;
+		break;
+	default:
+		return MFX_ERR_UNSUPPORTED;
+	}
+
+	mfxStatus sts = m_pmfxENC->Reset(&encParams);
+	MSDK_IGNORE_MFX_STS(sts, MFX_WRN_INCOMPATIBLE_VIDEO_PARAM);
+	MSDK_CHECK_RESULT(sts, MFX_ERR_NONE, sts);
+
+	m_mfxEncParams = encParams;
+	m_params = *pParams;
+	return sts;
+}
+
 mfxStatus QSV_Encoder_Internal::Reset(qsv_param_t *pParams)
 {
 	mfxStatus sts = ClearData();
@@ -73,6 +73,7 @@ public:
 			**pBS);
 	mfxStatus    ClearData();
 	mfxStatus    Reset(qsv_param_t *pParams);
+	mfxStatus    UpdateBitrate(qsv_param_t *pParams);
 
 protected:
 	bool         InitParams(qsv_param_t * pParams);
@@ -90,6 +91,7 @@ private:
 	MFXVideoSession                m_session;
 	mfxFrameAllocator              m_mfxAllocator;
 	mfxVideoParam                  m_mfxEncParams;
+	qsv_param_t                    m_params;
 	mfxFrameAllocResponse          m_mfxResponse;
 	mfxFrameSurface1**             m_pmfxSurfaces;
 	mfxU16                         m_nSurfNum;
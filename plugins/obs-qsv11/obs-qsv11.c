@@ -721,6 +721,7 @@ struct obs_encoder_info obs_qsv_encoder = {
 	.id = "obs_qsv11",
 	.type = OBS_ENCODER_VIDEO,
 	.codec = "h264",
+	.caps = OBS_ENCODER_CAP_DYN_BITRATE,
 	.get_name = obs_qsv_getname,
 	.create = obs_qsv_create,
 	.destroy = obs_qsv_destroy,
@@ -62,6 +62,7 @@ void dc_capture_init(struct dc_capture *capture, int x, int y,
 				DIB_RGB_COLORS, (void**)&capture->bits,
 				NULL, 0);
 		capture->old_bmp = SelectObject(capture->hdc, capture->bmp);
+		capture->last_bits = bmalloc(width * height * 4);
 	}
 }
 
@@ -73,6 +74,8 @@ void dc_capture_free(struct dc_capture *capture)
 		DeleteObject(capture->bmp);
 	}
 
+	bfree(capture->last_bits);
+
 	obs_enter_graphics();
 	gs_texture_destroy(capture->texture);
 	obs_leave_graphics();
@@ -123,18 +126,31 @@ static inline HDC dc_capture_get_dc(struct dc_capture *capture)
 		return gs_texture_get_dc(capture->texture);
 }
 
-static inline void dc_capture_release_dc(struct dc_capture *capture)
+static inline bool dc_capture_release_dc(struct dc_capture *capture)
 {
 	if (capture->compatibility) {
+		size_t size = capture->width * capture->height * 4;
+
+		/* the bits are on the CPU anyway, so only upload them when
+		 * something in the window changed */
+		GdiFlush();
+		if (capture->texture_written &&
+		    memcmp(capture->bits, capture->last_bits, size) == 0)
+			return false;
+
+		memcpy(capture->last_bits, capture->bits, size);
 		gs_texture_set_image(capture->texture,
 				capture->bits, capture->width*4, false);
 	} else {
 		gs_texture_release_dc(capture->texture);
 	}
+
+	return true;
 }
 
-void dc_capture_capture(struct dc_capture *capture, HWND window)
+bool dc_capture_capture(struct dc_capture *capture, HWND window)
 {
+	bool changed;
 	HDC hdc_target;
 	HDC hdc;
 
@@ -148,7 +164,7 @@ void dc_capture_capture(struct dc_capture *capture, HWND window)
 	if (!hdc) {
 		blog(LOG_WARNING, "[capture_screen] Failed to get "
 		                  "texture DC");
-		return;
+		return false;
 	}
 
 	hdc_target = GetDC(window);
@@ -161,9 +177,10 @@ void dc_capture_capture(struct dc_capture *capture, HWND window)
 	if (capture->cursor_captured && !capture->cursor_hidden)
 		draw_cursor(capture, hdc, window);
 
-	dc_capture_release_dc(capture);
+	changed = dc_capture_release_dc(capture);
 
 	capture->texture_written = true;
+	return changed;
 }
 
 static void draw_texture(struct dc_capture *capture, gs_effect_t *effect)
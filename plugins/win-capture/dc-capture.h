@@ -16,6 +16,7 @@ struct dc_capture {
 	HDC          hdc;
 	HBITMAP      bmp, old_bmp;
 	BYTE         *bits;
+	BYTE         *last_bits;
 
 	bool         capture_cursor;
 	bool         cursor_captured;
@@ -30,5 +31,6 @@ extern void dc_capture_init(struct dc_capture *capture, int x, int y,
 		bool compatibility);
 extern void dc_capture_free(struct dc_capture *capture);
 
-extern void dc_capture_capture(struct dc_capture *capture, HWND window);
+/* returns true if the texture changed */
+extern bool dc_capture_capture(struct dc_capture *capture, HWND window);
 extern void dc_capture_render(struct dc_capture *capture, gs_effect_t *effect);
@@ -162,8 +162,10 @@ static void wc_tick(void *data, float seconds)
 		wc->window = find_window(EXCLUDE_MINIMIZED, wc->priority,
 				wc->class, wc->title, wc->executable);
 		if (!wc->window) {
-			if (wc->capture.valid)
+			if (wc->capture.valid) {
 				dc_capture_free(&wc->capture);
+				obs_source_damage(wc->source);
+			}
 			return;
 		}
 
@@ -216,7 +218,8 @@ static void wc_tick(void *data, float seconds)
 				wc->cursor, wc->compatibility);
 	}
 
-	dc_capture_capture(&wc->capture, wc->window);
+	if (dc_capture_capture(&wc->capture, wc->window))
+		obs_source_damage(wc->source);
 	obs_leave_graphics();
 }
 
@@ -231,7 +234,8 @@ static void wc_render(void *data, gs_effect_t *effect)
 struct obs_source_info window_capture_info = {
 	.id             = "window_capture",
 	.type           = OBS_SOURCE_TYPE_INPUT,
-	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW,
+	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
+	                  OBS_SOURCE_DAMAGE,
 	.get_name       = wc_getname,
 	.create         = wc_create,
 	.destroy        = wc_destroy,
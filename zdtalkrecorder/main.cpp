@@ -16,14 +16,11 @@
 ******************************************************************************/
 
 #include <QApplication>
-#include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
 #include <QProcess>
 #include <QTextcodec>
-#include <QTimeZone>
-#include <QThread>
 
 #include <Windows.h>
 #include <iostream>
@@ -123,29 +120,31 @@ static bool SetupCrashRpt(CrAutoInstallHelper **helper, const QString &user_name
 static void QtLogHandler(QtMsgType type, const QMessageLogContext &,
     const QString &msg)
 {
-    QString tag = "UNKNOWN";
+    const char *tag = "UNKNOWN";
     switch (type)
     {
     case QtInfoMsg:
-        tag = QString("INFO");    break;
+        tag = "INFO";    break;
     case QtDebugMsg:
-        tag = QString("DEBUG");   break;
+        tag = "DEBUG";   break;
     case QtWarningMsg:
-        tag = QString("WARNING"); break;
+        tag = "WARNING"; break;
     case QtCriticalMsg:
-        tag = QString("ERROR");   break;
+        tag = "ERROR";   break;
     case QtFatalMsg:
-        tag = QString("FATAL");   break;
+        tag = "FATAL";   break;
     default:
         break;
     }
 
-    QString text = QStringLiteral("[%1][%2:%3] %4")
-        .arg(QDateTime::currentDateTime().toTimeZone(QTimeZone("UTC+08:00")).
-        toString("hh:mm:ss.zzz"))
-        .arg(quintptr(QThread::currentThreadId()))
-        .arg(tag).arg(msg);
-    RecorderLogger::GetInstance()->WriteLog(text);
+    // the time and thread are taken here, the line is formatted and
+    // written by the logger's own thread
+    RecorderLogger::GetInstance()->WriteLog(tag, msg);
+
+    // fatal messages abort right after this, and the crash handler wants
+    // the log file complete
+    if (type == QtFatalMsg || msg == LOG_CRASHED)
+        RecorderLogger::GetInstance()->Flush();
 }
 // [Qt Log Handler]
 
@@ -162,7 +161,27 @@ static void OBSLogHandler(int level, const char *format, va_list args, void *par
     va_copy(args2, args);
 #endif
 
-    vsnprintf_s(str, sizeof(str), format, args);
+    int len = vsnprintf_s(str, sizeof(str), _TRUNCATE, format, args);
+    if (len < 0)
+        len = (int)strlen(str);
+
+    // straight to the logger instead of through the qDebug streams, the
+    // calling thread only formats the message and queues it
+    RecorderLogger *logger = RecorderLogger::GetInstance();
+    if (logger->IsOpen()) {
+        const char *tag = "UNKNOWN";
+        switch (level) {
+        case LOG_DEBUG:   tag = "DEBUG";   break;
+        case LOG_WARNING: tag = "WARNING"; break;
+        case LOG_ERROR:   tag = "ERROR";   break;
+        case LOG_INFO:    tag = "INFO";    break;
+        }
+
+        QByteArray text("-- ", 3);
+        text.append(str, len);
+        logger->WriteLog(tag, text);
+        return;
+    }
 
     switch (level) {
     case LOG_DEBUG:   qDebug() << "--" << str;    break;
@@ -429,6 +448,7 @@ int main(int argc, char *argv[])
     blog(LOG_INFO, "Memory leaks: %ld.", bnum_allocs());
     qInfo() << "======================= Recorder End =======================\n";
     base_set_log_handler(nullptr, nullptr);
+    RecorderLogger::GetInstance()->CloseLogFile();
 
     delete cr_install_helper;
 
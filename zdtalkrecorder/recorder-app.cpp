@@ -150,6 +150,11 @@ void ZDTalkRecorder::InitDefaultsGlobalConfig()
     config_set_default_string(global_config_, "Output", "RecMode", "ffmpeg");
 
     config_set_default_bool(global_config_, "Output", "Reconnect", false);
+    config_set_default_bool(global_config_, "Output", "DynamicBitrate", true);
+    config_set_default_bool(global_config_, "Output", "RecFragmented", true);
+    config_set_default_uint(global_config_, "Output", "RecFragmentMs", 2000);
+    config_set_default_bool(global_config_, "Output", "RecRemux", false);
+    config_set_default_uint(global_config_, "Output", "DestDropThresholdMs", 1000);
 
     config_set_default_string(global_config_, "Output", "StreamEncoder", 
         SIMPLE_ENCODER_X264);
@@ -174,6 +179,10 @@ void ZDTalkRecorder::InitDefaultsGlobalConfig()
     config_set_default_string(global_config_, "Video", "ColorFormat", "I420");
     config_set_default_string(global_config_, "Video", "ColorSpace", "601");
     config_set_default_string(global_config_, "Video", "ColorRange", "Partial");
+    // most captured frames are identical slides, don't encode them again
+    config_set_default_bool(global_config_, "Video", "SkipStaticFrames", true);
+    // deeper readback ring so integrated GPUs don't stall the render loop
+    config_set_default_uint(global_config_, "Video", "StagingDepth", 3);
 
     // Audio -------------------------------------------------------------------
     config_set_default_int(global_config_, "Audio", "SampleRate", 44100);
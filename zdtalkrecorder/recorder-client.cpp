@@ -135,14 +135,22 @@ RecorderClient::RecorderClient(QObject *parent) : QObject(parent)
 #ifndef TEST
     connect(obs_context_, &RecorderObsContext::Inited,
         this, &RecorderClient::OnOBSInited);
+    connect(obs_context_, &RecorderObsContext::InitTimings,
+        this, &RecorderClient::OnOBSInitTimings);
     connect(obs_context_, &RecorderObsContext::RecordingStarted,
         this, &RecorderClient::OnOBSRecordingStarted);
     connect(obs_context_, &RecorderObsContext::RecordingStopped,
         this, &RecorderClient::OnOBSRecordingStopped);
+    connect(obs_context_, &RecorderObsContext::RecordingRemuxed,
+        this, &RecorderClient::OnOBSRecordingRemuxed);
     connect(obs_context_, &RecorderObsContext::StreamingStarted,
         this, &RecorderClient::OnOBSStreamingStarted);
     connect(obs_context_, &RecorderObsContext::StreamingStopped,
         this, &RecorderClient::OnOBSStreamingStopped);
+    connect(obs_context_, &RecorderObsContext::StreamDestinationStarted,
+        this, &RecorderClient::OnOBSStreamDestinationStarted);
+    connect(obs_context_, &RecorderObsContext::StreamDestinationStopped,
+        this, &RecorderClient::OnOBSStreamDestinationStopped);
     connect(obs_context_, &RecorderObsContext::ErrorOccurred,
         this, &RecorderClient::OnOBSErrorOccurred);
 #else
@@ -201,6 +209,10 @@ RecorderClient::RecorderClient(QObject *parent) : QObject(parent)
         obs_context_, &RecorderObsContext::StartStreaming);
     connect(this, &RecorderClient::OBSStopStreaming,
         obs_context_, &RecorderObsContext::StopStreaming);
+    connect(this, &RecorderClient::OBSAddStreamDestination,
+        obs_context_, &RecorderObsContext::AddStreamDestination);
+    connect(this, &RecorderClient::OBSRemoveStreamDestination,
+        obs_context_, &RecorderObsContext::RemoveStreamDestination);
     connect(this, &RecorderClient::OBSLogStreamStats,
         obs_context_, &RecorderObsContext::LogStreamStats);
 
@@ -457,6 +469,31 @@ void RecorderClient::OnSocketReadyRead()
             emit OBSStopStreaming(force);
 #else
             obs_context_->StopStreaming(force);
+#endif
+        }
+            break;
+        case kEventAddStreamDestination:
+        {
+            QString id, server, key;
+            in >> id >> server >> key;
+            qInfo() << TAG_IN << "Add Stream Destination:" << id << server;
+#ifdef THREADWORKER
+            emit OBSAddStreamDestination(id, server, key);
+#else
+            obs_context_->AddStreamDestination(id, server, key);
+#endif
+        }
+            break;
+        case kEventRemoveStreamDestination:
+        {
+            QString id;
+            bool force;
+            in >> id >> force;
+            qInfo() << TAG_IN << "Remove Stream Destination:" << id << force;
+#ifdef THREADWORKER
+            emit OBSRemoveStreamDestination(id, force);
+#else
+            obs_context_->RemoveStreamDestination(id, force);
 #endif
         }
             break;
@@ -503,6 +540,12 @@ void RecorderClient::OnOBSInited()
     SendMessageToServer(kEventInited);
 }
 
+void RecorderClient::OnOBSInitTimings(const QString &timings)
+{
+    qInfo() << TAG_OUT << "Init Timings:" << timings;
+    SendMessageToServer(kEventInitTimings, kErrorNone, timings);
+}
+
 void RecorderClient::OnOBSRecordingStarted()
 {
     qInfo() << TAG_OUT << "Recording Started.";
@@ -515,6 +558,12 @@ void RecorderClient::OnOBSRecordingStopped(const QString &path)
     SendMessageToServer(kEventRecordingStopped, kErrorNone, path);
 }
 
+void RecorderClient::OnOBSRecordingRemuxed(const QString &path)
+{
+    qInfo() << TAG_OUT << "Recording Remuxed." << path;
+    SendMessageToServer(kEventRecordingRemuxed, kErrorNone, path);
+}
+
 void RecorderClient::OnOBSStreamingStarted()
 {
     qInfo() << TAG_OUT << "Streaming Started.";
@@ -527,6 +576,20 @@ void RecorderClient::OnOBSStreamingStopped()
     SendMessageToServer(kEventStreamingStopped);
 }
 
+void RecorderClient::OnOBSStreamDestinationStarted(const QString &id)
+{
+    qInfo() << TAG_OUT << "Stream Destination Started." << id;
+    SendMessageToServer(kEventStreamDestinationStarted, kErrorNone, id);
+}
+
+void RecorderClient::OnOBSStreamDestinationStopped(const QString &id,
+    bool error)
+{
+    qInfo() << TAG_OUT << "Stream Destination Stopped." << id << error;
+    SendMessageToServer(kEventStreamDestinationStopped,
+        error ? kErrorClientStreaming : kErrorNone, id);
+}
+
 void RecorderClient::OnOBSErrorOccurred(const int type, const QString &msg)
 {
     qCritical() << TAG_OUT << "!!! Error Occurred :" << type << msg;
@@ -65,15 +65,22 @@ signals:
     void OBSStopRecording(bool force);
     void OBSStartStreaming(const QString &server, const QString &key);
     void OBSStopStreaming(bool force);
+    void OBSAddStreamDestination(const QString &id, const QString &server,
+                                 const QString &key);
+    void OBSRemoveStreamDestination(const QString &id, bool force);
     void OBSLogStreamStats();
 
 public slots:
     // Recording Callback -> Client
     void OnOBSInited();
+    void OnOBSInitTimings(const QString &);
     void OnOBSRecordingStarted();
     void OnOBSRecordingStopped(const QString &);
+    void OnOBSRecordingRemuxed(const QString &);
     void OnOBSStreamingStarted();
     void OnOBSStreamingStopped();
+    void OnOBSStreamDestinationStarted(const QString &);
+    void OnOBSStreamDestinationStopped(const QString &, bool);
     void OnOBSErrorOccurred(const int, const QString &);
 
 private slots:
@@ -76,6 +76,16 @@ enum ZDTalkRecorderEvent
     kEventStreamingStopped,
     kEventStateNotify,
     kEventErrorOccurred,
+    kEventInitTimings,
+    kEventRecordingRemuxed,
+
+    // Server to client
+    kEventAddStreamDestination,
+    kEventRemoveStreamDestination,
+
+    // Client to server
+    kEventStreamDestinationStarted,
+    kEventStreamDestinationStopped,
 };
 
 enum ZDTalkRecorderError
@@ -17,31 +17,207 @@
 
 #include "recorder-logger.h"
 
-#include <QMutexLocker>
-#include <QTextStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QThread>
+#include <QTimeZone>
+
+namespace {
+
+const int kMaxPendingLines = 16384;
+const int kFlushIntervalMs = 50;
+const qint64 kMaxFileSize = 32 * 1024 * 1024;
+const int kMaxBackupFiles = 3;
+
+} // namespace
 
 void RecorderLogger::OpenLogFile(const QString &path)
 {
-    QMutexLocker locker(&mutex_);
-
-    if (file_.isOpen())
-        file_.close();
+    CloseLogFile();
 
+    path_ = path;
     file_.setFileName(path);
-    if (file_.open(QIODevice::WriteOnly | QIODevice::Append)) {
-        QTextStream ts(&file_);
-        ts.setCodec("UTF-8");
-        ts << "\n";
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Append))
+        return;
+
+    file_.write("\n");
+    file_.flush();
+
+    stop_ = false;
+    running_ = true;
+    thread_ = std::thread(&RecorderLogger::FlushThread, this);
+}
+
+void RecorderLogger::CloseLogFile()
+{
+    if (!running_)
+        return;
+
+    running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
     }
+    wake_.notify_one();
+    thread_.join();
+
+    // anything pushed while the flusher was stopping is thrown away
+    Entry *entries = head_.exchange(nullptr);
+    while (entries) {
+        Entry *next = entries->next;
+        delete entries;
+        entries = next;
+    }
+    pending_ = 0;
+
+    file_.close();
 }
 
 void RecorderLogger::WriteLog(const QString &text)
 {
-    QMutexLocker locker(&mutex_);
+    WriteLog(nullptr, text.toUtf8());
+}
+
+void RecorderLogger::WriteLog(const char *tag, const QString &text)
+{
+    WriteLog(tag, text.toUtf8());
+}
+
+void RecorderLogger::WriteLog(const char *tag, const QByteArray &utf8)
+{
+    if (!running_)
+        return;
+
+    if (pending_.fetch_add(1) >= kMaxPendingLines) {
+        pending_.fetch_sub(1);
+        dropped_.fetch_add(1);
+        return;
+    }
+
+    Entry *entry = new Entry;
+    entry->msecs = QDateTime::currentMSecsSinceEpoch();
+    entry->thread_id = quintptr(QThread::currentThreadId());
+    entry->tag = tag;
+    entry->text = utf8;
+    Push(entry);
+}
+
+void RecorderLogger::Push(Entry *entry)
+{
+    entry->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(entry->next, entry,
+        std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+void RecorderLogger::Flush()
+{
+    if (!running_ || thread_.get_id() == std::this_thread::get_id())
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    quint64 request = ++flush_request_;
+    wake_.notify_one();
+    flushed_.wait_for(lock, std::chrono::seconds(1),
+        [&] { return flush_done_ >= request || stop_; });
+}
+
+void RecorderLogger::FlushThread()
+{
+    for (;;) {
+        quint64 request;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(kFlushIntervalMs),
+                [&] { return stop_ || flush_request_ != flush_done_; });
+            request = flush_request_;
+            stop = stop_;
+        }
+
+        // the list is newest first, so take all of it and reverse it
+        Entry *entries = head_.exchange(nullptr, std::memory_order_acquire);
+        Entry *ordered = nullptr;
+        while (entries) {
+            Entry *next = entries->next;
+            entries->next = ordered;
+            ordered = entries;
+            entries = next;
+        }
+
+        if (WriteBatch(ordered))
+            file_.flush();
 
-    if (file_.isOpen()) {
-        QTextStream ts(&file_);
-        ts.setCodec("UTF-8");
-        ts << text << "\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flush_done_ = request;
+        }
+        flushed_.notify_all();
+
+        if (stop)
+            break;
     }
 }
+
+bool RecorderLogger::WriteBatch(Entry *entries)
+{
+    static const QTimeZone time_zone("UTC+08:00");
+
+    int dropped = dropped_.exchange(0);
+    if (!entries && !dropped)
+        return false;
+
+    QByteArray batch;
+    int count = 0;
+
+    while (entries) {
+        Entry *next = entries->next;
+
+        // untagged lines are written as they are
+        if (entries->tag) {
+            QDateTime time = QDateTime::fromMSecsSinceEpoch(entries->msecs,
+                time_zone);
+            batch += '[';
+            batch += time.toString("hh:mm:ss.zzz").toLatin1();
+            batch += "][";
+            batch += QByteArray::number(qulonglong(entries->thread_id));
+            batch += ':';
+            batch += entries->tag;
+            batch += "] ";
+        }
+        batch += entries->text;
+        batch += '\n';
+
+        delete entries;
+        entries = next;
+        count++;
+    }
+
+    pending_.fetch_sub(count);
+
+    if (dropped) {
+        batch += "[logger] ";
+        batch += QByteArray::number(dropped);
+        batch += " log line(s) dropped, the log file can't keep up\n";
+    }
+
+    if (file_.size() + batch.size() > kMaxFileSize)
+        RotateFile();
+
+    file_.write(batch);
+    return true;
+}
+
+// log.txt -> log.txt.1 -> log.txt.2 ..., the oldest one is removed
+void RecorderLogger::RotateFile()
+{
+    file_.close();
+
+    QFile::remove(QString("%1.%2").arg(path_).arg(kMaxBackupFiles));
+    for (int i = kMaxBackupFiles - 1; i > 0; i--)
+        QFile::rename(QString("%1.%2").arg(path_).arg(i),
+            QString("%1.%2").arg(path_).arg(i + 1));
+    QFile::rename(path_, path_ + ".1");
+
+    file_.setFileName(path_);
+    file_.open(QIODevice::WriteOnly | QIODevice::Append);
+}
@@ -18,24 +18,72 @@
 #ifndef ZDTALKOBS_RECORDER_LOGGER_H_
 #define ZDTALKOBS_RECORDER_LOGGER_H_
 
+#include <QByteArray>
 #include <QFile>
+#include <QString>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "singlebase.h"
 
+// Log lines are pushed onto a lock-free list by whichever thread logs them,
+// and a flusher thread formats and writes them to the file in batches, so
+// logging never waits on the disk.  When the flusher falls too far behind,
+// new lines are dropped and counted instead of growing the queue.
 class RecorderLogger : public Singleton<RecorderLogger>
 {
 public:
     friend class Singleton<RecorderLogger>;
-    ~RecorderLogger() {}
+    ~RecorderLogger() { CloseLogFile(); }
 
-    QString LogPath() const { return file_.fileName(); }
+    QString LogPath() const { return path_; }
+    bool IsOpen() const { return running_; }
     void OpenLogFile(const QString &);
+    void CloseLogFile();
+
     void WriteLog(const QString &);
+    void WriteLog(const char *tag, const QString &);
+    void WriteLog(const char *tag, const QByteArray &utf8);
+
+    // Waits (up to a second) until everything logged so far is on disk.
+    void Flush();
 
 private:
-    RecorderLogger() {}
+    struct Entry {
+        Entry *next;
+        qint64 msecs;
+        quintptr thread_id;
+        const char *tag;
+        QByteArray text;
+    };
 
+    RecorderLogger()
+        : head_(nullptr), pending_(0), dropped_(0), running_(false),
+          flush_request_(0), flush_done_(0), stop_(false) {}
+
+    void Push(Entry *);
+    void FlushThread();
+    bool WriteBatch(Entry *);
+    void RotateFile();
+
+    QString path_;
     QFile file_;
-    QMutex mutex_;
+
+    std::atomic<Entry *> head_;
+    std::atomic<int> pending_;
+    std::atomic<int> dropped_;
+    std::atomic<bool> running_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    quint64 flush_request_;
+    quint64 flush_done_;
+    bool stop_;
 };
 
 #endif // ZDTALKOBS_RECORDER_LOGGER_H_
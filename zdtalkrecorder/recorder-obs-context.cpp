@@ -20,19 +20,29 @@
 #include "recorder-define.h"
 #include "recorder-platform.h"
 
+#include <atomic>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <mutex>
 using std::string;
 
+#ifdef _WIN32
+#include <objbase.h>
+#endif
+
 #include <libavcodec/avcodec.h>
+#include <media-io/media-remux.h>
 #include <util/platform.h>
 #include <util/util.hpp>
 
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
+#include <QStringList>
 
 static inline enum obs_scale_type GetScaleType(const char *scale_type)
 {
@@ -76,7 +86,23 @@ static bool EncoderAvailable(const char *encoder)
 	return false;
 }
 
-static void DetectEncoder()
+struct EncoderSupport {
+	bool qsv = false;
+	bool nvenc = false;
+	bool amd = false;
+};
+
+/* only reads the registered encoder types, safe to run next to video reset */
+static EncoderSupport ProbeEncoders()
+{
+	EncoderSupport support;
+	support.qsv = EncoderAvailable("obs_qsv11");
+	support.nvenc = EncoderAvailable("ffmpeg_nvenc");
+	support.amd = EncoderAvailable("amd_amf_h264");
+	return support;
+}
+
+static void DetectEncoder(const EncoderSupport &support)
 {
 	const char *stream_encoder = config_get_string(App()->GetGlobalConfig(),
 		"Output", "StreamEncoder");
@@ -85,7 +111,7 @@ static void DetectEncoder()
 	bool reset_stream_encoder = false;
 	bool reset_rec_encoder = false;
 
-	if (EncoderAvailable("obs_qsv11"))
+	if (support.qsv)
 		blog(LOG_INFO, "Hardware.QSV is available.");
 	else {
 		blog(LOG_INFO, "Hardware.QSV is unavailable.");
@@ -93,7 +119,7 @@ static void DetectEncoder()
 		reset_rec_encoder = strcmp(rec_encoder, SIMPLE_ENCODER_QSV) == 0;
 	}
 
-	if (EncoderAvailable("ffmpeg_nvenc"))
+	if (support.nvenc)
 		blog(LOG_INFO, "Hardware.NVENC is available.");
 	else {
 		blog(LOG_INFO, "Hardware.NVENC is unavailable.");
@@ -103,7 +129,7 @@ static void DetectEncoder()
 			strcmp(rec_encoder, SIMPLE_ENCODER_NVENC) == 0;
 	}
 
-	if (EncoderAvailable("amd_amf_h264"))
+	if (support.amd)
 		blog(LOG_INFO, "Hardware.AMD is available.");
 	else {
 		blog(LOG_INFO, "Hardware.AMD is unavailable.");
@@ -194,6 +220,133 @@ static inline bool HasAudioDevices(const char *source_id)
     return count != 0;
 }
 
+struct AudioDevicePresence {
+    bool output = false;
+    bool input = false;
+};
+
+/* wasapi enumerates through COM, so the task thread needs its own apartment */
+static AudioDevicePresence ProbeAudioDevices(const char *outputSourceId,
+                                             const char *inputSourceId)
+{
+    AudioDevicePresence presence;
+
+#ifdef _WIN32
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+    presence.output = HasAudioDevices(outputSourceId);
+    presence.input = HasAudioDevices(inputSourceId);
+#ifdef _WIN32
+    if (SUCCEEDED(hr))
+        CoUninitialize();
+#endif
+
+    return presence;
+}
+
+/* Startup cache ---------------------------------------------------------------
+ * The module binaries loaded last time are remembered so the next launch can
+ * start reading them from disk while obs starts up.  Loading itself has to
+ * stay on one thread since modules register their types without locking. */
+
+#define STARTUP_CACHE_SECTION "StartupCache"
+#define PREFETCH_CHUNK_SIZE   (1024 * 1024)
+
+static QStringList GetCachedModules()
+{
+    config_t *config = App()->GetGlobalConfig();
+    const char *version = config_get_string(config, STARTUP_CACHE_SECTION,
+        "ObsVersion");
+    const char *modules = config_get_string(config, STARTUP_CACHE_SECTION,
+        "Modules");
+
+    if (!version || strcmp(version, obs_get_version_string()) != 0 ||
+        !modules || !*modules)
+        return QStringList();
+
+    return QString::fromUtf8(modules).split('|', QString::SkipEmptyParts);
+}
+
+static void AddLoadedModule(void *param, obs_module_t *module)
+{
+    QStringList *modules = static_cast<QStringList *>(param);
+    const char *path = obs_get_module_binary_path(module);
+    if (path && *path)
+        modules->prepend(QString::fromUtf8(path));
+}
+
+static void SaveStartupCache()
+{
+    config_t *config = App()->GetGlobalConfig();
+    QStringList modules;
+
+    obs_enum_modules(AddLoadedModule, &modules);
+
+    config_set_string(config, STARTUP_CACHE_SECTION, "ObsVersion",
+        obs_get_version_string());
+    config_set_string(config, STARTUP_CACHE_SECTION, "Modules",
+        modules.join('|').toUtf8().constData());
+
+    if (config_save_safe(config, "tmp", nullptr) != CONFIG_SUCCESS)
+        blog(LOG_WARNING, "Failed to save startup cache.");
+}
+
+/* reads the files through once so the loader finds them in the file cache */
+static int PrefetchModules(const QStringList &modules,
+                           const std::atomic<bool> *stop)
+{
+    QByteArray buffer(PREFETCH_CHUNK_SIZE, Qt::Uninitialized);
+    int count = 0;
+
+    for (const QString &path : modules) {
+        if (stop->load())
+            break;
+
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+
+        while (!stop->load() &&
+               file.read(buffer.data(), buffer.size()) > 0)
+            ;
+        count++;
+    }
+
+    return count;
+}
+
+class StartupTimer {
+public:
+    StartupTimer() : start_(os_gettime_ns()), last_(start_) {}
+
+    void Mark(const char *phase)
+    {
+        uint64_t now = os_gettime_ns();
+        Append(phase, now - last_);
+        last_ = now;
+    }
+
+    void AddTask(const char *phase, uint64_t ns) { Append(phase, ns); }
+
+    QString Finish()
+    {
+        Append("total", os_gettime_ns() - start_);
+        return timings_;
+    }
+
+private:
+    void Append(const char *phase, uint64_t ns)
+    {
+        if (!timings_.isEmpty())
+            timings_ += ';';
+        timings_ += QString("%1=%2").arg(phase).arg(ns / 1000000);
+    }
+
+    uint64_t start_;
+    uint64_t last_;
+    QString timings_;
+};
+
 static void ResetAudioDevice(const char *sourceId, const char *deviceId,
                              const char *deviceDesc, int channel)
 {
@@ -315,7 +468,8 @@ void RecorderObsContext::SourceDeactivated(void *data, calldata_t *params)
 }
 
 RecorderObsContext::RecorderObsContext(QObject *parent) : 
-    QObject(parent)
+    QObject(parent),
+    remux_cancel_(false)
 {
     qRegisterMetaType<OBSSource>("OBSSource");
 }
@@ -324,6 +478,17 @@ RecorderObsContext::~RecorderObsContext()
 {
     qDebug() << "Release context...";
 
+    /* 正在进行的转封装会在下一个包时取消，排队的直接丢弃 */
+    {
+        std::lock_guard<std::mutex> lock(remux_mutex_);
+        remux_queue_.clear();
+        remux_exit_ = true;
+    }
+    remux_cancel_ = true;
+    remux_cv_.notify_one();
+    if (remux_thread_.joinable())
+        remux_thread_.join();
+
     rtmp_service_ = nullptr;
     output_handler_.reset();
 
@@ -442,10 +607,6 @@ bool RecorderObsContext::StartupOBS()
 	blog(LOG_INFO, "---------------------------------");
 	obs_post_load_modules();
 
-	blog(LOG_INFO, "---------------------------------");
-	DetectEncoder();
-	blog(LOG_INFO, "---------------------------------");
-
 	// InitOBSCallbacks();
 
 	//#if defined(_WIN32)
@@ -515,8 +676,18 @@ int RecorderObsContext::ResetVideo()
 		"AdapterIdx");
 	ovi.gpu_conversion = true;
 	ovi.scale_type = GetScaleType(scaleType);
+	ovi.skip_static_frames = config_get_bool(App()->GetGlobalConfig(),
+		"Video", "SkipStaticFrames");
+	ovi.staging_depth = (uint32_t)config_get_uint(App()->GetGlobalConfig(),
+		"Video", "StagingDepth");
 	ovi.graphics_module = DL_D3D11;
 
+	QString base_path = config_get_string(App()->GetGlobalConfig(),
+		"General", "BasePath");
+	QByteArray shader_cache_path =
+		(base_path + "/data/shader-cache").toUtf8();
+	ovi.shader_cache_path = shader_cache_path.constData();
+
 	int ret = obs_reset_video(&ovi);
 
 	if (IS_WIN32 && ret != OBS_VIDEO_SUCCESS) {
@@ -540,11 +711,47 @@ bool RecorderObsContext::Init()
 {
     ProfileScope("RecorderObsContext::Init");
 
-	if (!StartupOBS()) {
+    StartupTimer timer;
+
+    /* warm the module files from the last launch while obs starts up */
+    std::atomic<bool> stop_prefetch(false);
+    QStringList cached_modules = GetCachedModules();
+    std::future<int> prefetch = std::async(std::launch::async,
+        [&cached_modules, &stop_prefetch] () {
+            return PrefetchModules(cached_modules, &stop_prefetch);
+        });
+
+    bool started = StartupOBS();
+    stop_prefetch = true;
+    blog(LOG_INFO, "Prefetched %d of %d cached modules.", prefetch.get(),
+        cached_modules.size());
+    timer.Mark("modules");
+
+	if (!started) {
 		emit ErrorOccurred(kErrorClientInit, tr("OBSStartup"));
 		return false;
 	}
 
+    /* encoder probing and device enumeration only need the loaded modules,
+     * so they run while audio, video and the service are reset */
+    uint64_t encoder_ns = 0;
+    uint64_t device_ns = 0;
+    std::future<EncoderSupport> encoders = std::async(std::launch::async,
+        [&encoder_ns] () {
+            uint64_t start = os_gettime_ns();
+            EncoderSupport support = ProbeEncoders();
+            encoder_ns = os_gettime_ns() - start;
+            return support;
+        });
+    std::future<AudioDevicePresence> devices = std::async(std::launch::async,
+        [&device_ns] () {
+            uint64_t start = os_gettime_ns();
+            AudioDevicePresence presence = ProbeAudioDevices(
+                App()->OutputAudioSource(), App()->InputAudioSource());
+            device_ns = os_gettime_ns() - start;
+            return presence;
+        });
+
 	if (!ResetAudio()) {
 		blog(LOG_ERROR, "Reset audio failed.");
 		emit ErrorOccurred(kErrorClientInit, tr("ResetAudio"));
@@ -571,12 +778,19 @@ bool RecorderObsContext::Init()
 		emit ErrorOccurred(kErrorClientInit, tr("ResetVideo"));
 		return false;
 	}
+    timer.Mark("video");
 
     if (!InitService()) {
         emit ErrorOccurred(kErrorClientInit, tr("初始化服务失败"));
         return false;
     }
 
+    /* outputs pick their encoders from the config DetectEncoder fixes up */
+	blog(LOG_INFO, "---------------------------------");
+	DetectEncoder(encoders.get());
+	blog(LOG_INFO, "---------------------------------");
+    timer.AddTask("encoders", encoder_ns);
+
     if (!ResetOutputs()) {
         emit ErrorOccurred(kErrorClientInit, tr("初始化输出失败"));
         return false;
@@ -586,8 +800,12 @@ bool RecorderObsContext::Init()
         emit ErrorOccurred(kErrorClientInit, tr("初始化场景失败"));
         return false;
     }
+    timer.Mark("outputs");
+
+    AudioDevicePresence presence = devices.get();
+    timer.AddTask("devices", device_ns);
 
-    if (HasAudioDevices(App()->OutputAudioSource())) {
+    if (presence.output) {
         ResetAudioDevice(App()->OutputAudioSource(),
             ZDTALK_AUDIO_OUTPUT_DEVICE_ID, "Default Desktop Audio",
             ZDTALK_AUDIO_OUTPUT_INDEX);
@@ -595,7 +813,7 @@ bool RecorderObsContext::Init()
         blog(LOG_WARNING, "Audio device %s not found.", App()->OutputAudioSource());
     }
 
-    if (HasAudioDevices(App()->InputAudioSource())) {
+    if (presence.input) {
         ResetAudioDevice(App()->InputAudioSource(),
             ZDTALK_AUDIO_INPUT_DEVICE_ID, "Default Mic/Aux",
             ZDTALK_AUDIO_INPUT_INDEX);
@@ -608,8 +826,15 @@ bool RecorderObsContext::Init()
     obs_set_output_source(2, nullptr);
     obs_set_output_source(4, nullptr);
     obs_set_output_source(5, nullptr);
+    timer.Mark("audio");
+
+    SaveStartupCache();
+
+    QString timings = timer.Finish();
+    blog(LOG_INFO, "Init timings (ms): %s", timings.toUtf8().constData());
 
     emit Inited();
+    emit InitTimings(timings);
     return true;
 }
 
@@ -650,6 +875,10 @@ bool RecorderObsContext::UpdateWindowCapture(const QString &title)
 	obs_data_apply(setting, cur_setting);
 	obs_data_release(cur_setting);
 
+	// capture through a DIB, so the capture can tell when the window
+	// content changes and the scene isn't redrawn while it doesn't
+	obs_data_set_bool(setting, "compatibility", true);
+
     blog(LOG_INFO, "Find window '%s'.", title.toStdString().c_str());
 	obs_properties_t *properties = 
 		obs_source_properties(capture_source_);
@@ -966,6 +1195,91 @@ void RecorderObsContext::StopRecording(bool force)
         output_handler_->StopRecording(force);
 }
 
+static bool RemuxProgress(void *data, float /*percent*/)
+{
+    return !*static_cast<std::atomic<bool>*>(data);
+}
+
+/* 分片 MP4 停止时即可播放，这里在后台转成普通 MP4，成功后替换原文件 */
+void RecorderObsContext::RemuxRecording(const QString &path)
+{
+    QFileInfo info(path);
+    QString suffix = info.suffix().toLower();
+    if (suffix != "mp4" && suffix != "mov")
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(remux_mutex_);
+        remux_queue_.push_back(path);
+    }
+    remux_cv_.notify_one();
+
+    if (!remux_thread_.joinable())
+        remux_thread_ = std::thread(&RecorderObsContext::RemuxThread, this);
+}
+
+void RecorderObsContext::RemuxThread()
+{
+    for (;;) {
+        QString path;
+
+        {
+            std::unique_lock<std::mutex> lock(remux_mutex_);
+            remux_cv_.wait(lock, [this]() {
+                return remux_exit_ || !remux_queue_.empty();
+            });
+            if (remux_exit_)
+                return;
+
+            path = remux_queue_.front();
+            remux_queue_.pop_front();
+        }
+
+        RemuxFile(path);
+    }
+}
+
+void RecorderObsContext::RemuxFile(const QString &path)
+{
+    QFileInfo info(path);
+    std::string in = path.toUtf8().constData();
+    std::string out = QString("%1/%2.remux.%3").arg(info.absolutePath(),
+        info.completeBaseName(), info.suffix()).toUtf8().constData();
+
+    /* 转换期间原文件可能被同名的新录制覆盖，这时不能用转换结果替换它 */
+    qint64 size = info.size();
+    QDateTime modified = info.lastModified();
+
+    uint64_t start = os_gettime_ns();
+    media_remux_job_t job = nullptr;
+    bool success = false;
+
+    if (media_remux_job_create(&job, in.c_str(), out.c_str())) {
+        success = media_remux_job_process(job, RemuxProgress,
+            &remux_cancel_);
+        media_remux_job_destroy(job);
+    }
+
+    info.refresh();
+    bool unchanged = info.exists() && info.size() == size &&
+        info.lastModified() == modified;
+
+    if (success && unchanged && os_rename(out.c_str(), in.c_str()) == 0) {
+        blog(LOG_INFO, "Remuxed '%s' in %d ms.", in.c_str(),
+            (int)((os_gettime_ns() - start) / 1000000));
+        QMetaObject::invokeMethod(this, "RecordingRemuxed",
+            Qt::QueuedConnection, Q_ARG(QString, path));
+    } else if (success && !unchanged) {
+        blog(LOG_WARNING, "'%s' changed during the remux, discarding "
+            "the remuxed copy.", in.c_str());
+        os_unlink(out.c_str());
+    } else {
+        blog(LOG_WARNING, "Remux of '%s' failed, keeping the "
+            "fragmented file.", in.c_str());
+        os_unlink(out.c_str());
+    }
+}
+
 void RecorderObsContext::StartStreaming(const QString &server, const QString &key)
 {
     if (output_handler_->StreamingActive())
@@ -1012,6 +1326,38 @@ void RecorderObsContext::StopStreaming(bool force)
         output_handler_->StopStreaming(force);
 }
 
+void RecorderObsContext::AddStreamDestination(const QString &id,
+    const QString &server, const QString &key)
+{
+    if (!output_handler_)
+        return;
+
+    if (id.isEmpty() || server.isEmpty() || key.isEmpty()) {
+        blog(LOG_ERROR, "Stream destination parameter invalid, id=%s, "
+             "server=%s.", id.toStdString().c_str(),
+             server.toStdString().c_str());
+        emit StreamDestinationStopped(id, true);
+        return;
+    }
+
+    if (!output_handler_->AddStreamDestination(id.toStdString(),
+            server.toStdString().c_str(), key.toStdString().c_str()))
+        emit StreamDestinationStopped(id, true);
+}
+
+void RecorderObsContext::RemoveStreamDestination(const QString &id,
+    bool force)
+{
+    if (output_handler_)
+        output_handler_->RemoveStreamDestination(id.toStdString(), force);
+}
+
+void RecorderObsContext::ReleaseStreamDestination(const QString &id)
+{
+    if (output_handler_)
+        output_handler_->ReleaseStreamDestination(id.toStdString());
+}
+
 void RecorderObsContext::UpdateCaptureConfig(bool cursor, bool compatibility)
 {
     if (!capture_source_) return;
@@ -20,6 +20,11 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #include <QObject>
 #include <QRect>
@@ -47,13 +52,17 @@ public:
 
 signals:
     void Inited();
+    void InitTimings(const QString &);
     void RecordingStarted();
     void RecordingStopping();
     void RecordingStopped(const QString &);
+    void RecordingRemuxed(const QString &);
     void StreamingStarting(int);
     void StreamingStarted();
     void StreamingStopping(int);
     void StreamingStopped();
+    void StreamDestinationStarted(const QString &);
+    void StreamDestinationStopped(const QString &, bool error);
     void ErrorOccurred(const int, const QString &);
 
 public:
@@ -85,10 +94,17 @@ public slots:
 
     void StartRecording(const QString &output);
     void StopRecording(bool force);
+    void RemuxRecording(const QString &path);
 
     void StartStreaming(const QString &server, const QString &key);
     void StopStreaming(bool force);
 
+    /* 备用推流地址，可以在推流过程中随时添加和移除 */
+    void AddStreamDestination(const QString &id, const QString &server,
+        const QString &key);
+    void RemoveStreamDestination(const QString &id, bool force);
+    void ReleaseStreamDestination(const QString &id);
+
     void LogStreamStats();
 
 private slots:
@@ -100,6 +116,9 @@ private:
     void ClearSceneData();
     void ClearVolumeControls();
 
+    void RemuxThread();
+    void RemuxFile(const QString &path);
+
 	bool StartupOBS();
 	void AddExtraModulePaths();
 	bool ResetAudio();
@@ -118,6 +137,14 @@ private:
 
     std::vector<VolumeController *> volumes_;
 	std::vector<OBSSignal> signal_handlers_;
+
+    /* 转封装按录制结束的顺序在后台线程中逐个处理 */
+    std::thread remux_thread_;
+    std::mutex remux_mutex_;
+    std::condition_variable remux_cv_;
+    std::deque<QString> remux_queue_;
+    bool remux_exit_ = false;
+    std::atomic<bool> remux_cancel_;
 };
 
 #endif // ZDTALK_RECORDER_OBS_CONTEXT_H_
\ No newline at end of file
@@ -194,9 +194,46 @@ static void OBSStopRecording(void *data, calldata_t *params)
             config_get_string(App()->GetGlobalConfig(), "Output", "FilePath");
         QMetaObject::invokeMethod(output->context_, "RecordingStopped",
             Q_ARG(QString, QString::fromUtf8(filePath)));
+
+        if (config_get_bool(App()->GetGlobalConfig(), "Output", "RecFragmented") &&
+            config_get_bool(App()->GetGlobalConfig(), "Output", "RecRemux"))
+            QMetaObject::invokeMethod(output->context_, "RemuxRecording",
+                Q_ARG(QString, QString::fromUtf8(filePath)));
     }
 }
 
+static void OBSDestinationStarted(void *data, calldata_t *params)
+{
+    StreamDestination *dest = static_cast<StreamDestination*>(data);
+    QMetaObject::invokeMethod(dest->handler->context_,
+        "StreamDestinationStarted",
+        Q_ARG(QString, QString::fromStdString(dest->id)));
+
+    UNUSED_PARAMETER(params);
+    blog(LOG_INFO, "Stream destination '%s' started.", dest->id.c_str());
+}
+
+static void OBSDestinationStopped(void *data, calldata_t *params)
+{
+    StreamDestination *dest = static_cast<StreamDestination*>(data);
+    int code = (int)calldata_int(params, "code");
+
+    blog(code == OBS_OUTPUT_SUCCESS ? LOG_INFO : LOG_WARNING,
+        "Stream destination '%s' stopped, code = %d, error = %s.",
+        dest->id.c_str(), code, calldata_string(params, "last_error"));
+
+    QMetaObject::invokeMethod(dest->handler->context_,
+        "StreamDestinationStopped",
+        Q_ARG(QString, QString::fromStdString(dest->id)),
+        Q_ARG(bool, code != OBS_OUTPUT_SUCCESS));
+
+    /* Լźͷ */
+    if (dest->removing)
+        QMetaObject::invokeMethod(dest->handler->context_,
+            "ReleaseStreamDestination", Qt::QueuedConnection,
+            Q_ARG(QString, QString::fromStdString(dest->id)));
+}
+
 static void OBSRecordStopping(void *data, calldata_t *params)
 {
     BasicOutputHandler *output = static_cast<BasicOutputHandler*>(data);
@@ -340,6 +377,114 @@ bool BasicOutputHandler::StreamingActive() const
     return obs_output_active(streamOutput);
 }
 
+/* ַñֻһΣÿַԼ
+ * ̡߳֡Ժ */
+bool BasicOutputHandler::AddStreamDestination(const std::string &id,
+    const char *server, const char *key)
+{
+    if (destinations.count(id))
+        ReleaseStreamDestination(id);
+
+    OBSData settings = obs_data_create();
+    obs_data_release(settings);
+    obs_data_set_string(settings, "server", server);
+    obs_data_set_string(settings, "key", key);
+    obs_data_set_bool(settings, "use_auth", false);
+
+    std::unique_ptr<StreamDestination> dest(new StreamDestination);
+    dest->handler = this;
+    dest->id = id;
+
+    string name = "destination_" + id;
+    dest->service = obs_service_create("rtmp_custom",
+        (name + "_service").c_str(), settings, nullptr);
+    if (!dest->service) {
+        blog(LOG_ERROR, "Failed to create service for destination '%s'",
+            id.c_str());
+        return false;
+    }
+    obs_service_release(dest->service);
+
+    dest->output = obs_output_create("rtmp_output", name.c_str(),
+        nullptr, nullptr);
+    if (!dest->output) {
+        blog(LOG_ERROR, "Failed to create output for destination '%s'",
+            id.c_str());
+        return false;
+    }
+    obs_output_release(dest->output);
+
+    if (!obs_encoder_active(h264Streaming))
+        UpdateStreamingEncoders(dest->service);
+
+    obs_output_set_video_encoder(dest->output, h264Streaming);
+    obs_output_set_audio_encoder(dest->output, aacStreaming, 0);
+    obs_output_set_service(dest->output, dest->service);
+    obs_output_set_reconnect_settings(dest->output,
+        ZDTALK_STREAMING_MAX_RETRY_TIMES, ZDTALK_STREAMING_RETRY_INTERVAL);
+
+    /* ֻụӰ */
+    obs_data_t *outputSettings = obs_data_create();
+    obs_data_set_bool(outputSettings, "dyn_bitrate", false);
+    obs_data_set_int(outputSettings, "drop_threshold_ms",
+        config_get_uint(App()->GetGlobalConfig(), "Output",
+            "DestDropThresholdMs"));
+    obs_output_update(dest->output, outputSettings);
+    obs_data_release(outputSettings);
+
+    signal_handler_t *handler = obs_output_get_signal_handler(dest->output);
+    dest->startSignal.Connect(handler, "start", OBSDestinationStarted,
+        dest.get());
+    dest->stopSignal.Connect(handler, "stop", OBSDestinationStopped,
+        dest.get());
+
+    if (!obs_output_start(dest->output)) {
+        const char *error = obs_output_get_last_error(dest->output);
+        blog(LOG_WARNING, "Stream destination '%s' failed to start!%s%s",
+            id.c_str(), error && *error ? "  Last Error: " : "",
+            error && *error ? error : "");
+        return false;
+    }
+
+    blog(LOG_INFO, "Stream destination '%s' added: %s", id.c_str(), server);
+    destinations[id] = std::move(dest);
+    return true;
+}
+
+void BasicOutputHandler::RemoveStreamDestination(const std::string &id,
+    bool force)
+{
+    auto it = destinations.find(id);
+    if (it == destinations.end())
+        return;
+
+    StreamDestination *dest = it->second.get();
+    if (!obs_output_active(dest->output)) {
+        destinations.erase(it);
+        return;
+    }
+
+    /* ֹͣ stop źͷ */
+    dest->removing = true;
+    if (force)
+        obs_output_force_stop(dest->output);
+    else
+        obs_output_stop(dest->output);
+}
+
+void BasicOutputHandler::ReleaseStreamDestination(const std::string &id)
+{
+    auto it = destinations.find(id);
+    if (it == destinations.end())
+        return;
+
+    /* ϿźźͷеĻᱻǿֹͣ */
+    it->second->startSignal.Disconnect();
+    it->second->stopSignal.Disconnect();
+    destinations.erase(it);
+    blog(LOG_INFO, "Stream destination '%s' removed.", id.c_str());
+}
+
 bool BasicOutputHandler::RecordingActive() const
 {
     return obs_output_active(fileOutput);
@@ -362,7 +507,7 @@ OBSData BasicOutputHandler::GetStreamEncSettings()
     return dataRet;
 }
 
-void BasicOutputHandler::UpdateStreamingSettings(obs_service_t *service)
+void BasicOutputHandler::UpdateStreamingEncoders(obs_service_t *service)
 {
     obs_encoder_set_scaled_size(h264Streaming, 0, 0);
 
@@ -373,12 +518,25 @@ void BasicOutputHandler::UpdateStreamingSettings(obs_service_t *service)
     obs_data_set_int(audioSettings, "bitrate", GetAudioBitrate());
     obs_data_release(audioSettings);
     obs_service_apply_encoder_settings(service, GetStreamEncSettings(), audioSettings);
+}
+
+void BasicOutputHandler::UpdateStreamingSettings(obs_service_t *service)
+{
+    /* ַѾñ */
+    if (!obs_encoder_active(h264Streaming))
+        UpdateStreamingEncoders(service);
 
     obs_output_set_video_encoder(streamOutput, h264Streaming);
     obs_output_set_audio_encoder(streamOutput, aacStreaming, 0);
 
     obs_output_set_reconnect_settings(streamOutput, 0, 0);
     obs_output_set_service(streamOutput, service);
+
+    obs_data_t *outputSettings = obs_data_create();
+    obs_data_set_bool(outputSettings, "dyn_bitrate",
+        config_get_bool(App()->GetGlobalConfig(), "Output", "DynamicBitrate"));
+    obs_output_update(streamOutput, outputSettings);
+    obs_data_release(outputSettings);
 }
 
 void BasicOutputHandler::LoadRecordingPreset_h264(const char *encoderId)
@@ -525,6 +683,10 @@ void BasicOutputHandler::UpdateRecordingSettings()
     obs_data_t *settings = obs_data_create();
     obs_data_set_string(settings, "path", path);
     obs_data_set_string(settings, "muxer_settings", "movflags = faststart");
+    obs_data_set_bool(settings, "fragmented",
+        config_get_bool(App()->GetGlobalConfig(), "Output", "RecFragmented"));
+    obs_data_set_int(settings, "fragment_duration_ms",
+        config_get_uint(App()->GetGlobalConfig(), "Output", "RecFragmentMs"));
     obs_output_update(fileOutput, settings);
     obs_data_release(settings);
 }
@@ -569,6 +731,11 @@ void BasicOutputHandler::UpdateRecordingSettings_ffmpeg()
     obs_data_set_int(settings, "scale_width", cx);
     obs_data_set_int(settings, "scale_height", cy);
 
+    obs_data_set_bool(settings, "fragmented",
+        config_get_bool(App()->GetGlobalConfig(), "Output", "RecFragmented"));
+    obs_data_set_int(settings, "fragment_duration_ms",
+        config_get_uint(App()->GetGlobalConfig(), "Output", "RecFragmentMs"));
+
     obs_output_set_mixer(fileOutput, 0/*aTrack - 1*/);
     obs_output_set_media(fileOutput, obs_get_video(), obs_get_audio());
     obs_output_update(fileOutput, settings);
@@ -620,6 +787,30 @@ void BasicOutputHandler::LogStreaming()
     blog(LOG_INFO, "Streaming => bitrate:%.2lf kb/s, frames:%d / %d (%.2lf%%).",
         kbps, dropped, total, num);
 
+    calldata_t cd = { 0 };
+    proc_handler_t *ph = obs_output_get_proc_handler(streamOutput);
+    if (proc_handler_call(ph, "get_dynamic_bitrate", &cd) &&
+        calldata_bool(&cd, "enabled")) {
+        blog(LOG_INFO, "Dynamic bitrate => current:%d kb/s, original:%d kb/s, "
+            "estimated:%d kb/s, down:%d, up:%d.",
+            (int)calldata_int(&cd, "current_bitrate"),
+            (int)calldata_int(&cd, "original_bitrate"),
+            (int)calldata_int(&cd, "estimated_bitrate"),
+            (int)calldata_int(&cd, "decreases"),
+            (int)calldata_int(&cd, "increases"));
+    }
+    calldata_free(&cd);
+
+    for (auto &it : destinations) {
+        obs_output_t *output = it.second->output;
+        blog(LOG_INFO, "Destination %s => %s, sent:%llu bytes, frames:%d / %d.",
+            it.first.c_str(),
+            obs_output_active(output) ? "active" : "stopped",
+            (unsigned long long)obs_output_get_total_bytes(output),
+            obs_output_get_frames_dropped(output),
+            obs_output_get_total_frames(output));
+    }
+
     lastBytesSent = bytesSent;
     lastBytesSentTime = curTime;
 }
\ No newline at end of file
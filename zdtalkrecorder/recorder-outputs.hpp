@@ -22,8 +22,24 @@
 #include "obs.hpp"
 
 #include <string>
+#include <map>
+#include <memory>
 
 class RecorderObsContext;
+struct BasicOutputHandler;
+
+struct StreamDestination
+{
+    BasicOutputHandler     *handler;
+    std::string            id;
+    bool                   removing = false;
+
+    OBSService             service;
+    OBSOutput              output;
+
+    OBSSignal              startSignal;
+    OBSSignal              stopSignal;
+};
 
 struct BasicOutputHandler 
 {
@@ -50,6 +66,8 @@ struct BasicOutputHandler
 	OBSSignal              streamStopping;
 	OBSSignal              recordStopping;
 
+    std::map<std::string, std::unique_ptr<StreamDestination>> destinations;
+
     uint64_t               lastBytesSent;
     uint64_t               lastBytesSentTime;
     int                    firstTotal;
@@ -68,9 +86,15 @@ struct BasicOutputHandler
 	bool StreamingActive() const;
 	bool RecordingActive() const;
 
+    bool AddStreamDestination(const std::string &id, const char *server,
+        const char *key);
+    void RemoveStreamDestination(const std::string &id, bool force = true);
+    void ReleaseStreamDestination(const std::string &id);
+
     int GetAudioBitrate() const;
     OBSData GetStreamEncSettings();
 
+    void UpdateStreamingEncoders(obs_service_t *service);
     void UpdateStreamingSettings(obs_service_t *service);
     void UpdateRecordingSettings();
 